@@ -0,0 +1,144 @@
+// ==============================================
+// Pruebas de la cola de comandos (BB84/lib/CommandQueue)
+// ==============================================
+// pio test -e native: orden FIFO, desbordamiento y política de vaciado de
+// los PREPARE redundantes, también cuando la cola da la vuelta al buffer.
+#include <unity.h>
+#include <BB84Protocol.h>
+#include <CommandQueue.h>
+
+static QueuedCommand command(uint8_t cmd, uint32_t pulseNum) {
+  QueuedCommand c = {};
+  c.cmd = cmd;
+  c.pulseNum = pulseNum;
+  return c;
+}
+
+// Retira un comando y comprueba cuál es
+static void expectPop(CommandQueue& queue, uint8_t cmd, uint32_t pulseNum) {
+  QueuedCommand c;
+  TEST_ASSERT_TRUE(queue.pop(c));
+  TEST_ASSERT_EQUAL_UINT8(cmd, c.cmd);
+  TEST_ASSERT_EQUAL_UINT32(pulseNum, c.pulseNum);
+}
+
+static void expectEmpty(CommandQueue& queue) {
+  QueuedCommand c;
+  TEST_ASSERT_FALSE(queue.pop(c));
+  TEST_ASSERT_EQUAL_UINT32(0, queue.size());
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_fifo_order() {
+  CommandQueue queue;
+  queue.push(command(CMD_PING, 1));
+  queue.push(command(CMD_HOME, 2));
+  queue.push(command(CMD_PREPARE_PULSE, 3));
+  TEST_ASSERT_EQUAL_UINT32(3, queue.size());
+  expectPop(queue, CMD_PING, 1);
+  expectPop(queue, CMD_HOME, 2);
+  expectPop(queue, CMD_PREPARE_PULSE, 3);
+  expectEmpty(queue);
+  TEST_ASSERT_EQUAL_UINT32(0, queue.merged());
+}
+
+void test_overflow_drops_and_counts() {
+  CommandQueue queue;
+  for (uint32_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    TEST_ASSERT_TRUE(queue.push(command(CMD_PING, i)));
+  }
+  TEST_ASSERT_FALSE(queue.push(command(CMD_PING, COMMAND_QUEUE_SIZE)));
+  TEST_ASSERT_EQUAL_UINT32(1, queue.overflows());
+  TEST_ASSERT_EQUAL_UINT32(COMMAND_QUEUE_SIZE, queue.size());
+  expectPop(queue, CMD_PING, 0);
+  TEST_ASSERT_TRUE(queue.push(command(CMD_PING, COMMAND_QUEUE_SIZE)));  // Hay sitio otra vez
+}
+
+void test_prepare_replaced_by_later_prepare() {
+  CommandQueue queue;
+  queue.push(command(CMD_PREPARE_PULSE, 1));
+  queue.push(command(CMD_PREPARE_PULSE, 2));
+  queue.push(command(CMD_PREPARE_REFERENCE, 3));
+  expectPop(queue, CMD_PREPARE_REFERENCE, 3);
+  expectEmpty(queue);
+  TEST_ASSERT_EQUAL_UINT32(2, queue.merged());
+}
+
+void test_prepare_cancelled_by_abort() {
+  CommandQueue queue;
+  queue.push(command(CMD_PREPARE_REFERENCE, 1));
+  queue.push(command(CMD_ABORT, 0));
+  expectPop(queue, CMD_ABORT, 0);
+  expectEmpty(queue);
+  TEST_ASSERT_EQUAL_UINT32(1, queue.merged());
+}
+
+// Los comandos intermedios se conservan y en su orden
+void test_merge_keeps_other_commands() {
+  CommandQueue queue;
+  queue.push(command(CMD_PREPARE_PULSE, 1));
+  queue.push(command(CMD_PING, 2));
+  queue.push(command(CMD_PREPARE_PULSE, 3));
+  expectPop(queue, CMD_PING, 2);
+  expectPop(queue, CMD_PREPARE_PULSE, 3);
+  expectEmpty(queue);
+  TEST_ASSERT_EQUAL_UINT32(1, queue.merged());
+}
+
+// Un comando que no es PREPARE nunca se descarta, aunque lo siga un ABORT
+void test_abort_does_not_drop_other_commands() {
+  CommandQueue queue;
+  queue.push(command(CMD_HOME, 1));
+  queue.push(command(CMD_ABORT, 0));
+  expectPop(queue, CMD_HOME, 1);
+  expectPop(queue, CMD_ABORT, 0);
+  TEST_ASSERT_EQUAL_UINT32(0, queue.merged());
+}
+
+// Los PREPARE redundantes ocupan el final y el principio del buffer
+void test_merge_across_wrap_around() {
+  CommandQueue queue;
+  const uint32_t before = COMMAND_QUEUE_SIZE - 2;
+  for (uint32_t i = 0; i < before; i++) {
+    queue.push(command(CMD_PING, i));
+    expectPop(queue, CMD_PING, i);
+  }
+  for (uint32_t i = 0; i < 5; i++) {
+    TEST_ASSERT_TRUE(queue.push(command(CMD_PREPARE_PULSE, 100 + i)));  // Con 16 casillas: 14, 15, 0, 1, 2
+  }
+  expectPop(queue, CMD_PREPARE_PULSE, 104);
+  expectEmpty(queue);
+  TEST_ASSERT_EQUAL_UINT32(4, queue.merged());
+}
+
+// Cola llena que da la vuelta: solo queda el último PREPARE tras el último ABORT
+void test_full_queue_across_wrap_around() {
+  CommandQueue queue;
+  for (uint32_t i = 0; i < COMMAND_QUEUE_SIZE / 2; i++) {
+    queue.push(command(CMD_PING, i));
+    expectPop(queue, CMD_PING, i);
+  }
+  for (uint32_t i = 0; i < COMMAND_QUEUE_SIZE - 1; i++) {
+    queue.push(command(CMD_PREPARE_PULSE, i));
+  }
+  queue.push(command(CMD_ABORT, 0));
+  TEST_ASSERT_FALSE(queue.push(command(CMD_PREPARE_PULSE, 99)));
+  expectPop(queue, CMD_ABORT, 0);
+  expectEmpty(queue);
+  TEST_ASSERT_EQUAL_UINT32(COMMAND_QUEUE_SIZE - 1, queue.merged());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_order);
+  RUN_TEST(test_overflow_drops_and_counts);
+  RUN_TEST(test_prepare_replaced_by_later_prepare);
+  RUN_TEST(test_prepare_cancelled_by_abort);
+  RUN_TEST(test_merge_keeps_other_commands);
+  RUN_TEST(test_abort_does_not_drop_other_commands);
+  RUN_TEST(test_merge_across_wrap_around);
+  RUN_TEST(test_full_queue_across_wrap_around);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+// ==============================================
+// Pruebas de salud del RNG (BB84/lib/RandomBits)
+// ==============================================
+// pio test -e native: la prueba pone la fuente de bits (esp_fill_random) y
+// comprueba los límites de la Repetition Count Test y la Adaptive Proportion
+// Test: RANDOM_RCT_CUTOFF - 1 y RANDOM_APT_CUTOFF - 1 pasan, el límite falla.
+#include <unity.h>
+#include <string.h>
+#include <RandomBits.h>
+
+// Patrón de cada buffer: bits alternados con una racha de runLength bits
+// iguales en la posición runStart, o bien (aptOnes > 0) una ventana que
+// empieza por 1 con aptOnes unos en rachas de como mucho 2
+static uint32_t runStart = 0;
+static uint32_t runLength = 0;
+static uint32_t aptOnes = 0;
+
+static void setBit(uint32_t* words, uint32_t index, uint8_t bit) {
+  if (bit) words[index >> 5] |= 1u << (index & 31);
+}
+
+static void fillAlternating(uint32_t* words) {
+  uint8_t prev = 0;
+  uint8_t runBit = 0;
+  for (uint32_t i = 0; i < RANDOM_APT_WINDOW; i++) {
+    uint8_t bit;
+    if (runLength && i == runStart) {
+      runBit = prev ^ 1;
+      bit = runBit;
+    } else if (runLength && i > runStart && i < runStart + runLength) {
+      bit = runBit;
+    } else {
+      bit = prev ^ 1;
+    }
+    setBit(words, i, bit);
+    prev = bit;
+  }
+}
+
+// Un hueco de unos antes de cada cero y otro al final: uno por hueco y los
+// sobrantes de dos en dos en los primeros
+static void fillProportion(uint32_t* words) {
+  uint32_t zeros = RANDOM_APT_WINDOW - aptOnes;
+  uint32_t extra = aptOnes - (zeros + 1);
+  uint32_t index = 0;
+  for (uint32_t gap = 0; gap <= zeros; gap++) {
+    uint32_t ones = gap < extra ? 2 : 1;
+    for (uint32_t k = 0; k < ones; k++) setBit(words, index++, 1);
+    if (gap < zeros) index++;  // El cero
+  }
+}
+
+extern "C" void esp_fill_random(void* buf, size_t len) {
+  uint32_t words[RANDOM_APT_WINDOW / 32] = {};
+  if (aptOnes) {
+    fillProportion(words);
+  } else {
+    fillAlternating(words);
+  }
+  memcpy(buf, words, len < sizeof(words) ? len : sizeof(words));
+}
+
+void setUp() {
+  runStart = 0;
+  runLength = 0;
+  aptOnes = 0;
+}
+
+void tearDown() {}
+
+void test_alternating_bits_pass() {
+  RandomBits rng;
+  TEST_ASSERT_TRUE(rng.begin());
+  TEST_ASSERT_EQUAL_UINT32(RANDOM_STARTUP_WINDOWS * RANDOM_APT_WINDOW, rng.statistics().testedBits);
+  TEST_ASSERT_EQUAL_UINT16(1, rng.statistics().longestRun);
+  TEST_ASSERT_EQUAL_UINT8(1, rng.nextBit());
+  TEST_ASSERT_EQUAL_UINT8(0, rng.nextBit());
+  TEST_ASSERT_TRUE(rng.healthy());
+  TEST_ASSERT_EQUAL_UINT32(2, rng.statistics().deliveredBits);
+}
+
+void test_rct_below_cutoff_passes() {
+  runStart = 100;
+  runLength = RANDOM_RCT_CUTOFF - 1;
+  RandomBits rng;
+  TEST_ASSERT_TRUE(rng.begin());
+  TEST_ASSERT_EQUAL_UINT16(RANDOM_RCT_CUTOFF - 1, rng.statistics().longestRun);
+  TEST_ASSERT_EQUAL_UINT16(0, rng.statistics().rctFailures);
+}
+
+void test_rct_cutoff_fails() {
+  runStart = 100;
+  runLength = RANDOM_RCT_CUTOFF;
+  RandomBits rng;
+  TEST_ASSERT_FALSE(rng.begin());
+  TEST_ASSERT_FALSE(rng.healthy());
+  TEST_ASSERT_EQUAL_UINT16(1, rng.statistics().rctFailures);
+  TEST_ASSERT_EQUAL_UINT16(0, rng.statistics().aptFailures);
+}
+
+void test_apt_below_cutoff_passes() {
+  aptOnes = RANDOM_APT_CUTOFF - 1;
+  RandomBits rng;
+  TEST_ASSERT_TRUE(rng.begin());
+  TEST_ASSERT_EQUAL_UINT16(RANDOM_APT_CUTOFF - 1, rng.statistics().maxWindowCount);
+  TEST_ASSERT_EQUAL_UINT16(0, rng.statistics().aptFailures);
+}
+
+void test_apt_cutoff_fails() {
+  aptOnes = RANDOM_APT_CUTOFF;
+  RandomBits rng;
+  TEST_ASSERT_FALSE(rng.begin());
+  TEST_ASSERT_EQUAL_UINT16(1, rng.statistics().aptFailures);
+  TEST_ASSERT_EQUAL_UINT16(0, rng.statistics().rctFailures);
+}
+
+// Tras un fallo no se entregan bits hasta el próximo begin()
+void test_failure_latches_until_begin() {
+  RandomBits rng;
+  TEST_ASSERT_TRUE(rng.begin());
+  for (uint32_t i = 0; i < RANDOM_APT_WINDOW; i++) rng.nextBit();  // Agota el buffer probado
+
+  runStart = 10;
+  runLength = RANDOM_RCT_CUTOFF;
+  TEST_ASSERT_EQUAL_UINT8(0, rng.nextBit());  // El buffer nuevo no pasa
+  TEST_ASSERT_FALSE(rng.healthy());
+
+  setUp();
+  TEST_ASSERT_EQUAL_UINT8(0, rng.nextBit());  // Fuente sana, pero el fallo se mantiene
+  TEST_ASSERT_FALSE(rng.healthy());
+  TEST_ASSERT_TRUE(rng.begin());
+  TEST_ASSERT_EQUAL_UINT8(1, rng.nextBit());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_alternating_bits_pass);
+  RUN_TEST(test_rct_below_cutoff_passes);
+  RUN_TEST(test_rct_cutoff_fails);
+  RUN_TEST(test_apt_below_cutoff_passes);
+  RUN_TEST(test_apt_cutoff_fails);
+  RUN_TEST(test_failure_latches_until_begin);
+  return UNITY_END();
+}
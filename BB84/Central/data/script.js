@@ -15,9 +15,15 @@ const completeDataHistory = {
     baseAlice: [],
     bitEnviado: [],
     baseBob: [],
-    bitRecibido: []
+    bitRecibido: [],
+    cribado: [],
+    claveAlice: [],
+    claveBob: []
 };
 
+// Protocolo de la sesión (lo anuncia el Central al iniciar, ver sifting.cpp)
+let protocoloSesion = { id: 0, nombre: "BB84", umbralQber: 15 };
+
 // Función para cambiar entre pestañas - actualizada para las nuevas pestañas
 function openTab(tabName) {
     const tabContents = document.getElementsByClassName('tab-content');
@@ -77,31 +83,51 @@ socket.onmessage = function(event) {
                     completeDataHistory.bitEnviado = [];
                     completeDataHistory.baseBob = [];
                     completeDataHistory.bitRecibido = [];
+                    completeDataHistory.cribado = [];
+                    completeDataHistory.claveAlice = [];
+                    completeDataHistory.claveBob = [];
                     
                     // Reiniciar estadísticas
                     actualizarEstadisticas();
                 }
+            } else if (data.status === "error") {
+                // Sesión abortada por el Central (p. ej. RNG de un nodo defectuoso)
+                document.getElementById("status-message").textContent = data.message;
+                alert(data.message);
+            } else if (data.transiciones) {
+                mostrarTransiciones(data.transiciones);
+            } else if (data.protocolo) {
+                protocoloSesion = data.protocolo;
+                document.getElementById("protocolo-nombre").textContent = protocoloSesion.nombre;
+                document.getElementById("qber-umbral").textContent = protocoloSesion.umbralQber;
+            } else if (data.tomografia) {
+                mostrarTomografia(data.tomografia);
+            } else if (data.parametros) {
+                mostrarParametros(data.parametros);
             } else if (data.conteos) {
                 // Conversion de valores numéricos a símbolos
-                const baseAliceSymbol = data.baseAlice === 0 ? "+" : "x";
-                const baseBobSymbol = data.baseBob === 0 ? "+" : "x";
-                const bitEnviado = data.bitEnviado !== undefined ? String(data.bitEnviado) : "-";
+                // valido 0: algún nodo no respondió a tiempo y las bases son de otro pulso
+                const valido = data.valido !== 0;
+                const baseAliceSymbol = !valido ? "-" : data.baseAlice === 0 ? "+" : "x";
+                const baseBobSymbol = !valido ? "-" : data.baseBob === 0 ? "+" : "x";
+                const bitEnviado = valido && data.bitEnviado !== undefined ? String(data.bitEnviado) : "-";
                 const bitRecibido = data.bitRecibido !== undefined ? String(data.bitRecibido) : "-";
                 
                 // Actualizar tabla con el nuevo orden de columnas
                 const tablaCuerpo = document.getElementById("datos-cuerpo");
                 const fila = document.createElement("tr");
                 
-                // Verificar si las bases coinciden
-                const basesCoinciden = baseAliceSymbol === baseBobSymbol;
+                // El Central criba cada pulso según el protocolo de la sesión
+                const cribado = data.cribado === 1;
+                const claveAlice = cribado ? String(data.claveAlice) : "-";
+                const claveBob = cribado ? String(data.claveBob) : "-";
                 
-                // Aplicar clase según coincidencia de bases y bits
-                if (basesCoinciden) {
-                    if (bitEnviado !== "-" && bitRecibido !== "-" && bitEnviado !== bitRecibido) {
-                        // Bases coinciden pero bits no coinciden (error)
+                // Aplicar clase según la criba y la coincidencia de los bits de clave
+                if (cribado) {
+                    if (claveAlice !== claveBob) {
+                        // Pulso cribado con bits de clave distintos (error)
                         fila.classList.add('bits-error');
                     } else {
-                        // Bases coinciden y bits también (o no están definidos)
                         fila.classList.add('bases-match');
                     }
                 }
@@ -125,6 +151,9 @@ socket.onmessage = function(event) {
                 completeDataHistory.bitEnviado.push(bitEnviado);
                 completeDataHistory.baseBob.push(baseBobSymbol);
                 completeDataHistory.bitRecibido.push(bitRecibido);
+                completeDataHistory.cribado.push(cribado);
+                completeDataHistory.claveAlice.push(claveAlice);
+                completeDataHistory.claveBob.push(claveBob);
 
                 rawDataDetector0.push(data.conteos.detector0);
                 rawDataDetector1.push(data.conteos.detector1);
@@ -467,8 +496,8 @@ function cambiarGrafico(tipo) {
     }
 }
 
-function enviarConfiguracion() {
-    const num_pulsos = document.getElementById('num_pulsos').value;
+// Duración del pulso ON del formulario en microsegundos (null si está fuera de rango)
+function leerDuracionUs() {
     const duracion_value = document.getElementById('duracion_us').value;
     const duracion_unit = document.getElementById('duracion_unit').value;
 
@@ -484,9 +513,24 @@ function enviarConfiguracion() {
     // Validar los rangos en microsegundos
     duracion_us = Math.round(duracion_us);
 
-    if (duracion_us < 0 || duracion_us > 16777215) {
+    if (isNaN(duracion_us) || duracion_us < 0 || duracion_us > 16777215) {
         document.getElementById("status-message").textContent = 
             "Error: La duración ON debe estar entre 0 y 16777215 μs";
+        return null;
+    }
+    return duracion_us;
+}
+
+function enviarConfiguracion() {
+    const num_pulsos = document.getElementById('num_pulsos').value;
+    const duracion_us = leerDuracionUs();
+    if (duracion_us === null) return;
+
+    // Compensación de deriva: los pulsos de referencia no llegan a la tabla
+    const drift_interval = parseInt(document.getElementById('drift_interval').value, 10);
+    if (isNaN(drift_interval) || drift_interval < 0 || drift_interval === 1) {
+        document.getElementById("status-message").textContent =
+            "Error: El intervalo de referencia debe ser 0 o al menos 2 pulsos";
         return;
     }
 
@@ -511,6 +555,9 @@ function enviarConfiguracion() {
         duracion_us: duracion_us
     });
 
+    const protocolo = document.getElementById('protocolo').value;
+    socket.send(`PROTOCOL:${protocolo}`);
+    socket.send(`DRIFT:${drift_interval}`);
     socket.send(configuracion);
     document.getElementById("status-message").textContent = "Configuración enviada correctamente.";
 }
@@ -525,6 +572,37 @@ function ejecutarHoming() {
     document.getElementById("status-message").textContent = "Ejecutando homing en Alice y Bob...";
 }
 
+// Barre cada ángulo de Alice y Bob con pulsos de la FPGA y guarda las tablas
+// ajustadas en los nodos (usa la duración del pulso del formulario)
+function calibrarAngulos() {
+    const duracion_us = leerDuracionUs();
+    if (duracion_us === null || duracion_us === 0) {
+        document.getElementById("status-message").textContent = "Error: indica la duración del pulso ON";
+        return;
+    }
+    if (!confirm("La calibración de ángulos lanza unos 400 pulsos y reescribe las tablas de Alice y Bob. ¿Continuar?")) return;
+    socket.send(`ANGLE_CAL:${duracion_us}`);
+    document.getElementById("status-message").textContent = "Calibrando ángulos de Alice y Bob...";
+}
+
+function lanzarTomografia() {
+    const duracion_us = leerDuracionUs();
+    if (duracion_us === null || duracion_us === 0) {
+        document.getElementById("status-message").textContent = "Error: indica la duración del pulso ON";
+        return;
+    }
+    const estado = document.getElementById("tomography-state").value;
+    document.getElementById("tomografia-resultados").innerHTML = "";
+    socket.send(`TOMOGRAPHY:${duracion_us},${estado}`);
+    document.getElementById("status-message").textContent = "Tomografía de estados en curso...";
+}
+
+function calibrarPerfiles() {
+    if (!confirm("La calibración mueve los motores durante varios minutos. ¿Continuar?")) return;
+    socket.send("CALIBRATE_ALL");
+    document.getElementById("status-message").textContent = "Calibrando perfiles de movimiento en Alice y Bob...";
+}
+
 // ============================================
 // FUNCIONES DE CONTROL MANUAL
 // ============================================
@@ -597,6 +675,77 @@ function moverBobPreset(base) {
     document.getElementById('bob-status').textContent = `Moviendo a ${labels[base]} - ${angle}°...`;
 }
 
+// ============================================
+// MATRIZ DE TRANSICIONES
+// ============================================
+
+function benchmarkTransiciones() {
+    const rounds = parseInt(document.getElementById('transition-rounds').value);
+    if (isNaN(rounds) || rounds < 1 || rounds > 1000) {
+        alert("Por favor, introduce un número de repeticiones entre 1 y 1000");
+        return;
+    }
+    socket.send(`TRANSITION_BENCH:${rounds}`);
+    document.getElementById("status-message").textContent = "Benchmark de transiciones en curso...";
+}
+
+function pruebaResistencia() {
+    const minutos = parseInt(document.getElementById('soak-minutes').value);
+    if (isNaN(minutos) || minutos < 1 || minutos > 1440) {
+        alert("Por favor, introduce una duración entre 1 y 1440 minutos");
+        return;
+    }
+    socket.send(`SOAK:${minutos * 60}`);
+    document.getElementById("status-message").textContent = "Prueba de resistencia en curso en Alice y Bob...";
+}
+
+function pedirTransiciones() {
+    socket.send("TRANSITIONS");
+}
+
+// Tabla desde (filas) × hacia (columnas); tiempos recibidos en µs
+function mostrarTransiciones(matriz) {
+    const contenedor = document.getElementById(matriz.nodo === "Alice" ? "transiciones-alice" : "transiciones-bob");
+    if (!contenedor) return;
+    const ms = us => (us / 1000).toFixed(1);
+    const celdas = {};
+    matriz.celdas.forEach(c => { celdas[`${c.d},${c.h}`] = c; });
+
+    let html = `<h4>${matriz.nodo} <small>(${matriz.movimientos} movimientos)</small></h4>`;
+    html += '<table class="transition-table"><thead><tr><th>desde \\ hacia</th>';
+    matriz.angulos.forEach(a => { html += `<th>${a.toFixed(2)}°</th>`; });
+    html += '</tr></thead><tbody>';
+    matriz.angulos.forEach((desde, d) => {
+        html += `<tr><th>${desde.toFixed(2)}°</th>`;
+        matriz.angulos.forEach((hacia, h) => {
+            const c = celdas[`${d},${h}`];
+            html += c
+                ? `<td title="n=${c.n}, pasos máx. ${c.pasos_max}">${ms(c.media)} / ${ms(c.p99)} / ${ms(c.max)}<br><small>${c.pasos} pasos</small></td>`
+                : '<td>-</td>';
+        });
+        html += '</tr>';
+    });
+    html += '</tbody></table>';
+    contenedor.innerHTML = html;
+}
+
+function mostrarTomografia(t) {
+    const contenedor = document.getElementById("tomografia-resultados");
+    if (!contenedor) return;
+    const f = x => x.toFixed(3);
+    let html = `<div><h4>${t.estado} <small>(${t.pulsos} pulsos)</small></h4>`;
+    html += '<table class="transition-table"><tbody>';
+    html += `<tr><th>ρ</th><td>${f(t.rho[0][0])}</td><td>${f(t.rho[0][1])}</td></tr>`;
+    html += `<tr><th></th><td>${f(t.rho[1][0])}</td><td>${f(t.rho[1][1])}</td></tr>`;
+    html += `<tr><th>S1 / S2</th><td>${f(t.s1)}</td><td>${f(t.s2)}</td></tr>`;
+    html += `<tr><th>Fidelidad</th><td colspan="2">${(t.fidelidad * 100).toFixed(2)}%</td></tr>`;
+    html += `<tr><th>Pureza</th><td colspan="2">${f(t.pureza)}</td></tr>`;
+    html += '</tbody></table>';
+    html += `<small>${t.cuentas.map((c, k) => `${(k * 22.5).toFixed(1)}°: ${c[0]}/${c[1]}`).join("<br>")}</small></div>`;
+    if (contenedor.querySelector("p")) contenedor.innerHTML = "";
+    contenedor.insertAdjacentHTML("beforeend", html);
+}
+
 // Actualizar rangos del input de duración según la unidad seleccionada
 function updateDurationRanges() {
     const unit = document.getElementById('duracion_unit').value;
@@ -643,6 +792,17 @@ function downloadCSV() {
     alert("✅ Archivo CSV descargado con " + completeDataHistory.pulsos.length + " registros.");
 }
 
+// Descarga la traza de eventos de Central, Alice y Bob (formato Chrome Trace,
+// abrir en https://ui.perfetto.dev). El Central tarda ~1 s en recoger los buffers.
+function descargarTraza() {
+    const link = document.createElement('a');
+    link.href = '/trace.json';
+    link.download = 'bb84_trace.json';
+    document.body.appendChild(link);
+    link.click();
+    document.body.removeChild(link);
+}
+
 // Función para actualizar los rangos de la duración ON según la unidad seleccionada
 function updateDurationRanges() {
     const unitSelect = document.getElementById('duracion_unit');
@@ -704,22 +864,20 @@ function generarClaveBB84() {
 }
 
 /**
- * Paso 1: Filtrar únicamente los bits donde las bases de Alice y Bob coinciden
- * y el bit enviado y recibido están definidos (no son "-")
+ * Paso 1: Quedarse con los pulsos que pasan la criba del protocolo (la hace el
+ * Central: bases coincidentes en BB84, resultado concluyente en B92) con los
+ * bits de clave de Alice y Bob
  */
 function filtrarBaseCoincidente() {
     bitsFiltrados = [];
     
-    for (let i = 0; i < completeDataHistory.baseAlice.length; i++) {
-        if (completeDataHistory.baseAlice[i] === completeDataHistory.baseBob[i] &&
-            completeDataHistory.bitEnviado[i] !== "-" &&
-            completeDataHistory.bitRecibido[i] !== "-") {
-            
+    for (let i = 0; i < completeDataHistory.cribado.length; i++) {
+        if (completeDataHistory.cribado[i]) {
             bitsFiltrados.push({
                 pulso: completeDataHistory.pulsos[i],
                 base: completeDataHistory.baseAlice[i],
-                bitEnviado: completeDataHistory.bitEnviado[i],
-                bitRecibido: completeDataHistory.bitRecibido[i]
+                bitEnviado: completeDataHistory.claveAlice[i],
+                bitRecibido: completeDataHistory.claveBob[i]
             });
         }
     }
@@ -760,7 +918,7 @@ function dividirSeries() {
 
 /**
  * Paso 3: Validar la transmisión comparando los bits enviados con los recibidos
- * en la serie de validación para detectar intrusiones (QBER < 15% = seguro)
+ * en la serie de validación para detectar intrusiones (QBER < umbral del protocolo = seguro)
  */
 function validarTransmision() {
     let errores = 0;
@@ -774,7 +932,7 @@ function validarTransmision() {
     
     // Calcular QBER (Quantum Bit Error Rate)
     const qber = bitsValidacion.length > 0 ? (errores / bitsValidacion.length * 100).toFixed(2) : "0";
-    const isSecure = parseFloat(qber) < 15;
+    const isSecure = parseFloat(qber) < protocoloSesion.umbralQber;
     
     // Actualizar estadísticas en la interfaz
     document.getElementById("validation-errors").textContent = errores;
@@ -1306,3 +1464,55 @@ document.addEventListener('DOMContentLoaded', function() {
 
 // ...existing code...
 
+// ============================================
+// PARÁMETROS DE MOVIMIENTO
+// ============================================
+
+const CAMPOS_PARAMETROS = ["corriente", "velocidad", "aceleracion", "micropasos", "toff", "tbl", "hstrt", "hend"];
+
+function pedirParametros() {
+    socket.send(JSON.stringify({ type: "GET_PARAMS" }));
+}
+
+function buscarLimites() {
+    if (!confirm("La búsqueda de límites mueve los motores hasta que pierden pasos, durante varios minutos. ¿Continuar?")) return;
+    socket.send("FIND_LIMITS_ALL");
+    document.getElementById("status-message").textContent = "Buscando límites de velocidad y aceleración en Alice y Bob...";
+}
+
+function aplicarParametros(nodo) {
+    const prefijo = `params-${nodo.toLowerCase()}-`;
+    const comando = { type: "SET_PARAMS", nodo: nodo };
+    for (const campo of CAMPOS_PARAMETROS) {
+        const valor = parseInt(document.getElementById(prefijo + campo).value, 10);
+        if (isNaN(valor)) {
+            alert(`Valor inválido en ${campo}. Lee primero los parámetros del nodo.`);
+            return;
+        }
+        comando[campo] = valor;
+    }
+    comando.angulos = document.getElementById(prefijo + "angulos").value.split(",").map(a => parseFloat(a));
+    if (comando.angulos.some(isNaN)) {
+        alert("Los ángulos deben ser números separados por comas");
+        return;
+    }
+    socket.send(JSON.stringify(comando));
+    document.getElementById(prefijo + "estado").textContent = "Enviando...";
+}
+
+// Valores vigentes en el nodo y resultado del último cambio
+function mostrarParametros(p) {
+    const prefijo = `params-${p.nodo.toLowerCase()}-`;
+    if (!document.getElementById(prefijo + "estado")) return;
+    for (const campo of CAMPOS_PARAMETROS) {
+        document.getElementById(prefijo + campo).value = p[campo];
+    }
+    document.getElementById(prefijo + "angulos").value = p.angulos.map(a => +a.toFixed(3)).join(", ");
+    const resultados = {
+        ok: p.guardado ? "Guardados en NVS" : "Por defecto del firmware",
+        invalido: `Rechazados: ${p.campo} fuera de rango`,
+        ocupado: "Rechazados: motor ocupado",
+        sin_guardar: "Aplicados sin guardar en NVS"
+    };
+    document.getElementById(prefijo + "estado").textContent = `(${resultados[p.resultado] || p.resultado})`;
+}
@@ -0,0 +1,16 @@
+#ifndef ANGLECAL_H
+#define ANGLECAL_H
+
+#include <stdint.h>
+
+// ==============================================
+// Calibración de las tablas de ángulos con los conteos de la FPGA (ver src/anglecal.cpp)
+// ==============================================
+bool anglecalStart(uint32_t durationUs);
+void anglecalLoop();
+bool anglecalActive();
+void anglecalSendPulse(bool isAlice, uint32_t pulseNum);
+bool anglecalOnPulse(uint32_t detector0, uint32_t detector1, bool valid);
+void anglecalAbort();
+
+#endif // ANGLECAL_H
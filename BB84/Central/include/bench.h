@@ -0,0 +1,10 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// ==============================================
+// Benchmark de latencia ESP-NOW (solo env:bench, ver src/bench.cpp)
+// ==============================================
+void benchBegin();
+void benchLoop();
+
+#endif // BENCH_H
@@ -0,0 +1,18 @@
+#ifndef DRIFT_H
+#define DRIFT_H
+
+#include <stdint.h>
+
+// ==============================================
+// Compensación de deriva de polarización durante el protocolo (ver src/drift.cpp)
+// ==============================================
+void driftSetInterval(uint32_t pulses);   // Un pulso de referencia cada 'pulses' (0 = desactivada)
+uint32_t driftInterval();
+void driftReset();                        // Al iniciar el protocolo
+bool driftReferenceDue(uint32_t pulseNum);
+void driftSendReference(bool isAlice, uint32_t pulseNum);
+bool driftOnPulse(uint32_t detector0, uint32_t detector1, bool valid);
+void driftOnParamsResult(uint8_t result);  // ParamsReport.result de Bob
+void driftPrintSummary();
+
+#endif // DRIFT_H
@@ -0,0 +1,17 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <BB84Protocol.h>
+
+// ==============================================
+// Sincronización de reloj y desglose de latencia por pulso (ver src/latency.cpp)
+// ==============================================
+void latencyBegin();
+void latencyLoop();
+void latencyOnTimeSync(bool isAlice, const TimeSyncResponse& response, uint32_t rxMicros);
+void latencyRecordPulse(bool isAlice, uint32_t sentMicros, const ResponseData& ready, uint32_t readyMicros);
+void latencyReset();
+bool latencyToCentral(bool isAlice, uint32_t nodeMicros, uint32_t* centralMicros);
+void latencyPrintSummary();
+
+#endif // LATENCY_H
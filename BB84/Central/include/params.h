@@ -0,0 +1,18 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdint.h>
+#include <ArduinoJson.h>
+#include <BB84Protocol.h>
+
+// ==============================================
+// Parámetros de movimiento de Alice y Bob desde la web (ver src/params.cpp)
+// ==============================================
+void paramsRequest();
+bool paramsCurrent(bool isAlice, MotionParams& params);
+bool paramsFromJson(const JsonDocument& doc, MotionParams& params);
+bool paramsSend(bool isAlice, const MotionParams& params);
+void paramsOnReport(bool isAlice, const uint8_t* data, int len);
+void paramsLoop();
+
+#endif // PARAMS_H
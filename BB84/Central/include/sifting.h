@@ -0,0 +1,17 @@
+#ifndef SIFTING_H
+#define SIFTING_H
+
+#include <stdint.h>
+
+// ==============================================
+// Protocolo de la sesión y criba de la clave (ver src/sifting.cpp)
+// ==============================================
+bool siftSetProtocol(uint8_t id);         // "PROTOCOL:n" (ver QkdProtocol.h); false si no existe
+uint8_t siftProtocol();
+void siftReset();                         // Al iniciar el protocolo: contadores y aviso a la web
+bool siftPulse(int baseAlice, int bitAlice, int baseBob, int bitBob, uint32_t detector0, uint32_t detector1,
+               uint8_t& keyAlice, uint8_t& keyBob);
+void siftDiscardPulse();                  // Pulso publicado sin estados válidos: no entra en la criba
+void siftPrintSummary();
+
+#endif // SIFTING_H
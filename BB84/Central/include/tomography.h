@@ -0,0 +1,17 @@
+#ifndef TOMOGRAPHY_H
+#define TOMOGRAPHY_H
+
+#include <stdint.h>
+
+// ==============================================
+// Tomografía de los estados de polarización con los conteos de la FPGA (ver src/tomography.cpp)
+// ==============================================
+#define TOMOGRAPHY_ALL_STATES 4   // Estado de Alice: 0-3 (H, V, D, A) o los cuatro
+
+bool tomographyStart(uint32_t durationUs, uint8_t aliceState);
+bool tomographyActive();
+void tomographySendPulse(bool isAlice, uint32_t pulseNum);
+bool tomographyOnPulse(uint32_t detector0, uint32_t detector1, bool valid);
+void tomographyAbort();
+
+#endif // TOMOGRAPHY_H
@@ -0,0 +1,19 @@
+#ifndef TRACE_EXPORT_H
+#define TRACE_EXPORT_H
+
+#include <stdint.h>
+
+// ==============================================
+// Exportación de trazas en formato Chrome Trace Event (ver src/trace_export.cpp)
+// ==============================================
+#define TRACE_NODE_CENTRAL 0
+#define TRACE_NODE_ALICE   1
+#define TRACE_NODE_BOB     2
+
+// arg de TR_ESPNOW_RX/TX en el Central: nodo en el byte alto, comando/estado en el bajo
+#define TRACE_ESPNOW_ARG(node, code) (((uint32_t)(node) << 8) | (uint8_t)(code))
+
+void traceOnChunk(bool isAlice, const uint8_t* data, int len);
+void handleTraceDownload();
+
+#endif // TRACE_EXPORT_H
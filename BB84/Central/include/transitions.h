@@ -0,0 +1,12 @@
+#ifndef TRANSITIONS_H
+#define TRANSITIONS_H
+
+#include <stdint.h>
+
+// ==============================================
+// Matriz de coste de transiciones de Alice y Bob (ver src/transitions.cpp)
+// ==============================================
+void transitionsOnReport(bool isAlice, const uint8_t* data, int len);
+void transitionsLoop();
+
+#endif // TRANSITIONS_H
@@ -0,0 +1,112 @@
+"""
+Estadísticas de latencia ESP-NOW a partir de la salida del env:bench del Central.
+
+Lee las líneas "bench,run,node,seq,payload,channel,ps,tx_power,rtt_us" desde un
+archivo de log o directamente del puerto serial, agrupa por configuración
+(nodo, payload, canal, ahorro de energía, potencia TX) y reporta percentiles
+del tiempo de ida y vuelta en microsegundos. rtt_us = -1 indica timeout.
+
+Uso:
+    python latency_stats.py log.txt
+    python latency_stats.py --port COM5 --baud 115200 --csv resumen.csv
+"""
+
+import argparse
+import csv
+import math
+import sys
+from collections import defaultdict
+
+CAMPOS = ("run", "node", "seq", "payload", "channel", "ps", "tx_power", "rtt_us")
+CLAVE = ("node", "payload", "channel", "ps", "tx_power")
+
+
+def parsear_linea(linea):
+    linea = linea.strip()
+    if not linea.startswith("bench,"):
+        return None
+    partes = linea.split(",")[1:]
+    if len(partes) != len(CAMPOS):
+        return None
+    fila = dict(zip(CAMPOS, partes))
+    try:
+        fila["rtt_us"] = int(fila["rtt_us"])
+    except ValueError:
+        return None
+    return fila
+
+
+def percentil(ordenados, p):
+    # Método del rango más cercano (sin interpolación)
+    if not ordenados:
+        return float("nan")
+    k = max(0, math.ceil(p / 100.0 * len(ordenados)) - 1)
+    return ordenados[k]
+
+
+def leer_lineas(args):
+    if args.port:
+        import serial  # pyserial
+
+        with serial.Serial(args.port, args.baud, timeout=1) as puerto:
+            print("Leyendo %s (Ctrl+C para terminar)..." % args.port, file=sys.stderr)
+            try:
+                while True:
+                    linea = puerto.readline().decode("utf-8", errors="replace")
+                    if linea:
+                        if args.echo:
+                            sys.stderr.write(linea)
+                        yield linea
+            except KeyboardInterrupt:
+                return
+    else:
+        with open(args.log, encoding="utf-8", errors="replace") as f:
+            for linea in f:
+                yield linea
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Percentiles de latencia ESP-NOW")
+    parser.add_argument("log", nargs="?", help="Archivo con la salida serial del Central")
+    parser.add_argument("--port", help="Puerto serial (en lugar de archivo)")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--echo", action="store_true", help="Repetir la salida serial")
+    parser.add_argument("--csv", help="Guardar el resumen en CSV")
+    args = parser.parse_args()
+    if not args.log and not args.port:
+        parser.error("indicar un archivo de log o --port")
+
+    grupos = defaultdict(list)
+    for linea in leer_lineas(args):
+        fila = parsear_linea(linea)
+        if fila:
+            grupos[tuple(fila[c] for c in CLAVE)].append(fila["rtt_us"])
+
+    resumen = []
+    for clave in sorted(grupos, key=lambda c: (c[0], int(c[1]), int(c[2]), int(c[3]), int(c[4]))):
+        muestras = grupos[clave]
+        validas = sorted(m for m in muestras if m >= 0)
+        media = sum(validas) / len(validas) if validas else float("nan")
+        resumen.append(dict(zip(CLAVE, clave), n=len(muestras),
+                            timeouts=len(muestras) - len(validas),
+                            min=validas[0] if validas else float("nan"),
+                            mean=round(media, 1),
+                            p50=percentil(validas, 50), p90=percentil(validas, 90),
+                            p99=percentil(validas, 99),
+                            max=validas[-1] if validas else float("nan")))
+
+    columnas = list(CLAVE) + ["n", "timeouts", "min", "mean", "p50", "p90", "p99", "max"]
+    print(" ".join("%9s" % c for c in columnas))
+    for r in resumen:
+        print(" ".join("%9s" % r[c] for c in columnas))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            escritor = csv.DictWriter(f, fieldnames=columnas)
+            escritor.writeheader()
+            escritor.writerows(resumen)
+        print("Resumen guardado en %s" % args.csv, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
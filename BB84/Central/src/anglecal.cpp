@@ -0,0 +1,328 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include <math.h>
+#include <BB84Protocol.h>
+#include <AsyncLog.h>
+#include "params.h"
+#include "anglecal.h"
+
+// ==============================================
+// Calibración de las tablas de ángulos
+// ==============================================
+// Busca los ángulos de Alice y Bob con los conteos de los detectores en vez de
+// a mano. Es una sesión de la FPGA en la que cada pulso es un pulso de
+// referencia (CMD_PREPARE_REFERENCE, los de la compensación de deriva): el
+// Central fija el estado de cada nodo y un desplazamiento sobre su tabla, y el
+// nodo responde STATUS_READY al llegar, así que cada punto se mide con el
+// motor parado sin esperas fijas.
+//
+// Cada ángulo se barre alrededor de su valor vigente, primero grueso (±8° cada
+// 1°) y luego fino (±1.2° cada 0.3°) alrededor del mínimo grueso, midiendo en
+// cada punto la fracción de detecciones en el detector que debería quedar a
+// oscuras (el del bit contrario, como en sendDataToWeb()). Cerca de la
+// extinción esa fracción es sin²(2x) ≈ 4x² más el fondo, así que el ángulo
+// sale del vértice de una parábola ajustada por mínimos cuadrados a los
+// puntos finos.
+//
+// Solo importan los ángulos relativos, así que Alice H queda como referencia:
+//
+//   1. Bob base +   con Alice en H        (detector 1 a oscuras)
+//   2. Alice V      con Bob en la base +  (detector 0)
+//   3. Alice D      con Bob en la base x  (detector 1)
+//   4. Alice A      con Bob en la base x  (detector 0)
+//
+// La base x de Bob se mueve lo mismo que la base + (conserva la separación de
+// la tabla, que fija el convenio de la base diagonal). Al terminar las tablas
+// se envían con CMD_SET_PARAMS y cada nodo las guarda en NVS (log [PARAMS]).
+// Los ángulos sin ajuste válido conservan su valor.
+//
+// Un pulso sin el READY de los dos nodos (timeout) se midió con un motor que
+// quizá no había llegado: no suma conteos, pero el barrido avanza igual. Si en
+// un ángulo faltan más del ANGLECAL_MAX_INVALID_PCT % de los pulsos, sus puntos
+// no son fiables y el ángulo conserva su valor.
+//
+// WebSocket "ANGLE_CAL:us" (botón Calibrar ángulos) la lanza con pulsos de
+// 'us' microsegundos; el progreso queda en el log [ANGLECAL].
+
+#define ANGLECAL_PULSES_PER_POINT 4
+#define ANGLECAL_COARSE_SPAN_MDEG 8000
+#define ANGLECAL_COARSE_STEP_MDEG 1000
+#define ANGLECAL_FINE_SPAN_MDEG 1200
+#define ANGLECAL_FINE_STEP_MDEG 300
+#define ANGLECAL_COARSE_POINTS (2 * ANGLECAL_COARSE_SPAN_MDEG / ANGLECAL_COARSE_STEP_MDEG + 1)
+#define ANGLECAL_FINE_POINTS (2 * ANGLECAL_FINE_SPAN_MDEG / ANGLECAL_FINE_STEP_MDEG + 1)
+#define ANGLECAL_PARAMS_TIMEOUT_MS 3000   // Espera de las tablas vigentes (CMD_GET_PARAMS)
+#define ANGLECAL_MAX_INVALID_PCT 10       // Pulsos sin READY tolerados por ángulo
+
+// Variables y funciones definidas en main.cpp
+extern bool start_protocol;
+void enviarConfiguracion(uint32_t num_pulsos, uint32_t duracion_us);
+esp_err_t sendReferencePulse(bool isAlice, uint32_t pulseNum, uint8_t index, int32_t offsetMdeg);
+
+struct AngleCalStage {
+  const char* name;
+  bool scanAlice;            // false = se barre Bob
+  uint8_t aliceIndex;        // Tabla de Alice [base][bit]
+  uint8_t bobIndex;          // Tabla de Bob [base]
+  uint8_t darkDetector;      // Detector del bit contrario al de Alice
+};
+
+static const AngleCalStage stages[] = {
+  {"Bob base +", false, 0, 0, 1},
+  {"Alice V",    true,  1, 0, 0},
+  {"Alice D",    true,  2, 1, 1},
+  {"Alice A",    true,  3, 1, 0},
+};
+#define ANGLECAL_STAGES (sizeof(stages) / sizeof(stages[0]))
+#define ANGLECAL_STAGE_PULSES ((ANGLECAL_COARSE_POINTS + ANGLECAL_FINE_POINTS) * ANGLECAL_PULSES_PER_POINT)
+#define ANGLECAL_PULSES (ANGLECAL_STAGES * ANGLECAL_STAGE_PULSES)
+
+struct ScanPoint {
+  uint32_t dark;
+  uint32_t total;
+};
+
+enum AngleCalState : uint8_t {
+  ANGLECAL_IDLE,
+  ANGLECAL_WAIT_PARAMS,      // Pidiendo las tablas vigentes
+  ANGLECAL_SCANNING
+};
+
+static AngleCalState state = ANGLECAL_IDLE;
+static uint32_t pulseDurationUs = 0;
+static uint32_t requestMs = 0;
+static MotionParams aliceParams;   // Tablas al empezar (los barridos son desplazamientos sobre ellas)
+static MotionParams bobParams;
+
+static uint8_t stage = 0;
+static bool fine = false;
+static uint8_t point = 0;
+static uint8_t pulse = 0;
+static uint16_t invalidPulses = 0;             // Pulsos sin READY en el ángulo en curso
+static ScanPoint coarsePoints[ANGLECAL_COARSE_POINTS];
+static ScanPoint finePoints[ANGLECAL_FINE_POINTS];
+static int32_t fineCenter = 0;                 // Desplazamiento del mínimo grueso
+static int32_t fitted[ANGLECAL_STAGES];        // Desplazamiento ajustado (milésimas de grado)
+static bool fittedOk[ANGLECAL_STAGES];
+
+static float darkFraction(const ScanPoint& p) {
+  return p.total ? (float)p.dark / p.total : 1.0f;
+}
+
+static int32_t pointOffset() {
+  if (fine) return fineCenter - ANGLECAL_FINE_SPAN_MDEG + point * ANGLECAL_FINE_STEP_MDEG;
+  return -ANGLECAL_COARSE_SPAN_MDEG + point * ANGLECAL_COARSE_STEP_MDEG;
+}
+
+static int32_t wrapAngle(int32_t angle) {
+  angle %= 360000;
+  return angle < 0 ? angle + 360000 : angle;
+}
+
+// Vértice de y = a·x² + b·x + c por mínimos cuadrados (regla de Cramer). false
+// si hay menos de tres puntos o la parábola no tiene mínimo.
+static bool fitParabola(const float* x, const float* y, uint8_t n, float& vertex) {
+  if (n < 3) return false;
+  double s0 = n, s1 = 0, s2 = 0, s3 = 0, s4 = 0, t0 = 0, t1 = 0, t2 = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    double xi = x[i], x2 = xi * xi;
+    s1 += xi; s2 += x2; s3 += x2 * xi; s4 += x2 * x2;
+    t0 += y[i]; t1 += xi * y[i]; t2 += x2 * y[i];
+  }
+  // | s4 s3 s2 | |a|   |t2|
+  // | s3 s2 s1 | |b| = |t1|
+  // | s2 s1 s0 | |c|   |t0|
+  double det = s4 * (s2 * s0 - s1 * s1) - s3 * (s3 * s0 - s1 * s2) + s2 * (s3 * s1 - s2 * s2);
+  if (fabs(det) < 1e-12) return false;
+  double a = (t2 * (s2 * s0 - s1 * s1) - s3 * (t1 * s0 - s1 * t0) + s2 * (t1 * s1 - s2 * t0)) / det;
+  double b = (s4 * (t1 * s0 - s1 * t0) - t2 * (s3 * s0 - s1 * s2) + s2 * (s3 * t0 - t1 * s2)) / det;
+  if (a <= 0) return false;
+  vertex = -b / (2 * a);
+  return true;
+}
+
+// Mínimo grueso: centro del barrido fino
+static void finishCoarse() {
+  uint8_t best = 0;
+  for (uint8_t i = 1; i < ANGLECAL_COARSE_POINTS; i++) {
+    if (darkFraction(coarsePoints[i]) < darkFraction(coarsePoints[best])) best = i;
+  }
+  fineCenter = -ANGLECAL_COARSE_SPAN_MDEG + best * ANGLECAL_COARSE_STEP_MDEG;
+  LOG_I("[ANGLECAL] %s: mínimo grueso a %+.1f° (%.2f%% a oscuras)", stages[stage].name, fineCenter / 1000.0f,
+        darkFraction(coarsePoints[best]) * 100.0f);
+  if (best == 0 || best == ANGLECAL_COARSE_POINTS - 1) {
+    LOG_W("[ANGLECAL]   en el borde del barrido: la tabla está a más de %.0f° del mínimo",
+          ANGLECAL_COARSE_SPAN_MDEG / 1000.0f);
+  }
+}
+
+// Ajuste fino: vértice de la parábola, o el mejor punto si no hay parábola
+static void finishFine() {
+  float x[ANGLECAL_FINE_POINTS];
+  float y[ANGLECAL_FINE_POINTS];
+  uint8_t n = 0;
+  uint8_t best = 0;
+  for (uint8_t i = 0; i < ANGLECAL_FINE_POINTS; i++) {
+    if (darkFraction(finePoints[i]) < darkFraction(finePoints[best])) best = i;
+    if (finePoints[i].total == 0) continue;
+    x[n] = (-ANGLECAL_FINE_SPAN_MDEG + i * ANGLECAL_FINE_STEP_MDEG) / 1000.0f;
+    y[n] = darkFraction(finePoints[i]);
+    n++;
+  }
+
+  const AngleCalStage& s = stages[stage];
+  const MotionParams& params = s.scanAlice ? aliceParams : bobParams;
+  int32_t nominal = params.angles[s.scanAlice ? s.aliceIndex : s.bobIndex];
+  float vertex = 0;
+  if (invalidPulses * 100 > ANGLECAL_STAGE_PULSES * ANGLECAL_MAX_INVALID_PCT) {
+    fittedOk[stage] = false;
+    LOG_W("[ANGLECAL] %s: %u de %u pulsos sin READY, se conserva %.3f°", s.name, invalidPulses,
+          (unsigned)ANGLECAL_STAGE_PULSES, nominal / 1000.0f);
+    return;
+  }
+  if (finePoints[best].total == 0) {
+    fittedOk[stage] = false;
+    LOG_W("[ANGLECAL] %s: sin detecciones, se conserva %.3f°", s.name, nominal / 1000.0f);
+    return;
+  }
+  if (fitParabola(x, y, n, vertex) && fabsf(vertex) <= ANGLECAL_FINE_SPAN_MDEG / 1000.0f) {
+    fitted[stage] = fineCenter + lroundf(vertex * 1000.0f);
+  } else {
+    fitted[stage] = fineCenter - ANGLECAL_FINE_SPAN_MDEG + best * ANGLECAL_FINE_STEP_MDEG;
+    LOG_W("[ANGLECAL] %s: la parábola no ajusta, se usa el mejor punto fino", s.name);
+  }
+  fittedOk[stage] = true;
+  LOG_I("[ANGLECAL] %s: %.3f° -> %.3f° (%+.3f°), extinción %.2f%%", s.name, nominal / 1000.0f,
+        wrapAngle(nominal + fitted[stage]) / 1000.0f, fitted[stage] / 1000.0f, darkFraction(finePoints[best]) * 100.0f);
+}
+
+// Enviar las tablas ajustadas; cada nodo las valida y guarda en NVS
+static void finish() {
+  state = ANGLECAL_IDLE;
+  MotionParams alice = aliceParams;
+  MotionParams bob = bobParams;
+  bool aliceChanged = false;
+  bool bobChanged = false;
+  for (uint8_t i = 0; i < ANGLECAL_STAGES; i++) {
+    if (!fittedOk[i]) continue;
+    const AngleCalStage& s = stages[i];
+    if (s.scanAlice) {
+      alice.angles[s.aliceIndex] = wrapAngle(aliceParams.angles[s.aliceIndex] + fitted[i]);
+      aliceChanged = true;
+    } else {
+      // La base x acompaña a la + (misma separación que en la tabla)
+      for (uint8_t b = 0; b < bob.angleCount; b++) bob.angles[b] = wrapAngle(bobParams.angles[b] + fitted[i]);
+      bobChanged = true;
+    }
+  }
+  if (!aliceChanged && !bobChanged) {
+    LOG_W("[ANGLECAL] Calibración terminada sin ajustes válidos: tablas sin cambios");
+    return;
+  }
+  if (aliceChanged) paramsSend(true, alice);
+  if (bobChanged) paramsSend(false, bob);
+  LOG_I("[ANGLECAL] Calibración terminada: tablas enviadas%s%s", aliceChanged ? " a Alice" : "",
+        bobChanged ? " a Bob" : "");
+}
+
+bool anglecalStart(uint32_t durationUs) {
+  if (state != ANGLECAL_IDLE || start_protocol) return false;
+  pulseDurationUs = durationUs;
+  paramsRequest();  // Los barridos son relativos a las tablas vigentes
+  requestMs = millis();
+  state = ANGLECAL_WAIT_PARAMS;
+  LOG_I("[ANGLECAL] Pidiendo las tablas vigentes a Alice y Bob...");
+  return true;
+}
+
+// Lanza la sesión de la FPGA cuando llegan las tablas
+void anglecalLoop() {
+  if (state != ANGLECAL_WAIT_PARAMS) return;
+  if (paramsCurrent(true, aliceParams) && paramsCurrent(false, bobParams)) {
+    if (start_protocol) {
+      LOG_E("[ANGLECAL] Hay una sesión de la FPGA en curso: calibración cancelada");
+      state = ANGLECAL_IDLE;
+      return;
+    }
+    if (aliceParams.angleCount != 4 || bobParams.angleCount != 2) {
+      LOG_E("[ANGLECAL] Tablas inesperadas (Alice %u, Bob %u ángulos): calibración cancelada",
+            aliceParams.angleCount, bobParams.angleCount);
+      state = ANGLECAL_IDLE;
+      return;
+    }
+    stage = 0;
+    fine = false;
+    point = 0;
+    pulse = 0;
+    invalidPulses = 0;
+    memset(coarsePoints, 0, sizeof(coarsePoints));
+    memset(fittedOk, 0, sizeof(fittedOk));
+    state = ANGLECAL_SCANNING;  // Antes de configurar: el primer pulso ya es de calibración
+    LOG_I("[ANGLECAL] %u ángulos, %u puntos cada uno, %u pulsos de %lu us", (unsigned)ANGLECAL_STAGES,
+          ANGLECAL_COARSE_POINTS + ANGLECAL_FINE_POINTS, (unsigned)ANGLECAL_PULSES, (unsigned long)pulseDurationUs);
+    enviarConfiguracion(ANGLECAL_PULSES, pulseDurationUs);
+    if (!start_protocol) {
+      LOG_E("[ANGLECAL] No se pudo iniciar la sesión de la FPGA: calibración cancelada");
+      state = ANGLECAL_IDLE;
+    }
+    return;
+  }
+  if (millis() - requestMs > ANGLECAL_PARAMS_TIMEOUT_MS) {
+    LOG_E("[ANGLECAL] %s no envió su tabla de ángulos: calibración cancelada",
+          paramsCurrent(true, aliceParams) ? "Bob" : "Alice");
+    state = ANGLECAL_IDLE;
+  }
+}
+
+bool anglecalActive() {
+  return state == ANGLECAL_SCANNING;
+}
+
+void anglecalSendPulse(bool isAlice, uint32_t pulseNum) {
+  const AngleCalStage& s = stages[stage];
+  if (isAlice) {
+    sendReferencePulse(true, pulseNum, s.aliceIndex, s.scanAlice ? pointOffset() : 0);
+  } else {
+    // En los barridos de Alice, Bob ya lleva su corrección de la primera etapa
+    int32_t bobOffset = fittedOk[0] ? fitted[0] : 0;
+    sendReferencePulse(false, pulseNum, s.bobIndex, s.scanAlice ? bobOffset : pointOffset());
+  }
+}
+
+// Pulso terminado: si es de la calibración suma sus conteos al punto en curso
+// (salvo que le falte algún READY), avanza el barrido y devuelve true
+bool anglecalOnPulse(uint32_t detector0, uint32_t detector1, bool valid) {
+  if (state != ANGLECAL_SCANNING) return false;
+  if (valid) {
+    ScanPoint& p = fine ? finePoints[point] : coarsePoints[point];
+    p.dark += stages[stage].darkDetector == 0 ? detector0 : detector1;
+    p.total += detector0 + detector1;
+  } else {
+    invalidPulses++;
+  }
+  if (++pulse < ANGLECAL_PULSES_PER_POINT) return true;
+
+  pulse = 0;
+  point++;
+  if (!fine && point == ANGLECAL_COARSE_POINTS) {
+    finishCoarse();
+    fine = true;
+    point = 0;
+    memset(finePoints, 0, sizeof(finePoints));
+  } else if (fine && point == ANGLECAL_FINE_POINTS) {
+    finishFine();
+    fine = false;
+    point = 0;
+    memset(coarsePoints, 0, sizeof(coarsePoints));
+    invalidPulses = 0;
+    if (++stage == ANGLECAL_STAGES) finish();
+  }
+  return true;
+}
+
+// CMD_ABORT / abort desde la web: las tablas no cambian
+void anglecalAbort() {
+  if (state == ANGLECAL_IDLE) return;
+  state = ANGLECAL_IDLE;
+  LOG_W("[ANGLECAL] Calibración abortada: tablas sin cambios");
+}
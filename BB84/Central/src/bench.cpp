@@ -0,0 +1,352 @@
+#ifdef BB84_BENCH
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <BB84Protocol.h>
+#include "bench.h"
+
+// ==============================================
+// Benchmark de latencia ESP-NOW (env:bench)
+// ==============================================
+// Mide el intercambio CMD_PREPARE_PULSE -> STATUS_READY contra Alice y Bob
+// compilados con su propio env:bench (homing y movimiento simulados), usando
+// la misma configuración ESP-NOW del setup() del Central.
+//
+// Se controla desde el monitor serial con una línea por corrida:
+//
+//   RUN n=200 size=9 ch=6 ps=0 tx=34 node=both gap=2000
+//   SWEEP n=200 node=both
+//
+// Los resultados se imprimen al final de cada corrida como líneas CSV
+// "bench,..." (una por intercambio y nodo). El script scripts/latency_stats.py
+// las agrupa por configuración y calcula los percentiles.
+
+// Variables y funciones definidas en main.cpp
+extern uint8_t aliceMAC[];
+extern uint8_t bobMAC[];
+extern int ESP_NOW_CHANNEL;
+extern bool aliceReady;
+extern bool bobReady;
+extern volatile uint32_t aliceReadyMicros;
+extern volatile uint32_t bobReadyMicros;
+extern volatile uint32_t aliceReadyPulse;
+extern volatile uint32_t bobReadyPulse;
+extern volatile uint32_t alicePongMicros;
+extern volatile uint32_t bobPongMicros;
+esp_err_t sendCommandToAlice(uint8_t cmd, uint32_t pulseNum);
+esp_err_t sendCommandToBob(uint8_t cmd, uint32_t pulseNum);
+
+#define BENCH_NODE_ALICE 0x01
+#define BENCH_NODE_BOB   0x02
+
+#define BENCH_MAX_SAMPLES 2000       // Intercambios máximos por corrida
+#define BENCH_TIMEOUT_US  100000     // Tiempo máximo de espera de STATUS_READY
+#define BENCH_PONG_TIMEOUT_MS 300    // Espera de confirmación tras cambiar canal/radio
+
+struct BenchConfig {
+  uint32_t count;      // Intercambios por corrida
+  uint16_t payload;    // Tamaño del comando en bytes (sizeof(CommandData) - BB84_MAX_PAYLOAD)
+  uint8_t channel;     // Canal WiFi (1-13)
+  uint8_t powerSave;   // wifi_ps_type_t: 0=NONE, 1=MIN_MODEM, 2=MAX_MODEM
+  int8_t txPower;      // Potencia TX (8-84, unidad = 0.25 dBm)
+  uint8_t nodes;       // BENCH_NODE_ALICE | BENCH_NODE_BOB
+  uint32_t gapUs;      // Pausa entre intercambios
+};
+
+// Matriz recorrida por SWEEP
+static const uint16_t SWEEP_PAYLOADS[] = {sizeof(CommandData), 64, 128, BB84_MAX_PAYLOAD};
+static const uint8_t SWEEP_CHANNELS[] = {1, 6, 11};
+static const uint8_t SWEEP_POWER_SAVE[] = {WIFI_PS_NONE, WIFI_PS_MIN_MODEM};
+static const int8_t SWEEP_TX_POWER[] = {34, 52, 78};
+
+// Resultados de la corrida actual (-1 = timeout)
+static int32_t rttAlice[BENCH_MAX_SAMPLES];
+static int32_t rttBob[BENCH_MAX_SAMPLES];
+static uint32_t runId = 0;
+
+// Buffer de la línea serial en curso
+static char lineBuffer[128];
+static size_t lineLength = 0;
+
+static BenchConfig defaultConfig() {
+  BenchConfig cfg;
+  cfg.count = 200;
+  cfg.payload = sizeof(CommandData);
+  cfg.channel = ESP_NOW_CHANNEL;
+  cfg.powerSave = WIFI_PS_NONE;
+  cfg.txPower = 34;
+  cfg.nodes = BENCH_NODE_ALICE | BENCH_NODE_BOB;
+  cfg.gapUs = 2000;
+  return cfg;
+}
+
+static void setPeerChannel(const uint8_t* mac, uint8_t channel) {
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, 6);
+  peer.channel = channel;
+  peer.encrypt = false;
+  esp_now_mod_peer(&peer);
+}
+
+// Esperar un PONG nuevo de cada nodo seleccionado (cualquier PONG posterior a prev*)
+static bool waitForPong(uint8_t nodes, uint32_t prevAlice, uint32_t prevBob) {
+  unsigned long start = millis();
+  while (millis() - start < BENCH_PONG_TIMEOUT_MS) {
+    bool aliceOk = !(nodes & BENCH_NODE_ALICE) || alicePongMicros != prevAlice;
+    bool bobOk = !(nodes & BENCH_NODE_BOB) || bobPongMicros != prevBob;
+    if (aliceOk && bobOk) return true;
+    yield();
+  }
+  return false;
+}
+
+static bool pingNodes(uint8_t nodes) {
+  for (int attempt = 0; attempt < 3; attempt++) {
+    uint32_t prevAlice = alicePongMicros;
+    uint32_t prevBob = bobPongMicros;
+    if (nodes & BENCH_NODE_ALICE) sendCommandToAlice(CMD_PING, 0);
+    if (nodes & BENCH_NODE_BOB) sendCommandToBob(CMD_PING, 0);
+    if (waitForPong(nodes, prevAlice, prevBob)) return true;
+  }
+  return false;
+}
+
+// Mover los nodos y el Central a otro canal. Los nodos confirman ya en el canal
+// nuevo, así que la confirmación se verifica con un PING después del cambio.
+static bool switchChannel(uint8_t channel, uint8_t nodes) {
+  if (channel == ESP_NOW_CHANNEL) return true;
+
+  for (int i = 0; i < 3; i++) {
+    sendCommandToAlice(CMD_SET_CHANNEL, channel);
+    sendCommandToBob(CMD_SET_CHANNEL, channel);
+    delay(20);
+  }
+
+  esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+  ESP_NOW_CHANNEL = channel;
+  setPeerChannel(aliceMAC, channel);
+  setPeerChannel(bobMAC, channel);
+  delay(50);
+
+  return pingNodes(nodes);
+}
+
+// CMD_SET_RADIO: ahorro de energía en pulseNum, potencia TX en totalPulses
+static void sendRadioCommand(const uint8_t* mac, const BenchConfig& cfg) {
+  CommandData command = {CMD_SET_RADIO, cfg.powerSave, (uint32_t)cfg.txPower};
+  esp_now_send(mac, (uint8_t*)&command, sizeof(command));
+}
+
+static bool applyRadio(const BenchConfig& cfg) {
+  if (!switchChannel(cfg.channel, cfg.nodes)) {
+    Serial.printf("# ERROR: nodos sin respuesta en canal %u\n", cfg.channel);
+    return false;
+  }
+
+  esp_wifi_set_ps((wifi_ps_type_t)cfg.powerSave);
+  esp_wifi_set_max_tx_power(cfg.txPower);
+
+  for (int attempt = 0; attempt < 3; attempt++) {
+    uint32_t prevAlice = alicePongMicros;
+    uint32_t prevBob = bobPongMicros;
+    if (cfg.nodes & BENCH_NODE_ALICE) sendRadioCommand(aliceMAC, cfg);
+    if (cfg.nodes & BENCH_NODE_BOB) sendRadioCommand(bobMAC, cfg);
+    if (waitForPong(cfg.nodes, prevAlice, prevBob)) return true;
+  }
+  Serial.println("# ERROR: nodos no confirmaron configuración de radio");
+  return false;
+}
+
+static void sendPaddedPrepare(const uint8_t* mac, uint32_t pulseNum, uint16_t payload) {
+  uint8_t buffer[BB84_MAX_PAYLOAD] = {0};
+  CommandData command = {CMD_PREPARE_PULSE, pulseNum, 0};
+  memcpy(buffer, &command, sizeof(command));
+  esp_now_send(mac, buffer, payload);
+}
+
+static void runBench(const BenchConfig& cfg) {
+  runId++;
+
+  if (!applyRadio(cfg)) return;
+
+  uint32_t timeoutsAlice = 0, timeoutsBob = 0;
+  uint32_t lateAlice = 0, lateBob = 0;
+
+  for (uint32_t seq = 0; seq < cfg.count; seq++) {
+    bool wantAlice = cfg.nodes & BENCH_NODE_ALICE;
+    bool wantBob = cfg.nodes & BENCH_NODE_BOB;
+    // Una respuesta llegada durante la pausa es de un intercambio ya vencido
+    if (aliceReady) lateAlice++;
+    if (bobReady) lateBob++;
+    aliceReady = false;
+    bobReady = false;
+
+    uint32_t sentAlice = 0, sentBob = 0;
+    if (wantAlice) {
+      sentAlice = micros();
+      sendPaddedPrepare(aliceMAC, seq, cfg.payload);
+    }
+    if (wantBob) {
+      sentBob = micros();
+      sendPaddedPrepare(bobMAC, seq, cfg.payload);
+    }
+
+    // Solo vale el STATUS_READY con el número de este intercambio: uno tardío
+    // de un intercambio vencido desplazaría todas las muestras siguientes. El
+    // RTT sale de la marca del callback, así que yield() no lo altera.
+    rttAlice[seq] = -1;
+    rttBob[seq] = -1;
+    bool gotAlice = !wantAlice;
+    bool gotBob = !wantBob;
+    uint32_t start = micros();
+    while (!gotAlice || !gotBob) {
+      if (!gotAlice && aliceReady) {
+        aliceReady = false;
+        if (aliceReadyPulse == seq) {
+          rttAlice[seq] = aliceReadyMicros - sentAlice;
+          gotAlice = true;
+        } else {
+          lateAlice++;
+        }
+      }
+      if (!gotBob && bobReady) {
+        bobReady = false;
+        if (bobReadyPulse == seq) {
+          rttBob[seq] = bobReadyMicros - sentBob;
+          gotBob = true;
+        } else {
+          lateBob++;
+        }
+      }
+      if (micros() - start > BENCH_TIMEOUT_US) break;
+      yield();
+    }
+    if (!gotAlice) timeoutsAlice++;
+    if (!gotBob) timeoutsBob++;
+
+    if (cfg.gapUs > 0) {
+      uint32_t gapStart = micros();
+      while (micros() - gapStart < cfg.gapUs) yield();
+    }
+  }
+
+  // Volcar la distribución completa (fuera de la ventana de medición)
+  for (uint32_t seq = 0; seq < cfg.count; seq++) {
+    if (cfg.nodes & BENCH_NODE_ALICE) {
+      Serial.printf("bench,%u,alice,%u,%u,%u,%u,%d,%d\n", runId, seq, cfg.payload,
+                    cfg.channel, cfg.powerSave, cfg.txPower, rttAlice[seq]);
+    }
+    if (cfg.nodes & BENCH_NODE_BOB) {
+      Serial.printf("bench,%u,bob,%u,%u,%u,%u,%d,%d\n", runId, seq, cfg.payload,
+                    cfg.channel, cfg.powerSave, cfg.txPower, rttBob[seq]);
+    }
+  }
+  Serial.printf("# run %u: n=%u size=%u ch=%u ps=%u tx=%d timeouts alice=%u bob=%u tardías alice=%u bob=%u\n",
+                runId, cfg.count, cfg.payload, cfg.channel, cfg.powerSave, cfg.txPower,
+                timeoutsAlice, timeoutsBob, lateAlice, lateBob);
+}
+
+// Leer pares clave=valor ("n=200 size=64 node=alice") sobre la configuración
+static bool parseOptions(char* args, BenchConfig& cfg) {
+  char* savePtr = nullptr;
+  for (char* token = strtok_r(args, " ", &savePtr); token; token = strtok_r(nullptr, " ", &savePtr)) {
+    char* eq = strchr(token, '=');
+    if (!eq) return false;
+    *eq = '\0';
+    const char* key = token;
+    const char* value = eq + 1;
+    long number = strtol(value, nullptr, 10);
+
+    if (strcmp(key, "n") == 0) cfg.count = constrain(number, 1L, (long)BENCH_MAX_SAMPLES);
+    else if (strcmp(key, "size") == 0) cfg.payload = constrain(number, (long)sizeof(CommandData), (long)BB84_MAX_PAYLOAD);
+    else if (strcmp(key, "ch") == 0) cfg.channel = constrain(number, 1L, 13L);
+    else if (strcmp(key, "ps") == 0) cfg.powerSave = constrain(number, 0L, (long)WIFI_PS_MAX_MODEM);
+    else if (strcmp(key, "tx") == 0) cfg.txPower = constrain(number, 8L, 84L);
+    else if (strcmp(key, "gap") == 0) cfg.gapUs = number < 0 ? 0 : number;
+    else if (strcmp(key, "node") == 0) {
+      if (strcmp(value, "alice") == 0) cfg.nodes = BENCH_NODE_ALICE;
+      else if (strcmp(value, "bob") == 0) cfg.nodes = BENCH_NODE_BOB;
+      else if (strcmp(value, "both") == 0) cfg.nodes = BENCH_NODE_ALICE | BENCH_NODE_BOB;
+      else return false;
+    }
+    else return false;
+  }
+  return true;
+}
+
+static void runSweep(BenchConfig base) {
+  for (uint8_t channel : SWEEP_CHANNELS) {
+    for (uint8_t powerSave : SWEEP_POWER_SAVE) {
+      for (int8_t txPower : SWEEP_TX_POWER) {
+        for (uint16_t payload : SWEEP_PAYLOADS) {
+          BenchConfig cfg = base;
+          cfg.channel = channel;
+          cfg.powerSave = powerSave;
+          cfg.txPower = txPower;
+          cfg.payload = payload;
+          runBench(cfg);
+        }
+      }
+    }
+  }
+  Serial.println("# sweep completado");
+}
+
+static void printHelp() {
+  Serial.println("# Comandos:");
+  Serial.println("#   RUN n=200 size=9 ch=6 ps=0 tx=34 node=both gap=2000");
+  Serial.println("#   SWEEP n=200 node=both gap=2000");
+  Serial.println("# Formato CSV:");
+  Serial.println("#bench,run,node,seq,payload,channel,ps,tx_power,rtt_us");
+}
+
+static void handleLine(char* line) {
+  char* args = strchr(line, ' ');
+  if (args) *args++ = '\0';
+  else args = line + strlen(line);
+
+  BenchConfig cfg = defaultConfig();
+  if (!parseOptions(args, cfg)) {
+    Serial.println("# ERROR: opción inválida");
+    printHelp();
+    return;
+  }
+
+  if (strcmp(line, "RUN") == 0) {
+    runBench(cfg);
+  } else if (strcmp(line, "SWEEP") == 0) {
+    runSweep(cfg);
+  } else {
+    printHelp();
+  }
+}
+
+void benchBegin() {
+  // Sin conexión al router: el canal queda libre para recorrer la matriz
+  WiFi.disconnect();
+  delay(100);
+  esp_wifi_set_channel(ESP_NOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+
+  Serial.println("\n=== BENCHMARK LATENCIA ESP-NOW ===");
+  Serial.printf("# Canal actual: %d\n", ESP_NOW_CHANNEL);
+  printHelp();
+}
+
+void benchLoop() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      lineBuffer[lineLength] = '\0';
+      if (lineLength > 0) handleLine(lineBuffer);
+      lineLength = 0;
+    } else if (lineLength < sizeof(lineBuffer) - 1) {
+      lineBuffer[lineLength++] = c;
+    }
+  }
+  yield();
+}
+
+#endif // BB84_BENCH
@@ -0,0 +1,212 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include <math.h>
+#include <BB84Protocol.h>
+#include <AsyncLog.h>
+#include "drift.h"
+
+// ==============================================
+// Compensación de deriva de polarización
+// ==============================================
+// En ejecuciones largas la polarización que llega a Bob gira despacio (fibra,
+// temperatura, holgura de las monturas) y el QBER sube sin que cambie nada en
+// los motores. Cada 'interval' pulsos el Central intercala un pulso de
+// referencia (CMD_PREPARE_REFERENCE) con estado conocido: Alice en un estado de
+// la base k y Bob midiendo en la base k con su lámina desplazada
+// ±DRIFT_DITHER_MDEG. Los pulsos de referencia no se publican en la web ni
+// entran en la clave.
+//
+// Si la lámina de Bob está desalineada ε respecto del ideal, el error en la
+// base coincidente es E(x) = sin²(2x) y, midiendo a ε ± d:
+//
+//   E(+d) - E(-d) = sin(4ε) · sin(4d)
+//
+// La diferencia entre los dos lados del dither da el signo y el tamaño de ε
+// sin conocer la geometría del montaje. Cuando los dos lados de una base
+// reúnen DRIFT_MIN_COUNTS detecciones y la diferencia supera 2σ, se corrige el
+// ángulo de esa base en la tabla de Bob con CMD_TRIM_ANGLE (una fracción
+// DRIFT_GAIN_PCT de ε, como mucho DRIFT_MAX_STEP_MDEG). Bob no guarda la
+// corrección en NVS y responde STATUS_PARAMS: la corrección solo se suma a la
+// acumulada de la base cuando Bob la confirma (PARAMS_NOT_SAVED); si la
+// rechaza (fuera de rango, motor ocupado) o la respuesta no llega, la
+// acumulada no cambia. Cada estimación y cada corrección quedan en el log [DRIFT].
+//
+// Las referencias recorren base, lado del dither y bit de Alice, así que cada
+// base se mide con sus dos estados ortogonales (mismo eje del analizador).
+// El bit correcto es el del detector del mismo número, como en sendDataToWeb().
+// WebSocket "DRIFT:n" cambia el intervalo (0 = desactivada).
+
+#define DRIFT_DEFAULT_INTERVAL 20   // Un pulso de referencia cada 20 (5 % de los pulsos)
+#define DRIFT_DITHER_MDEG 4000      // Desplazamiento de la lámina de Bob (E(±d) ≈ 2 % sin deriva)
+#define DRIFT_MIN_COUNTS 500        // Detecciones por lado antes de estimar
+#define DRIFT_GAIN_PCT 50           // Fracción de ε corregida (la estimación tiene ruido)
+#define DRIFT_MAX_STEP_MDEG 500     // Corrección máxima por estimación
+#define DRIFT_MIN_STEP_MDEG 50      // Por debajo no se envía
+#define DRIFT_BASES 2
+
+// Variables y funciones definidas en main.cpp
+extern uint8_t bobMAC[];
+esp_err_t sendReferencePulse(bool isAlice, uint32_t pulseNum, uint8_t index, int32_t offsetMdeg);
+
+struct DriftArm {
+  uint32_t errors;           // Detecciones en el detector del bit contrario
+  uint32_t counts;           // Detecciones totales
+};
+
+struct DriftBasis {
+  DriftArm arms[2];          // [0] = +DRIFT_DITHER_MDEG, [1] = -DRIFT_DITHER_MDEG
+  int32_t totalTrim;         // Corrección acumulada en la sesión (milésimas de grado)
+  uint16_t estimates;
+  uint16_t corrections;
+};
+
+static DriftBasis bases[DRIFT_BASES];
+static uint32_t interval = DRIFT_DEFAULT_INTERVAL;
+static uint32_t references = 0;   // Pulsos de referencia de la sesión
+static uint32_t skipped = 0;      // Referencias descartadas por falta de READY
+static bool pending = false;      // El pulso en curso es de referencia
+static uint8_t slotBase = 0;      // Estado del pulso de referencia en curso
+static uint8_t slotArm = 0;
+static uint8_t slotBit = 0;
+// Corrección enviada a Bob y aún sin respuesta (la confirma el callback ESP-NOW)
+static volatile bool trimPending = false;
+static uint8_t trimBase = 0;
+static int32_t trimValue = 0;
+
+void driftSetInterval(uint32_t pulses) {
+  interval = pulses;
+  if (pulses) {
+    LOG_I("[DRIFT] Compensación activada: un pulso de referencia cada %lu", (unsigned long)pulses);
+  } else {
+    LOG_I("[DRIFT] Compensación desactivada");
+  }
+}
+
+uint32_t driftInterval() {
+  return interval;
+}
+
+void driftReset() {
+  memset(bases, 0, sizeof(bases));
+  references = 0;
+  skipped = 0;
+  pending = false;
+  trimPending = false;
+}
+
+// Decide si el pulso pulseNum es de referencia y, si lo es, qué estado lleva
+bool driftReferenceDue(uint32_t pulseNum) {
+  pending = interval > 0 && pulseNum > 0 && pulseNum % interval == 0;
+  if (pending) {
+    uint32_t slot = references++;
+    slotBase = slot & 1;
+    slotArm = (slot >> 1) & 1;
+    slotBit = (slot >> 2) & 1;
+  }
+  return pending;
+}
+
+void driftSendReference(bool isAlice, uint32_t pulseNum) {
+  if (isAlice) {
+    sendReferencePulse(true, pulseNum, slotBase * 2 + slotBit, 0);  // Tabla de Alice [base][bit]
+  } else {
+    sendReferencePulse(false, pulseNum, slotBase, slotArm == 0 ? DRIFT_DITHER_MDEG : -DRIFT_DITHER_MDEG);
+  }
+}
+
+static void sendTrim(uint8_t base, int32_t trim) {
+  CommandData command = {CMD_TRIM_ANGLE, base, (uint32_t)trim};
+  esp_now_send(bobMAC, (uint8_t*)&command, sizeof(command));
+}
+
+static float errorRate(const DriftArm& arm) {
+  return (float)arm.errors / arm.counts;
+}
+
+static void estimate(uint8_t base) {
+  DriftBasis& basis = bases[base];
+  const DriftArm& plus = basis.arms[0];
+  const DriftArm& minus = basis.arms[1];
+  float ePlus = errorRate(plus);
+  float eMinus = errorRate(minus);
+  float sigma = sqrtf(ePlus * (1.0f - ePlus) / plus.counts + eMinus * (1.0f - eMinus) / minus.counts);
+
+  float dither = DRIFT_DITHER_MDEG / 1000.0f * (float)M_PI / 180.0f;
+  float ratio = (ePlus - eMinus) / sinf(4.0f * dither);
+  if (ratio > 1.0f) ratio = 1.0f;
+  if (ratio < -1.0f) ratio = -1.0f;
+  int32_t misalignment = lroundf(asinf(ratio) / 4.0f * 180000.0f / (float)M_PI);
+  bool significant = fabsf(ePlus - eMinus) > 2.0f * sigma;
+  basis.estimates++;
+
+  LOG_I("[DRIFT] Base %u: error %.2f%% a %+.1f°, %.2f%% a %+.1f° (%lu/%lu detecciones) -> desalineación %+.3f°",
+        base, ePlus * 100.0f, DRIFT_DITHER_MDEG / 1000.0f, eMinus * 100.0f, -DRIFT_DITHER_MDEG / 1000.0f,
+        (unsigned long)plus.counts, (unsigned long)minus.counts, misalignment / 1000.0f);
+
+  int32_t trim = -misalignment * DRIFT_GAIN_PCT / 100;
+  if (trim > DRIFT_MAX_STEP_MDEG) trim = DRIFT_MAX_STEP_MDEG;
+  if (trim < -DRIFT_MAX_STEP_MDEG) trim = -DRIFT_MAX_STEP_MDEG;
+  if (!significant || abs(trim) < DRIFT_MIN_STEP_MDEG) {
+    LOG_I("[DRIFT]   sin corrección (%s)", significant ? "menor que el mínimo" : "diferencia menor que 2σ");
+  } else {
+    // Bob está parado (el pulso acaba de terminar) y la procesa antes del siguiente PREPARE
+    if (trimPending) {
+      LOG_W("[DRIFT]   la corrección anterior de la base %u no se confirmó: no cuenta", trimBase);
+    }
+    trimBase = base;
+    trimValue = trim;
+    trimPending = true;  // Antes de enviar: la respuesta puede llegar enseguida
+    sendTrim(base, trim);
+    LOG_I("[DRIFT]   corrección %+.3f° enviada a la base %u de Bob", trim / 1000.0f, base);
+  }
+  memset(basis.arms, 0, sizeof(basis.arms));
+}
+
+// Pulso terminado: si era de referencia acumula sus conteos (y puede corregir)
+// y devuelve true; si no, false y el pulso sigue su camino normal. Una
+// referencia sin READY de los dos nodos se descarta: el recorrido de estados
+// sigue adelante, pero sus conteos no entran en la estimación
+bool driftOnPulse(uint32_t detector0, uint32_t detector1, bool valid) {
+  if (!pending) return false;
+  pending = false;
+  if (!valid) {
+    skipped++;
+    LOG_W("[DRIFT] Referencia sin READY de los dos nodos: conteos descartados");
+    return true;
+  }
+  DriftBasis& basis = bases[slotBase];
+  DriftArm& arm = basis.arms[slotArm];
+  arm.errors += slotBit == 0 ? detector1 : detector0;
+  arm.counts += detector0 + detector1;
+  if (basis.arms[0].counts >= DRIFT_MIN_COUNTS && basis.arms[1].counts >= DRIFT_MIN_COUNTS) {
+    estimate(slotBase);
+  }
+  return true;
+}
+
+// STATUS_PARAMS de Bob (callback ESP-NOW): respuesta a la corrección pendiente.
+// PARAMS_OK es la de un CMD_GET_PARAMS y no la resuelve
+void driftOnParamsResult(uint8_t result) {
+  if (!trimPending || result == PARAMS_OK) return;
+  trimPending = false;
+  DriftBasis& basis = bases[trimBase];
+  if (result == PARAMS_NOT_SAVED) {
+    basis.totalTrim += trimValue;
+    basis.corrections++;
+    LOG_I("[DRIFT]   Bob aplicó la corrección de la base %u (acumulada %+.3f°)", trimBase,
+          basis.totalTrim / 1000.0f);
+  } else {
+    LOG_W("[DRIFT]   Bob rechazó la corrección %+.3f° de la base %u (%s): acumulada sin cambios",
+          trimValue / 1000.0f, trimBase, result == PARAMS_BUSY ? "motor ocupado" : "fuera de rango");
+  }
+}
+
+void driftPrintSummary() {
+  if (references == 0) return;
+  LOG_I("[DRIFT] Sesión: %lu pulsos de referencia (uno cada %lu), %lu descartados sin READY",
+        (unsigned long)references, (unsigned long)interval, (unsigned long)skipped);
+  for (uint8_t base = 0; base < DRIFT_BASES; base++) {
+    LOG_I("[DRIFT]   base %u: %u estimaciones, %u correcciones, acumulada %+.3f°", base, bases[base].estimates,
+          bases[base].corrections, bases[base].totalTrim / 1000.0f);
+  }
+}
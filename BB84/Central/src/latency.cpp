@@ -0,0 +1,136 @@
+#include <Arduino.h>
+#include <ClockSync.h>
+#include <AsyncLog.h>
+#include "latency.h"
+
+// ==============================================
+// Desglose de latencia CMD_PREPARE_PULSE -> STATUS_READY
+// ==============================================
+// Con los relojes de Alice y Bob sincronizados (ClockSync), las marcas de
+// tiempo de STATUS_READY se llevan al reloj del Central y cada pulso se reparte en:
+//
+//   radio ida    envío del comando -> recepción en el nodo
+//   cola         recepción -> inicio del movimiento (loop del nodo)
+//   motor        inicio -> fin del movimiento
+//   radio vuelta fin del movimiento -> recepción de STATUS_READY en el Central
+//
+// Cola y motor son duraciones locales del nodo y no dependen de la
+// sincronización. Sin sincronización la radio se reporta solo como suma de ida y vuelta.
+
+// Variables definidas en main.cpp
+extern uint8_t aliceMAC[];
+extern uint8_t bobMAC[];
+
+#define LATENCY_REPORT_PULSES 100  // Resumen por serial cada N pulsos
+
+enum LatencySegment {
+  SEG_RADIO_UP = 0,
+  SEG_QUEUE,
+  SEG_MOTION,
+  SEG_RADIO_DOWN,
+  SEG_RADIO,       // Ida + vuelta (no requiere sincronización)
+  SEG_TOTAL,
+  SEG_COUNT
+};
+
+static const char* SEGMENT_NAMES[SEG_COUNT] = {
+  "radio_ida", "cola", "motor", "radio_vuelta", "radio", "total"
+};
+
+struct SegmentStats {
+  uint32_t count;
+  uint64_t sum;
+  uint32_t max;
+};
+
+struct NodeLatency {
+  const char* name;
+  ClockSync clock;
+  SegmentStats seg[SEG_COUNT];
+  uint32_t pulses;
+};
+
+static NodeLatency alice = {"Alice"};
+static NodeLatency bob = {"Bob"};
+
+static void addSample(SegmentStats& s, int32_t value) {
+  if (value < 0) value = 0;  // Error de sincronización por debajo de la resolución
+  s.count++;
+  s.sum += (uint32_t)value;
+  if ((uint32_t)value > s.max) s.max = value;
+}
+
+void latencyBegin() {
+  alice.clock.begin(aliceMAC);
+  bob.clock.begin(bobMAC);
+  latencyReset();
+}
+
+void latencyLoop() {
+  alice.clock.loop();
+  bob.clock.loop();
+}
+
+void latencyOnTimeSync(bool isAlice, const TimeSyncResponse& response, uint32_t rxMicros) {
+  (isAlice ? alice : bob).clock.onResponse(response, rxMicros);
+}
+
+// Convierte una marca del nodo al reloj del Central; false si aún no hay sincronización
+bool latencyToCentral(bool isAlice, uint32_t nodeMicros, uint32_t* centralMicros) {
+  const ClockSync& clock = (isAlice ? alice : bob).clock;
+  if (!clock.isSynced()) return false;
+  *centralMicros = clock.toCentral(nodeMicros);
+  return true;
+}
+
+void latencyReset() {
+  memset(alice.seg, 0, sizeof(alice.seg));
+  memset(bob.seg, 0, sizeof(bob.seg));
+  alice.pulses = 0;
+  bob.pulses = 0;
+}
+
+void latencyRecordPulse(bool isAlice, uint32_t sentMicros, const ResponseData& ready, uint32_t readyMicros) {
+  NodeLatency& node = isAlice ? alice : bob;
+  if (ready.rxMicros == 0) return;  // Nodo sin marcas de tiempo
+
+  int32_t total = (int32_t)(readyMicros - sentMicros);
+  int32_t nodeTime = (int32_t)(ready.moveEndMicros - ready.rxMicros);
+  addSample(node.seg[SEG_TOTAL], total);
+  addSample(node.seg[SEG_QUEUE], (int32_t)(ready.moveStartMicros - ready.rxMicros));
+  addSample(node.seg[SEG_MOTION], (int32_t)(ready.moveEndMicros - ready.moveStartMicros));
+  addSample(node.seg[SEG_RADIO], total - nodeTime);
+
+  if (node.clock.isSynced()) {
+    uint32_t rxCentral = node.clock.toCentral(ready.rxMicros);
+    uint32_t endCentral = node.clock.toCentral(ready.moveEndMicros);
+    addSample(node.seg[SEG_RADIO_UP], (int32_t)(rxCentral - sentMicros));
+    addSample(node.seg[SEG_RADIO_DOWN], (int32_t)(readyMicros - endCentral));
+  }
+
+  node.pulses++;
+  if (!isAlice && node.pulses % LATENCY_REPORT_PULSES == 0) {
+    latencyPrintSummary();
+  }
+}
+
+static void printNode(NodeLatency& node) {
+  if (node.clock.isSynced()) {
+    LOG_I("[LAT] %s pulsos=%u offset=%d us deriva=%.2f ppm rtt_sync=%u us residuo=%d us",
+          node.name, node.pulses, node.clock.offsetUs(), node.clock.driftPpm(),
+          node.clock.lastDelayUs(), node.clock.lastResidualUs());
+  } else {
+    LOG_I("[LAT] %s pulsos=%u (reloj sin sincronizar)", node.name, node.pulses);
+  }
+  for (int i = 0; i < SEG_COUNT; i++) {
+    const SegmentStats& s = node.seg[i];
+    if (s.count == 0) continue;
+    LOG_I("[LAT]   %-13s media=%7lu us  max=%7u us", SEGMENT_NAMES[i],
+          (unsigned long)(s.sum / s.count), s.max);
+  }
+}
+
+void latencyPrintSummary() {
+  printNode(alice);
+  printNode(bob);
+}
@@ -6,6 +6,20 @@
 #include <SPIFFS.h>
 #include <esp_now.h>
 #include <esp_wifi.h>
+#include <BB84Protocol.h>
+#include <QkdProtocol.h>
+#include "bench.h"
+#include "latency.h"
+#include "trace_export.h"
+#include "transitions.h"
+#include "params.h"
+#include "drift.h"
+#include "anglecal.h"
+#include "tomography.h"
+#include "sifting.h"
+#include <AsyncLog.h>
+#include <WsCommand.h>
+#include <HeapStats.h>
 
 // ==============================================
 // Configuración de RED
@@ -38,53 +52,54 @@ int ESP_NOW_CHANNEL = ESP_NOW_INITIAL_CHANNEL;  // Se actualizará con el canal
 uint8_t aliceMAC[] = {0x0C,0x4E,0xA0,0x65,0x48,0xCC};  // MAC de la Super Mini 1 (Alice)
 uint8_t bobMAC[] = {0x0C,0x4E,0xA0,0x65,0x48,0x80};     // MAC de la Super Mini 2 (Bob)
 
-// Estructuras de comunicación ESP-NOW
-struct CommandData {
-  uint8_t cmd;          // Tipo de comando
-  uint32_t pulseNum;    // Número de pulso actual
-  uint32_t totalPulses; // Total de pulsos a transmitir
-} __attribute__((packed));
-
-// Nueva estructura para comandos de movimiento manual
-struct ManualMoveCommand {
-  uint8_t cmd;          // CMD_MOVE_MANUAL
-  float targetAngle;    // Ángulo objetivo
-  uint32_t reserved;    // Reservado para mantener tamaño
-} __attribute__((packed));
-
-struct ResponseData {
-  uint8_t status;       // Estado: READY, ERROR, HOME_COMPLETE
-  uint32_t pulseNum;    // Número de pulso
-  int base;             // Base usada (Alice: 0-1, Bob: 0-1)
-  int bit;              // Bit enviado (solo Alice: 0-1)
-  float angle;          // Ángulo alcanzado
-} __attribute__((packed));
-
-// Comandos
-#define CMD_SET_CHANNEL 0x00   // Configurar canal WiFi (debe ser el primero)
-#define CMD_PING 0x01          // Comando de ping para verificar conexión
-#define CMD_HOME 0x02
-#define CMD_PREPARE_PULSE 0x03
-#define CMD_ABORT 0x04
-#define CMD_START_PROTOCOL 0x05
-#define CMD_MOVE_MANUAL 0x06   // Comando para movimiento manual
-
-// Estados (DEBEN coincidir con Alice/Bob)
-#define STATUS_PONG 0              // Respuesta al ping
-#define STATUS_HOME_COMPLETE 1
-#define STATUS_READY 2
-#define STATUS_ERROR 3
+// Estructuras y comandos ESP-NOW (CommandData, ManualMoveCommand, ResponseData)
+// definidos en la librería compartida BB84Protocol (BB84/lib), común con Alice y Bob
 
 // Flags de estado de los motores
 bool aliceReady = false;
 bool bobReady = false;
 bool aliceHomed = false;
 bool bobHomed = false;
+bool aliceVerifyDone = false;  // Llegó la respuesta a CMD_VERIFY_HOME
+bool bobVerifyDone = false;
+
+// Repetibilidad del homing: desvío de cada 0 respecto del anterior (pasos),
+// informado por el nodo en STATUS_HOME_COMPLETE
+struct HomingRepeatability {
+  uint32_t count;
+  int64_t sum;
+  int64_t sumSq;
+  int32_t maxAbs;
+};
+
+HomingRepeatability aliceHomingStats = {0, 0, 0, 0};
+HomingRepeatability bobHomingStats = {0, 0, 0, 0};
 
 // Flags de conexión (para LEDs)
 bool aliceConnected = false;
 bool bobConnected = false;
 
+// Marcas de tiempo (micros) de la última respuesta de cada nodo, escritas en el
+// callback ESP-NOW (las usa el benchmark de latencia)
+volatile uint32_t aliceReadyMicros = 0;
+volatile uint32_t bobReadyMicros = 0;
+volatile uint32_t aliceReadyPulse = 0;   // pulseNum del último STATUS_READY
+volatile uint32_t bobReadyPulse = 0;
+volatile uint32_t alicePongMicros = 0;
+volatile uint32_t bobPongMicros = 0;
+volatile bool aliceProtocolAck = false;  // STATUS_PROTOCOL recibido tras CMD_SET_PROTOCOL
+volatile bool bobProtocolAck = false;
+volatile uint8_t aliceProtocol = 0;      // Protocolo que confirmó cada nodo
+volatile uint8_t bobProtocol = 0;
+volatile uint8_t rngFailureNodes = 0;    // ERROR_RNG_HEALTH recibido: bit 0 Alice, bit 1 Bob
+
+// Desglose de latencia por pulso: envío de CMD_PREPARE_PULSE y última
+// respuesta STATUS_READY (con marcas de tiempo del nodo)
+uint32_t alicePrepareMicros = 0;
+uint32_t bobPrepareMicros = 0;
+ResponseData aliceLastReady = {};
+ResponseData bobLastReady = {};
+
 // Flags de sincronización de canal (para Fase 2)
 bool aliceChannelConfigured = false;
 bool bobChannelConfigured = false;
@@ -130,7 +145,7 @@ uint32_t detector1_count = 0;
 // Declaraciones de Funciones
 // ==============================================
 void enviarConfiguracion(uint32_t num_pulsos, uint32_t duracion_us);
-void sendDataToWeb();
+void sendDataToWeb(bool valido);
 void generateResetPulse();
 void onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length);
 void handleWebSocketMessage(uint8_t num, uint8_t* payload, size_t length);
@@ -139,12 +154,17 @@ void abortarProtocolo();
 void checkUARTFPGAMessages();
 void generateNextPulseReady();
 void sendHomingCommand();
+bool prepareMotorsHome();
 void waitForMotorsReady();
+void abortOnRngFailure();
 void onESPNowSend(const uint8_t *mac_addr, esp_now_send_status_t status);
 void onESPNowReceive(const uint8_t *mac_addr, const uint8_t *data, int len);
 esp_err_t sendCommandToAlice(uint8_t cmd, uint32_t pulseNum = 0);
 esp_err_t sendCommandToBob(uint8_t cmd, uint32_t pulseNum = 0);
+esp_err_t sendReferencePulse(bool isAlice, uint32_t pulseNum, uint8_t index, int32_t offsetMdeg);
 void prepareNextPulse();
+void recordPulseLatency();
+void publishPulse();
 
 // Helper para servir archivos SPIFFS de forma optimizada
 void serveFile(const char* path, const char* contentType, bool enableCache = true) {
@@ -181,6 +201,7 @@ void serveFile(const char* path, const char* contentType, bool enableCache = tru
 void setup() {
   // Inicialización de comunicaciones
   Serial.begin(115200);
+  logBegin();  // Logging diferido (ver lib/AsyncLog)
   Serial.println("Iniciando configuración...");
   UARTFPGA.begin(115200, SERIAL_8N1, RX_PIN, TX_PIN);
   
@@ -317,6 +338,16 @@ void setup() {
     serveFile("/scriptCascade.js", "application/javascript");
   });
 
+  // Traza de Central, Alice y Bob en formato Chrome Trace Event (Perfetto)
+  server.on("/trace.json", HTTP_GET, handleTraceDownload);
+
+  // Estado del heap (fragmentación) para pruebas de funcionamiento prolongado
+  server.on("/api/heap", HTTP_GET, []() {
+    char json[192];
+    heapStatsJson(json, sizeof(json));
+    server.send(200, "application/json", json);
+  });
+
   server.on("/favicon.ico", HTTP_GET, []() {
     serveFile("/favicon.ico", "image/x-icon");
   });
@@ -493,12 +524,29 @@ void setup() {
   Serial.printf("Alice: %s\n", aliceConnected ? "✓" : "✗");
   Serial.printf("Bob:   %s\n", bobConnected ? "✓" : "✗");
   Serial.println("==============\n");
+
+#ifdef BB84_BENCH
+  benchBegin();
+#else
+  // Sincronización de reloj con Alice y Bob (ráfagas periódicas en segundo plano)
+  latencyBegin();
+#endif
 }
 
 
 void loop() {
+#ifdef BB84_BENCH
+  benchLoop();  // Benchmark de latencia: sin FPGA ni interfaz web
+  return;
+#endif
+
   server.handleClient();
   webSocket.loop();
+  latencyLoop();  // Ráfagas de sincronización de reloj (no bloqueante)
+  transitionsLoop();  // Publicar matrices de transiciones recibidas
+  paramsLoop();  // Publicar parámetros de movimiento recibidos
+  anglecalLoop();  // Arrancar la calibración de ángulos cuando llegan las tablas
+  heapStatsLoop();
 
   if (!start_protocol) return; // Esperar a que se inicie el protocolo
   
@@ -507,19 +555,31 @@ void loop() {
 
   // Verificar si se recibió el mensaje de FIFO vacía
   if (empty_id_received) {
-    sendDataToWeb();
+    publishPulse();
     currentPulseNum++;
+    TRACE_INSTANT(TR_PULSE, currentPulseNum);
     prepareNextPulse();  // Enviar comandos a Alice y Bob via ESP-NOW
     waitForMotorsReady();  // Esperar a que ambos motores estén listos
+    if (rngFailureNodes) {
+      abortOnRngFailure();  // Sin bases aleatorias no se dispara el pulso
+      empty_id_received = false;
+      return;
+    }
     generateNextPulseReady();
+    recordPulseLatency();
     empty_id_received = false;
   }
 
   // Verificar si se recibió el mensaje de finalización de transmisión
   if (tx_ended_received) {
-    Serial.printf("\n[PROTOCOLO] Finalizado en pulso %d de %d\n", currentPulseNum, totalPulses);
-    Serial.println("[FPGA] TX_ENDED_ID recibido - Protocolo completado correctamente");
-    sendDataToWeb();
+    LOG_I("\n[PROTOCOLO] Finalizado en pulso %d de %d", currentPulseNum, totalPulses);
+    LOG_I("[FPGA] TX_ENDED_ID recibido - Protocolo completado correctamente");
+    publishPulse();
+    latencyPrintSummary();
+    driftPrintSummary();
+    siftPrintSummary();
+    sendCommandToAlice(CMD_RNG_STATS, 0);  // Sesgo de las bases/bits de la sesión (log [RNG])
+    sendCommandToBob(CMD_RNG_STATS, 0);
     abortarProtocolo();
     tx_ended_received = false;
     start_protocol = false;
@@ -533,111 +593,272 @@ void loop() {
 void onESPNowSend(const uint8_t *mac_addr, esp_now_send_status_t status) {
   // Optimizado: Callback vacío para máxima velocidad (errores visibles en timeout)
   // Si se necesita debug, descomentar línea siguiente:
-  // if (status != ESP_NOW_SEND_SUCCESS) Serial.printf("[TX ERR] %d\n", status);
+  // if (status != ESP_NOW_SEND_SUCCESS) LOG_E("[TX ERR] %d", status);
 }
 
 void onESPNowReceive(const uint8_t *mac_addr, const uint8_t *data, int len) {
   // Optimizado: Eliminado Serial.printf para reducir latencia en callback crítico
+  uint32_t rxMicros = micros();
+  
+  // Determinar origen comparando MAC
+  bool isAlice = (memcmp(mac_addr, aliceMAC, 6) == 0);
+  bool isBob = (memcmp(mac_addr, bobMAC, 6) == 0);
+  
+  // Sincronización de reloj: respuesta más corta que ResponseData, se procesa aparte
+  if(len >= (int)sizeof(TimeSyncResponse) && data[0] == STATUS_TIME_SYNC) {
+    if(isAlice || isBob) {
+      TimeSyncResponse sync;
+      memcpy(&sync, data, sizeof(sync));
+      latencyOnTimeSync(isAlice, sync, rxMicros);
+    }
+    return;
+  }
+  
+  // Fragmentos del buffer de traza (respuesta a CMD_TRACE_DUMP)
+  if(data[0] == STATUS_TRACE_CHUNK) {
+    if(isAlice || isBob) traceOnChunk(isAlice, data, len);
+    return;
+  }
+  
+  // Matriz de transiciones (respuesta a CMD_TRANSITION_STATS / CMD_TRANSITION_BENCH)
+  if(data[0] == STATUS_TRANSITION_STATS) {
+    if(isAlice || isBob) transitionsOnReport(isAlice, data, len);
+    return;
+  }
+  
+  // Parámetros de movimiento (respuesta a CMD_GET_PARAMS / CMD_SET_PARAMS / CMD_TRIM_ANGLE)
+  if(data[0] == STATUS_PARAMS) {
+    if(isBob && len >= (int)sizeof(ParamsReport)) driftOnParamsResult(((const ParamsReport*)data)->result);
+    if(isAlice || isBob) paramsOnReport(isAlice, data, len);
+    return;
+  }
   
-  if(len != sizeof(ResponseData)) {
-    return;  // Error silencioso - callback debe ser rápido
+  // Fin de la búsqueda de límites (CMD_FIND_LIMITS)
+  if(data[0] == STATUS_LIMITS_DONE) {
+    if((isAlice || isBob) && len >= (int)sizeof(LimitsReport)) {
+      LimitsReport limits;
+      memcpy(&limits, data, sizeof(limits));
+      static const char* const resultNames[] = {"guardados", "aplicados sin guardar", "abortada", "fallida", "ocupado"};
+      LOG_I("[LIMITS] %s: %s en %lu s (%u pruebas)", isAlice ? "Alice" : "Bob",
+            limits.result <= LIMITS_BUSY ? resultNames[limits.result] : "?",
+            (unsigned long)limits.durationS, limits.trials);
+      LOG_I("[LIMITS]   límites %lu pasos/s, %lu pasos/s²; en uso %lu pasos/s, %lu pasos/s²",
+            (unsigned long)limits.speedLimit, (unsigned long)limits.accelerationLimit,
+            (unsigned long)limits.maxSpeed, (unsigned long)limits.acceleration);
+      // Refrescar el panel de parámetros con los valores nuevos
+      if(limits.result == LIMITS_SAVED || limits.result == LIMITS_NOT_SAVED) paramsRequest();
+    }
+    return;
+  }
+  
+  // Progreso y fin de la prueba de resistencia (CMD_SOAK)
+  if(data[0] == STATUS_SOAK_REPORT) {
+    if((isAlice || isBob) && len >= (int)sizeof(SoakReport)) {
+      SoakReport soak;
+      memcpy(&soak, data, sizeof(soak));
+      static const char* const resultNames[] = {"en curso", "terminada", "abortada", "fallida", "ocupado"};
+      LOG_I("[SOAK] %s: %s, %lu/%lu s, %lu movimientos (%.1f/s), medio %.2f ms, máx %.2f ms",
+            isAlice ? "Alice" : "Bob", soak.result <= SOAK_BUSY ? resultNames[soak.result] : "?",
+            (unsigned long)(soak.elapsedMs / 1000), (unsigned long)soak.durationS, (unsigned long)soak.moves,
+            soak.elapsedMs ? soak.moves * 1000.0f / soak.elapsedMs : 0.0f,
+            soak.meanMoveUs / 1000.0f, soak.maxMoveUs / 1000.0f);
+      LOG_I("[SOAK]   verificaciones %u (%u fallidas), pérdidas de pasos %u, DRV_STATUS 0x%08lX",
+            soak.verifications, soak.verifyFailures, soak.stepLosses, (unsigned long)soak.driverFlags);
+    }
+    return;
+  }
+  
+  // Estado del RNG de bases/bits (respuesta a CMD_RNG_STATS)
+  if(data[0] == STATUS_RNG_STATS) {
+    if((isAlice || isBob) && len >= (int)sizeof(RngStatsReport)) {
+      RngStatsReport rng;
+      memcpy(&rng, data, sizeof(rng));
+      LOG_I("[RNG] %s: %s, %u bits entregados (sesgo %d ppm), %u probados (%.4f unos)",
+            isAlice ? "Alice" : "Bob", rng.healthy ? "OK" : "FALLO", rng.deliveredBits, rng.biasPpm,
+            rng.testedBits, rng.testedBits ? (float)rng.testedOnes / rng.testedBits : 0.0f);
+      LOG_I("[RNG]   racha máx. %u (límite 21), ventana máx. %u/1024 (límite 589), fallos RCT %u APT %u",
+            rng.longestRun, rng.maxWindowCount, rng.rctFailures, rng.aptFailures);
+    }
+    return;
+  }
+  
+  TRACE_INSTANT(TR_ESPNOW_RX, TRACE_ESPNOW_ARG(isAlice ? TRACE_NODE_ALICE : TRACE_NODE_BOB, data[0]));
+  
+  if(len < (int)sizeof(ResponseData)) {
+    return;  // Error silencioso - callback debe ser rápido (se acepta relleno al final)
   }
   
   ResponseData response;
   memcpy(&response, data, sizeof(response));
   
-  // Determinar origen comparando MAC
-  bool isAlice = (memcmp(mac_addr, aliceMAC, 6) == 0);
-  bool isBob = (memcmp(mac_addr, bobMAC, 6) == 0);
-  
   // Actualizar LEDs de conexión (solo primera vez)
   if(isAlice && !aliceConnected) {
     aliceConnected = true;
     digitalWrite(LED_ALICE_PIN, HIGH);
-    Serial.println("[✓] Alice conectada");
+    LOG_I("[✓] Alice conectada");
   } else if(isBob && !bobConnected) {
     bobConnected = true;
     digitalWrite(LED_BOB_PIN, HIGH);
-    Serial.println("[✓] Bob conectado");
+    LOG_I("[✓] Bob conectado");
   }
   
   // Procesar respuesta según estado
   switch(response.status) {
     case STATUS_PONG:
+      if(isAlice) alicePongMicros = rxMicros;
+      else if(isBob) bobPongMicros = rxMicros;
+      
       // Verificar si es confirmación de cambio de canal (pulseNum contiene el canal)
       if(response.pulseNum == ESP_NOW_CHANNEL) {
         if(isAlice && !aliceChannelConfigured) {
           aliceChannelConfigured = true;
-          Serial.println("[✓] Alice confirmó canal " + String(ESP_NOW_CHANNEL));
+          LOG_I("[✓] Alice confirmó canal %d", ESP_NOW_CHANNEL);
         } else if(isBob && !bobChannelConfigured) {
           bobChannelConfigured = true;
-          Serial.println("[✓] Bob confirmó canal " + String(ESP_NOW_CHANNEL));
+          LOG_I("[✓] Bob confirmó canal %d", ESP_NOW_CHANNEL);
         }
       }
       break;
-      
-    case STATUS_HOME_COMPLETE:
+
+    case STATUS_PROTOCOL:
       if(isAlice) {
-        aliceHomed = true;
-        Serial.println("[Alice] HOME OK");
-        Serial.printf("[DEBUG] aliceHomed=%d, bobHomed=%d\n", aliceHomed, bobHomed);
+        aliceProtocol = response.base;
+        aliceProtocolAck = true;
       } else {
-        bobHomed = true;
-        Serial.println("[Bob] HOME OK");
-        Serial.printf("[DEBUG] aliceHomed=%d, bobHomed=%d\n", aliceHomed, bobHomed);
+        bobProtocol = response.base;
+        bobProtocolAck = true;
       }
       break;
       
+    case STATUS_HOME_COMPLETE: {
+      HomingRepeatability& stats = isAlice ? aliceHomingStats : bobHomingStats;
+      if(isAlice) aliceHomed = true;
+      else bobHomed = true;
+      if(response.base == HOME_NO_REFERENCE) {
+        LOG_I("[%s] HOME OK en %u ms (imán %d pasos)", isAlice ? "Alice" : "Bob", response.pulseNum, response.bit);
+      } else {
+        int32_t deviation = response.base;
+        stats.count++;
+        stats.sum += deviation;
+        stats.sumSq += (int64_t)deviation * deviation;
+        if(abs(deviation) > stats.maxAbs) stats.maxAbs = abs(deviation);
+        float mean = (float)stats.sum / stats.count;
+        float variance = (float)stats.sumSq / stats.count - mean * mean;
+        LOG_I("[%s] HOME OK en %u ms (imán %d pasos), desvío %+d pasos | repetibilidad n=%u σ=%.2f máx %d pasos",
+              isAlice ? "Alice" : "Bob", response.pulseNum, response.bit, deviation,
+              stats.count, variance > 0 ? sqrtf(variance) : 0.0f, stats.maxAbs);
+      }
+      LOG_D("[DEBUG] aliceHomed=%d, bobHomed=%d", aliceHomed, bobHomed);
+      break;
+    }
+      
     case STATUS_READY:
       if(isAlice) {
+        aliceReadyMicros = rxMicros;
+        aliceReadyPulse = response.pulseNum;
+#ifndef BB84_BENCH
+        if (response.pulseNum != currentPulseNum) break;  // READY de un pulso ya vencido: bases de otro pulso
+#endif
+        aliceLastReady = response;
         aliceReady = true;
         baseAlice = response.base;
         bitAlice = response.bit;
         angleAlice = response.angle;
         // OPTIMIZADO: Solo loguear si el protocolo no está activo
         if (!start_protocol) {
-          Serial.printf("[Alice] READY #%d B:%d b:%d A:%.1f\n", 
-                        response.pulseNum, baseAlice, bitAlice, angleAlice);
+          LOG_I("[Alice] READY #%d B:%d b:%d A:%.1f", 
+                response.pulseNum, baseAlice, bitAlice, angleAlice);
         }
       } else {
+        bobReadyMicros = rxMicros;
+        bobReadyPulse = response.pulseNum;
+#ifndef BB84_BENCH
+        if (response.pulseNum != currentPulseNum) break;
+#endif
+        bobLastReady = response;
         bobReady = true;
         baseBob = response.base;
         angleBob = response.angle;
         // OPTIMIZADO: Solo loguear si el protocolo no está activo
         if (!start_protocol) {
-          Serial.printf("[Bob] READY #%d B:%d A:%.1f\n", 
-                        response.pulseNum, baseBob, angleBob);
+          LOG_I("[Bob] READY #%d B:%d A:%.1f", 
+                response.pulseNum, baseBob, angleBob);
         }
       }
       break;
       
     case STATUS_ERROR:
-      Serial.printf("[ERROR] %s - Pulso %d\n", isAlice ? "Alice" : "Bob", response.pulseNum);
+      if (response.base == ERROR_RNG_HEALTH) rngFailureNodes |= isAlice ? 1 : 2;
+      LOG_E("[ERROR] %s - Pulso %d%s", isAlice ? "Alice" : "Bob", response.pulseNum,
+            response.base == ERROR_RNG_HEALTH ? " (RNG no supera las pruebas de salud)" : "");
+      break;
+      
+    case STATUS_CALIBRATION_DONE:
+      // El nodo termina la calibración con un homing propio: queda en posición 0
+      LOG_I("[%s] Calibración de perfiles %s: %u transiciones ajustadas",
+            isAlice ? "Alice" : "Bob", response.base ? "guardada" : "sin guardar", response.pulseNum);
+      break;
+
+    case STATUS_HOME_VERIFIED:
+      // VERIFY_OK vale como homing; el resto lo repite prepareMotorsHome()
+      if(response.base == VERIFY_OK) {
+        if(isAlice) aliceHomed = true;
+        else bobHomed = true;
+      }
+      if(isAlice) aliceVerifyDone = true;
+      else bobVerifyDone = true;
+      LOG_I("[%s] Verificación de homing: %s en %u ms (desvío %d pasos)", isAlice ? "Alice" : "Bob",
+            response.base == VERIFY_OK ? "OK" :
+            response.base == VERIFY_NO_REFERENCE ? "sin referencia" :
+            response.base == VERIFY_BUSY ? "ocupado" : "FALLO",
+            response.pulseNum, response.bit);
+      break;
+
+    case STATUS_STEP_LOSS:
+      // El nodo ya inició un homing propio: sin posición válida hasta su HOME_COMPLETE
+      if(isAlice) aliceHomed = false;
+      else bobHomed = false;
+      LOG_E("[STEP] %s perdió pasos cerca del pulso %u (%s, detalle %d, %.2f°): homing automático",
+            isAlice ? "Alice" : "Bob", response.pulseNum,
+            response.base == STEP_LOSS_STALL ? "StallGuard2" :
+            response.base == STEP_LOSS_HALL ? "sensor Hall" :
+            response.base == STEP_LOSS_DRIVER ? "falla del driver" : "?",
+            response.bit, response.angle);
       break;
   }
 }
 
 esp_err_t sendCommandToAlice(uint8_t cmd, uint32_t pulseNum) {
+  TRACE_INSTANT(TR_ESPNOW_TX, TRACE_ESPNOW_ARG(TRACE_NODE_ALICE, cmd));
   CommandData command = {cmd, pulseNum, totalPulses};
   esp_err_t result = esp_now_send(aliceMAC, (uint8_t*)&command, sizeof(command));
   return result;
 }
 
 esp_err_t sendCommandToBob(uint8_t cmd, uint32_t pulseNum) {
+  TRACE_INSTANT(TR_ESPNOW_TX, TRACE_ESPNOW_ARG(TRACE_NODE_BOB, cmd));
   CommandData command = {cmd, pulseNum, totalPulses};
   esp_err_t result = esp_now_send(bobMAC, (uint8_t*)&command, sizeof(command));
   return result;
 }
 
+// Pulso de referencia: estado 'index' de la tabla del nodo más offsetMdeg
+// (compensación de deriva y calibración de ángulos)
+esp_err_t sendReferencePulse(bool isAlice, uint32_t pulseNum, uint8_t index, int32_t offsetMdeg) {
+  TRACE_INSTANT(TR_ESPNOW_TX, TRACE_ESPNOW_ARG(isAlice ? TRACE_NODE_ALICE : TRACE_NODE_BOB, CMD_PREPARE_REFERENCE));
+  ReferencePulseCommand command = {CMD_PREPARE_REFERENCE, pulseNum, index, offsetMdeg};
+  return esp_now_send(isAlice ? aliceMAC : bobMAC, (uint8_t*)&command, sizeof(command));
+}
+
 // Funciones para movimiento manual
 void sendManualMoveToAlice(float angle) {
   ManualMoveCommand command = {CMD_MOVE_MANUAL, angle, 0};
   esp_err_t result = esp_now_send(aliceMAC, (uint8_t*)&command, sizeof(command));
   
   if(result == ESP_OK) {
-    Serial.printf("[Manual] Alice -> %.2f°\n", angle);
+    LOG_I("[Manual] Alice -> %.2f°", angle);
   } else {
-    Serial.printf("[Alice Manual TX ERR] %d\n", result);
+    LOG_E("[Alice Manual TX ERR] %d", result);
   }
 }
 
@@ -646,20 +867,54 @@ void sendManualMoveToBob(float angle) {
   esp_err_t result = esp_now_send(bobMAC, (uint8_t*)&command, sizeof(command));
   
   if(result == ESP_OK) {
-    Serial.printf("[Manual] Bob -> %.2f°\n", angle);
+    LOG_I("[Manual] Bob -> %.2f°", angle);
   } else {
-    Serial.printf("[Bob Manual TX ERR] %d\n", result);
+    LOG_E("[Bob Manual TX ERR] %d", result);
+  }
+}
+
+// Origen del comando de cada pulso: durante la calibración de ángulos
+// (anglecal.cpp) o la tomografía (tomography.cpp) todos son de referencia;
+// fuera de ellas, cada pocos pulsos lo es el de turno (compensación de deriva,
+// ver drift.cpp)
+enum PulseKind : uint8_t { PULSE_KEY, PULSE_DRIFT, PULSE_ANGLECAL, PULSE_TOMOGRAPHY };
+
+static PulseKind nextPulseKind() {
+  if (anglecalActive()) return PULSE_ANGLECAL;
+  if (tomographyActive()) return PULSE_TOMOGRAPHY;
+  if (driftReferenceDue(currentPulseNum)) return PULSE_DRIFT;
+  return PULSE_KEY;
+}
+
+static void sendPulseCommand(bool isAlice, PulseKind kind) {
+  switch (kind) {
+    case PULSE_ANGLECAL:   anglecalSendPulse(isAlice, currentPulseNum); break;
+    case PULSE_TOMOGRAPHY: tomographySendPulse(isAlice, currentPulseNum); break;
+    case PULSE_DRIFT:      driftSendReference(isAlice, currentPulseNum); break;
+    default:
+      if (isAlice) sendCommandToAlice(CMD_PREPARE_PULSE, currentPulseNum);
+      else sendCommandToBob(CMD_PREPARE_PULSE, currentPulseNum);
+      break;
   }
 }
 
 void prepareNextPulse() {
   aliceReady = false;
   bobReady = false;
-  sendCommandToAlice(CMD_PREPARE_PULSE, currentPulseNum);
-  sendCommandToBob(CMD_PREPARE_PULSE, currentPulseNum);
+  PulseKind kind = nextPulseKind();
+  alicePrepareMicros = micros();
+  sendPulseCommand(true, kind);
+  bobPrepareMicros = micros();
+  sendPulseCommand(false, kind);
   yield();  // OPTIMIZADO: Permitir procesamiento inmediato de respuestas ESP-NOW
 }
 
+// Acumula el desglose radio/cola/motor del último pulso (ver latency.cpp)
+void recordPulseLatency() {
+  if (aliceReady) latencyRecordPulse(true, alicePrepareMicros, aliceLastReady, aliceReadyMicros);
+  if (bobReady) latencyRecordPulse(false, bobPrepareMicros, bobLastReady, bobReadyMicros);
+}
+
 // ==============================================
 // Funciones obsoletas (ELIMINADAS - usar prepareNextPulse())
 // ==============================================
@@ -684,13 +939,15 @@ void checkUARTFPGAMessages() {
         break;
 
       case EMPTY_ID:
+        TRACE_INSTANT(TR_UART_RX, incomingByte);
         empty_id_received = true;
-        Serial.println("[FPGA] EMPTY_ID received - FIFOs empty");
+        LOG_D("[FPGA] EMPTY_ID received - FIFOs empty");
         break;
 
       case TX_ENDED_ID:
+        TRACE_INSTANT(TR_UART_RX, incomingByte);
         tx_ended_received = true;
-        Serial.println("[FPGA] TX_ENDED_ID received - Protocol finished");
+        LOG_I("[FPGA] TX_ENDED_ID received - Protocol finished");
         while (UARTFPGA.available() > 0) {
           uint8_t remainingByte = UARTFPGA.read();
         }
@@ -700,8 +957,8 @@ void checkUARTFPGAMessages() {
 
   // Print status summary every second (avoid flooding serial)
   if (messageCount > 0 && millis() - lastPrintTime > 1000) {
-    Serial.printf("[FPGA] Communication status: D0=%d, D1=%d, Messages=%d\n", 
-                  detector0_count, detector1_count, messageCount);
+    LOG_I("[FPGA] Communication status: D0=%d, D1=%d, Messages=%d", 
+          detector0_count, detector1_count, messageCount);
     messageCount = 0;
     lastPrintTime = millis();
   }
@@ -712,7 +969,23 @@ void resetCounters() {
     detector1_count = 0;
 }
 
-void sendDataToWeb() {
+// Pulso terminado: los de referencia solo alimentan la compensación de deriva,
+// la calibración de ángulos o la tomografía. Sin el READY de este pulso de los
+// dos nodos (timeout) no se sabe qué estado prepararon: el pulso no cuenta
+void publishPulse() {
+    bool valido = aliceReady && bobReady && aliceLastReady.pulseNum == currentPulseNum &&
+                  bobLastReady.pulseNum == currentPulseNum;
+    if (anglecalOnPulse(detector0_count, detector1_count, valido) ||
+        tomographyOnPulse(detector0_count, detector1_count, valido) ||
+        driftOnPulse(detector0_count, detector1_count, valido)) {
+        resetCounters();
+    } else {
+        sendDataToWeb(valido);
+    }
+}
+
+void sendDataToWeb(bool valido) {
+    TRACE_BEGIN(TR_WEB_PUBLISH, currentPulseNum);
     // Calcular bit recibido basado en los conteos de detectores
     int bitRecibido;
     if (detector0_count > detector1_count) {
@@ -723,7 +996,26 @@ void sendDataToWeb() {
         bitRecibido = random() % 2; // Empate en conteos
     }
 
-    StaticJsonDocument<200> jsonDoc;
+    // Criba según el protocolo de la sesión (ver sifting.cpp). En un pulso no
+    // válido las bases son las del anterior, y un estado sorteado con otro
+    // protocolo tampoco vale: el pulso no entra en la clave
+    uint8_t claveAlice = 0;
+    uint8_t claveBob = 0;
+    bool cribado = false;
+    if (!valido) {
+        LOG_W("[SIFT] Pulso %u sin READY de %s: fuera de la criba", currentPulseNum,
+              !aliceReady && !bobReady ? "Alice ni Bob" : !aliceReady ? "Alice" : "Bob");
+        siftDiscardPulse();
+    } else if (aliceLastReady.protocol == siftProtocol() && bobLastReady.protocol == siftProtocol()) {
+        cribado = siftPulse(baseAlice, bitAlice, baseBob, bitRecibido, detector0_count, detector1_count,
+                            claveAlice, claveBob);
+    } else {
+        LOG_W("[SIFT] Pulso %u sorteado con otro protocolo (Alice %u, Bob %u): fuera de la criba",
+              currentPulseNum, aliceLastReady.protocol, bobLastReady.protocol);
+        siftDiscardPulse();
+    }
+
+    StaticJsonDocument<256> jsonDoc;
     JsonObject conteos = jsonDoc.createNestedObject("conteos");
     conteos["detector0"] = detector0_count;
     conteos["detector1"] = detector1_count;
@@ -731,13 +1023,59 @@ void sendDataToWeb() {
     jsonDoc["bitEnviado"] = bitAlice;
     jsonDoc["baseBob"] = baseBob;
     jsonDoc["bitRecibido"] = bitRecibido;
+    jsonDoc["cribado"] = cribado ? 1 : 0;
+    if (!valido) jsonDoc["valido"] = 0;  // Bases y bit de otro pulso: la web no los muestra
+    if (cribado) {
+        jsonDoc["claveAlice"] = claveAlice;
+        jsonDoc["claveBob"] = claveBob;
+    }
 
-    String jsonString;
-    serializeJson(jsonDoc, jsonString);
-    webSocket.broadcastTXT(jsonString);
+    char jsonBuffer[224];
+    size_t jsonLen = serializeJson(jsonDoc, jsonBuffer, sizeof(jsonBuffer));
+    webSocket.broadcastTXT(jsonBuffer, jsonLen);
 
     resetCounters();
-    Serial.println("Conteos enviados y contadores reiniciados.");
+    TRACE_END(TR_WEB_PUBLISH, currentPulseNum);
+    LOG_D("Conteos enviados y contadores reiniciados.");
+}
+
+// Aviso {"status":"error","message":...} a todos los clientes web
+static void broadcastStatusError(const char* message) {
+    char json[160];
+    int len = snprintf(json, sizeof(json), "{\"status\":\"error\",\"message\":\"%s\"}", message);
+    webSocket.broadcastTXT(json, len < (int)sizeof(json) ? len : sizeof(json) - 1);
+}
+
+// Protocolo de la sesión: se envía CMD_SET_PROTOCOL (hasta 3 intentos) y cada
+// nodo confirma con STATUS_PROTOCOL el que aplica. Si alguno no responde o se
+// queda con otro, la sesión no arranca: sortearía los estados con otras
+// probabilidades y la criba no cuadraría
+static bool confirmProtocol() {
+  uint8_t protocol = siftProtocol();
+  aliceProtocolAck = false;
+  bobProtocolAck = false;
+  for (int attempt = 0; attempt < 3 && (!aliceProtocolAck || !bobProtocolAck); attempt++) {
+    if (!aliceProtocolAck) sendCommandToAlice(CMD_SET_PROTOCOL, protocol);
+    if (!bobProtocolAck) sendCommandToBob(CMD_SET_PROTOCOL, protocol);
+    unsigned long start = millis();
+    while ((!aliceProtocolAck || !bobProtocolAck) && millis() - start < 300) {
+      webSocket.loop();
+      yield();  // Permitir callbacks ESP-NOW
+    }
+  }
+
+  bool aliceOk = aliceProtocolAck && aliceProtocol == protocol;
+  bool bobOk = bobProtocolAck && bobProtocol == protocol;
+  if (aliceOk && bobOk) return true;
+
+  char message[128];
+  snprintf(message, sizeof(message), "Protocolo %s no confirmado por %s: sesión no iniciada",
+           qkdProtocols[protocol].name, !aliceOk && !bobOk ? "Alice ni Bob" : !aliceOk ? "Alice" : "Bob");
+  LOG_E("[SIFT] %s", message);
+  if (aliceProtocolAck && !aliceOk) LOG_E("  Alice sigue en el protocolo %u", aliceProtocol);
+  if (bobProtocolAck && !bobOk) LOG_E("  Bob sigue en el protocolo %u", bobProtocol);
+  broadcastStatusError(message);
+  return false;
 }
 
 void enviarConfiguracion(uint32_t num_pulsos, uint32_t duracion_us) {
@@ -746,10 +1084,13 @@ void enviarConfiguracion(uint32_t num_pulsos, uint32_t duracion_us) {
       // Guardar el número total de pulsos configurados
       totalPulses = num_pulsos;
       
-      Serial.println("\n=== Iniciando configuración a FPGA ===");
-      Serial.printf("Número de pulsos: %u\n", num_pulsos);
-      Serial.printf("Duración (us): %u\n", duracion_us);
-      Serial.printf("Dead time (us): %u\n", dead_time_us);
+      // Sin los dos nodos en el protocolo de la sesión no se configura la FPGA
+      if (!confirmProtocol()) return;
+
+      LOG_I("\n=== Iniciando configuración a FPGA ===");
+      LOG_I("Número de pulsos: %u", num_pulsos);
+      LOG_I("Duración (us): %u", duracion_us);
+      LOG_I("Dead time (us): %u", dead_time_us);
       
       // Enviar START_BYTE
       UARTFPGA.write(START_BYTE);
@@ -769,118 +1110,294 @@ void enviarConfiguracion(uint32_t num_pulsos, uint32_t duracion_us) {
       UARTFPGA.write((dead_time_us >> 8) & 0xFF);
       UARTFPGA.write(dead_time_us & 0xFF);
 
-      Serial.println("=== Configuración enviada completamente ===\n");
+      LOG_I("=== Configuración enviada completamente ===\n");
 
-      // Enviar comando de homing a ambos motores (reinicia flags internamente)
-      sendHomingCommand();
-      
-      // Esperar a que ambos completen el homing (flags set by onESPNowReceive)
-      Serial.println("Esperando homing de motores...");
-      Serial.printf("[DEBUG ANTES] aliceHomed=%d, bobHomed=%d\n", aliceHomed, bobHomed);
-      
-      unsigned long homingTimeout = millis();
-      while ((!aliceHomed || !bobHomed) && millis() - homingTimeout < 30000) {
-        // Procesar eventos del servidor y websocket para que los callbacks funcionen
-        server.handleClient();
-        webSocket.loop();
-        yield();  // Permitir que se ejecuten los callbacks ESP-NOW
-        delay(10);  // Pequeña pausa para no saturar el CPU
-        
-        // Debug cada segundo
-        static unsigned long lastDebug = 0;
-        if (millis() - lastDebug > 1000) {
-          Serial.printf("[DEBUG WAIT] aliceHomed=%d, bobHomed=%d (%.1fs)\n", 
-                        aliceHomed, bobHomed, (millis() - homingTimeout) / 1000.0);
-          lastDebug = millis();
-        }
-      }
+      // Homing solo si la verificación rápida no lo confirma (ver prepareMotorsHome)
+      prepareMotorsHome();
       
       if (aliceHomed && bobHomed) {
-        Serial.println("Homing completado en ambos motores");
+        LOG_I("Homing listo en ambos motores");
         
         // Apagar LEDs al iniciar protocolo (indicadores de conexión ya no necesarios)
         digitalWrite(LED_ALICE_PIN, LOW);
         digitalWrite(LED_BOB_PIN, LOW);
-        Serial.println("[LEDs OFF] Protocolo iniciado - Indicadores de conexión apagados");
+        LOG_I("[LEDs OFF] Protocolo iniciado - Indicadores de conexión apagados");
         
         currentPulseNum = 0;
+        latencyReset();
+        driftReset();
+        siftReset();
+        rngFailureNodes = 0;
         prepareNextPulse();  // OPTIMIZADO: Reemplaza prepareAlice()+prepareBob()
         waitForMotorsReady();
+        start_protocol = true;  // La FPGA ya está configurada: un fallo se aborta como en curso
+        if (rngFailureNodes) {
+          abortOnRngFailure();
+          return;
+        }
         resetCounters();
         generateNextPulseReady();
-        start_protocol = true;
       } else {
-        Serial.println("ERROR: Timeout en homing de motores");
-        if (!aliceHomed) Serial.println("  - Alice no completó homing");
-        if (!bobHomed) Serial.println("  - Bob no completó homing");
+        LOG_E("ERROR: Timeout en homing de motores");
+        if (!aliceHomed) LOG_E("  - Alice no completó homing");
+        if (!bobHomed) LOG_E("  - Bob no completó homing");
       }
       
   } else {
-      Serial.println("Protocolo ya iniciado. Bloqueando reenvío de configuración.");
+      LOG_I("Protocolo ya iniciado. Bloqueando reenvío de configuración.");
   }
 }
 
+// Respuesta JSON {"status":"ok","message":...} sin pasar por String
+static void sendStatusOk(uint8_t num, const char* message) {
+    char json[96];
+    int len = snprintf(json, sizeof(json), "{\"status\":\"ok\",\"message\":\"%s\"}", message);
+    webSocket.sendTXT(num, json, len < (int)sizeof(json) ? len : sizeof(json) - 1);
+}
+
+// ==============================================
+// Comandos WebSocket: se interpretan directamente sobre el payload, sin copiar
+// a String. El documento JSON es estático (no se reserva en cada mensaje) y
+// deserializeJson lo usa en modo zero-copy sobre el propio payload.
+// ==============================================
 void handleWebSocketMessage(uint8_t num, uint8_t* payload, size_t length) {
-    String message = String((char*)payload).substring(0, length);
-    Serial.println("Mensaje recibido: " + message);
+    LOG_I("Mensaje recibido: %.*s", (int)length, (const char*)payload);
 
     // Comandos de control de motores ahora se reenvían a los Super Minis
-    if (message == "HOMING_ALL") {
+    if (wsEquals(payload, length, "HOMING_ALL")) {
         sendHomingCommand();
         webSocket.sendTXT(num, "Comando de homing enviado a Alice y Bob");
         return;
     }
     
-    if (message == "HOMING1") {
+    if (wsEquals(payload, length, "HOMING1")) {
         sendCommandToAlice(CMD_HOME, 0);
         webSocket.sendTXT(num, "Comando de homing enviado a Alice");
         return;
     }
     
-    if (message == "HOMING2") {
+    if (wsEquals(payload, length, "HOMING2")) {
         sendCommandToBob(CMD_HOME, 0);
         webSocket.sendTXT(num, "Comando de homing enviado a Bob");
         return;
     }
 
+    // Volver a medir el offset del homing (aproximación fina, se guarda en NVS)
+    if (wsEquals(payload, length, "HOMING_CALIBRATE")) {
+        aliceHomed = false;
+        bobHomed = false;
+        sendCommandToAlice(CMD_HOME, HOME_RECALIBRATE);
+        sendCommandToBob(CMD_HOME, HOME_RECALIBRATE);
+        webSocket.sendTXT(num, "Medición del offset de homing enviada a Alice y Bob");
+        return;
+    }
+
+    // Calibración de perfiles de movimiento (varios minutos; el resultado llega
+    // como STATUS_CALIBRATION_DONE y queda en el log)
+    if (wsEquals(payload, length, "CALIBRATE_ALL")) {
+        sendCommandToAlice(CMD_CALIBRATE_PROFILES, 0);
+        sendCommandToBob(CMD_CALIBRATE_PROFILES, 0);
+        webSocket.sendTXT(num, "Calibración de perfiles enviada a Alice y Bob");
+        return;
+    }
+    
+    if (wsEquals(payload, length, "CALIBRATE1")) {
+        sendCommandToAlice(CMD_CALIBRATE_PROFILES, 0);
+        webSocket.sendTXT(num, "Calibración de perfiles enviada a Alice");
+        return;
+    }
+    
+    if (wsEquals(payload, length, "CALIBRATE2")) {
+        sendCommandToBob(CMD_CALIBRATE_PROFILES, 0);
+        webSocket.sendTXT(num, "Calibración de perfiles enviada a Bob");
+        return;
+    }
+
+    // Búsqueda de límites de velocidad y aceleración (minutos; el resultado
+    // llega como STATUS_LIMITS_DONE y queda en el log)
+    if (wsEquals(payload, length, "FIND_LIMITS_ALL")) {
+        sendCommandToAlice(CMD_FIND_LIMITS, 0);
+        sendCommandToBob(CMD_FIND_LIMITS, 0);
+        webSocket.sendTXT(num, "Búsqueda de límites enviada a Alice y Bob");
+        return;
+    }
+    
+    if (wsEquals(payload, length, "FIND_LIMITS1")) {
+        sendCommandToAlice(CMD_FIND_LIMITS, 0);
+        webSocket.sendTXT(num, "Búsqueda de límites enviada a Alice");
+        return;
+    }
+    
+    if (wsEquals(payload, length, "FIND_LIMITS2")) {
+        sendCommandToBob(CMD_FIND_LIMITS, 0);
+        webSocket.sendTXT(num, "Búsqueda de límites enviada a Bob");
+        return;
+    }
+
+    // Matriz de coste de transiciones: pedirla o lanzar el benchmark
+    // ("TRANSITION_BENCH:n" = cada transición n veces en orden aleatorio)
+    if (wsEquals(payload, length, "TRANSITIONS")) {
+        sendCommandToAlice(CMD_TRANSITION_STATS, 0);
+        sendCommandToBob(CMD_TRANSITION_STATS, 0);
+        webSocket.sendTXT(num, "Matriz de transiciones solicitada a Alice y Bob");
+        return;
+    }
+    
+    if (wsStartsWith(payload, length, "TRANSITION_BENCH:")) {
+        const size_t prefix = strlen("TRANSITION_BENCH:");
+        long rounds = 0;
+        if (wsParseInts((const char*)payload + prefix, length - prefix, ',', &rounds, 1) != 1 || rounds <= 0) {
+            webSocket.sendTXT(num, "Error: número de repeticiones inválido.");
+            return;
+        }
+        sendCommandToAlice(CMD_TRANSITION_BENCH, rounds);
+        sendCommandToBob(CMD_TRANSITION_BENCH, rounds);
+        webSocket.sendTXT(num, "Benchmark de transiciones enviado a Alice y Bob");
+        return;
+    }
+
+    // Prueba de resistencia ("SOAK:s" = transiciones aleatorias durante s
+    // segundos; el progreso llega como STATUS_SOAK_REPORT y queda en el log)
+    if (wsStartsWith(payload, length, "SOAK:")) {
+        const size_t prefix = strlen("SOAK:");
+        long seconds = 0;
+        if (wsParseInts((const char*)payload + prefix, length - prefix, ',', &seconds, 1) != 1 || seconds <= 0) {
+            webSocket.sendTXT(num, "Error: duración inválida.");
+            return;
+        }
+        sendCommandToAlice(CMD_SOAK, seconds);
+        sendCommandToBob(CMD_SOAK, seconds);
+        webSocket.sendTXT(num, "Prueba de resistencia enviada a Alice y Bob");
+        return;
+    }
+
+    // Compensación de deriva de polarización ("DRIFT:n" = un pulso de
+    // referencia cada n, 0 = desactivada; las correcciones quedan en el log)
+    if (wsStartsWith(payload, length, "DRIFT:")) {
+        const size_t prefix = strlen("DRIFT:");
+        long pulses = 0;
+        if (wsParseInts((const char*)payload + prefix, length - prefix, ',', &pulses, 1) != 1 || pulses < 0 ||
+            pulses == 1) {
+            webSocket.sendTXT(num, "Error: intervalo inválido (0 o al menos 2 pulsos).");
+            return;
+        }
+        driftSetInterval(pulses);
+        webSocket.sendTXT(num, pulses ? "Compensación de deriva activada" : "Compensación de deriva desactivada");
+        return;
+    }
+
+    // Protocolo de la próxima sesión ("PROTOCOL:n", ver QkdProtocol.h)
+    if (wsStartsWith(payload, length, "PROTOCOL:")) {
+        const size_t prefix = strlen("PROTOCOL:");
+        long id = 0;
+        if (wsParseInts((const char*)payload + prefix, length - prefix, ',', &id, 1) != 1 || id < 0 ||
+            start_protocol || !siftSetProtocol(id)) {
+            webSocket.sendTXT(num, "Error: protocolo inválido o sesión en curso.");
+            return;
+        }
+        webSocket.sendTXT(num, "Protocolo seleccionado");
+        return;
+    }
+
+    // Calibración de las tablas de ángulos ("ANGLE_CAL:us" = sesión de la FPGA
+    // con pulsos de us microsegundos; el resultado queda en el log y en NVS)
+    if (wsStartsWith(payload, length, "ANGLE_CAL:")) {
+        const size_t prefix = strlen("ANGLE_CAL:");
+        long durationUs = 0;
+        if (wsParseInts((const char*)payload + prefix, length - prefix, ',', &durationUs, 1) != 1 ||
+            durationUs <= 0 || durationUs > 16777215) {
+            webSocket.sendTXT(num, "Error: duración del pulso inválida.");
+            return;
+        }
+        if (!anglecalStart(durationUs)) {
+            webSocket.sendTXT(num, "Error: protocolo o calibración en curso.");
+            return;
+        }
+        webSocket.sendTXT(num, "Calibración de ángulos en curso (ver log [ANGLECAL])");
+        return;
+    }
+
+    // Tomografía de los estados de Alice ("TOMOGRAPHY:us,estado" = sesión de la
+    // FPGA con pulsos de us microsegundos; estado 0-3 = H, V, D, A, 4 = todos)
+    if (wsStartsWith(payload, length, "TOMOGRAPHY:")) {
+        const size_t prefix = strlen("TOMOGRAPHY:");
+        long values[2] = {0, 0};
+        if (wsParseInts((const char*)payload + prefix, length - prefix, ',', values, 2) != 2 ||
+            values[0] <= 0 || values[0] > 16777215 || values[1] < 0 || values[1] > TOMOGRAPHY_ALL_STATES) {
+            webSocket.sendTXT(num, "Error: parámetros de tomografía inválidos.");
+            return;
+        }
+        if (anglecalActive() || !tomographyStart(values[0], values[1])) {
+            webSocket.sendTXT(num, "Error: protocolo o calibración en curso.");
+            return;
+        }
+        webSocket.sendTXT(num, "Tomografía en curso (ver log [TOMO])");
+        return;
+    }
+
+    // Estado de las pruebas de salud del RNG de Alice y Bob (resultado por serial)
+    if (wsEquals(payload, length, "RNG_STATS")) {
+        sendCommandToAlice(CMD_RNG_STATS, 0);
+        sendCommandToBob(CMD_RNG_STATS, 0);
+        webSocket.sendTXT(num, "Estado del RNG solicitado a Alice y Bob");
+        return;
+    }
+
     // Movimiento manual de motores - no soportado con ESP-NOW (CommandData no incluye ángulo)
     // Las estructuras ESP-NOW solo soportan comandos predefinidos
-    if (message.startsWith("MOVE1:") || message.startsWith("MOVE2:")) {
+    if (wsStartsWith(payload, length, "MOVE1:") || wsStartsWith(payload, length, "MOVE2:")) {
         webSocket.sendTXT(num, "Movimiento manual no disponible en modo ESP-NOW");
         return;
     }
 
     // Verificar si es un comando de abortar
-    if (message == "abort") {
+    if (wsEquals(payload, length, "abort")) {
         abortarProtocolo();
-        StaticJsonDocument<200> response;
-        response["status"] = "ok";
-        response["message"] = "Protocolo abortado.";
-        String jsonResponse;
-        serializeJson(response, jsonResponse);
-        webSocket.sendTXT(num, jsonResponse);
+        sendStatusOk(num, "Protocolo abortado.");
         return;
     }
 
-    // Parsear el mensaje JSON
-    StaticJsonDocument<200> doc;
-    DeserializationError error = deserializeJson(doc, message);
+    // Parsear el mensaje JSON (zero-copy: las cadenas apuntan al payload)
+    static StaticJsonDocument<512> doc;  // SET_PARAMS: 11 campos y hasta 4 ángulos
+    DeserializationError error = deserializeJson(doc, (char*)payload, length);
 
     if (!error) {
         // Verificar si es comando de movimiento manual
-        if (doc.containsKey("type")) {
-            String type = doc["type"].as<String>();
-            
-            if (type == "MOVE_ALICE") {
+        const char* type = doc["type"];
+        if (type) {
+            char reply[48];
+            if (strcmp(type, "MOVE_ALICE") == 0) {
                 float angle = doc["angle"];
                 sendManualMoveToAlice(angle);
-                webSocket.sendTXT(num, "Moviendo Alice a " + String(angle) + "°");
+                int len = snprintf(reply, sizeof(reply), "Moviendo Alice a %.2f°", angle);
+                webSocket.sendTXT(num, reply, len < (int)sizeof(reply) ? len : sizeof(reply) - 1);
                 return;
             }
-            else if (type == "MOVE_BOB") {
+            else if (strcmp(type, "MOVE_BOB") == 0) {
                 float angle = doc["angle"];
                 sendManualMoveToBob(angle);
-                webSocket.sendTXT(num, "Moviendo Bob a " + String(angle) + "°");
+                int len = snprintf(reply, sizeof(reply), "Moviendo Bob a %.2f°", angle);
+                webSocket.sendTXT(num, reply, len < (int)sizeof(reply) ? len : sizeof(reply) - 1);
+                return;
+            }
+            // Parámetros de movimiento (ver src/params.cpp); la respuesta de
+            // cada nodo llega aparte como {"parametros":...}
+            else if (strcmp(type, "GET_PARAMS") == 0) {
+                paramsRequest();
+                webSocket.sendTXT(num, "Parámetros solicitados a Alice y Bob");
+                return;
+            }
+            else if (strcmp(type, "SET_PARAMS") == 0) {
+                const char* node = doc["nodo"] | "";
+                bool isAlice = strcmp(node, "Alice") == 0;
+                MotionParams params;
+                if ((!isAlice && strcmp(node, "Bob") != 0) || !paramsFromJson(doc, params)) {
+                    webSocket.sendTXT(num, "Error: parámetros incompletos.");
+                    return;
+                }
+                paramsSend(isAlice, params);
+                int len = snprintf(reply, sizeof(reply), "Parámetros enviados a %s", node);
+                webSocket.sendTXT(num, reply, len < (int)sizeof(reply) ? len : sizeof(reply) - 1);
                 return;
             }
         }
@@ -891,14 +1408,7 @@ void handleWebSocketMessage(uint8_t num, uint8_t* payload, size_t length) {
 
         if (num_pulsos <= 16777215 && duracion_us <= 16777215) {
             enviarConfiguracion(num_pulsos, duracion_us);
-            StaticJsonDocument<200> response;
-            response["status"] = "ok";
-            response["message"] = "Configuración enviada correctamente.";
-
-            String jsonResponse;
-            serializeJson(response, jsonResponse);
-            webSocket.sendTXT(num, jsonResponse);
-
+            sendStatusOk(num, "Configuración enviada correctamente.");
         } else {
             webSocket.sendTXT(num, "Error: Valores fuera de rango.");
         }
@@ -922,7 +1432,7 @@ void generateResetPulse() {
     digitalWrite(RESET_PIN, LOW);  // Activar reset
     delay(5);                    // Mantener reset por 5ms
     digitalWrite(RESET_PIN, HIGH); // Desactivar reset
-    Serial.println("Pulso de reset enviado a la FPGA");
+    LOG_I("Pulso de reset enviado a la FPGA");
 }
 
 // Función que envía señal a la FPGA para generar el siguiente pulso
@@ -930,13 +1440,15 @@ void generateNextPulseReady() {
   digitalWrite(NEXT_PULSE_PIN, LOW); 
   delay(5);                    
   digitalWrite(NEXT_PULSE_PIN, HIGH); 
-  Serial.println("Next pulse ready enviado a la FPGA");
+  LOG_D("Next pulse ready enviado a la FPGA");
 }
 
 void abortarProtocolo() {
     if (!start_protocol) return;
     
-    Serial.println("\n[ABORT] Deteniendo protocolo...");
+    LOG_I("\n[ABORT] Deteniendo protocolo...");
+    anglecalAbort();
+    tomographyAbort();
     resetCounters();
     generateResetPulse();
     
@@ -959,37 +1471,98 @@ void abortarProtocolo() {
     while (UARTFPGA.available() > 0) {
         UARTFPGA.read();
     }
-    Serial.println("[OK] Protocolo abortado\n");
+    LOG_I("[OK] Protocolo abortado\n");
 }
 
 void sendHomingCommand() {
-    Serial.println("[HOMING] Iniciando...");
+    LOG_I("[HOMING] Iniciando...");
     aliceHomed = false;
     bobHomed = false;
     sendCommandToAlice(CMD_HOME, 0);
     sendCommandToBob(CMD_HOME, 0);
 }
 
+// Esperar hasta que ambos flags se activen (los escribe el callback ESP-NOW),
+// atendiendo mientras tanto la web y la sincronización de reloj
+static void waitForBothFlags(const bool& aliceFlag, const bool& bobFlag, uint32_t timeoutMs, const char* what) {
+  unsigned long start = millis();
+  unsigned long lastDebug = start;
+  while ((!aliceFlag || !bobFlag) && millis() - start < timeoutMs) {
+    server.handleClient();
+    webSocket.loop();
+    yield();  // Permitir que se ejecuten los callbacks ESP-NOW
+    latencyLoop();  // Mantener la sincronización de reloj durante la espera
+    delay(10);  // Pequeña pausa para no saturar el CPU
+    
+    // Debug cada segundo
+    if (millis() - lastDebug > 1000) {
+      LOG_D("[DEBUG WAIT] %s alice=%d, bob=%d (%.1fs)", what, aliceFlag, bobFlag, (millis() - start) / 1000.0);
+      lastDebug = millis();
+    }
+  }
+}
+
+// Antes de cada protocolo: los nodos comprueban su homing con una pasada corta
+// por el imán (CMD_VERIFY_HOME) y solo los que no lo superan (reinicio sin
+// posición conservada, posición corrida, nunca homeados) hacen el homing completo.
+bool prepareMotorsHome() {
+  unsigned long start = millis();
+  aliceHomed = false;
+  bobHomed = false;
+  aliceVerifyDone = false;
+  bobVerifyDone = false;
+  LOG_I("Verificando homing de motores...");
+  sendCommandToAlice(CMD_VERIFY_HOME, 0);
+  sendCommandToBob(CMD_VERIFY_HOME, 0);
+  waitForBothFlags(aliceVerifyDone, bobVerifyDone, 5000, "verify");
+  
+  if (!aliceHomed || !bobHomed) {
+    if (!aliceHomed) sendCommandToAlice(CMD_HOME, 0);
+    if (!bobHomed) sendCommandToBob(CMD_HOME, 0);
+    LOG_I("Esperando homing de motores...");
+    waitForBothFlags(aliceHomed, bobHomed, 30000, "homing");
+  }
+  LOG_I("[HOMING] Motores listos en %lu ms", millis() - start);
+  return aliceHomed && bobHomed;
+}
+
 void waitForMotorsReady() {
+    TRACE_BEGIN(TR_WAIT_MOTORS, currentPulseNum);
     unsigned long timeout = millis();
     // OPTIMIZADO: Timeout reducido de 10s a 3s (los motores deberían responder en <1s)
-    while ((!aliceReady || !bobReady) && millis() - timeout < 3000) {
+    // Un nodo que rechaza el pulso por su RNG no va a mandar READY: no esperar
+    while ((!aliceReady || !bobReady) && !rngFailureNodes && millis() - timeout < 3000) {
         // OPTIMIZADO: Solo yield() sin delay - reduce latencia de ~3ms a ~0.01ms/ciclo
         server.handleClient();  // Mantener WebSocket activo
         webSocket.loop();
         yield();  // Permitir callbacks ESP-NOW
     }
+    TRACE_END(TR_WAIT_MOTORS, (aliceReady ? 1 : 0) | (bobReady ? 2 : 0));
     
     if (aliceReady && bobReady) {
         // Motores listos (silencioso para no saturar serial)
-    } else {
-        Serial.printf("\n[ERROR CRÍTICO] Timeout esperando motores en pulso %d\n", currentPulseNum);
-        if (!aliceReady) Serial.println("  Alice no respondió");
-        if (!bobReady) Serial.println("  Bob no respondió");
-        Serial.println("[ABORT] Deteniendo protocolo por timeout\n");
+    } else if (!rngFailureNodes) {
+        LOG_E("\n[ERROR CRÍTICO] Timeout esperando motores en pulso %d", currentPulseNum);
+        if (!aliceReady) LOG_E("  Alice no respondió");
+        if (!bobReady) LOG_E("  Bob no respondió");
+        LOG_E("  El pulso se dispara igualmente y queda fuera de la criba\n");
     }
 }
 
+// Un nodo rechazó el pulso con ERROR_RNG_HEALTH: sus bases ya no son
+// aleatorias, así que la sesión se aborta y se avisa a la web
+void abortOnRngFailure() {
+    uint8_t nodes = rngFailureNodes;
+    const char* who = nodes == 3 ? "Alice y Bob" : (nodes & 1) ? "Alice" : "Bob";
+    char message[128];
+    snprintf(message, sizeof(message), "Sesión abortada en el pulso %u: el RNG de %s no supera las pruebas de salud",
+             currentPulseNum, who);
+    LOG_E("[RNG] %s", message);
+    rngFailureNodes = 0;
+    abortarProtocolo();
+    broadcastStatusError(message);
+}
+
 // Manejador de eventos WebSocket para Alice
 // ==============================================
 // FUNCIONES WEBSOCKET OBSOLETAS (ESP-NOW las reemplaza)
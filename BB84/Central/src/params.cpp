@@ -0,0 +1,148 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include <WebSocketsServer.h>
+#include <ArduinoJson.h>
+#include <BB84Protocol.h>
+#include <NodeParams.h>
+#include <AsyncLog.h>
+#include "params.h"
+
+// ==============================================
+// Parámetros de movimiento de Alice y Bob
+// ==============================================
+// Corriente, velocidad, aceleración, chopper y tabla de ángulos de cada nodo
+// se editan desde la interfaz web durante una campaña de medidas, sin
+// reflashear. Mensajes WebSocket:
+//
+//   {"type":"GET_PARAMS"}  -> CMD_GET_PARAMS a ambos nodos
+//   {"type":"SET_PARAMS","nodo":"Alice","corriente":600,"velocidad":4000,
+//    "aceleracion":18000,"micropasos":4,"toff":4,"tbl":24,"hstrt":3,"hend":1,
+//    "angulos":[47.7,2.7,25.2,70.2]}  -> CMD_SET_PARAMS (ángulos en grados)
+//
+// El nodo valida, aplica, guarda en NVS y responde STATUS_PARAMS con los
+// valores vigentes. El callback ESP-NOW solo los guarda; paramsLoop() los
+// registra por serial y los publica:
+//
+//   {"parametros":{"nodo":"Alice","resultado":"ok","campo":"-","guardado":true,
+//    "corriente":600,...,"angulos":[47.7,...]}}
+
+// Variables definidas en main.cpp
+extern WebSocketsServer webSocket;
+extern uint8_t aliceMAC[];
+extern uint8_t bobMAC[];
+
+struct NodeParamsState {
+  const char* name;
+  ParamsReport report;
+  volatile bool pending;     // Respuesta recibida, pendiente de publicar
+  MotionParams current;      // Últimos valores publicados (solo loop())
+  bool known;                // current llegó después del último paramsRequest()
+};
+
+static NodeParamsState alice = {"Alice"};
+static NodeParamsState bob = {"Bob"};
+
+static const char* resultName(uint8_t result) {
+  switch (result) {
+    case PARAMS_OK: return "ok";
+    case PARAMS_INVALID: return "invalido";
+    case PARAMS_BUSY: return "ocupado";
+    case PARAMS_NOT_SAVED: return "sin_guardar";
+    default: return "?";
+  }
+}
+
+void paramsRequest() {
+  alice.known = false;
+  bob.known = false;
+  CommandData command = {CMD_GET_PARAMS, 0, 0};
+  esp_now_send(aliceMAC, (uint8_t*)&command, sizeof(command));
+  esp_now_send(bobMAC, (uint8_t*)&command, sizeof(command));
+}
+
+// Valores vigentes de un nodo según su última respuesta (false si no llegó
+// ninguna desde el último paramsRequest())
+bool paramsCurrent(bool isAlice, MotionParams& params) {
+  const NodeParamsState& node = isAlice ? alice : bob;
+  if (!node.known) return false;
+  params = node.current;
+  return true;
+}
+
+// Solo forma el mensaje: los rangos los comprueba el nodo
+bool paramsFromJson(const JsonDocument& doc, MotionParams& params) {
+  JsonArray angles = doc["angulos"].as<JsonArray>();
+  if (angles.size() == 0 || angles.size() > PARAMS_MAX_ANGLES) return false;
+  params = MotionParams{};
+  params.currentMa = doc["corriente"].as<uint16_t>();
+  params.maxSpeed = doc["velocidad"].as<uint32_t>();
+  params.acceleration = doc["aceleracion"].as<uint32_t>();
+  params.microsteps = doc["micropasos"].as<uint16_t>();
+  params.toff = doc["toff"].as<uint8_t>();
+  params.blankTime = doc["tbl"].as<uint8_t>();
+  params.hysteresisStart = doc["hstrt"].as<uint8_t>();
+  params.hysteresisEnd = doc["hend"].as<int8_t>();
+  params.angleCount = angles.size();
+  uint8_t i = 0;
+  for (JsonVariant angle : angles) {
+    params.angles[i++] = lroundf(angle.as<float>() * 1000.0f);
+  }
+  return true;
+}
+
+bool paramsSend(bool isAlice, const MotionParams& params) {
+  ParamsCommand command = {CMD_SET_PARAMS, params};
+  esp_err_t result = esp_now_send(isAlice ? aliceMAC : bobMAC, (uint8_t*)&command, sizeof(command));
+  if (result != ESP_OK) {
+    LOG_E("[PARAMS] Error enviando a %s: %d", isAlice ? "Alice" : "Bob", result);
+  }
+  return result == ESP_OK;
+}
+
+void paramsOnReport(bool isAlice, const uint8_t* data, int len) {
+  if (len < (int)sizeof(ParamsReport)) return;
+  NodeParamsState& node = isAlice ? alice : bob;
+  if (node.pending) return;  // La anterior aún no se publicó
+  memcpy(&node.report, data, sizeof(node.report));
+  node.pending = true;
+}
+
+static void publishNode(const NodeParamsState& node) {
+  const MotionParams& p = node.report.params;
+  char json[384];
+  size_t len = snprintf(json, sizeof(json),
+                        "{\"parametros\":{\"nodo\":\"%s\",\"resultado\":\"%s\",\"campo\":\"%s\",\"guardado\":%s,"
+                        "\"corriente\":%u,\"velocidad\":%u,\"aceleracion\":%u,\"micropasos\":%u,"
+                        "\"toff\":%u,\"tbl\":%u,\"hstrt\":%u,\"hend\":%d,\"angulos\":[",
+                        node.name, resultName(node.report.result), paramsFieldName(node.report.field),
+                        node.report.stored ? "true" : "false", p.currentMa, p.maxSpeed, p.acceleration,
+                        p.microsteps, p.toff, p.blankTime, p.hysteresisStart, p.hysteresisEnd);
+  uint8_t count = p.angleCount < PARAMS_MAX_ANGLES ? p.angleCount : PARAMS_MAX_ANGLES;
+  for (uint8_t i = 0; i < count && len < sizeof(json); i++) {
+    len += snprintf(json + len, sizeof(json) - len, "%s%.3f", i ? "," : "", p.angles[i] / 1000.0f);
+  }
+  if (len < sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "]}}");
+  if (len >= sizeof(json)) return;
+  webSocket.broadcastTXT(json, len);
+}
+
+void paramsLoop() {
+  NodeParamsState* nodes[2] = {&alice, &bob};
+  for (int n = 0; n < 2; n++) {
+    NodeParamsState& node = *nodes[n];
+    if (!node.pending) continue;
+    const MotionParams& p = node.report.params;
+    if (node.report.result == PARAMS_INVALID) {
+      LOG_W("[PARAMS] %s rechazó los parámetros: %s fuera de rango", node.name, paramsFieldName(node.report.field));
+    } else if (node.report.result == PARAMS_BUSY) {
+      LOG_W("[PARAMS] %s rechazó los parámetros: motor ocupado", node.name);
+    }
+    LOG_I("[PARAMS] %s%s: %u mA, %u pasos/s, %u pasos/s², 1/%u, chopper toff=%u tbl=%u hstrt=%u hend=%d",
+          node.name, node.report.stored ? " (NVS)" : " (firmware)", p.currentMa, p.maxSpeed, p.acceleration,
+          p.microsteps, p.toff, p.blankTime, p.hysteresisStart, p.hysteresisEnd);
+    publishNode(node);
+    node.current = p;
+    node.known = true;
+    node.pending = false;
+  }
+}
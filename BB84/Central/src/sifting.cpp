@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include <WebSocketsServer.h>
+#include <QkdProtocol.h>
+#include <AsyncLog.h>
+#include "sifting.h"
+
+// ==============================================
+// Protocolo de la sesión y criba de la clave
+// ==============================================
+// El protocolo (BB84, BB84 sesgado o B92, ver QkdProtocol.h) se elige con
+// "PROTOCOL:n" antes de "Iniciar"; al empezar la sesión el Central se lo envía
+// a Alice y Bob (CMD_SET_PROTOCOL) y lo anuncia a la web:
+//
+//   {"protocolo":{"id":0,"nombre":"BB84","umbralQber":15.0}}
+//
+// Cada pulso publicado pasa por qkdSift(): la web recibe si entra en la clave
+// y el bit de clave de cada lado ("cribado", "claveAlice", "claveBob"). El
+// Central conoce el bit de Alice, así que además lleva la cuenta del QBER real
+// de toda la sesión y la imprime al terminar (log [SIFT]).
+
+// Variables definidas en main.cpp
+extern WebSocketsServer webSocket;
+
+static uint8_t protocolId = QKD_BB84;
+static uint32_t published = 0;     // Pulsos publicados en la sesión
+static uint32_t sifted = 0;
+static uint32_t errors = 0;
+static uint32_t discarded = 0;     // Publicados sin estados válidos (ver siftDiscardPulse)
+
+bool siftSetProtocol(uint8_t id) {
+  if (id >= QKD_PROTOCOL_COUNT) return false;
+  protocolId = id;
+  LOG_I("[SIFT] Protocolo: %s", qkdProtocols[id].name);
+  return true;
+}
+
+uint8_t siftProtocol() {
+  return protocolId;
+}
+
+void siftReset() {
+  published = 0;
+  sifted = 0;
+  errors = 0;
+  discarded = 0;
+  const QkdProtocolDef& protocol = qkdProtocols[protocolId];
+  char json[96];
+  int len = snprintf(json, sizeof(json), "{\"protocolo\":{\"id\":%u,\"nombre\":\"%s\",\"umbralQber\":%.1f}}",
+                     protocolId, protocol.name, protocol.qberLimitPct);
+  webSocket.broadcastTXT(json, len < (int)sizeof(json) ? len : sizeof(json) - 1);
+}
+
+bool siftPulse(int baseAlice, int bitAlice, int baseBob, int bitBob, uint32_t detector0, uint32_t detector1,
+               uint8_t& keyAlice, uint8_t& keyBob) {
+  published++;
+  if (!qkdSift(qkdProtocols[protocolId], baseAlice, bitAlice, baseBob, bitBob, detector0, detector1, keyAlice,
+               keyBob)) {
+    return false;
+  }
+  sifted++;
+  if (keyAlice != keyBob) errors++;
+  return true;
+}
+
+void siftDiscardPulse() {
+  published++;
+  discarded++;
+}
+
+void siftPrintSummary() {
+  if (published == 0) return;
+  const QkdProtocolDef& protocol = qkdProtocols[protocolId];
+  float qber = sifted ? 100.0f * errors / sifted : 0.0f;
+  LOG_I("[SIFT] %s: %lu pulsos, %lu cribados (%.1f%%), %lu errores -> QBER %.2f%% (%s del %.1f%%)", protocol.name,
+        (unsigned long)published, (unsigned long)sifted, 100.0f * sifted / published, (unsigned long)errors, qber,
+        qber < protocol.qberLimitPct ? "por debajo" : "por encima", protocol.qberLimitPct);
+  if (discarded) LOG_W("[SIFT] %lu pulsos sin estados válidos, fuera de la criba", (unsigned long)discarded);
+}
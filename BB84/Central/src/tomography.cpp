@@ -0,0 +1,309 @@
+#include <Arduino.h>
+#include <WebSocketsServer.h>
+#include <math.h>
+#include <BB84Protocol.h>
+#include <AsyncLog.h>
+#include "tomography.h"
+
+// ==============================================
+// Tomografía de los estados de polarización
+// ==============================================
+// Caracteriza el canal en una sola sesión de la FPGA en vez de decenas de
+// movimientos manuales. Alice prepara un estado de su tabla y Bob recorre un
+// juego de analizadores; los conteos de cada ajuste se integran con los
+// detectores y al terminar cada estado se reconstruye su matriz densidad por
+// máxima verosimilitud. Todos los pulsos son de referencia
+// (CMD_PREPARE_REFERENCE): el nodo responde STATUS_READY con el motor parado,
+// así que cada ajuste se mide sin esperas fijas.
+//
+// Bob solo tiene una lámina de media onda delante del divisor polarizador:
+// mide polarizaciones lineales, no circulares. El ajuste k gira su lámina
+// k · 11.25° sobre la base + de su tabla, así que el detector 0 proyecta sobre
+// la polarización lineal a φk = k · 22.5° de H (k = 2 es la base x, como en la
+// tabla por defecto) y el detector 1 sobre la ortogonal:
+//
+//   p0(k) = (1 + S1·cos 2φk + S2·sin 2φk) / 2
+//
+// Los ajustes k y k + 4 intercambian los detectores, así que cada uno de los
+// 8 proyectores del ecuador de la esfera de Poincaré se mide con los dos y la
+// diferencia de eficiencia entre ellos se compensa. S3 (circular) no es
+// observable y se toma 0; la fidelidad con H, V, D o A no depende de él.
+//
+// Los conteos n0, n1 de cada ajuste se condicionan a su suma (la eficiencia
+// absoluta de los detectores no entra) y (S1, S2) maximiza
+//
+//   L = Σk n0(k)·ln p0(k) + n1(k)·ln(1 - p0(k))
+//
+// dentro del disco S1² + S2² <= 1 (estado físico). L es cóncava: Newton con
+// búsqueda lineal, partiendo de la inversión lineal y proyectando al disco.
+//
+// Orden de las medidas: los nodos llegan siempre girando en sentido +
+// (APPROACH_DIR) y un paso hacia atrás cuesta el sobrepaso del juego. Los
+// ajustes de Bob cubren su periodo óptico (90°) en pasos de 11.25° hacia
+// delante: el último vuelve al primero con otro paso igual, así que Bob nunca
+// retrocede. Los estados de Alice van en orden creciente de su ángulo en la
+// tabla por defecto (V, D, H, A).
+//
+// Un pulso sin el READY de los dos nodos (timeout) se midió con una lámina que
+// quizá no había llegado: no suma conteos, pero la secuencia avanza igual. Si a
+// un estado le faltan más del TOMOGRAPHY_MAX_INVALID_PCT % de los pulsos no se
+// reconstruye ni se publica.
+//
+// WebSocket "TOMOGRAPHY:us,estado" (estado 0-3 = H, V, D, A; 4 = los cuatro).
+// Cada estado queda en el log [TOMO] y se publica en la interfaz web:
+//
+//   {"tomografia":{"estado":"H","pulsos":64,"s1":..,"s2":..,"rho":[[..,..],[..,..]],
+//    "fidelidad":..,"pureza":..,"cuentas":[[n0,n1],...]}}
+
+#define TOMOGRAPHY_SETTINGS 8                  // Analizadores de Bob por estado
+#define TOMOGRAPHY_STEP_MDEG 11250             // Giro de la lámina entre ajustes (22.5° de polarización)
+#define TOMOGRAPHY_PULSES_PER_SETTING 8
+#define TOMOGRAPHY_MLE_ITERATIONS 50
+#define TOMOGRAPHY_MAX_RADIUS 0.999999         // Dentro del disco: p0 nunca vale 0 ni 1
+#define TOMOGRAPHY_MAX_INVALID_PCT 10          // Pulsos sin READY tolerados por estado
+#define TOMOGRAPHY_STATE_PULSES (TOMOGRAPHY_SETTINGS * TOMOGRAPHY_PULSES_PER_SETTING)
+
+// Variables y funciones definidas en main.cpp
+extern bool start_protocol;
+extern WebSocketsServer webSocket;
+void enviarConfiguracion(uint32_t num_pulsos, uint32_t duracion_us);
+esp_err_t sendReferencePulse(bool isAlice, uint32_t pulseNum, uint8_t index, int32_t offsetMdeg);
+
+struct TomographyState {
+  const char* name;
+  uint8_t aliceIndex;        // Tabla de Alice [base][bit]
+  float s1, s2;              // Vector de Stokes ideal
+};
+
+// En orden creciente de ángulo en la tabla por defecto de Alice
+static const TomographyState states[] = {
+  {"V", 1, -1.0f, 0.0f},
+  {"D", 2, 0.0f, 1.0f},
+  {"H", 0, 1.0f, 0.0f},
+  {"A", 3, 0.0f, -1.0f},
+};
+#define TOMOGRAPHY_STATES (sizeof(states) / sizeof(states[0]))
+
+struct SettingCounts {
+  uint32_t n0;
+  uint32_t n1;
+};
+
+static bool active = false;
+static uint8_t first = 0;          // Estados de la sesión: [first, last] en states[]
+static uint8_t last = 0;
+static uint8_t current = 0;
+static uint8_t setting = 0;
+static uint8_t pulse = 0;
+static SettingCounts counts[TOMOGRAPHY_SETTINGS];
+static uint16_t invalidPulses = 0;   // Pulsos sin READY en el estado en curso
+
+static void analyzer(uint8_t k, double& c, double& s) {
+  double phi = k * TOMOGRAPHY_STEP_MDEG * 2 / 1000.0 * M_PI / 180.0;
+  c = cos(2 * phi);
+  s = sin(2 * phi);
+}
+
+static void clampToDisk(double& s1, double& s2) {
+  double r = sqrt(s1 * s1 + s2 * s2);
+  if (r > TOMOGRAPHY_MAX_RADIUS) {
+    s1 *= TOMOGRAPHY_MAX_RADIUS / r;
+    s2 *= TOMOGRAPHY_MAX_RADIUS / r;
+  }
+}
+
+static double logLikelihood(double s1, double s2) {
+  double l = 0;
+  for (uint8_t k = 0; k < TOMOGRAPHY_SETTINGS; k++) {
+    double c, s;
+    analyzer(k, c, s);
+    double p = 0.5 * (1 + s1 * c + s2 * s);
+    if (counts[k].n0) l += counts[k].n0 * log(p);
+    if (counts[k].n1) l += counts[k].n1 * log(1 - p);
+  }
+  return l;
+}
+
+// Máxima verosimilitud de (S1, S2). false si no hay detecciones
+static bool fitStokes(double& s1, double& s2) {
+  // Inversión lineal: los analizadores están repartidos por igual, así que
+  // Σ cos² = Σ sin² = N/2 y Σ cos·sin = 0
+  double a1 = 0, a2 = 0;
+  uint8_t used = 0;
+  for (uint8_t k = 0; k < TOMOGRAPHY_SETTINGS; k++) {
+    uint32_t n = counts[k].n0 + counts[k].n1;
+    if (n == 0) continue;
+    double c, s;
+    analyzer(k, c, s);
+    double e = (double)((int32_t)counts[k].n0 - (int32_t)counts[k].n1) / n;  // 2·p0 - 1
+    a1 += e * c;
+    a2 += e * s;
+    used++;
+  }
+  if (used == 0) return false;
+  s1 = 2 * a1 / TOMOGRAPHY_SETTINGS;
+  s2 = 2 * a2 / TOMOGRAPHY_SETTINGS;
+  clampToDisk(s1, s2);
+
+  double l = logLikelihood(s1, s2);
+  for (uint8_t it = 0; it < TOMOGRAPHY_MLE_ITERATIONS; it++) {
+    // Gradiente y hessiana (definida negativa) de L
+    double g1 = 0, g2 = 0, h11 = 0, h12 = 0, h22 = 0;
+    for (uint8_t k = 0; k < TOMOGRAPHY_SETTINGS; k++) {
+      double c, s;
+      analyzer(k, c, s);
+      double p = 0.5 * (1 + s1 * c + s2 * s);
+      double d = 0.5 * (counts[k].n0 / p - counts[k].n1 / (1 - p));
+      double w = 0.25 * (counts[k].n0 / (p * p) + counts[k].n1 / ((1 - p) * (1 - p)));
+      g1 += d * c;
+      g2 += d * s;
+      h11 += w * c * c;
+      h12 += w * c * s;
+      h22 += w * s * s;
+    }
+    double det = h11 * h22 - h12 * h12;
+    if (det < 1e-12) break;
+    double step1 = (h22 * g1 - h12 * g2) / det;
+    double step2 = (h11 * g2 - h12 * g1) / det;
+    double t = 1.0;
+    double n1 = s1, n2 = s2, nl = l;
+    while (t > 1e-4) {
+      n1 = s1 + t * step1;
+      n2 = s2 + t * step2;
+      clampToDisk(n1, n2);
+      nl = logLikelihood(n1, n2);
+      if (nl >= l) break;
+      t *= 0.5;
+    }
+    if (nl < l) break;
+    double moved = fabs(n1 - s1) + fabs(n2 - s2);
+    s1 = n1;
+    s2 = n2;
+    l = nl;
+    if (moved < 1e-7) break;
+  }
+  return true;
+}
+
+static void publishState(const TomographyState& target, double s1, double s2) {
+  // ρ = (I + S1·σz + S2·σx) / 2 en la base H/V
+  double rho00 = (1 + s1) / 2;
+  double rho01 = s2 / 2;
+  double rho11 = (1 - s1) / 2;
+  double fidelity = (1 + s1 * target.s1 + s2 * target.s2) / 2;
+  double purity = (1 + s1 * s1 + s2 * s2) / 2;
+  uint32_t total = 0;
+  for (uint8_t k = 0; k < TOMOGRAPHY_SETTINGS; k++) total += counts[k].n0 + counts[k].n1;
+
+  LOG_I("[TOMO] Estado %s: %lu detecciones en %u analizadores", target.name, (unsigned long)total,
+        TOMOGRAPHY_SETTINGS);
+  for (uint8_t k = 0; k < TOMOGRAPHY_SETTINGS; k++) {
+    LOG_I("[TOMO]   %5.1f°: %6lu / %6lu", k * TOMOGRAPHY_STEP_MDEG * 2 / 1000.0f, (unsigned long)counts[k].n0,
+          (unsigned long)counts[k].n1);
+  }
+  LOG_I("[TOMO]   S1=%+.4f S2=%+.4f  ρ=[[%.4f %+.4f] [%+.4f %.4f]]", s1, s2, rho00, rho01, rho01, rho11);
+  LOG_I("[TOMO]   fidelidad con %s %.2f%%, pureza %.4f", target.name, fidelity * 100.0, purity);
+
+  static char json[512];
+  size_t len = snprintf(json, sizeof(json),
+                        "{\"tomografia\":{\"estado\":\"%s\",\"pulsos\":%u,\"s1\":%.4f,\"s2\":%.4f,"
+                        "\"rho\":[[%.4f,%.4f],[%.4f,%.4f]],\"fidelidad\":%.4f,\"pureza\":%.4f,\"cuentas\":[",
+                        target.name, TOMOGRAPHY_STATE_PULSES - invalidPulses, s1, s2, rho00, rho01,
+                        rho01, rho11, fidelity, purity);
+  for (uint8_t k = 0; k < TOMOGRAPHY_SETTINGS && len < sizeof(json); k++) {
+    len += snprintf(json + len, sizeof(json) - len, "%s[%lu,%lu]", k ? "," : "", (unsigned long)counts[k].n0,
+                    (unsigned long)counts[k].n1);
+  }
+  if (len < sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "]}}");
+  if (len >= sizeof(json)) {
+    LOG_E("[TOMO] Resultado de %s demasiado grande para publicar", target.name);
+    return;
+  }
+  webSocket.broadcastTXT(json, len);
+}
+
+static void finishState() {
+  const TomographyState& target = states[current];
+  double s1 = 0, s2 = 0;
+  if (invalidPulses * 100 > TOMOGRAPHY_STATE_PULSES * TOMOGRAPHY_MAX_INVALID_PCT) {
+    LOG_W("[TOMO] Estado %s: %u de %u pulsos sin READY, no se reconstruye", target.name, invalidPulses,
+          TOMOGRAPHY_STATE_PULSES);
+    return;
+  }
+  if (!fitStokes(s1, s2)) {
+    LOG_W("[TOMO] Estado %s: sin detecciones", target.name);
+    return;
+  }
+  publishState(target, s1, s2);
+}
+
+bool tomographyStart(uint32_t durationUs, uint8_t aliceState) {
+  if (active || start_protocol || aliceState > TOMOGRAPHY_ALL_STATES) return false;
+  first = 0;
+  last = TOMOGRAPHY_STATES - 1;
+  if (aliceState != TOMOGRAPHY_ALL_STATES) {
+    for (uint8_t i = 0; i < TOMOGRAPHY_STATES; i++) {
+      if (states[i].aliceIndex == aliceState) first = last = i;
+    }
+  }
+  current = first;
+  setting = 0;
+  pulse = 0;
+  invalidPulses = 0;
+  memset(counts, 0, sizeof(counts));
+  uint32_t pulses = (last - first + 1) * TOMOGRAPHY_STATE_PULSES;
+  active = true;  // Antes de configurar: el primer pulso ya es de la tomografía
+  LOG_I("[TOMO] %u estado(s) x %u analizadores x %u pulsos = %lu pulsos de %lu us", last - first + 1,
+        TOMOGRAPHY_SETTINGS, TOMOGRAPHY_PULSES_PER_SETTING, (unsigned long)pulses, (unsigned long)durationUs);
+  enviarConfiguracion(pulses, durationUs);
+  if (!start_protocol) {
+    LOG_E("[TOMO] No se pudo iniciar la sesión de la FPGA: tomografía cancelada");
+    active = false;
+    return false;
+  }
+  return true;
+}
+
+bool tomographyActive() {
+  return active;
+}
+
+void tomographySendPulse(bool isAlice, uint32_t pulseNum) {
+  if (isAlice) {
+    sendReferencePulse(true, pulseNum, states[current].aliceIndex, 0);
+  } else {
+    sendReferencePulse(false, pulseNum, 0, setting * TOMOGRAPHY_STEP_MDEG);
+  }
+}
+
+// Pulso terminado: si es de la tomografía suma sus conteos al ajuste en curso
+// (salvo que le falte algún READY), avanza la secuencia y devuelve true
+bool tomographyOnPulse(uint32_t detector0, uint32_t detector1, bool valid) {
+  if (!active) return false;
+  if (valid) {
+    counts[setting].n0 += detector0;
+    counts[setting].n1 += detector1;
+  } else {
+    invalidPulses++;
+  }
+  if (++pulse < TOMOGRAPHY_PULSES_PER_SETTING) return true;
+
+  pulse = 0;
+  if (++setting < TOMOGRAPHY_SETTINGS) return true;
+  finishState();
+  setting = 0;
+  invalidPulses = 0;
+  memset(counts, 0, sizeof(counts));
+  if (current++ == last) {
+    active = false;
+    LOG_I("[TOMO] Tomografía terminada");
+  }
+  return true;
+}
+
+// CMD_ABORT / abort desde la web: se descartan los conteos del estado en curso
+void tomographyAbort() {
+  if (!active) return;
+  active = false;
+  LOG_W("[TOMO] Tomografía abortada");
+}
@@ -0,0 +1,202 @@
+#include <Arduino.h>
+#include <WebServer.h>
+#include <WebSocketsServer.h>
+#include <esp_now.h>
+#include <BB84Protocol.h>
+#include <AsyncLog.h>
+#include "latency.h"
+#include "trace_export.h"
+
+// ==============================================
+// Descarga de trazas /trace.json
+// ==============================================
+// Pide a Alice y Bob su buffer de traza (CMD_TRACE_DUMP), lo une con el del
+// Central y lo envía como JSON Chrome Trace Event, que se abre directamente en
+// https://ui.perfetto.dev o chrome://tracing. Cada firmware es un proceso
+// (pid 0 Central, 1 Alice, 2 Bob). Las marcas de Alice y Bob se llevan al
+// reloj del Central con la sincronización de latency.cpp; si un nodo aún no
+// está sincronizado su último evento se alinea con el instante de la descarga.
+
+// Variables definidas en main.cpp
+extern WebServer server;
+extern WebSocketsServer webSocket;
+extern uint8_t aliceMAC[];
+extern uint8_t bobMAC[];
+
+#define TRACE_DUMP_TIMEOUT_MS 1500
+
+struct NodeTrace {
+  TraceEvent events[TRACE_CAPACITY];  // phase = 0 marca un evento no recibido
+  volatile uint16_t total;     // Eventos anunciados por el nodo
+  volatile uint16_t received;  // Eventos recibidos
+  volatile bool started;
+  uint32_t lastTs;             // Marca del evento más reciente (alineación sin sincronización)
+};
+
+static NodeTrace aliceTrace;
+static NodeTrace bobTrace;
+
+void traceOnChunk(bool isAlice, const uint8_t* data, int len) {
+  if (len < (int)(sizeof(TraceChunk) - sizeof(TraceChunk::events))) return;
+  TraceChunk chunk;
+  memcpy(&chunk, data, len < (int)sizeof(chunk) ? len : sizeof(chunk));
+  if (chunk.count > TRACE_CHUNK_EVENTS) return;
+
+  NodeTrace& node = isAlice ? aliceTrace : bobTrace;
+  node.total = chunk.total < TRACE_CAPACITY ? chunk.total : TRACE_CAPACITY;
+  node.started = true;
+  for (uint8_t i = 0; i < chunk.count; i++) {
+    uint32_t index = (uint32_t)chunk.index + i;
+    if (index < TRACE_CAPACITY) {
+      node.events[index] = chunk.events[i];
+      node.received++;
+    }
+  }
+}
+
+static bool nodeComplete(const NodeTrace& node) {
+  return node.started && node.received >= node.total;
+}
+
+// Pide el volcado a ambos nodos y espera los fragmentos
+static void collectNodeTraces() {
+  aliceTrace.started = bobTrace.started = false;
+  aliceTrace.received = bobTrace.received = 0;
+  aliceTrace.total = bobTrace.total = 0;
+  memset(aliceTrace.events, 0, sizeof(aliceTrace.events));
+  memset(bobTrace.events, 0, sizeof(bobTrace.events));
+
+  CommandData command = {CMD_TRACE_DUMP, 0, 0};
+  esp_now_send(aliceMAC, (uint8_t*)&command, sizeof(command));
+  esp_now_send(bobMAC, (uint8_t*)&command, sizeof(command));
+
+  unsigned long start = millis();
+  while ((!nodeComplete(aliceTrace) || !nodeComplete(bobTrace)) &&
+         millis() - start < TRACE_DUMP_TIMEOUT_MS) {
+    webSocket.loop();
+    delay(5);
+  }
+  NodeTrace* nodes[2] = {&aliceTrace, &bobTrace};
+  for (NodeTrace* node : nodes) {
+    node->lastTs = 0;
+    for (int i = node->total - 1; i >= 0; i--) {
+      if (node->events[i].phase != 0) {
+        node->lastTs = node->events[i].ts;
+        break;
+      }
+    }
+  }
+  LOG_I("[TRACE] Alice %u/%u, Bob %u/%u eventos",
+        aliceTrace.received, aliceTrace.total, bobTrace.received, bobTrace.total);
+}
+
+// Buffer de salida: se envía al cliente por partes para no armar el JSON completo en RAM
+static char outBuf[1024];
+static size_t outLen = 0;
+
+static void flushOut() {
+  if (outLen > 0) {
+    server.sendContent(outBuf, outLen);
+    outLen = 0;
+  }
+}
+
+static void emit(const char* fmt, ...) {
+  char line[192];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (n <= 0) return;
+  if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+  if (outLen + n > sizeof(outBuf)) flushOut();
+  memcpy(outBuf + outLen, line, n);
+  outLen += n;
+}
+
+static const char* nodeName(uint32_t node) {
+  switch (node) {
+    case TRACE_NODE_ALICE: return "Alice";
+    case TRACE_NODE_BOB: return "Bob";
+    default: return "Central";
+  }
+}
+
+// Escribe un evento; ts relativo al instante de referencia de la descarga
+static void emitEvent(bool& first, int pid, const TraceEvent& e, int64_t ts) {
+  emit("%s{\"name\":\"%s\",\"cat\":\"bb84\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":%d,\"tid\":0",
+       first ? "" : ",\n", traceName(e.id), e.phase, (long long)ts, pid);
+  first = false;
+  if (e.phase == TRACE_PH_INSTANT) emit(",\"s\":\"p\"");
+  if (pid == TRACE_NODE_CENTRAL && (e.id == TR_ESPNOW_RX || e.id == TR_ESPNOW_TX)) {
+    emit(",\"args\":{\"nodo\":\"%s\",\"codigo\":%u}}", nodeName(e.arg >> 8), e.arg & 0xFF);
+  } else {
+    emit(",\"args\":{\"arg\":%u}}", e.arg);
+  }
+}
+
+// Convierte la marca de un nodo a "µs antes de la descarga" (negativo) en el reloj del Central
+static int32_t nodeToRef(bool isAlice, const NodeTrace& node, uint32_t ts, uint32_t refMicros) {
+  uint32_t central;
+  if (latencyToCentral(isAlice, ts, &central)) {
+    return (int32_t)(central - refMicros);
+  }
+  return (int32_t)(ts - node.lastTs);
+}
+
+void handleTraceDownload() {
+  collectNodeTraces();
+
+  // Congelar el buffer del Central durante la exportación
+  traceEnabled = false;
+  uint32_t refMicros = micros();
+  uint32_t centralCount = traceCount();
+
+  // Instante más antiguo para que todas las marcas queden positivas
+  int32_t oldest = 0;
+  for (uint32_t i = 0; i < centralCount; i++) {
+    int32_t t = (int32_t)(traceAt(i).ts - refMicros);
+    if (t < oldest) oldest = t;
+  }
+  const NodeTrace* nodes[2] = {&aliceTrace, &bobTrace};
+  for (int n = 0; n < 2; n++) {
+    const NodeTrace& node = *nodes[n];
+    for (uint16_t i = 0; i < node.total; i++) {
+      if (node.events[i].phase == 0) continue;
+      int32_t t = nodeToRef(n == 0, node, node.events[i].ts, refMicros);
+      if (t < oldest) oldest = t;
+    }
+  }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.sendHeader("Content-Disposition", "attachment; filename=\"bb84_trace.json\"");
+  server.send(200, "application/json", "");
+
+  outLen = 0;
+  bool first = true;
+  emit("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (int pid = TRACE_NODE_CENTRAL; pid <= TRACE_NODE_BOB; pid++) {
+    emit("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+         first ? "" : ",\n", pid, nodeName(pid));
+    first = false;
+  }
+
+  for (uint32_t i = 0; i < centralCount; i++) {
+    const TraceEvent& e = traceAt(i);
+    emitEvent(first, TRACE_NODE_CENTRAL, e, (int64_t)(int32_t)(e.ts - refMicros) - oldest);
+  }
+  for (int n = 0; n < 2; n++) {
+    const NodeTrace& node = *nodes[n];
+    for (uint16_t i = 0; i < node.total; i++) {
+      const TraceEvent& e = node.events[i];
+      if (e.phase == 0) continue;  // Fragmento perdido
+      emitEvent(first, n == 0 ? TRACE_NODE_ALICE : TRACE_NODE_BOB, e,
+                (int64_t)nodeToRef(n == 0, node, e.ts, refMicros) - oldest);
+    }
+  }
+  emit("\n]}\n");
+  flushOut();
+  server.sendContent("");  // Fin de la respuesta por partes
+
+  traceEnabled = true;
+}
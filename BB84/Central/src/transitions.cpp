@@ -0,0 +1,115 @@
+#include <Arduino.h>
+#include <WebSocketsServer.h>
+#include <BB84Protocol.h>
+#include <AsyncLog.h>
+#include "transitions.h"
+
+// ==============================================
+// Matriz de coste de transiciones
+// ==============================================
+// Alice y Bob miden cada movimiento entre dos ángulos de su tabla (tiempo de
+// reloj y pasos) y envían la matriz celda a celda (STATUS_TRANSITION_STATS)
+// con CMD_TRANSITION_STATS o al terminar CMD_TRANSITION_BENCH. El callback
+// ESP-NOW solo guarda las celdas; al llegar el mensaje final loop() imprime la
+// matriz por serial y la publica en la interfaz web:
+//
+//   {"transiciones":{"nodo":"Alice","angulos":[47.7,...],"movimientos":N,
+//    "celdas":[{"d":0,"h":1,"n":..,"media":..,"p99":..,"max":..,"pasos":..,"pasos_max":..},...]}}
+//
+// Tiempos en µs.
+
+// Variables definidas en main.cpp
+extern WebSocketsServer webSocket;
+
+#define TRANSITION_MAX_ANGLES 4
+
+struct NodeTransitions {
+  const char* name;
+  TransitionStatsReport cells[TRANSITION_MAX_ANGLES][TRANSITION_MAX_ANGLES];  // count 0 = sin datos
+  int32_t angles[TRANSITION_MAX_ANGLES];  // Milésimas de grado
+  uint8_t angleCount;
+  uint32_t total;
+  volatile bool complete;    // Mensaje final recibido, pendiente de publicar
+  bool receiving;            // Entre la primera celda y el mensaje final
+};
+
+static NodeTransitions alice = {"Alice"};
+static NodeTransitions bob = {"Bob"};
+
+void transitionsOnReport(bool isAlice, const uint8_t* data, int len) {
+  if (len < (int)sizeof(TransitionStatsReport)) return;
+  TransitionStatsReport report;
+  memcpy(&report, data, sizeof(report));
+
+  NodeTransitions& node = isAlice ? alice : bob;
+  if (!node.receiving) {
+    memset(node.cells, 0, sizeof(node.cells));  // Nueva matriz
+    memset(node.angles, 0, sizeof(node.angles));
+    node.receiving = true;
+  }
+  node.angleCount = report.angles < TRANSITION_MAX_ANGLES ? report.angles : TRANSITION_MAX_ANGLES;
+
+  if (report.from == TRANSITION_REPORT_END) {
+    node.total = report.count;
+    node.receiving = false;
+    node.complete = true;
+    return;
+  }
+  if (report.from >= TRANSITION_MAX_ANGLES || report.to >= TRANSITION_MAX_ANGLES) return;
+  node.cells[report.from][report.to] = report;
+  node.angles[report.from] = report.fromAngle;
+  node.angles[report.to] = report.toAngle;
+}
+
+static void printNode(const NodeTransitions& node) {
+  LOG_I("[TRANS] %s: %u movimientos (media / p99 / max en ms, pasos medios)", node.name, node.total);
+  for (uint8_t from = 0; from < node.angleCount; from++) {
+    for (uint8_t to = 0; to < node.angleCount; to++) {
+      const TransitionStatsReport& c = node.cells[from][to];
+      if (c.count == 0) continue;
+      LOG_I("[TRANS]   %6.2f -> %6.2f  n=%-5u %7.1f %7.1f %7.1f  %u pasos",
+            node.angles[from] / 1000.0f, node.angles[to] / 1000.0f, c.count,
+            c.meanUs / 1000.0f, c.p99Us / 1000.0f, c.maxUs / 1000.0f, c.meanSteps);
+    }
+  }
+}
+
+static void publishNode(const NodeTransitions& node) {
+  static char json[1536];
+  size_t len = 0;
+  len += snprintf(json + len, sizeof(json) - len,
+                  "{\"transiciones\":{\"nodo\":\"%s\",\"movimientos\":%u,\"angulos\":[",
+                  node.name, node.total);
+  for (uint8_t i = 0; i < node.angleCount && len < sizeof(json); i++) {
+    len += snprintf(json + len, sizeof(json) - len, "%s%.3f", i ? "," : "", node.angles[i] / 1000.0f);
+  }
+  if (len < sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "],\"celdas\":[");
+  bool first = true;
+  for (uint8_t from = 0; from < node.angleCount; from++) {
+    for (uint8_t to = 0; to < node.angleCount; to++) {
+      const TransitionStatsReport& c = node.cells[from][to];
+      if (c.count == 0 || len >= sizeof(json)) continue;
+      len += snprintf(json + len, sizeof(json) - len,
+                      "%s{\"d\":%u,\"h\":%u,\"n\":%u,\"media\":%u,\"p99\":%u,\"max\":%u,\"pasos\":%u,\"pasos_max\":%u}",
+                      first ? "" : ",", from, to, c.count, c.meanUs, c.p99Us, c.maxUs, c.meanSteps, c.maxSteps);
+      first = false;
+    }
+  }
+  if (len < sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "]}}");
+  if (len >= sizeof(json)) {
+    LOG_E("[TRANS] Matriz de %s demasiado grande para publicar", node.name);
+    return;
+  }
+  webSocket.broadcastTXT(json, len);
+}
+
+void transitionsLoop() {
+  NodeTransitions* nodes[2] = {&alice, &bob};
+  for (int n = 0; n < 2; n++) {
+    NodeTransitions& node = *nodes[n];
+    if (!node.complete) continue;
+    node.complete = false;
+    printNode(node);
+    publishNode(node);
+  }
+}
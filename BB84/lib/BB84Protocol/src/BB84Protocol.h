@@ -0,0 +1,284 @@
+#ifndef BB84_PROTOCOL_H
+#define BB84_PROTOCOL_H
+
+#include <stdint.h>
+#include <BB84Trace.h>
+
+// ==============================================
+// Protocolo ESP-NOW compartido entre Central, Alice y Bob
+// ==============================================
+// Los tres firmwares incluyen este archivo para que los valores de los
+// comandos y el tamaño de las estructuras no diverjan entre proyectos.
+
+// Comandos desde el ESP32 Central
+enum Command {
+  CMD_SET_CHANNEL = 0x00,     // Configurar canal WiFi (el canal viene en pulseNum)
+  CMD_PING = 0x01,            // Ping para verificar conexión
+  CMD_HOME = 0x02,            // pulseNum HOME_RECALIBRATE = volver a medir el offset del homing
+  CMD_PREPARE_PULSE = 0x03,
+  CMD_ABORT = 0x04,
+  CMD_START_PROTOCOL = 0x05,
+  CMD_MOVE_MANUAL = 0x06,     // Movimiento manual (ver ManualMoveCommand)
+  CMD_SET_RADIO = 0x07,       // Ahorro de energía en pulseNum, potencia TX en totalPulses (0 = sin cambio)
+  CMD_TIME_SYNC = 0x08,       // Sincronización de reloj: secuencia en pulseNum, t1 (micros del Central) en totalPulses
+  CMD_TRACE_DUMP = 0x09,      // Enviar el buffer de traza al Central (ver TraceChunk)
+  CMD_CALIBRATE_PROFILES = 0x0A, // Recalibrar velocidad/aceleración de cada transición (NVS)
+  CMD_TRANSITION_STATS = 0x0B,   // Enviar la matriz de transiciones (pulseNum 1 = reiniciarla después)
+  CMD_TRANSITION_BENCH = 0x0C,   // Recorrer todas las transiciones pulseNum veces en orden aleatorio
+  CMD_RNG_STATS = 0x0D,          // Enviar estadísticas y estado de las pruebas de salud del RNG
+  CMD_VERIFY_HOME = 0x0E,        // Comprobar el homing con una pasada corta por el imán (sin repetirlo)
+  CMD_GET_PARAMS = 0x0F,         // Enviar los parámetros de movimiento vigentes (ver ParamsReport)
+  CMD_SET_PARAMS = 0x10,         // Validar, aplicar y guardar en NVS parámetros de movimiento (ver ParamsCommand)
+  CMD_FIND_LIMITS = 0x11,        // Buscar la velocidad y aceleración máximas sin pérdida de pasos (ver LimitsReport)
+  CMD_SOAK = 0x12,               // Prueba de resistencia: transiciones aleatorias durante pulseNum s (ver SoakReport)
+  CMD_PREPARE_REFERENCE = 0x13,  // Pulso de referencia con estado fijado por el Central (ver ReferencePulseCommand)
+  CMD_TRIM_ANGLE = 0x14,         // Corregir un ángulo de la tabla sin guardar en NVS: índice en pulseNum,
+                                 // corrección en milésimas de grado (con signo) en totalPulses; responde STATUS_PARAMS
+  CMD_SET_PROTOCOL = 0x15        // Protocolo de la sesión en pulseNum (ver QkdProtocol.h); responde STATUS_PROTOCOL
+};
+
+struct CommandData {
+  uint8_t cmd;           // Tipo de comando
+  uint32_t pulseNum;     // Número de pulso actual
+  uint32_t totalPulses;  // Total de pulsos a transmitir
+} __attribute__((packed));
+
+// Comando de movimiento manual (mismo tamaño que CommandData)
+struct ManualMoveCommand {
+  uint8_t cmd;           // CMD_MOVE_MANUAL
+  float targetAngle;     // Ángulo objetivo
+  uint32_t reserved;     // Reservado para mantener tamaño
+} __attribute__((packed));
+
+// Pulso de referencia para la compensación de deriva de polarización: el nodo
+// va al estado 'index' de su tabla más offsetMdeg, sin tirar del RNG, y
+// responde STATUS_READY igual que a CMD_PREPARE_PULSE
+struct ReferencePulseCommand {
+  uint8_t cmd;           // CMD_PREPARE_REFERENCE
+  uint32_t pulseNum;     // Número de pulso actual
+  uint8_t index;         // Índice en la tabla del nodo (base * bits por base + bit)
+  int32_t offsetMdeg;    // Desplazamiento sobre el ángulo de la tabla (milésimas de grado)
+} __attribute__((packed));
+
+// Respuestas hacia el ESP32 Central
+enum Status {
+  STATUS_PONG = 0,            // Respuesta al ping
+  STATUS_HOME_COMPLETE = 1,   // Duración (ms) en pulseNum, desvío del 0 anterior en base, ancho del imán en bit
+  STATUS_READY = 2,
+  STATUS_ERROR = 3,
+  STATUS_TIME_SYNC = 4,       // Respuesta a CMD_TIME_SYNC (ver TimeSyncResponse)
+  STATUS_TRACE_CHUNK = 5,     // Fragmento del buffer de traza (ver TraceChunk)
+  STATUS_CALIBRATION_DONE = 6, // Fin de CMD_CALIBRATE_PROFILES: transiciones ajustadas en pulseNum, base 1 = guardado
+  STATUS_TRANSITION_STATS = 7, // Celda de la matriz de transiciones (ver TransitionStatsReport)
+  STATUS_RNG_STATS = 8,        // Respuesta a CMD_RNG_STATS (ver RngStatsReport)
+  STATUS_STEP_LOSS = 9,        // Pérdida de pasos detectada: causa en base, detalle en bit; el nodo se re-homea solo
+  STATUS_HOME_VERIFIED = 10,   // Respuesta a CMD_VERIFY_HOME: duración (ms) en pulseNum, resultado en base, desvío en bit
+  STATUS_PARAMS = 11,          // Respuesta a CMD_GET_PARAMS / CMD_SET_PARAMS (ver ParamsReport)
+  STATUS_LIMITS_DONE = 12,     // Fin de CMD_FIND_LIMITS (ver LimitsReport)
+  STATUS_SOAK_REPORT = 13,     // Progreso y fin de CMD_SOAK (ver SoakReport)
+  STATUS_PROTOCOL = 14         // Respuesta a CMD_SET_PROTOCOL: protocolo vigente en base
+};
+
+// Motivo de STATUS_ERROR (en el campo base de ResponseData)
+enum ErrorCode {
+  ERROR_NOT_READY = 0,        // Sin homing o motor ocupado (homing, calibración, benchmark)
+  ERROR_RNG_HEALTH = 1        // El RNG no supera las pruebas de salud: no se generan bases ni bits
+};
+
+// Causa de STATUS_STEP_LOSS (en el campo base de ResponseData). En bit va el
+// detalle: SG_RESULT para STEP_LOSS_STALL, desvío en pasos del flanco Hall para
+// STEP_LOSS_HALL y los bits de falla de DRV_STATUS para STEP_LOSS_DRIVER.
+enum StepLossCause {
+  STEP_LOSS_NONE = 0,
+  STEP_LOSS_STALL = 1,        // StallGuard2 del TMC2130 durante un movimiento
+  STEP_LOSS_HALL = 2,         // El sensor Hall pasó fuera de su posición esperada
+  STEP_LOSS_DRIVER = 3        // Falla del driver: sobretemperatura o cortocircuito
+};
+
+// Homing con offset calibrado (ver README de Alice/Bob)
+#define HOME_RECALIBRATE 1            // CMD_HOME: medir de nuevo el offset con la aproximación fina
+#define HOME_NO_REFERENCE 0x7FFFFFFF  // STATUS_HOME_COMPLETE.base: sin homing previo con el que comparar
+
+// Resultado de CMD_VERIFY_HOME (STATUS_HOME_VERIFIED, en el campo base)
+enum HomeVerifyResult {
+  VERIFY_OK = 0,              // Entrada del imán donde se esperaba: no hace falta homing
+  VERIFY_NO_REFERENCE = 1,    // Sin homing ni posición conservada de antes de un reinicio
+  VERIFY_BUSY = 2,            // Homing, calibración o benchmark en curso
+  VERIFY_MISMATCH = 3         // Entrada fuera de tolerancia o no encontrada
+};
+
+struct ResponseData {
+  uint8_t status;        // HOME_COMPLETE, READY, ERROR
+  uint32_t pulseNum;     // Número de pulso
+  int base;              // Base usada (Alice: 0-1, Bob: 0-1)
+  int bit;               // Bit enviado (solo Alice: 0-1)
+  float angle;           // Ángulo alcanzado
+  // Marcas de tiempo en micros() del nodo (solo STATUS_READY, 0 en el resto).
+  // El Central las convierte a su reloj con ClockSync para desglosar la latencia.
+  uint32_t rxMicros;         // Comando recibido (callback ESP-NOW)
+  uint32_t moveStartMicros;  // Inicio del movimiento
+  uint32_t moveEndMicros;    // Fin del movimiento
+  uint8_t protocol;          // Protocolo con el que se sortearon base y bit (solo STATUS_READY)
+} __attribute__((packed));
+
+// Respuesta a CMD_TIME_SYNC (intercambio de dos vías, estilo NTP):
+// t1 = envío en el Central, t2 = recepción en el nodo, t3 = respuesta del nodo.
+// El Central marca t4 al recibirla.
+struct TimeSyncResponse {
+  uint8_t status;        // STATUS_TIME_SYNC
+  uint32_t seq;          // Secuencia copiada del comando
+  uint32_t t1;           // micros() del Central copiado del comando
+  uint32_t t2;           // micros() del nodo al recibir
+  uint32_t t3;           // micros() del nodo al responder
+} __attribute__((packed));
+
+// Fragmento del buffer de traza en respuesta a CMD_TRACE_DUMP. Los eventos van
+// del más antiguo al más reciente; el Central los reordena con index/total.
+#define TRACE_CHUNK_EVENTS 24
+
+struct TraceChunk {
+  uint8_t status;        // STATUS_TRACE_CHUNK
+  uint16_t index;        // Posición del primer evento de este fragmento
+  uint16_t total;        // Eventos totales del volcado
+  uint8_t count;         // Eventos válidos en este fragmento
+  TraceEvent events[TRACE_CHUNK_EVENTS];
+} __attribute__((packed));
+
+// Celda de la matriz de transiciones en respuesta a CMD_TRANSITION_STATS (y al
+// terminar CMD_TRANSITION_BENCH): una por transición con movimientos, y al
+// final una con from = to = TRANSITION_REPORT_END y count = movimientos totales.
+#define TRANSITION_REPORT_END 0xFF
+
+struct TransitionStatsReport {
+  uint8_t status;        // STATUS_TRANSITION_STATS
+  uint8_t from;          // Índice en la tabla de ángulos del nodo
+  uint8_t to;
+  uint8_t angles;        // Ángulos en la tabla del nodo
+  int32_t fromAngle;     // Milésimas de grado
+  int32_t toAngle;
+  uint32_t count;        // Movimientos medidos
+  uint32_t meanUs;       // Tiempo de reloj del movimiento
+  uint32_t p99Us;
+  uint32_t maxUs;
+  uint16_t meanSteps;    // Pasos emitidos (incluye sobrepaso)
+  uint16_t maxSteps;
+} __attribute__((packed));
+
+// Estado del generador de bases/bits (respuesta a CMD_RNG_STATS). Pruebas de
+// salud continuas SP 800-90B: Repetition Count (rct) y Adaptive Proportion (apt).
+struct RngStatsReport {
+  uint8_t status;          // STATUS_RNG_STATS
+  uint8_t healthy;         // 1 = pruebas superadas
+  uint16_t longestRun;     // Racha más larga de bits iguales
+  uint16_t maxWindowCount; // Mayor cuenta del primer bit en una ventana de 1024
+  uint16_t rctFailures;
+  uint16_t aptFailures;
+  uint32_t testedBits;
+  uint32_t testedOnes;
+  uint32_t deliveredBits;  // Bits usados como base/bit
+  uint32_t deliveredOnes;
+  int32_t biasPpm;         // Sesgo de los bits entregados (unos - 0.5, en ppm)
+} __attribute__((packed));
+
+// Parámetros de movimiento de un nodo, editables sin reflashear desde la
+// interfaz web del Central. Los nodos los validan (BB84/lib/NodeParams), los
+// aplican con el motor parado y los guardan en NVS para los siguientes arranques.
+#define PARAMS_MAX_ANGLES 4
+
+struct MotionParams {
+  uint16_t currentMa;      // Corriente RMS del TMC2130 (mA)
+  uint32_t maxSpeed;       // pasos/s (movimientos sin perfil calibrado)
+  uint32_t acceleration;   // pasos/s²
+  uint16_t microsteps;     // Solo lectura: fijo en compilación (de él salen los pasos por vuelta)
+  uint8_t toff;            // Chopper SpreadCycle: tiempo de apagado (1-15)
+  uint8_t blankTime;       // Tiempo de blanking: 16, 24, 36 o 54 ciclos
+  uint8_t hysteresisStart; // 1-8
+  int8_t hysteresisEnd;    // -3 a 12 (hysteresisStart + hysteresisEnd <= 16)
+  uint8_t angleCount;      // Ángulos de la tabla: Alice 4 ([base][bit]), Bob 2 ([base])
+  int32_t angles[PARAMS_MAX_ANGLES];  // Milésimas de grado
+} __attribute__((packed));
+
+struct ParamsCommand {
+  uint8_t cmd;             // CMD_SET_PARAMS
+  MotionParams params;
+} __attribute__((packed));
+
+// Resultado de CMD_SET_PARAMS (ParamsReport.result)
+enum ParamsResult {
+  PARAMS_OK = 0,
+  PARAMS_INVALID = 1,      // Valor fuera de rango: nada aplicado, campo en ParamsReport.field
+  PARAMS_BUSY = 2,         // Motor en movimiento, homing, calibración o benchmark
+  PARAMS_NOT_SAVED = 3     // Aplicados pero no guardados en NVS
+};
+
+// Campo rechazado con PARAMS_INVALID
+enum ParamsField {
+  PARAM_NONE = 0,
+  PARAM_CURRENT = 1,
+  PARAM_SPEED = 2,
+  PARAM_ACCELERATION = 3,
+  PARAM_MICROSTEPS = 4,
+  PARAM_TOFF = 5,
+  PARAM_BLANK_TIME = 6,
+  PARAM_HYSTERESIS = 7,
+  PARAM_ANGLES = 8
+};
+
+struct ParamsReport {
+  uint8_t status;          // STATUS_PARAMS
+  uint8_t result;          // ParamsResult (PARAMS_OK en CMD_GET_PARAMS)
+  uint8_t field;           // ParamsField con PARAMS_INVALID
+  uint8_t stored;          // 1 = los valores vigentes están en NVS, 0 = por defecto del firmware
+  MotionParams params;     // Valores vigentes tras el comando
+} __attribute__((packed));
+
+// Resultado de CMD_FIND_LIMITS (LimitsReport.result)
+enum LimitsResult {
+  LIMITS_SAVED = 0,        // Confirmados y guardados como parámetros del nodo (NVS)
+  LIMITS_NOT_SAVED = 1,    // Confirmados y aplicados, pero no guardados en NVS
+  LIMITS_ABORTED = 2,      // CMD_HOME / CMD_ABORT / CMD_CALIBRATE_PROFILES: parámetros sin cambios
+  LIMITS_FAILED = 3,       // Homing fallido, ningún candidato superado o confirmación fallida
+  LIMITS_BUSY = 4          // Homing, calibración o benchmark en curso
+};
+
+// Fin de CMD_FIND_LIMITS: límites medidos y valores aplicados (límites × margen)
+struct LimitsReport {
+  uint8_t status;          // STATUS_LIMITS_DONE
+  uint8_t result;          // LimitsResult
+  uint16_t trials;         // Pruebas realizadas
+  uint32_t durationS;      // Duración de la búsqueda (s)
+  uint32_t speedLimit;     // Mayor velocidad superada (pasos/s, 0 = ninguna)
+  uint32_t accelerationLimit; // Mayor aceleración superada a esa velocidad (pasos/s²)
+  uint32_t maxSpeed;       // Valores vigentes al terminar
+  uint32_t acceleration;
+} __attribute__((packed));
+
+// Estado de CMD_SOAK (SoakReport.result)
+enum SoakResult {
+  SOAK_RUNNING = 0,        // Informe periódico, la prueba sigue
+  SOAK_DONE = 1,           // Duración completada (con o sin fallos: ver contadores)
+  SOAK_ABORTED = 2,        // CMD_HOME / CMD_ABORT / CMD_CALIBRATE_PROFILES o "soak stop" por serial
+  SOAK_FAILED = 3,         // Homing fallido: no se puede seguir
+  SOAK_BUSY = 4            // Homing, calibración, búsqueda de límites o benchmark en curso
+};
+
+// Informe de CMD_SOAK: periódico (SOAK_RUNNING) y al terminar
+struct SoakReport {
+  uint8_t status;          // STATUS_SOAK_REPORT
+  uint8_t result;          // SoakResult
+  uint16_t verifications;  // Pasadas de verificación por el imán
+  uint16_t verifyFailures; // Verificaciones fuera de tolerancia (re-homing)
+  uint16_t stepLosses;     // Detecciones de StepLossMonitor (stall, driver, Hall)
+  uint32_t elapsedMs;      // Tiempo transcurrido
+  uint32_t durationS;      // Duración pedida
+  uint32_t moves;          // Transiciones completadas
+  uint32_t meanMoveUs;     // Tiempo medio y máximo por transición
+  uint32_t maxMoveUs;
+  uint32_t driverFlags;    // Bits de DRV_STATUS vistos (OT, OTPW, S2GA, S2GB)
+} __attribute__((packed));
+
+// Los mensajes pueden llegar con relleno al final (benchmark de latencia con
+// distintos tamaños de payload), por eso los receptores solo exigen el tamaño mínimo.
+#define BB84_MAX_PAYLOAD 250
+
+#endif // BB84_PROTOCOL_H
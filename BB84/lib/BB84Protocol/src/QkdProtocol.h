@@ -0,0 +1,72 @@
+#ifndef QKD_PROTOCOL_H
+#define QKD_PROTOCOL_H
+
+#include <stdint.h>
+
+// ==============================================
+// Protocolos de preparación y medida
+// ==============================================
+// Qué estados prepara Alice, qué bases mide Bob, con qué probabilidad y cómo
+// se criba la clave, en una tabla compartida por los tres firmwares. El
+// Central elige el protocolo de cada sesión con CMD_SET_PROTOCOL; los nodos
+// sortean con él base y bit en prepareForNextPulse() y el Central criba cada
+// pulso con qkdSift() antes de publicarlo.
+//
+// Los estados son los de las tablas de ángulos (base * 2 + bit en Alice, base
+// en Bob), así que STATUS_READY y la web siguen hablando de base y bit de la
+// tabla; el bit de clave sale de la regla de cribado.
+//
+// El protocolo de seis estados necesita la base circular (lámina de cuarto de
+// onda) en Alice y en Bob; con solo láminas de media onda no se puede preparar
+// ni medir, así que no está en la tabla.
+
+enum QkdProtocolId : uint8_t {
+  QKD_BB84 = 0,
+  QKD_BB84_BIASED = 1,      // BB84 con bases sesgadas: más pulsos cribados
+  QKD_B92 = 2,
+  QKD_PROTOCOL_COUNT
+};
+
+enum QkdSiftRule : uint8_t {
+  SIFT_MATCHING_BASES = 0,  // Cuenta el pulso si coinciden las bases; clave = bit de Alice / detector de Bob
+  SIFT_B92 = 1              // Cuenta si Bob detecta el estado que excluye uno de los dos de Alice
+};
+
+#define QKD_WEIGHT_EVEN 128   // Base 0 con probabilidad 1/2: un solo bit del RNG
+
+struct QkdProtocolDef {
+  const char* name;
+  uint8_t baseWeight;       // Probabilidad de la base 0 en 1/256, igual en Alice y Bob
+  bool aliceChoosesBit;     // false: Alice prepara siempre el bit 0 de la base sorteada
+  QkdSiftRule sift;
+  float qberLimitPct;       // QBER por encima del cual la sesión no es segura
+};
+
+// El umbral de BB84 es el que ya usaba la interfaz web
+static const QkdProtocolDef qkdProtocols[QKD_PROTOCOL_COUNT] = {
+  {"BB84",         QKD_WEIGHT_EVEN, true,  SIFT_MATCHING_BASES, 15.0f},
+  {"BB84 sesgado", 192,             true,  SIFT_MATCHING_BASES, 15.0f},  // 75 % base +: criba 5/8 en vez de 1/2
+  {"B92",          QKD_WEIGHT_EVEN, false, SIFT_B92,            4.8f},   // Alice: H (bit 0) o D (bit 1)
+};
+
+// Criba de un pulso. bitBob es el bit que el Central asigna a Bob (detector
+// con más cuentas, empate al azar) y detector0/detector1 los conteos de la
+// FPGA. En B92 solo cuenta una detección inequívoca en el detector 1: Bob en
+// la base + ve V (Alice no mandó H, clave 1) o en la base x ve A (no mandó D,
+// clave 0); un empate no excluye nada. Devuelve false si el pulso no entra en
+// la clave.
+inline bool qkdSift(const QkdProtocolDef& protocol, int baseAlice, int bitAlice, int baseBob, int bitBob,
+                    uint32_t detector0, uint32_t detector1, uint8_t& keyAlice, uint8_t& keyBob) {
+  if (protocol.sift == SIFT_B92) {
+    if (detector1 <= detector0) return false;
+    keyAlice = baseAlice;
+    keyBob = 1 - baseBob;
+    return true;
+  }
+  if (baseAlice != baseBob) return false;
+  keyAlice = bitAlice;
+  keyBob = bitBob;
+  return true;
+}
+
+#endif // QKD_PROTOCOL_H
@@ -0,0 +1,37 @@
+#include "BB84Trace.h"
+
+TraceEvent traceRing[TRACE_CAPACITY];
+volatile uint32_t traceHead = 0;
+volatile bool traceEnabled = true;
+
+static const char* const TRACE_NAMES[TR_COUNT] = {
+  "espnow_rx",
+  "espnow_tx",
+  "cmd_dequeue",
+  "move",
+  "homing",
+  "homing_phase",
+  "uart_rx",
+  "web_publish",
+  "wait_motors",
+  "pulse"
+};
+
+const char* traceName(uint8_t id) {
+  return id < TR_COUNT ? TRACE_NAMES[id] : "unknown";
+}
+
+uint32_t traceCount() {
+  uint32_t head = traceHead;
+  return head < TRACE_CAPACITY ? head : TRACE_CAPACITY;
+}
+
+const TraceEvent& traceAt(uint32_t i) {
+  uint32_t head = traceHead;
+  uint32_t first = head < TRACE_CAPACITY ? 0 : head - TRACE_CAPACITY;
+  return traceRing[(first + i) & (TRACE_CAPACITY - 1)];
+}
+
+void traceClear() {
+  traceHead = 0;
+}
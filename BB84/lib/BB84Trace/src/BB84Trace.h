@@ -0,0 +1,103 @@
+#ifndef BB84_TRACE_H
+#define BB84_TRACE_H
+
+#include <stdint.h>
+#ifdef ARDUINO
+#include <esp_timer.h>
+#endif
+
+// ==============================================
+// Registro de eventos de traza (Central, Alice y Bob)
+// ==============================================
+// Cada firmware guarda sus eventos en un buffer circular de tamaño fijo. Registrar
+// un evento es reservar una casilla con un incremento atómico y escribir 10 bytes,
+// sin bloqueos ni Serial, así que puede usarse desde callbacks ESP-NOW e ISRs.
+//
+// El Central recoge los buffers de Alice y Bob (CMD_TRACE_DUMP) y los exporta
+// junto con el suyo en formato Chrome Trace Event (/trace.json, ver trace_export.cpp).
+//
+// Se desactiva en compilación con -DBB84_TRACE=0 (las macros no generan código).
+
+#ifndef BB84_TRACE
+#define BB84_TRACE 1
+#endif
+
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY 512   // Eventos en el buffer (potencia de 2)
+#endif
+
+#if (TRACE_CAPACITY & (TRACE_CAPACITY - 1)) != 0
+#error "TRACE_CAPACITY debe ser potencia de 2"
+#endif
+
+// Identificadores de evento (comunes a los tres firmwares)
+enum TraceId {
+  TR_ESPNOW_RX = 0,    // Mensaje ESP-NOW recibido (arg = comando/estado)
+  TR_ESPNOW_TX,        // Mensaje ESP-NOW enviado (arg = comando/estado)
+  TR_CMD_DEQUEUE,      // Comando retirado de la cola del loop (arg = comando)
+  TR_MOVE,             // Movimiento del motor (B/E, arg = pasos objetivo / posición final)
+  TR_HOMING,           // Rutina de homing completa (B/E)
+  TR_HOMING_PHASE,     // Cambio de fase del homing (arg = fase, 0 = abortado)
+  TR_UART_RX,          // Mensaje de la FPGA (arg = ID)
+  TR_WEB_PUBLISH,      // Envío de datos a la interfaz web (B/E)
+  TR_WAIT_MOTORS,      // Espera de STATUS_READY de ambos nodos (B/E)
+  TR_PULSE,            // Nuevo pulso del protocolo (arg = número de pulso)
+  TR_COUNT
+};
+
+enum TracePhase {
+  TRACE_PH_BEGIN = 'B',
+  TRACE_PH_END = 'E',
+  TRACE_PH_INSTANT = 'i'
+};
+
+struct TraceEvent {
+  uint32_t ts;           // micros() del firmware que registró el evento
+  uint32_t arg;          // Dato asociado
+  uint8_t id;            // TraceId
+  uint8_t phase;         // TracePhase
+} __attribute__((packed));
+
+// Buffer circular (definido en BB84Trace.cpp)
+extern TraceEvent traceRing[TRACE_CAPACITY];
+extern volatile uint32_t traceHead;      // Total de eventos registrados (no se reinicia al dar la vuelta)
+extern volatile bool traceEnabled;
+
+const char* traceName(uint8_t id);
+
+// Número de eventos disponibles y acceso del más antiguo (0) al más reciente
+uint32_t traceCount();
+const TraceEvent& traceAt(uint32_t i);
+void traceClear();
+
+// Misma base de tiempo que micros() en el core Arduino de ESP32 (válido en ISRs).
+// En el entorno native de las pruebas unitarias no hay reloj: marca 0
+static inline uint32_t traceMicros() {
+#ifdef ARDUINO
+  return (uint32_t)esp_timer_get_time();
+#else
+  return 0;
+#endif
+}
+
+static inline void traceRecord(uint8_t id, uint8_t phase, uint32_t arg) {
+  if (!traceEnabled) return;
+  uint32_t slot = __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED) & (TRACE_CAPACITY - 1);
+  TraceEvent& e = traceRing[slot];
+  e.ts = traceMicros();
+  e.arg = arg;
+  e.id = id;
+  e.phase = phase;
+}
+
+#if BB84_TRACE
+#define TRACE_BEGIN(id, arg)   traceRecord((id), TRACE_PH_BEGIN, (uint32_t)(arg))
+#define TRACE_END(id, arg)     traceRecord((id), TRACE_PH_END, (uint32_t)(arg))
+#define TRACE_INSTANT(id, arg) traceRecord((id), TRACE_PH_INSTANT, (uint32_t)(arg))
+#else
+#define TRACE_BEGIN(id, arg)   ((void)0)
+#define TRACE_END(id, arg)     ((void)0)
+#define TRACE_INSTANT(id, arg) ((void)0)
+#endif
+
+#endif // BB84_TRACE_H
@@ -0,0 +1,144 @@
+#include "ClockSync.h"
+#include <esp_now.h>
+
+void ClockSync::begin(const uint8_t* peerMac) {
+  mac = peerMac;
+  reset();
+}
+
+void ClockSync::reset() {
+  responseReady = false;
+  awaiting = false;
+  inBurst = false;
+  windowHead = 0;
+  windowCount = 0;
+  drift = 0.0;
+  lastDelay = 0;
+  lastResidual = 0;
+  nextBurstMs = millis();
+}
+
+void ClockSync::onResponse(const TimeSyncResponse& response, uint32_t t4) {
+  // Solo se acepta la respuesta al intercambio en curso (las tardías se descartan)
+  if (!awaiting || responseReady || response.seq != seq) return;
+  rxT1 = response.t1;
+  rxT2 = response.t2;
+  rxT3 = response.t3;
+  rxT4 = t4;
+  responseReady = true;
+}
+
+void ClockSync::sendRequest() {
+  seq++;
+  sentMicros = micros();
+  CommandData command = {CMD_TIME_SYNC, seq, sentMicros};
+  awaiting = true;
+  if (esp_now_send(mac, (uint8_t*)&command, sizeof(command)) != ESP_OK) {
+    awaiting = false;
+    burstDone++;
+  }
+}
+
+void ClockSync::loop() {
+  if (mac == nullptr) return;
+
+  if (awaiting) {
+    if (responseReady) {
+      processExchange(rxT1, rxT2, rxT3, rxT4);
+      responseReady = false;
+      awaiting = false;
+      burstDone++;
+    } else if (micros() - sentMicros > CLOCK_SYNC_TIMEOUT_US) {
+      awaiting = false;  // Intercambio perdido
+      burstDone++;
+    } else {
+      return;
+    }
+  }
+
+  if (inBurst) {
+    if (burstDone < CLOCK_SYNC_BURST) {
+      sendRequest();
+    } else {
+      finishBurst();
+    }
+  } else if ((int32_t)(millis() - nextBurstMs) >= 0) {
+    inBurst = true;
+    burstDone = 0;
+    burstValid = false;
+    sendRequest();
+  }
+}
+
+void ClockSync::processExchange(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) {
+  // Retardo de radio = ida y vuelta menos el tiempo que el nodo tardó en responder
+  int32_t rtt = (int32_t)(t4 - t1) - (int32_t)(t3 - t2);
+  if (rtt < 0) return;
+
+  if (!burstValid || (uint32_t)rtt < burstBest.delay) {
+    // Suponiendo trayectos simétricos: t2 = t1 + offset + rtt/2
+    burstBest.central = t1 + (t4 - t1) / 2;
+    burstBest.offset = t2 - t1 - (uint32_t)rtt / 2;
+    burstBest.delay = (uint32_t)rtt;
+    burstValid = true;
+  }
+}
+
+void ClockSync::finishBurst() {
+  inBurst = false;
+  nextBurstMs = millis() + CLOCK_SYNC_INTERVAL_MS;
+  if (!burstValid) return;
+
+  lastDelay = burstBest.delay;
+
+  if (windowCount > 0) {
+    // Comparar con la predicción del modelo: un salto grande indica que el
+    // nodo se reinició y su micros() volvió a empezar
+    int32_t predicted = (int32_t)offsetRef + (int32_t)(drift * (double)(int32_t)(burstBest.central - centralRef));
+    lastResidual = (int32_t)burstBest.offset - predicted;
+    if (abs(lastResidual) > CLOCK_SYNC_MAX_JUMP_US) {
+      windowHead = 0;
+      windowCount = 0;
+      drift = 0.0;
+    }
+  }
+
+  window[windowHead] = burstBest;
+  windowHead = (windowHead + 1) % CLOCK_SYNC_WINDOW;
+  if (windowCount < CLOCK_SYNC_WINDOW) windowCount++;
+  fit();
+}
+
+void ClockSync::fit() {
+  // Referencia = muestra más reciente; las demás se expresan como diferencias
+  // con signo respecto a ella para que el ajuste no dependa del desborde
+  const Sample& ref = window[(windowHead + CLOCK_SYNC_WINDOW - 1) % CLOCK_SYNC_WINDOW];
+
+  double sumX = 0, sumY = 0;
+  for (uint8_t i = 0; i < windowCount; i++) {
+    sumX += (int32_t)(window[i].central - ref.central);
+    sumY += (int32_t)(window[i].offset - ref.offset);
+  }
+  double meanX = sumX / windowCount;
+  double meanY = sumY / windowCount;
+
+  double sxx = 0, sxy = 0;
+  for (uint8_t i = 0; i < windowCount; i++) {
+    double dx = (int32_t)(window[i].central - ref.central) - meanX;
+    double dy = (int32_t)(window[i].offset - ref.offset) - meanY;
+    sxx += dx * dx;
+    sxy += dx * dy;
+  }
+  drift = (sxx > 0) ? sxy / sxx : 0.0;
+
+  // Offset estimado en el instante de referencia
+  centralRef = ref.central;
+  offsetRef = ref.offset + (uint32_t)(int32_t)lround(meanY - drift * meanX);
+}
+
+uint32_t ClockSync::toCentral(uint32_t nodeMicros) const {
+  // central = nodo - offset(central); una iteración basta (deriva ~1e-5)
+  uint32_t central = nodeMicros - offsetRef;
+  int32_t correction = (int32_t)lround(drift * (double)(int32_t)(central - centralRef));
+  return central - (uint32_t)correction;
+}
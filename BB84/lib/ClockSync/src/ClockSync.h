@@ -0,0 +1,94 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <Arduino.h>
+#include <BB84Protocol.h>
+
+// ==============================================
+// Sincronización de reloj Central <-> nodo por ESP-NOW
+// ==============================================
+// Intercambio de dos vías (t1..t4, ver TimeSyncResponse). Cada ráfaga de
+// CLOCK_SYNC_BURST intercambios conserva el de menor retardo, que es el menos
+// afectado por colas y reintentos de radio. Con las últimas
+// CLOCK_SYNC_WINDOW ráfagas se ajusta una recta offset(t) = a + b·t (mínimos
+// cuadrados), de modo que se corrige también la deriva entre cristales.
+//
+// El offset se define como reloj_nodo - reloj_Central; toda la aritmética es
+// módulo 2^32 para tolerar el desborde de micros() (~71 min).
+//
+// Uso (Central): una instancia por nodo, loop() desde el loop principal y
+// onResponse() desde el callback ESP-NOW. El modelo solo se modifica en loop(),
+// así que toCentral() puede llamarse sin bloqueo desde el mismo contexto.
+
+#define CLOCK_SYNC_BURST        16       // Intercambios por ráfaga
+#define CLOCK_SYNC_WINDOW       16       // Ráfagas usadas en el ajuste (~30 s)
+#define CLOCK_SYNC_INTERVAL_MS  2000     // Periodo entre ráfagas
+#define CLOCK_SYNC_TIMEOUT_US   20000    // Espera máxima por respuesta
+#define CLOCK_SYNC_MAX_JUMP_US  1000     // Residuo a partir del cual se reinicia el modelo (reinicio del nodo)
+
+class ClockSync {
+public:
+  void begin(const uint8_t* peerMac);
+
+  // Programa y procesa las ráfagas sin bloquear. Llamar desde loop().
+  void loop();
+
+  // Callback ESP-NOW: guarda el intercambio para procesarlo en loop()
+  void onResponse(const TimeSyncResponse& response, uint32_t t4);
+
+  // Fuerza una ráfaga inmediata (p. ej. al iniciar el protocolo)
+  void requestBurst() { nextBurstMs = millis(); }
+
+  // Descarta el modelo (el nodo se reinició o cambió de canal)
+  void reset();
+
+  bool isSynced() const { return windowCount > 0; }
+
+  // Convierte una marca micros() del nodo al reloj del Central
+  uint32_t toCentral(uint32_t nodeMicros) const;
+
+  int32_t offsetUs() const { return (int32_t)offsetRef; }
+  float driftPpm() const { return (float)(drift * 1e6); }
+  uint32_t lastDelayUs() const { return lastDelay; }   // Retardo de ida y vuelta de la última ráfaga
+  int32_t lastResidualUs() const { return lastResidual; }  // Error de predicción de la última ráfaga
+
+private:
+  struct Sample {
+    uint32_t central;  // Punto medio del intercambio en reloj del Central
+    uint32_t offset;   // reloj_nodo - reloj_Central (módulo 2^32)
+    uint32_t delay;    // Retardo de ida y vuelta sin el tiempo de respuesta del nodo
+  };
+
+  void sendRequest();
+  void processExchange(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+  void finishBurst();
+  void fit();
+
+  const uint8_t* mac = nullptr;
+
+  // Intercambio en curso (escrito por el callback ESP-NOW)
+  volatile bool responseReady = false;
+  volatile uint32_t rxT1 = 0, rxT2 = 0, rxT3 = 0, rxT4 = 0;
+  uint32_t seq = 0;
+  bool awaiting = false;
+  uint32_t sentMicros = 0;
+
+  // Ráfaga en curso
+  bool inBurst = false;
+  uint8_t burstDone = 0;
+  bool burstValid = false;
+  Sample burstBest = {0, 0, 0};
+  uint32_t nextBurstMs = 0;
+
+  // Ventana de ráfagas y modelo ajustado
+  Sample window[CLOCK_SYNC_WINDOW];
+  uint8_t windowHead = 0;
+  uint8_t windowCount = 0;
+  uint32_t centralRef = 0;
+  uint32_t offsetRef = 0;
+  double drift = 0.0;       // Pendiente del offset (µs/µs)
+  uint32_t lastDelay = 0;
+  int32_t lastResidual = 0;
+};
+
+#endif // CLOCK_SYNC_H
@@ -0,0 +1,48 @@
+#include "CommandQueue.h"
+#include <BB84Protocol.h>
+
+bool CommandQueue::push(const QueuedCommand& command) {
+  uint32_t h = head;  // Solo lo escribe este lado
+  uint32_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  if (h - t >= COMMAND_QUEUE_SIZE) {
+    overflowCount = overflowCount + 1;
+    return false;
+  }
+  slots[h & (COMMAND_QUEUE_SIZE - 1)] = command;
+  __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);  // Publicar después de escribir la casilla
+  return true;
+}
+
+static bool isPrepare(uint8_t cmd) {
+  return cmd == CMD_PREPARE_PULSE || cmd == CMD_PREPARE_REFERENCE;
+}
+
+// Un PREPARE (normal o de referencia) es redundante si detrás hay otro PREPARE o un ABORT
+bool CommandQueue::redundant(uint32_t index, uint32_t h) const {
+  if (!isPrepare(slots[index & (COMMAND_QUEUE_SIZE - 1)].cmd)) return false;
+  for (uint32_t i = index + 1; i != h; i++) {
+    uint8_t next = slots[i & (COMMAND_QUEUE_SIZE - 1)].cmd;
+    if (isPrepare(next) || next == CMD_ABORT) return true;
+  }
+  return false;
+}
+
+bool CommandQueue::pop(QueuedCommand& command) {
+  uint32_t t = tail;  // Solo lo escribe este lado
+  uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  while (t != h && redundant(t, h)) {
+    t++;
+    mergedCount++;
+  }
+  if (t == h) {
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+    return false;
+  }
+  command = slots[t & (COMMAND_QUEUE_SIZE - 1)];
+  __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);  // Liberar la casilla después de copiarla
+  return true;
+}
+
+uint32_t CommandQueue::size() const {
+  return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+}
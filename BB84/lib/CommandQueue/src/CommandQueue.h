@@ -0,0 +1,59 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ==============================================
+// Cola de comandos ESP-NOW -> loop (Alice y Bob)
+// ==============================================
+// Buffer circular de un productor (callback ESP-NOW) y un consumidor (loop()).
+// Cada lado escribe solo su índice, con orden acquire/release, así que los
+// comandos nunca se pisan ni se leen a medio escribir. Si la cola está llena el
+// comando se descarta y se cuenta en overflows().
+//
+// Política de vaciado: un CMD_PREPARE_PULSE o CMD_PREPARE_REFERENCE seguido en
+// la cola por otro de los dos o por un CMD_ABORT es redundante (el siguiente lo
+// reemplaza o lo cancela) y se descarta al retirarlo, contado en merged().
+
+#ifndef COMMAND_QUEUE_SIZE
+#define COMMAND_QUEUE_SIZE 16   // Comandos en cola (potencia de 2)
+#endif
+
+#if (COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE - 1)) != 0
+#error "COMMAND_QUEUE_SIZE debe ser potencia de 2"
+#endif
+
+struct QueuedCommand {
+  uint8_t cmd;
+  uint8_t len;        // Tamaño del mensaje recibido (la respuesta usa el mismo tamaño)
+  uint32_t pulseNum;
+  uint32_t rxMicros;  // Instante de recepción (se devuelve en STATUS_READY)
+  int32_t angle;      // Milésimas de grado: objetivo (CMD_MOVE_MANUAL), desplazamiento
+                      // (CMD_PREPARE_REFERENCE) o corrección (CMD_TRIM_ANGLE)
+  uint8_t index;      // Índice en la tabla de ángulos (CMD_PREPARE_REFERENCE)
+};
+
+class CommandQueue {
+public:
+  // Productor: false si la cola está llena (el comando se pierde y se cuenta)
+  bool push(const QueuedCommand& command);
+
+  // Consumidor: siguiente comando aplicando la política de vaciado
+  bool pop(QueuedCommand& command);
+
+  uint32_t overflows() const { return overflowCount; }
+  uint32_t merged() const { return mergedCount; }
+  uint32_t size() const;
+
+private:
+  bool redundant(uint32_t index, uint32_t head) const;
+
+  QueuedCommand slots[COMMAND_QUEUE_SIZE];
+  volatile uint32_t head = 0;           // Próxima posición a escribir (solo productor)
+  volatile uint32_t tail = 0;           // Próxima posición a leer (solo consumidor)
+  volatile uint32_t overflowCount = 0;  // Solo productor
+  uint32_t mergedCount = 0;             // Solo consumidor
+};
+
+#endif // COMMAND_QUEUE_H
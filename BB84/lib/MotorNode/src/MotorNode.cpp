@@ -0,0 +1,2288 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <SPI.h>
+#include <TMC2130Stepper.h>
+#include <AccelStepper.h>
+#include <math.h>
+#include <BB84Protocol.h>
+#include <QkdProtocol.h>
+#include <AsyncLog.h>
+#include <MotionEngine.h>
+#include <TransitionProfiles.h>
+#include <TransitionStats.h>
+#include <RandomBits.h>
+#include <StepLossMonitor.h>
+#include <NodeParams.h>
+#include <RampBench.h>
+#include <CommandQueue.h>
+#include <Preferences.h>
+#include "NodeRole.h"
+#include "MotorNode.h"
+
+// ==============================================
+// Firmware de nodo con motor (Alice y Bob)
+// ==============================================
+// Todo el firmware de Alice y Bob, especializado en compilación por el rol
+// (NodeRole.h, elegido en los build_flags de cada proyecto). El estado del
+// nodo y sus funciones son static de este archivo; el src/main.cpp de cada
+// proyecto solo llama a motorNodeSetup() y motorNodeLoop() (MotorNode.h).
+// Homing, movimiento, calibración y diagnósticos son comunes; cualquier
+// mejora llega a ambos.
+
+// Definición de las tablas de NodeRole.h (se indexan en tiempo de ejecución)
+constexpr int32_t AliceRole::defaultAngles[];
+constexpr int32_t BobRole::defaultAngles[];
+
+// ======================
+// CONFIGURACIÓN
+// ======================
+
+// --- PINOUT ---
+#define SPI_MOSI   6
+#define SPI_MISO   5
+#define SPI_SCLK   4
+#define SPI_CS     7
+
+#define ENABLE_PIN  3
+#define DIR_PIN     2
+#define STEP_PIN    1
+
+#define HALL_SENSOR_PIN 10  // Pin del sensor Hall para homing
+
+#define SM_RESOLUTION 200
+#define GEAR_RATIO 3.0
+#define MICROSTEPS 4        // Fijo en compilación: de él salen los pasos por vuelta
+
+// Pasos por vuelta de la lámina y conversión ángulo <-> pasos sin coma flotante
+// (el C3 no tiene FPU; ver lib/MotionEngine/src/StepAngle.h)
+constexpr uint32_t STEPS_PER_REV = STEPS_PER_REV_OF(SM_RESOLUTION, MICROSTEPS, GEAR_RATIO);
+typedef StepAngle<STEPS_PER_REV> Angle;
+
+// Periodo óptico de la lámina de media onda: girarla 90° rota la polarización
+// 180°, el mismo estado lineal. Cada ángulo se alcanza por su equivalente más
+// cercano (MotionEngine::moveToNearest), así que la posición solo se conoce
+// módulo este periodo. Usar 180000 si la lámina no se comporta igual cada 90°.
+#define OPTICAL_PERIOD_MDEG 90000
+#define APPROACH_DIR 1                  // Llegar siempre girando en sentido + (juego del engranaje); 0 = sin preferencia
+#define BACKLASH_OVERSHOOT_MDEG 1000    // Al llegar en sentido contrario: pasarse esto y volver
+
+static_assert((uint64_t)STEPS_PER_REV * OPTICAL_PERIOD_MDEG % MDEG_PER_REV == 0,
+              "El periodo óptico debe ser un número entero de pasos");
+
+// Motor parameters (por defecto: al arrancar se cargan los guardados en NVS
+// con CMD_SET_PARAMS, ver "Parámetros de movimiento en tiempo de ejecución")
+static int   stepperCurrent = 600;   // mA (incrementado para mejor torque)
+static int   stepperSpeed   = 4000;  // steps/s
+static int   stepperAcc     = 18000; // steps/s^2 (reducido de 25000 para estabilidad)
+
+// Chopper SpreadCycle del TMC2130 (reduce el trabado en movimientos rápidos)
+static int   chopperToff    = 4;     // Off time (duración apagado chopper) - balance velocidad/estabilidad
+static int   chopperBlank   = 24;    // Tiempo de blanking (reduce ruido)
+static int   chopperHstrt   = 3;     // Histéresis inicio
+static int   chopperHend    = 1;     // Histéresis fin
+
+// Detección de pérdida de pasos (ver BB84/lib/StepLossMonitor)
+#define STALL_THRESHOLD 8           // sgt del TMC2130: ajustar con SG_RESULT en cada montaje
+#define STALL_MIN_SPEED 1200        // pasos/s: por debajo StallGuard2 no es fiable
+#ifndef HALL_PASS_CHECK
+#define HALL_PASS_CHECK 1           // Comprobar la posición en cada paso por el imán (0 = solo StallGuard2)
+#endif
+#define HALL_TOLERANCE_STEPS 6
+
+// WiFi TX power (valores válidos: 8-84, donde 8=2dBm, 84=21dBm, unidad=0.25dBm)
+// Valores comunes: 52(13dBm), 78(19.5dBm), 84(21dBm - máxima potencia)
+static int   wifiTxPower = 34;  // ESP32-C3 Super Mini funciona mejor con potencia moderada
+
+// Canal WiFi/ESP-NOW - se sincronizará automáticamente con el Central
+const int ESP_NOW_INITIAL_CHANNEL = 1;  // Canal inicial para recibir configuración
+static int ESP_NOW_CHANNEL = ESP_NOW_INITIAL_CHANNEL;  // Canal actual (se actualizará automáticamente)
+static bool channelConfigured = false;  // Flag de sincronización de canal
+
+// MAC del ESP32 Central (se aprenderá automáticamente)
+static uint8_t centralMAC[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// Driver + stepper
+static TMC2130Stepper driver = TMC2130Stepper(ENABLE_PIN, DIR_PIN, STEP_PIN, SPI_CS);  // SPI por hardware (SPI.begin en setup)
+static AccelStepper stepper = AccelStepper(AccelStepper::DRIVER, STEP_PIN, DIR_PIN);
+static MotionEngine motion(stepper);  // Avanza el perfil desde un temporizador (ver lib/MotionEngine)
+static StepLossMonitor stepLoss(driver);  // DRV_STATUS/StallGuard2 y paso por el sensor Hall
+
+// ==============================================
+// ESTRUCTURAS ESP-NOW
+// ==============================================
+// Comandos (Command, CommandData) y respuestas (Status, ResponseData) definidos
+// en la librería compartida BB84Protocol (BB84/lib), común con el Central
+
+// Flag de registro del Central
+static bool centralRegistered = false;
+
+// ==============================================
+// Sistema de Cola de Comandos (evita bloqueo en callback)
+// ==============================================
+// El callback ESP-NOW encola y loop() retira (ver BB84/lib/CommandQueue)
+static CommandQueue commandQueue;
+static uint32_t reportedOverflows = 0;
+
+// Pulso cuyo STATUS_READY se envía al terminar el movimiento
+struct PulseContext {
+  uint32_t pulseNum;
+  uint8_t replyLen;
+  uint32_t rxMicros;
+};
+
+static PulseContext pendingPulse = {0, 0, 0};
+
+// Etiquetas de movimiento (MotionEvent::tag): tipo en el byte alto y, para los
+// pulsos, el número de pulso (24 bits, el mismo límite que usa el Central)
+#define MOVE_TAG_KIND_MASK   0xFF000000UL
+#define MOVE_TAG_PULSE_MASK  0x00FFFFFFUL
+#define MOVE_TAG_PULSE       0x01000000UL
+#define MOVE_TAG_MANUAL      0x02000000UL
+#define MOVE_TAG_HOMING      0x03000000UL
+#define MOVE_TAG_CALIBRATION 0x04000000UL
+#define MOVE_TAG_BENCH       0x05000000UL
+#define MOVE_TAG_SOAK        0x06000000UL
+
+// Flag de optimización: desactivar logging durante protocolo activo
+static bool protocolActive = false;
+
+// ==============================================
+// Variables Protocolo BB84
+// ==============================================
+// Tabla de ángulos del rol, [base * bitsPerBase + bit] en milésimas de grado.
+// Al arrancar, la de NodeRole; CMD_SET_PARAMS la cambia
+static int32_t angulosRotacion[NodeRole::angleCount];
+
+static int pulseBase = 0;
+static int pulseBit = 0;               // Siempre 0 si el rol no elige bit (Bob) o el protocolo no lo usa (B92)
+static volatile uint8_t sessionProtocol = QKD_BB84;  // CMD_SET_PROTOCOL (ver QkdProtocol.h)
+static int32_t currentTargetAngle = 0;  // Milésimas de grado
+static uint32_t currentPulseNum = 0;
+
+// Bases y bits aleatorios con pruebas de salud continuas
+static RandomBits rng;
+
+// Flancos del sensor Hall capturados en la ISR con la posición exacta del paso
+static volatile bool hallFallLatched = false;   // Entrada al imán girando en sentido +
+static volatile bool hallRiseLatched = false;   // Salida tras esa entrada
+static volatile long hallFallPosition = 0;
+static volatile long hallRisePosition = 0;
+static bool isHomed = false;
+
+// Fases del homing (máquina de estados avanzada desde loop())
+enum HomingState : uint8_t {
+  HOMING_IDLE,
+  HOMING_START,     // Esperando que el motor se detenga
+  HOMING_SEARCH,    // Pasada rápida: la ISR captura entrada y salida del imán
+  HOMING_CORRECT,   // Frenando hasta el 0 calculado (centro del imán + offset)
+  HOMING_LEAD,      // Medición del offset: hasta poco antes de la entrada del imán
+  HOMING_FINE,      // Medición del offset: aproximación fina en bloques de 3 pasos
+  HOMING_CENTER,    // Medición del offset: retroceso final de 2 pasos
+  HOMING_VERIFY_START,  // CMD_VERIFY_HOME: esperando que el motor se detenga
+  HOMING_VERIFY_LEAD,   // Hasta poco antes de la entrada del imán esperada
+  HOMING_VERIFY_PASS    // Pasada corta en sentido + por la entrada
+};
+
+static HomingState homingState = HOMING_IDLE;
+static long homingEdge = 0;  // Posición (coordenadas previas) donde el último homing fijó el 0
+
+// El 0 está a homeOffset pasos del centro del imán. El offset se mide una vez
+// con la aproximación fina de siempre (bloques de 3 pasos hasta el sensor y 2
+// atrás) y se guarda en NVS; desde entonces el homing es una sola pasada
+// rápida que frena directamente en el 0 calculado. CMD_HOME con pulseNum
+// HOME_RECALIBRATE vuelve a medirlo (p. ej. tras mover el imán o el sensor).
+#define HOMING_NVS "homing"
+#define HOMING_SPEED 4500               // Pasada rápida (pasos/s)
+#define HOMING_ACC 18000                // pasos/s² (reducida para estabilidad)
+#define HOMING_FINE_SPEED 3000          // Aproximación fina
+#define HOMING_FINE_LEAD_STEPS 30       // La aproximación fina empieza esto antes de la entrada
+#define HALL_MIN_WIDTH_STEPS 4          // Entrada y salida más juntas: ruido, se descarta
+#define HALL_MAX_WIDTH_STEPS (STEPS_PER_REV / 4)
+
+static long homeOffset = 0;
+static bool homeOffsetValid = false;
+static bool homingCalibrating = false;    // Esta pasada mide homeOffset
+static bool homingHadReference = false;   // Había homing antes: se informa el desvío del 0
+static long homingCenter = 0;             // Centro del imán (coordenadas de la pasada)
+static long homingWidth = 0;              // Ancho del imán medido (pasos)
+static long homingZero = 0;               // Posición donde queda el nuevo 0
+static uint32_t homingStartMs = 0;
+
+// Entrada del imán respecto del 0 en coordenadas sin reducir al periodo
+// (posición + motion.wrapOffset()), módulo una vuelta: el imán está en una
+// sola de las posiciones equivalentes.
+static long homeEdge = 0;
+
+// CMD_VERIFY_HOME: en vez de repetir el homing se pasa por la entrada del imán
+// más cercana y la ISR debe capturarla a ±HALL_TOLERANCE_STEPS de homeEdge
+#define VERIFY_LEAD_STEPS 40    // La pasada empieza esto antes de la entrada (más que el juego)
+static long verifyEdge = 0;            // Entrada esperada (coordenadas del motor)
+
+// Posición conservada en memoria RTC tras cada parada con homing válido.
+// Sobrevive a reinicios por software, watchdog o pánico, no a un corte de
+// alimentación (que además suelta el motor). Tras un reinicio el nodo no queda
+// con homing hasta que CMD_VERIFY_HOME lo confirma.
+#define HOME_SNAPSHOT_MAGIC 0xB84A5E01UL
+
+struct HomeSnapshot {
+  uint32_t magic;
+  int32_t position;      // Posición sin reducir (pasos) con el motor parado
+  int32_t edge;          // homeEdge
+  uint32_t check;
+};
+
+static RTC_NOINIT_ATTR HomeSnapshot homeSnapshot;
+static bool homeRestored = false;      // Posición recuperada de la memoria RTC, sin verificar
+static bool snapshotMoving = false;
+
+// ==============================================
+// Perfiles precalculados por transición
+// ==============================================
+// Un perfil por par (desde, hacia) de la tabla de ángulos, reproducido con
+// motion.playProfile(). Velocidad y aceleración de cada transición salen de
+// CMD_CALIBRATE_PROFILES y se guardan en NVS (por defecto stepperSpeed/stepperAcc).
+#define PROFILE_ANGLES NodeRole::angleCount
+#define PROFILES_NVS "profiles"
+
+static TransitionProfiles profiles;
+
+// Fases de la calibración (máquina de estados avanzada desde loop())
+enum CalibrationState : uint8_t {
+  CAL_IDLE,
+  CAL_HOMING,       // Homing de referencia o de verificación
+  CAL_TO_START,     // Yendo al ángulo de partida de la transición
+  CAL_FORWARD,      // Perfil en prueba (desde -> hacia)
+  CAL_BACK,         // Vuelta con el movimiento genérico
+  CAL_ABORTING      // Esperando a que termine el perfil en curso para reconstruir el pool
+};
+
+static CalibrationState calState = CAL_IDLE;
+
+// Fases de la búsqueda de límites (CMD_FIND_LIMITS, avanzada desde loop())
+enum LimitState : uint8_t {
+  LIM_IDLE,
+  LIM_HOMING,       // Homing de referencia o tras una prueba fallida
+  LIM_TRIAL,        // Idas y vueltas con el candidato
+  LIM_VERIFY        // Pasada por la entrada del imán (la de CMD_VERIFY_HOME)
+};
+
+static LimitState limState = LIM_IDLE;
+
+// Fases de la prueba de resistencia (CMD_SOAK o "soak" por serial)
+enum SoakState : uint8_t {
+  SOAK_IDLE,
+  SOAK_HOMING,      // Homing inicial o tras una verificación/pérdida de pasos
+  SOAK_MOVING,      // Transiciones aleatorias
+  SOAK_VERIFY       // Pasada por la entrada del imán
+};
+
+static SoakState soakState = SOAK_IDLE;
+
+// ==============================================
+// Matriz de coste de transiciones
+// ==============================================
+// Cada movimiento entre dos ángulos de la tabla (pulsos, manuales y
+// CMD_TRANSITION_BENCH) suma su tiempo de reloj y sus pasos a la celda
+// (desde, hacia). Se envía al Central con CMD_TRANSITION_STATS.
+#define TRANSITION_BENCH_MAX_ROUNDS 1000
+
+static TransitionStats transitionStats;
+static int8_t transitionFrom = -1;   // Celda del movimiento en curso (-1 = fuera de la tabla)
+static int8_t transitionTo = -1;
+
+static uint16_t benchLeft[PROFILE_ANGLES][PROFILE_ANGLES];  // Repeticiones pendientes por transición
+static uint32_t benchPending = 0;
+static bool benchRunning = false;
+
+// Homing, calibración, búsqueda de límites, benchmark o prueba de resistencia
+// en curso: el motor no atiende pulsos ni movimientos manuales
+static bool motionReserved() {
+    return homingState != HOMING_IDLE || calState != CAL_IDLE || limState != LIM_IDLE || benchRunning ||
+           soakState != SOAK_IDLE;
+}
+
+// ==============================================
+// FUNCIONES
+// ==============================================
+
+// ISR para sensor Hall (ambos flancos): solo girando en sentido + (sentido 0 =
+// desconocido con MOTION_STEP_HW=0). La salida solo cuenta tras una entrada.
+static void IRAM_ATTR hallISR() {
+    long position = motion.stepPosition();
+    int8_t dir = motion.stepDirection();
+    if (dir < 0) return;
+    if (digitalRead(HALL_SENSOR_PIN) == LOW) {
+        hallFallPosition = position;
+        hallFallLatched = true;
+        hallRiseLatched = false;
+        stepLoss.hallEdge(position, dir);
+    } else if (hallFallLatched && !hallRiseLatched) {
+        hallRisePosition = position;
+        hallRiseLatched = true;
+    }
+}
+
+// Convertir ángulo (milésimas de grado) a pasos
+static long angleToSteps(int32_t angle) {
+  return Angle::toSteps(angle);
+}
+
+// Obtener ángulo actual (milésimas de grado)
+static int32_t getCurrentAngle() {
+    return Angle::toMilliDeg(motion.position());
+}
+
+// Enviar respuesta al Central. Si padTo supera sizeof(ResponseData) se rellena con
+// ceros hasta ese tamaño (benchmark de latencia con distintos tamaños de payload)
+static esp_err_t sendResponse(const ResponseData& response, size_t padTo = 0) {
+    TRACE_INSTANT(TR_ESPNOW_TX, response.status);
+    if (padTo <= sizeof(ResponseData)) {
+        return esp_now_send(centralMAC, (const uint8_t*)&response, sizeof(response));
+    }
+    uint8_t buffer[BB84_MAX_PAYLOAD] = {0};
+    if (padTo > sizeof(buffer)) padTo = sizeof(buffer);
+    memcpy(buffer, &response, sizeof(response));
+    return esp_now_send(centralMAC, buffer, padTo);
+}
+
+// Enviar el buffer de traza al Central en fragmentos (CMD_TRACE_DUMP).
+// El registro se pausa mientras dura el volcado para que los índices no cambien.
+static void sendTraceDump() {
+    if (!centralRegistered) return;
+    traceEnabled = false;
+    
+    uint16_t total = traceCount();
+    uint16_t index = 0;
+    do {
+        TraceChunk chunk = {};
+        chunk.status = STATUS_TRACE_CHUNK;
+        chunk.index = index;
+        chunk.total = total;
+        while (chunk.count < TRACE_CHUNK_EVENTS && index < total) {
+            chunk.events[chunk.count++] = traceAt(index++);
+        }
+        esp_now_send(centralMAC, (uint8_t*)&chunk, sizeof(chunk));
+        delay(4);  // No saturar la cola de transmisión ESP-NOW
+    } while (index < total);
+    
+    traceEnabled = true;
+    LOG_I(NODE_TAG " Traza enviada: %u eventos", total);
+}
+
+// Ángulo de la tabla por índice (el de los perfiles y la matriz de transiciones)
+static int32_t tableAngle(uint8_t index) {
+    return angulosRotacion[index];
+}
+
+// Tabla de ángulos a pasos y perfiles con los parámetros guardados en NVS.
+// También se llama en marcha (CMD_SET_PARAMS, CMD_TRIM_ANGLE, fin de la
+// calibración de límites): el log es diferido
+static void setupProfiles() {
+    long steps[PROFILE_ANGLES];
+    for (int i = 0; i < PROFILE_ANGLES; i++) {
+        steps[i] = angleToSteps(tableAngle(i));
+    }
+    profiles.configure(steps, PROFILE_ANGLES, angleToSteps(OPTICAL_PERIOD_MDEG), APPROACH_DIR,
+                       angleToSteps(BACKLASH_OVERSHOOT_MDEG),
+                       ProfileParams{(uint32_t)stepperSpeed, (uint32_t)stepperAcc});
+    bool calibrated = profiles.load(PROFILES_NVS);
+    if (!profiles.build()) {
+        LOG_W(NODE_TAG " ⚠ Pool de perfiles lleno: algunas transiciones usan el movimiento genérico");
+    }
+    LOG_I(NODE_TAG " Perfiles %s: %lu pasos precalculados", calibrated ? "calibrados" : "por defecto",
+          (unsigned long)profiles.poolUsed());
+}
+
+// ==============================================
+// Parámetros de movimiento en tiempo de ejecución
+// ==============================================
+// Corriente, velocidad, aceleración, chopper y tabla de ángulos se ajustan
+// desde la interfaz web del Central sin reflashear (CMD_SET_PARAMS). Se
+// validan (BB84/lib/NodeParams), se aplican solo con el motor parado y se
+// guardan en NVS; al arrancar se cargan antes de configurar el driver. Los
+// micropasos son de solo lectura: de MICROSTEPS salen los pasos por vuelta.
+#define PARAMS_NVS "params"
+
+static bool paramsStored = false;      // Los valores vigentes están en NVS
+static MotionParams pendingParams;     // Último CMD_SET_PARAMS (lo escribe el callback ESP-NOW)
+static portMUX_TYPE paramsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static MotionParams currentParams() {
+    MotionParams params = {};
+    params.currentMa = stepperCurrent;
+    params.maxSpeed = stepperSpeed;
+    params.acceleration = stepperAcc;
+    params.microsteps = MICROSTEPS;
+    params.toff = chopperToff;
+    params.blankTime = chopperBlank;
+    params.hysteresisStart = chopperHstrt;
+    params.hysteresisEnd = chopperHend;
+    params.angleCount = PROFILE_ANGLES;
+    for (uint8_t i = 0; i < PROFILE_ANGLES; i++) {
+        params.angles[i] = tableAngle(i);
+    }
+    return params;
+}
+
+// Copiar parámetros ya validados a las variables del motor y la tabla
+static void setParamValues(const MotionParams& params) {
+    stepperCurrent = params.currentMa;
+    stepperSpeed = params.maxSpeed;
+    stepperAcc = params.acceleration;
+    chopperToff = params.toff;
+    chopperBlank = params.blankTime;
+    chopperHstrt = params.hysteresisStart;
+    chopperHend = params.hysteresisEnd;
+    for (uint8_t i = 0; i < PROFILE_ANGLES; i++) {
+        angulosRotacion[i] = params.angles[i];
+    }
+}
+
+// Corriente y chopper del TMC2130 (en setup y tras CMD_SET_PARAMS)
+static void configureDriver() {
+    driver.rms_current(stepperCurrent);
+    driver.toff(chopperToff);
+    driver.blank_time(chopperBlank);
+    driver.hysteresis_start(chopperHstrt);
+    driver.hysteresis_end(chopperHend);
+}
+
+static void loadParams() {
+    MotionParams params;
+    if (!paramsLoad(PARAMS_NVS, params)) return;
+    ParamsField field = paramsValidate(params, PROFILE_ANGLES, MICROSTEPS, OPTICAL_PERIOD_MDEG);
+    if (field != PARAM_NONE) {
+        Serial.printf(NODE_TAG " ⚠ Parámetros en NVS inválidos (%s): se usan los del firmware\n", paramsFieldName(field));
+        return;
+    }
+    setParamValues(params);
+    paramsStored = true;
+    Serial.printf(NODE_TAG " Parámetros de NVS: %d mA, %d pasos/s, %d pasos/s²\n", stepperCurrent, stepperSpeed, stepperAcc);
+}
+
+static void sendParams(uint8_t result, uint8_t field) {
+    if (!centralRegistered) return;
+    ParamsReport report = {STATUS_PARAMS, result, field, (uint8_t)paramsStored, currentParams()};
+    esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+}
+
+// CMD_SET_PARAMS: todo o nada. Se rechaza con el motor en uso porque
+// reconstruir los perfiles pisa el pool que puede estar reproduciéndose.
+static void setParams() {
+    MotionParams params;
+    portENTER_CRITICAL(&paramsMux);
+    params = pendingParams;
+    portEXIT_CRITICAL(&paramsMux);
+    
+    ParamsField field = paramsValidate(params, PROFILE_ANGLES, MICROSTEPS, OPTICAL_PERIOD_MDEG);
+    if (field != PARAM_NONE) {
+        LOG_W(NODE_TAG " ⚠ Parámetros rechazados: %s fuera de rango", paramsFieldName(field));
+        sendParams(PARAMS_INVALID, field);
+        return;
+    }
+    if (motionReserved() || motion.busy()) {
+        LOG_W(NODE_TAG " ⚠ Parámetros rechazados: motor ocupado");
+        sendParams(PARAMS_BUSY, PARAM_NONE);
+        return;
+    }
+    
+    bool anglesChanged = false;
+    for (uint8_t i = 0; i < PROFILE_ANGLES; i++) {
+        if (params.angles[i] != tableAngle(i)) anglesChanged = true;
+    }
+    setParamValues(params);
+    configureDriver();
+    motion.setSpeed(stepperSpeed, stepperAcc);
+    setupProfiles();  // Transiciones sin calibrar: nueva velocidad; con ángulos nuevos, nuevos recorridos
+    if (anglesChanged) transitionStats.reset();  // Las celdas eran de los ángulos anteriores
+    
+    paramsStored = paramsSave(PARAMS_NVS, params);
+    LOG_I(NODE_TAG " Parámetros aplicados%s: %d mA, %d pasos/s, %d pasos/s², chopper %d/%d/%d/%d",
+          paramsStored ? " y guardados" : " (sin guardar en NVS)", stepperCurrent, stepperSpeed, stepperAcc,
+          chopperToff, chopperBlank, chopperHstrt, chopperHend);
+    sendParams(paramsStored ? PARAMS_OK : PARAMS_NOT_SAVED, PARAM_NONE);
+}
+
+// CMD_TRIM_ANGLE: corrección pequeña de un ángulo de la tabla en pleno
+// protocolo (compensación de deriva del Central, ver BB84/Central/src/drift.cpp).
+// Se valida y aplica como CMD_SET_PARAMS pero no se guarda en NVS: la deriva
+// es de la sesión y al reiniciar vuelve la tabla calibrada. La matriz de
+// transiciones se conserva: los recorridos cambian en décimas de grado.
+static void trimAngle(uint8_t index, int32_t delta) {
+    if (index >= PROFILE_ANGLES) {
+        sendParams(PARAMS_INVALID, PARAM_ANGLES);
+        return;
+    }
+    MotionParams params = currentParams();
+    int32_t angle = (params.angles[index] + delta) % MDEG_PER_REV;
+    if (angle < 0) angle += MDEG_PER_REV;
+    params.angles[index] = angle;
+    
+    ParamsField field = paramsValidate(params, PROFILE_ANGLES, MICROSTEPS, OPTICAL_PERIOD_MDEG);
+    if (field != PARAM_NONE) {
+        LOG_W(NODE_TAG " ⚠ Corrección del ángulo %u rechazada: %s fuera de rango", index, paramsFieldName(field));
+        sendParams(PARAMS_INVALID, field);
+        return;
+    }
+    if (motionReserved() || motion.busy()) {
+        LOG_W(NODE_TAG " ⚠ Corrección del ángulo %u rechazada: motor ocupado", index);
+        sendParams(PARAMS_BUSY, PARAM_NONE);
+        return;
+    }
+    
+    angulosRotacion[index] = angle;
+    setupProfiles();
+    paramsStored = false;  // La tabla vigente ya no es la de NVS
+    LOG_I(NODE_TAG " Ángulo %u corregido %+.3f° -> %.3f° (sin guardar en NVS)", index, mdegToDeg(delta),
+          mdegToDeg(angle));
+    sendParams(PARAMS_NOT_SAVED, PARAM_NONE);
+}
+
+// Fin de un movimiento (definida más abajo, la usa también el benchmark)
+static void onMotionDone(const MotionEvent& event);
+
+#ifdef BB84_BENCH
+// ==============================================
+// Benchmark de latencia ESP-NOW (env:bench): motor simulado
+// ==============================================
+// El homing y los movimientos terminan al instante para que el Central mida
+// solo el intercambio CMD_PREPARE_PULSE -> STATUS_READY por radio.
+static void startHoming(bool recalibrate = false) {
+    LOG_I(NODE_TAG " Homing simulado (benchmark)");
+    motion.setPosition(0);
+    isHomed = true;
+    
+    if (centralRegistered) {
+        ResponseData response = {STATUS_HOME_COMPLETE, 0, HOME_NO_REFERENCE, 0, 0.0};
+        sendResponse(response);
+    }
+}
+
+static void homingUpdate() {}
+static void abortHoming() {}
+static void loadHomeOffset() {}
+static void restoreHomeSnapshot() {}
+static void homeSnapshotUpdate() {}
+
+static void startVerifyHome() {
+    if (centralRegistered) {
+        ResponseData response = {STATUS_HOME_VERIFIED, 0, isHomed ? VERIFY_OK : VERIFY_NO_REFERENCE, 0, 0.0};
+        sendResponse(response);
+    }
+}
+
+// Sin motor real no hay nada que calibrar
+static void startCalibration() {
+    if (centralRegistered) {
+        ResponseData response = {STATUS_CALIBRATION_DONE, 0, 0, 0, 0.0};
+        sendResponse(response);
+    }
+}
+
+static void calibrationUpdate() {}
+static void abortCalibration() {}
+
+// Sin motor real no hay límites que medir
+static void startLimitFinder() {
+    if (centralRegistered) {
+        LimitsReport report = {STATUS_LIMITS_DONE, LIMITS_FAILED, 0, 0, 0, 0,
+                               (uint32_t)stepperSpeed, (uint32_t)stepperAcc};
+        esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+    }
+}
+
+static void limitUpdate() {}
+static void abortLimits() {}
+
+// Sin motor real la prueba de resistencia no tiene sentido
+static void startSoak(uint32_t seconds) {
+    LOG_W(NODE_TAG " Prueba de resistencia no disponible en modo benchmark");
+    if (centralRegistered) {
+        SoakReport report = {STATUS_SOAK_REPORT, SOAK_FAILED, 0, 0, 0, 0, seconds, 0, 0, 0, 0};
+        esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+    }
+}
+
+static void soakUpdate() {}
+static void soakOnMove(const MotionEvent& event) {}
+static void abortSoak() {}
+static void stepLossUpdate() {}
+
+static void startMove(int32_t targetAngle, uint32_t tag) {
+    long steps = angleToSteps(targetAngle);
+    TRACE_BEGIN(TR_MOVE, steps);
+    motion.setPosition(steps);  // La posición sigue al objetivo (benchmark de transiciones)
+    transitionFrom = -1;        // Sin motor no hay coste que medir
+    uint32_t now = micros();
+    MotionEvent event = {tag, MOTION_DONE, steps, now, now, 0};
+    onMotionDone(event);
+}
+#else
+// ==============================================
+// Homing no bloqueante
+// ==============================================
+// Cada fase lanza un movimiento en el motor de movimiento y homingUpdate()
+// (llamado desde loop()) avanza a la siguiente cuando termina, así los
+// comandos ESP-NOW se siguen atendiendo durante todo el homing.
+
+static long homingStepsPerRev() {
+    return STEPS_PER_REV;
+}
+
+static void loadHomeOffset() {
+    Preferences prefs;
+    if (!prefs.begin(HOMING_NVS, true)) return;
+    int32_t stored = prefs.getInt("offset", HOME_NO_REFERENCE);
+    prefs.end();
+    homeOffsetValid = stored != HOME_NO_REFERENCE;
+    if (homeOffsetValid) homeOffset = stored;
+}
+
+static bool saveHomeOffset() {
+    Preferences prefs;
+    if (!prefs.begin(HOMING_NVS, false)) return false;
+    bool ok = prefs.putInt("offset", (int32_t)homeOffset) == sizeof(int32_t);
+    prefs.end();
+    return ok;
+}
+
+static uint32_t snapshotCheck(const HomeSnapshot& snap) {
+    return ~(snap.magic ^ (uint32_t)snap.position ^ ((uint32_t)snap.edge << 1));
+}
+
+static void saveHomeSnapshot(long position) {
+    homeSnapshot.magic = HOME_SNAPSHOT_MAGIC;
+    homeSnapshot.position = (int32_t)position;
+    homeSnapshot.edge = (int32_t)homeEdge;
+    homeSnapshot.check = snapshotCheck(homeSnapshot);
+}
+
+static void clearHomeSnapshot() {
+    homeSnapshot.magic = 0;
+}
+
+// En setup(), tras motion.begin(): recuperar la posición de antes del reinicio
+static void restoreHomeSnapshot() {
+    if (homeSnapshot.magic != HOME_SNAPSHOT_MAGIC || homeSnapshot.check != snapshotCheck(homeSnapshot)) return;
+    motion.setPosition(homeSnapshot.position);
+    homeEdge = homeSnapshot.edge;
+    homeRestored = true;
+#if HALL_PASS_CHECK
+    stepLoss.setHallCheck(angleToSteps(OPTICAL_PERIOD_MDEG), homeEdge, HALL_TOLERANCE_STEPS);
+#endif
+    Serial.printf(NODE_TAG " Posición recuperada tras reinicio: %ld pasos (pendiente de CMD_VERIFY_HOME)\n",
+                  (long)homeSnapshot.position);
+}
+
+// Llamada desde loop(): la posición se conserva en cada parada con homing
+// válido y se invalida mientras el motor gira
+static void homeSnapshotUpdate() {
+    bool moving = motion.busy();
+    if (moving == snapshotMoving) return;
+    snapshotMoving = moving;
+    if (moving) {
+        clearHomeSnapshot();
+    } else if (isHomed && homingState == HOMING_IDLE) {
+        saveHomeSnapshot(motion.position() + motion.wrapOffset());
+    }
+}
+
+static void finishHoming(bool completed) {
+    detachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN));
+    homingState = HOMING_IDLE;
+    motion.setSpeed(stepperSpeed, stepperAcc);  // Restaurar velocidad normal
+    TRACE_END(TR_HOMING, completed ? 1 : 0);
+#if HALL_PASS_CHECK
+    // Fuera del homing el imán sigue vigilado: cada paso en sentido + debe caer en el 0
+    if (completed) attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, CHANGE);
+#endif
+}
+
+// Primera posición target + k·step a la que se llega frenando desde la pasada
+// en curso, sin invertir el sentido
+static long homingReachable(long target, long step) {
+    long minimum = motion.stepPosition() + (long)HOMING_SPEED * HOMING_SPEED / (2L * HOMING_ACC) + 1;
+    if (target < minimum) target += ((minimum - target + step - 1) / step) * step;
+    return target;
+}
+
+// Pasada rápida: hasta 3 vueltas, la ISR captura entrada y salida del imán.
+// Si arranca dentro del imán, esa primera salida se ignora.
+static void startHomingSearch() {
+    hallFallLatched = false;
+    hallRiseLatched = false;
+    attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, CHANGE);
+    TRACE_INSTANT(TR_HOMING_PHASE, 1);
+    motion.moveTo(motion.position() + homingStepsPerRev() * 3, MOVE_TAG_HOMING);
+    homingState = HOMING_SEARCH;
+}
+
+// Inicia el homing. Si el motor se estaba moviendo, primero se detiene.
+// Sin offset en NVS (o con recalibrate) se mide con la aproximación fina.
+static void startHoming(bool recalibrate = false) {
+    LOG_I(NODE_TAG " Iniciando homing...");
+    detachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN));  // También la vigilancia del paso por el imán
+    if (homingState != HOMING_IDLE) {
+        TRACE_END(TR_HOMING, 0);
+    }
+    TRACE_BEGIN(TR_HOMING, 0);
+    
+    homingHadReference = isHomed;
+    homingCalibrating = recalibrate || !homeOffsetValid;
+    homeRestored = false;
+    clearHomeSnapshot();
+    homingStartMs = millis();
+    isHomed = false;
+    pinMode(HALL_SENSOR_PIN, INPUT);
+    motion.stop();
+    homingState = HOMING_START;
+}
+
+// Entrada y salida capturadas: el 0 (o el inicio de la medición del offset)
+// se fija reprogramando el destino de la pasada, sin detenerla
+static void homingPassDone() {
+    long fall = hallFallPosition;
+    homingWidth = hallRisePosition - fall;
+    homingCenter = fall + homingWidth / 2;
+    TRACE_INSTANT(TR_HOMING_PHASE, 2);
+    
+    if (homingCalibrating) {
+        // Una vuelta más hasta poco antes de la entrada, como el homing original
+        LOG_I(NODE_TAG " Midiendo offset del homing (imán: %ld pasos)...", homingWidth);
+        motion.moveTo(homingReachable(fall - HOMING_FINE_LEAD_STEPS, homingStepsPerRev()), MOVE_TAG_HOMING);
+        homingState = HOMING_LEAD;
+        return;
+    }
+    
+    // El 0 se conoce módulo el periodo óptico: vale el primer equivalente por delante
+    homingZero = homingReachable(homingCenter + homeOffset, angleToSteps(OPTICAL_PERIOD_MDEG));
+    motion.moveTo(homingZero, MOVE_TAG_HOMING);
+    homingState = HOMING_CORRECT;
+}
+
+// Posición 0 establecida en la posición actual
+static void completeHoming() {
+    long period = angleToSteps(OPTICAL_PERIOD_MDEG);
+    long deviation = wrapSteps(homingZero, period);  // Desvío respecto del 0 anterior
+    if (deviation > period / 2) deviation -= period;
+    
+    homingEdge = motion.position();
+    motion.setPosition(0);
+    isHomed = true;
+    homeRestored = false;
+    homeEdge = wrapSteps(hallFallPosition - homingZero, homingStepsPerRev());
+    saveHomeSnapshot(0);
+#if HALL_PASS_CHECK
+    stepLoss.setHallCheck(period, homeEdge, HALL_TOLERANCE_STEPS);
+#endif
+    finishHoming(true);
+    
+    uint32_t elapsed = millis() - homingStartMs;
+    if (homingHadReference) {
+        LOG_I(NODE_TAG " Homing completado en %lu ms - imán %ld pasos, desvío %+ld pasos", elapsed, homingWidth, deviation);
+    } else {
+        LOG_I(NODE_TAG " Homing completado en %lu ms - imán %ld pasos", elapsed, homingWidth);
+    }
+    
+    // Notificar al ESP32 central vía ESP-NOW (la calibración y la búsqueda de
+    // límites usan sus propios homings)
+    if (centralRegistered && calState == CAL_IDLE && limState == LIM_IDLE) {
+        ResponseData response = {STATUS_HOME_COMPLETE, elapsed, homingHadReference ? (int)deviation : HOME_NO_REFERENCE,
+                                 (int)homingWidth, 0.0};
+        sendResponse(response);
+        LOG_I(NODE_TAG " HOME_COMPLETE");
+    }
+}
+
+static void sendHomeVerified(HomeVerifyResult result, long deviation) {
+    if (!centralRegistered) return;
+    ResponseData response = {STATUS_HOME_VERIFIED, (uint32_t)(millis() - homingStartMs), result, (int)deviation, 0.0};
+    sendResponse(response);
+}
+
+// Pasada corta por la entrada del imán esperada (CMD_VERIFY_HOME y pruebas
+// de la búsqueda de límites); primero se detiene el motor
+static void beginVerifyPass() {
+    TRACE_BEGIN(TR_HOMING, 0);
+    pinMode(HALL_SENSOR_PIN, INPUT);
+    motion.stop();
+    homingState = HOMING_VERIFY_START;
+}
+
+// CMD_VERIFY_HOME: sin homing (ni posición recuperada) u ocupado se responde
+// al momento
+static void startVerifyHome() {
+    homingStartMs = millis();
+    if (!isHomed && !homeRestored) {
+        sendHomeVerified(VERIFY_NO_REFERENCE, 0);
+        return;
+    }
+    if (motionReserved()) {
+        sendHomeVerified(VERIFY_BUSY, 0);
+        return;
+    }
+    LOG_I(NODE_TAG " Verificando homing...");
+    beginVerifyPass();
+}
+
+static void finishVerifyHome(HomeVerifyResult result, long deviation) {
+    bool ok = result == VERIFY_OK;
+    finishHoming(ok);
+    isHomed = ok;
+    homeRestored = false;
+    if (ok) {
+        saveHomeSnapshot(motion.position() + motion.wrapOffset());
+        LOG_I(NODE_TAG " Homing verificado en %lu ms (desvío %+ld pasos)", millis() - homingStartMs, deviation);
+    } else {
+        clearHomeSnapshot();
+        LOG_W(NODE_TAG " Verificación de homing fallida (desvío %+ld pasos): hace falta CMD_HOME", deviation);
+    }
+    if (limState == LIM_IDLE) sendHomeVerified(result, deviation);  // La búsqueda de límites lee isHomed
+}
+
+static void homingUpdate() {
+    if (homingState == HOMING_IDLE) return;
+    
+    // Pasada: el único estado que reacciona antes de terminar el movimiento
+    if (homingState == HOMING_SEARCH) {
+        if (hallRiseLatched) {
+            long width = hallRisePosition - hallFallPosition;
+            if (width >= HALL_MIN_WIDTH_STEPS && width <= HALL_MAX_WIDTH_STEPS) {
+                homingPassDone();
+                return;
+            }
+            hallFallLatched = false;  // Ruido: esperar la próxima entrada
+            hallRiseLatched = false;
+        }
+        if (!motion.busy()) {
+            LOG_E(NODE_TAG " ERROR: Sensor no detectado en 3 vueltas");
+            finishHoming(false);
+        }
+        return;
+    }
+    
+    if (motion.busy()) return;  // Esperar a que termine el movimiento de la fase
+    
+    switch (homingState) {
+        case HOMING_START:
+            motion.setSpeed(HOMING_SPEED, HOMING_ACC);
+            startHomingSearch();
+            break;
+            
+        case HOMING_CORRECT:
+            completeHoming();
+            break;
+            
+        case HOMING_LEAD:
+            // Aproximación fina: velocidad moderada para precisión sin ser excesivamente lento
+            TRACE_INSTANT(TR_HOMING_PHASE, 3);
+            motion.setSpeed(HOMING_FINE_SPEED, HOMING_ACC);
+            homingState = HOMING_FINE;  // Primer bloque en la siguiente llamada
+            break;
+            
+        case HOMING_FINE:
+            // Avanzar en bloques de 3 pasos (más eficiente que 1 paso) hasta activar sensor
+            if (digitalRead(HALL_SENSOR_PIN) == HIGH) {
+                motion.moveTo(motion.position() + 3, MOVE_TAG_HOMING);
+            } else {
+                // Ajuste fino final: retroceder 2 pasos para centrar mejor
+                motion.moveTo(motion.position() - 2, MOVE_TAG_HOMING);
+                homingState = HOMING_CENTER;
+            }
+            break;
+            
+        case HOMING_VERIFY_START: {
+            // Entrada del imán más cercana (módulo una vuelta) a la posición actual
+            long rev = homingStepsPerRev();
+            long position = motion.position();
+            long offset = wrapSteps(homeEdge - motion.wrapOffset() - VERIFY_LEAD_STEPS - position, rev);
+            if (offset > rev / 2) offset -= rev;
+            verifyEdge = position + offset + VERIFY_LEAD_STEPS;
+            motion.setSpeed(HOMING_SPEED, HOMING_ACC);
+            motion.moveTo(verifyEdge - VERIFY_LEAD_STEPS, MOVE_TAG_HOMING);
+            homingState = HOMING_VERIFY_LEAD;
+            break;
+        }
+            
+        case HOMING_VERIFY_LEAD:
+            // Antes de la entrada el sensor no puede estar activado
+            if (digitalRead(HALL_SENSOR_PIN) == LOW) {
+                finishVerifyHome(VERIFY_MISMATCH, 0);
+                break;
+            }
+            hallFallLatched = false;
+            hallRiseLatched = false;
+            attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, CHANGE);
+            motion.setSpeed(HOMING_FINE_SPEED, HOMING_ACC);
+            motion.moveTo(verifyEdge + VERIFY_LEAD_STEPS, MOVE_TAG_HOMING);
+            homingState = HOMING_VERIFY_PASS;
+            break;
+            
+        case HOMING_VERIFY_PASS: {
+            long deviation = hallFallLatched ? hallFallPosition - verifyEdge : 0;
+            bool ok = hallFallLatched && labs(deviation) <= HALL_TOLERANCE_STEPS;
+            finishVerifyHome(ok ? VERIFY_OK : VERIFY_MISMATCH, deviation);
+            break;
+        }
+            
+        case HOMING_CENTER: {
+            // El imán de la pasada está una vuelta por detrás
+            homingZero = motion.position();
+            homeOffset = homingZero - (homingCenter + homingStepsPerRev());
+            homeOffsetValid = true;
+            bool saved = saveHomeOffset();
+            LOG_I(NODE_TAG " Offset del homing: %ld pasos desde el centro del imán%s", homeOffset,
+                  saved ? " (guardado)" : " (sin guardar)");
+            completeHoming();
+            break;
+        }
+            
+        default:
+            break;
+    }
+}
+
+// CMD_ABORT durante el homing (el motor ya se detuvo desde el callback)
+static void abortHoming() {
+    if (homingState == HOMING_IDLE) return;
+    LOG_W(NODE_TAG " Homing abortado");
+    finishHoming(false);
+}
+
+static const char* stepLossName(StepLossCause cause) {
+    switch (cause) {
+        case STEP_LOSS_STALL:  return "StallGuard2";
+        case STEP_LOSS_HALL:   return "sensor Hall";
+        case STEP_LOSS_DRIVER: return "falla del driver";
+        default:               return "?";
+    }
+}
+
+static void abortTransitionBench();
+static bool limitStepLoss(StepLossCause cause, int32_t detail);
+static void soakStepLoss();
+
+// Vigilancia de pérdida de pasos (llamada desde loop()). Solo con un homing
+// válido y fuera del homing y la calibración, que pierde pasos a propósito al
+// probar candidatos. Con una pérdida se avisa al Central y se repite el homing
+// sin esperar a CMD_HOME: el pulso en curso queda sin READY.
+static void stepLossUpdate() {
+    bool wanted = isHomed && homingState == HOMING_IDLE && calState == CAL_IDLE;
+    if (wanted != stepLoss.armed()) stepLoss.arm(wanted);
+    
+    int32_t detail = 0;
+    StepLossCause cause = stepLoss.poll(motion.busy(), detail);
+    if (cause == STEP_LOSS_NONE) return;
+    if (limitStepLoss(cause, detail)) return;  // Prueba de la búsqueda de límites: falla sin homing automático
+    soakStepLoss();
+    
+    LOG_E(NODE_TAG " ⚠ Pérdida de pasos (%s, %ld): homing automático", stepLossName(cause), (long)detail);
+    if (centralRegistered) {
+        ResponseData response = {STATUS_STEP_LOSS, currentPulseNum, cause, detail, mdegToDeg(getCurrentAngle())};
+        sendResponse(response);
+    }
+    abortTransitionBench();
+    startHoming();
+}
+
+// Lanzar un movimiento al equivalente óptico más cercano (la posición se
+// conoce módulo OPTICAL_PERIOD_MDEG); el fin llega como MotionEvent en loop()
+static void startMove(int32_t targetAngle, uint32_t tag) {
+    if (!protocolActive) {
+        LOG_D(NODE_TAG " Moviendo a %.3f grados", mdegToDeg(targetAngle));
+    }
+    
+    long steps = angleToSteps(targetAngle);
+    transitionTo = profiles.indexOf(steps);
+    if (motion.busy()) {
+        transitionFrom = -1;  // Reprogramado: el tiempo no corresponde a ninguna transición
+        motion.moveToNearest(steps, tag);  // No hay perfil desde una posición en marcha
+        return;
+    }
+    TRACE_BEGIN(TR_MOVE, steps);
+    transitionFrom = profiles.indexOf(motion.position());
+    if (transitionFrom >= 0 && transitionTo >= 0 && profiles.get(transitionFrom, transitionTo).count > 0) {
+        motion.playProfile(profiles.get(transitionFrom, transitionTo), tag);
+    } else {
+        motion.moveToNearest(steps, tag);
+    }
+}
+
+// ==============================================
+// Calibración de perfiles (CMD_CALIBRATE_PROFILES)
+// ==============================================
+// Para cada transición se prueban candidatos de velocidad/aceleración, del
+// perfil más corto al más largo: CAL_ROUND_TRIPS idas con el perfil (vuelta
+// con el movimiento genérico) y un homing que mide los pasos perdidos. Se
+// queda el primero que pierde como mucho CAL_MAX_LOST_STEPS; si ninguno
+// cumple, la transición vuelve a los valores por defecto. Con 4 ángulos son
+// 12 transiciones: varios minutos.
+#define CAL_ROUND_TRIPS 10
+#define CAL_MAX_LOST_STEPS 3
+
+static const ProfileParams calCandidates[] = {
+  {8000, 80000}, {7000, 60000}, {6000, 50000}, {5000, 35000}, {4500, 25000}
+};
+#define CAL_CANDIDATES (sizeof(calCandidates) / sizeof(calCandidates[0]) + 1)  // + stepperSpeed/stepperAcc
+
+static uint8_t calFrom = 0;
+static uint8_t calTo = 0;
+static uint8_t calOrder[CAL_CANDIDATES];  // Candidatos ordenados por duración del perfil
+static uint8_t calCandidate = 0;          // Posición en calOrder
+static uint8_t calTrip = 0;
+static uint8_t calTuned = 0;              // Transiciones que aceptaron un candidato
+static bool calVerifying = false;         // false = homing de referencia inicial
+
+static ProfileParams calCandidateParams(uint8_t index) {
+    if (index < CAL_CANDIDATES - 1) return calCandidates[index];
+    return ProfileParams{(uint32_t)stepperSpeed, (uint32_t)stepperAcc};
+}
+
+static void finishCalibration(bool completed) {
+    calState = CAL_IDLE;
+    profiles.build();
+    bool saved = completed && profiles.save(PROFILES_NVS);
+    LOG_I(NODE_TAG " Calibración %s: %u transiciones ajustadas%s", completed ? "completada" : "abortada",
+          calTuned, saved ? " (guardadas en NVS)" : "");
+    if (centralRegistered) {
+        ResponseData response = {STATUS_CALIBRATION_DONE, calTuned, saved ? 1 : 0, 0, 0.0};
+        sendResponse(response);
+    }
+}
+
+// Probar el candidato calOrder[calCandidate] en la transición actual
+static void beginCandidate() {
+    ProfileParams params = calCandidateParams(calOrder[calCandidate]);
+    profiles.setParams(calFrom, calTo, params);
+    profiles.build();
+    calTrip = 0;
+    LOG_I(NODE_TAG " Calibrando %u->%u: %lu pasos/s, %lu pasos/s2", calFrom, calTo,
+          (unsigned long)params.maxSpeed, (unsigned long)params.acceleration);
+    motion.moveToNearest(profiles.angle(calFrom), MOVE_TAG_CALIBRATION);
+    calState = CAL_TO_START;
+}
+
+// Siguiente transición (desde != hacia); ordena sus candidatos por duración
+static void beginNextTransition() {
+    do {
+        if (++calTo >= profiles.count()) {
+            calTo = 0;
+            calFrom++;
+        }
+    } while (calFrom < profiles.count() && calFrom == calTo);
+    if (calFrom >= profiles.count()) {
+        finishCalibration(true);
+        return;
+    }
+
+    uint32_t duration[CAL_CANDIDATES];
+    for (uint8_t i = 0; i < CAL_CANDIDATES; i++) {
+        profiles.setParams(calFrom, calTo, calCandidateParams(i));
+        profiles.build();
+        const StepProfile& profile = profiles.get(calFrom, calTo);
+        duration[i] = profile.count > 0 ? profile.durationUs : UINT32_MAX;  // Sin sitio en el pool: al final
+        calOrder[i] = i;
+        for (uint8_t j = i; j > 0 && duration[calOrder[j]] < duration[calOrder[j - 1]]; j--) {
+            uint8_t swap = calOrder[j];
+            calOrder[j] = calOrder[j - 1];
+            calOrder[j - 1] = swap;
+        }
+    }
+    calCandidate = 0;
+    beginCandidate();
+}
+
+// Resultado del homing de verificación: el 0 debe caer donde estaba
+// (módulo el periodo óptico, que es lo que conservan las coordenadas)
+static void checkCandidate() {
+    long period = angleToSteps(OPTICAL_PERIOD_MDEG);
+    long lost = wrapSteps(homingEdge, period);
+    if (lost > period / 2) lost -= period;
+    if (labs(lost) <= CAL_MAX_LOST_STEPS) {
+        calTuned++;
+        beginNextTransition();
+        return;
+    }
+    LOG_W(NODE_TAG " %u->%u: %ld pasos perdidos", calFrom, calTo, lost);
+    if (++calCandidate < CAL_CANDIDATES) {
+        beginCandidate();
+        return;
+    }
+    profiles.setParams(calFrom, calTo, calCandidateParams(CAL_CANDIDATES - 1));
+    beginNextTransition();
+}
+
+static void startCalibration() {
+    if (calState != CAL_IDLE) return;
+    LOG_I(NODE_TAG " Iniciando calibración de perfiles...");
+    calFrom = 0;
+    calTo = 0;
+    calTuned = 0;
+    calVerifying = false;
+    startHoming();
+    calState = CAL_HOMING;
+}
+
+static void calibrationUpdate() {
+    if (calState == CAL_ABORTING) {
+        if (!motion.busy()) finishCalibration(false);
+        return;
+    }
+    if (calState == CAL_IDLE || homingState != HOMING_IDLE || motion.busy()) return;
+
+    switch (calState) {
+        case CAL_HOMING:
+            if (!isHomed) {
+                finishCalibration(false);
+            } else if (calVerifying) {
+                checkCandidate();
+            } else {
+                calVerifying = true;
+                beginNextTransition();
+            }
+            break;
+
+        case CAL_TO_START:
+        case CAL_BACK:
+            if (calState == CAL_BACK && ++calTrip >= CAL_ROUND_TRIPS) {
+                startHoming();
+                calState = CAL_HOMING;
+                break;
+            }
+            motion.playProfile(profiles.get(calFrom, calTo), MOVE_TAG_CALIBRATION);
+            calState = CAL_FORWARD;
+            break;
+
+        case CAL_FORWARD:
+            motion.moveToNearest(profiles.angle(calFrom), MOVE_TAG_CALIBRATION);
+            calState = CAL_BACK;
+            break;
+
+        default:
+            break;
+    }
+}
+
+// CMD_HOME / CMD_ABORT durante la calibración: se conservan los parámetros ya
+// ajustados en memoria, sin guardar. Un perfil en reproducción sigue leyendo
+// el pool, así que se reconstruye cuando el motor se detiene.
+static void abortCalibration() {
+    if (calState == CAL_IDLE || calState == CAL_ABORTING) return;
+    calState = CAL_ABORTING;
+}
+
+// ==============================================
+// Búsqueda de límites de velocidad y aceleración (CMD_FIND_LIMITS)
+// ==============================================
+// Cada prueba son idas y vueltas con el candidato, lo bastante largas para
+// llegar a la velocidad máxima y mantenerla una vuelta, entre dos posiciones
+// verificadas con el imán: parte tras un homing o una verificación superada y
+// termina con la pasada de CMD_VERIFY_HOME. Falla si la entrada del imán se
+// corrió, o antes, si StepLossMonitor ve un stall, una falla del driver o un
+// flanco Hall fuera de sitio. Tras un fallo se repite el homing.
+//
+// Primero sube la velocidad (con la aceleración actual) un 25 % por prueba
+// hasta el primer fallo y bisecciona hasta LIMIT_RESOLUTION_PCT; luego igual
+// con la aceleración a esa velocidad. Una prueba más larga con el
+// LIMIT_MARGIN_PCT de ambos límites decide si se aplican y se guardan como
+// parámetros del nodo (NVS, los mismos que CMD_SET_PARAMS). Las transiciones
+// calibradas conservan sus valores.
+#define LIMIT_ROUND_TRIPS 4
+#define LIMIT_CONFIRM_ROUND_TRIPS 12
+#define LIMIT_LADDER_PCT 125         // Subida mientras no hay fallos
+#define LIMIT_RESOLUTION_PCT 5       // Fin de la bisección
+#define LIMIT_MARGIN_PCT 80          // Valores aplicados respecto de los límites
+
+enum LimitPhase : uint8_t {
+  LIMIT_SPEED,
+  LIMIT_ACCELERATION,
+  LIMIT_CONFIRM
+};
+
+static LimitPhase limPhase = LIMIT_SPEED;
+static uint32_t limPass = 0;          // Mayor valor superado en la fase (0 = ninguno)
+static uint32_t limFail = 0;          // Menor valor fallido en la fase (0 = ninguno)
+static uint32_t limSpeed = 0;         // Candidato en prueba
+static uint32_t limAcc = 0;
+static uint32_t limSpeedLimit = 0;    // Resultados de cada fase
+static uint32_t limAccLimit = 0;
+static uint16_t limTrials = 0;
+static uint8_t limLegs = 0;           // Tramos pendientes de la prueba (ida y vuelta = 2)
+static long limOrigin = 0;            // Posición de partida de la prueba
+static long limLegSteps = 0;
+static bool limTrialFailed = false;
+static uint32_t limStartMs = 0;
+
+static void finishLimits(LimitsResult result) {
+    limState = LIM_IDLE;
+    if (result == LIMITS_SAVED) {
+        stepperSpeed = limSpeed;
+        stepperAcc = limAcc;
+        setupProfiles();  // Transiciones sin calibrar: nueva velocidad
+        paramsStored = paramsSave(PARAMS_NVS, currentParams());
+        if (!paramsStored) result = LIMITS_NOT_SAVED;
+    }
+    motion.setSpeed(stepperSpeed, stepperAcc);
+    
+    uint32_t elapsed = (millis() - limStartMs) / 1000;
+    LOG_I(NODE_TAG " Búsqueda de límites %s en %lu s (%u pruebas): límites %lu pasos/s, %lu pasos/s² -> %d pasos/s, %d pasos/s²",
+          result == LIMITS_SAVED ? "guardada" : result == LIMITS_NOT_SAVED ? "aplicada sin guardar" :
+          result == LIMITS_ABORTED ? "abortada" : "fallida",
+          (unsigned long)elapsed, limTrials, (unsigned long)limSpeedLimit, (unsigned long)limAccLimit,
+          stepperSpeed, stepperAcc);
+    if (centralRegistered) {
+        LimitsReport report = {STATUS_LIMITS_DONE, (uint8_t)result, limTrials, elapsed, limSpeedLimit, limAccLimit,
+                               (uint32_t)stepperSpeed, (uint32_t)stepperAcc};
+        esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+    }
+}
+
+// Siguiente candidato de la fase según limPass/limFail; 0 = fase terminada.
+// Sin fallos sube; con fallo y sin nada superado baja a la mitad; si no, bisecciona.
+static uint32_t nextLimitCandidate(uint32_t start, uint32_t minimum, uint32_t maximum) {
+    if (limFail == 0) {
+        if (limPass == 0) return start;
+        if (limPass >= maximum) return 0;
+        uint32_t next = limPass * LIMIT_LADDER_PCT / 100;
+        return next < maximum ? next : maximum;
+    }
+    if (limPass == 0) {
+        if (limFail <= minimum) return 0;
+        return limFail / 2 > minimum ? limFail / 2 : minimum;
+    }
+    if ((limFail - limPass) * 100 <= limPass * LIMIT_RESOLUTION_PCT) return 0;
+    return (limPass + limFail) / 2;
+}
+
+static void beginLimitTrial(uint32_t speed, uint32_t acc, uint8_t roundTrips) {
+    limSpeed = speed;
+    limAcc = acc;
+    limLegs = 2 * roundTrips;
+    limTrialFailed = false;
+    limTrials++;
+    // Acelerar y frenar (v²/a) más una vuelta a velocidad máxima
+    limLegSteps = (long)((uint64_t)speed * speed / acc) + STEPS_PER_REV;
+    LOG_I(NODE_TAG " Límites: prueba %u, %lu pasos/s, %lu pasos/s² (%u idas y vueltas de %ld pasos)", limTrials,
+          (unsigned long)speed, (unsigned long)acc, roundTrips, limLegSteps);
+    motion.setSpeed(speed, acc);
+    limOrigin = motion.position();
+    motion.moveTo(limOrigin + limLegSteps, MOVE_TAG_CALIBRATION);  // onMotionDone los ignora
+    limState = LIM_TRIAL;
+}
+
+// Con la posición verificada (homing o prueba superada): siguiente prueba o
+// siguiente fase
+static void nextLimitTrial() {
+    if (limPhase == LIMIT_SPEED) {
+        uint32_t speed = nextLimitCandidate(stepperSpeed, PARAMS_SPEED_MIN, PARAMS_SPEED_MAX);
+        if (speed) {
+            beginLimitTrial(speed, stepperAcc, LIMIT_ROUND_TRIPS);
+            return;
+        }
+        if (limPass == 0) {
+            finishLimits(LIMITS_FAILED);
+            return;
+        }
+        limSpeedLimit = limPass;
+        limPhase = LIMIT_ACCELERATION;
+        limPass = stepperAcc;  // Superada en la fase de velocidad
+        limFail = 0;
+    }
+    if (limPhase == LIMIT_ACCELERATION) {
+        uint32_t acc = nextLimitCandidate(stepperAcc, PARAMS_ACCELERATION_MIN, PARAMS_ACCELERATION_MAX);
+        if (acc) {
+            beginLimitTrial(limSpeedLimit, acc, LIMIT_ROUND_TRIPS);
+            return;
+        }
+        limAccLimit = limPass;
+        limPhase = LIMIT_CONFIRM;
+        uint32_t speed = limSpeedLimit * LIMIT_MARGIN_PCT / 100;
+        uint32_t acceleration = limAccLimit * LIMIT_MARGIN_PCT / 100;
+        beginLimitTrial(speed > PARAMS_SPEED_MIN ? speed : PARAMS_SPEED_MIN,
+                        acceleration > PARAMS_ACCELERATION_MIN ? acceleration : PARAMS_ACCELERATION_MIN,
+                        LIMIT_CONFIRM_ROUND_TRIPS);
+    }
+}
+
+static void limitTrialDone(bool passed) {
+    uint32_t value = limPhase == LIMIT_ACCELERATION ? limAcc : limSpeed;
+    if (!passed) LOG_W(NODE_TAG " Límites: prueba %u fallida", limTrials);
+    if (passed) {
+        if (limPhase == LIMIT_CONFIRM) {
+            finishLimits(LIMITS_SAVED);
+            return;
+        }
+        limPass = value;
+        nextLimitTrial();
+        return;
+    }
+    if (limPhase != LIMIT_CONFIRM) limFail = value;
+    startHoming();  // Posición perdida: homing antes de seguir (o de terminar)
+    limState = LIM_HOMING;
+}
+
+// Desde stepLossUpdate(): true si la pérdida es de una prueba en curso, que se
+// detiene y se da por fallida (el homing lo lanza limitTrialDone)
+static bool limitStepLoss(StepLossCause cause, int32_t detail) {
+    if (limState != LIM_TRIAL) return false;
+    if (!limTrialFailed) {
+        LOG_W(NODE_TAG " Límites: pérdida de pasos (%s, %ld)", stepLossName(cause), (long)detail);
+        limTrialFailed = true;
+        isHomed = false;  // Desarma el monitor hasta el próximo homing
+        motion.stop();
+    }
+    return true;
+}
+
+static void startLimitFinder() {
+    if (motionReserved()) {
+        if (centralRegistered) {
+            LimitsReport report = {STATUS_LIMITS_DONE, LIMITS_BUSY, 0, 0, 0, 0,
+                                   (uint32_t)stepperSpeed, (uint32_t)stepperAcc};
+            esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+        }
+        return;
+    }
+    LOG_I(NODE_TAG " Iniciando búsqueda de límites de velocidad y aceleración...");
+    limPhase = LIMIT_SPEED;
+    limPass = 0;
+    limFail = 0;
+    limSpeedLimit = 0;
+    limAccLimit = 0;
+    limTrials = 0;
+    limStartMs = millis();
+    startHoming();
+    limState = LIM_HOMING;
+}
+
+static void limitUpdate() {
+    if (limState == LIM_IDLE || homingState != HOMING_IDLE || motion.busy()) return;
+    
+    switch (limState) {
+        case LIM_HOMING:
+            if (!isHomed || limPhase == LIMIT_CONFIRM) {
+                finishLimits(LIMITS_FAILED);  // Homing fallido o confirmación fallida
+            } else {
+                nextLimitTrial();
+            }
+            break;
+            
+        case LIM_TRIAL:
+            if (limTrialFailed) {
+                limitTrialDone(false);
+            } else if (--limLegs > 0) {
+                // Tramos pares: ida; impares: vuelta al origen
+                motion.moveTo(limLegs % 2 ? limOrigin : limOrigin + limLegSteps, MOVE_TAG_CALIBRATION);
+            } else {
+                motion.setSpeed(stepperSpeed, stepperAcc);
+                homingStartMs = millis();
+                beginVerifyPass();
+                limState = LIM_VERIFY;
+            }
+            break;
+            
+        case LIM_VERIFY:
+            limitTrialDone(isHomed);  // finishVerifyHome deja isHomed según el resultado
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// CMD_HOME / CMD_ABORT / CMD_CALIBRATE_PROFILES: los parámetros no cambian. Sin
+// perfiles en juego, no hace falta esperar a que el motor se detenga.
+static void abortLimits() {
+    if (limState == LIM_IDLE) return;
+    finishLimits(LIMITS_ABORTED);
+}
+
+// ==============================================
+// Prueba de resistencia (CMD_SOAK o "soak <s>" por serial)
+// ==============================================
+// Para calificar un nodo antes de una sesión larga sin el Central ni la FPGA:
+// transiciones aleatorias entre los ángulos de la tabla, seguidas y con los
+// perfiles de los pulsos, durante la duración pedida. Cada SOAK_VERIFY_MOVES
+// movimientos (y al terminar) se verifica la posición con la pasada de
+// CMD_VERIFY_HOME; si falla, o si StepLossMonitor detecta una pérdida, se
+// repite el homing y se sigue. Cada SOAK_REPORT_MS se informa del progreso
+// por serial y, si hay Central, con STATUS_SOAK_REPORT.
+#define SOAK_DEFAULT_S 600
+#define SOAK_MAX_S 86400
+#define SOAK_VERIFY_MOVES 500
+#define SOAK_REPORT_MS 30000
+#define SOAK_DRIVER_FLAGS (DRV_STATUS_OT | DRV_STATUS_OTPW | DRV_STATUS_S2GA | DRV_STATUS_S2GB)
+
+static uint32_t soakDurationS = 0;
+static uint32_t soakStartMs = 0;
+static uint32_t soakLastReportMs = 0;
+static uint32_t soakMoves = 0;
+static uint32_t soakMovesSinceVerify = 0;
+static uint64_t soakMoveUsTotal = 0;
+static uint32_t soakMaxMoveUs = 0;
+static uint16_t soakVerifications = 0;
+static uint16_t soakVerifyFailures = 0;
+static uint16_t soakStepLosses = 0;
+static uint32_t soakDriverFlags = 0;
+static bool soakEnding = false;       // Duración cumplida: falta la verificación final
+
+static void sendSoakReport(SoakResult result) {
+    uint32_t elapsed = millis() - soakStartMs;
+    uint32_t meanUs = soakMoves ? (uint32_t)(soakMoveUsTotal / soakMoves) : 0;
+    LOG_I(NODE_TAG " Resistencia%s: %lu movimientos en %lu s (%.1f/s), medio %lu µs, máx %lu µs",
+          result == SOAK_RUNNING ? "" : result == SOAK_DONE ? " terminada" :
+          result == SOAK_ABORTED ? " abortada" : " fallida",
+          (unsigned long)soakMoves, (unsigned long)(elapsed / 1000),
+          elapsed ? soakMoves * 1000.0f / elapsed : 0.0f, (unsigned long)meanUs, (unsigned long)soakMaxMoveUs);
+    LOG_I(NODE_TAG "   verificaciones %u (%u fallidas), pérdidas de pasos %u, DRV_STATUS%s%s%s%s",
+          soakVerifications, soakVerifyFailures, soakStepLosses,
+          soakDriverFlags ? "" : " sin avisos", (soakDriverFlags & DRV_STATUS_OTPW) ? " OTPW" : "",
+          (soakDriverFlags & DRV_STATUS_OT) ? " OT" : "",
+          (soakDriverFlags & (DRV_STATUS_S2GA | DRV_STATUS_S2GB)) ? " S2G" : "");
+    if (centralRegistered) {
+        SoakReport report = {STATUS_SOAK_REPORT, (uint8_t)result, soakVerifications, soakVerifyFailures,
+                             soakStepLosses, elapsed, soakDurationS, soakMoves, meanUs, soakMaxMoveUs,
+                             soakDriverFlags};
+        esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+    }
+}
+
+static void finishSoak(SoakResult result) {
+    soakState = SOAK_IDLE;
+    sendSoakReport(result);
+}
+
+static void startSoak(uint32_t seconds) {
+    if (motionReserved()) {
+        LOG_W(NODE_TAG " Prueba de resistencia ignorada: motor ocupado");
+        if (centralRegistered) {
+            SoakReport report = {STATUS_SOAK_REPORT, SOAK_BUSY, 0, 0, 0, 0, seconds, 0, 0, 0, 0};
+            esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+        }
+        return;
+    }
+    if (seconds == 0) seconds = SOAK_DEFAULT_S;
+    if (seconds > SOAK_MAX_S) seconds = SOAK_MAX_S;
+    soakDurationS = seconds;
+    soakStartMs = millis();
+    soakLastReportMs = soakStartMs;
+    soakMoves = 0;
+    soakMovesSinceVerify = 0;
+    soakMoveUsTotal = 0;
+    soakMaxMoveUs = 0;
+    soakVerifications = 0;
+    soakVerifyFailures = 0;
+    soakStepLosses = 0;
+    soakDriverFlags = 0;
+    soakEnding = false;
+    LOG_I(NODE_TAG " Prueba de resistencia: %lu s de transiciones aleatorias", (unsigned long)seconds);
+    if (isHomed) {
+        soakState = SOAK_MOVING;
+    } else {
+        startHoming();
+        soakState = SOAK_HOMING;
+    }
+}
+
+// Fin de una transición de la prueba (desde onMotionDone)
+static void soakOnMove(const MotionEvent& event) {
+    if (soakState != SOAK_MOVING) return;
+    uint32_t elapsed = event.endMicros - event.startMicros;
+    soakMoves++;
+    soakMovesSinceVerify++;
+    soakMoveUsTotal += elapsed;
+    if (elapsed > soakMaxMoveUs) soakMaxMoveUs = elapsed;
+    soakDriverFlags |= stepLoss.lastStatus() & SOAK_DRIVER_FLAGS;  // Última lectura del monitor en movimiento
+}
+
+// Desde stepLossUpdate(), que ya lanza el homing automático
+static void soakStepLoss() {
+    if (soakState == SOAK_IDLE) return;
+    soakStepLosses++;
+    soakState = SOAK_HOMING;
+}
+
+static void soakUpdate() {
+    if (soakState == SOAK_IDLE) return;
+    uint32_t now = millis();
+    if (now - soakLastReportMs >= SOAK_REPORT_MS) {
+        soakLastReportMs = now;
+        sendSoakReport(SOAK_RUNNING);
+    }
+    if (homingState != HOMING_IDLE || motion.busy()) return;
+    
+    switch (soakState) {
+        case SOAK_HOMING:
+            if (!isHomed) {
+                finishSoak(SOAK_FAILED);
+            } else if (soakEnding) {
+                finishSoak(SOAK_DONE);
+            } else {
+                soakState = SOAK_MOVING;
+            }
+            break;
+            
+        case SOAK_MOVING: {
+            if (now - soakStartMs >= soakDurationS * 1000UL) soakEnding = true;
+            if (soakEnding || soakMovesSinceVerify >= SOAK_VERIFY_MOVES) {
+                soakMovesSinceVerify = 0;
+                homingStartMs = now;
+                beginVerifyPass();
+                soakState = SOAK_VERIFY;
+                break;
+            }
+            // Cualquier ángulo de la tabla distinto del actual
+            int from = profiles.indexOf(motion.position());
+            uint8_t to = esp_random() % PROFILE_ANGLES;
+            if (to == from) to = (to + 1 + esp_random() % (PROFILE_ANGLES - 1)) % PROFILE_ANGLES;
+            startMove(tableAngle(to), MOVE_TAG_SOAK);
+            break;
+        }
+            
+        case SOAK_VERIFY:
+            soakVerifications++;
+            if (isHomed) {  // finishVerifyHome deja isHomed según el resultado
+                if (soakEnding) finishSoak(SOAK_DONE);
+                else soakState = SOAK_MOVING;
+                break;
+            }
+            soakVerifyFailures++;
+            LOG_W(NODE_TAG " Resistencia: verificación fallida tras %lu movimientos, homing", (unsigned long)soakMoves);
+            startHoming();
+            soakState = SOAK_HOMING;
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// CMD_HOME / CMD_ABORT / CMD_CALIBRATE_PROFILES o "soak stop": se informa de lo
+// medido hasta ahora
+static void abortSoak() {
+    if (soakState == SOAK_IDLE) return;
+    finishSoak(SOAK_ABORTED);
+}
+
+#endif // BB84_BENCH
+
+// Rechazar un CMD_PREPARE_PULSE con STATUS_ERROR (motivo en el campo base)
+static void rejectPulse(uint32_t pulseNum, ErrorCode reason) {
+    if (reason == ERROR_RNG_HEALTH) {
+        LOG_E(NODE_TAG " ERROR: El RNG no supera las pruebas de salud (CMD_HOME las repite)");
+    } else if (!protocolActive) {
+        LOG_E(NODE_TAG " ERROR: Not homed");
+    }
+    if (centralRegistered) {
+        ResponseData response = {STATUS_ERROR, pulseNum, reason, 0, 0.0};
+        esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+    }
+}
+
+// Enviar el estado del RNG al Central (CMD_RNG_STATS)
+static void sendRngStats() {
+    if (!centralRegistered) return;
+    const RandomStats& s = rng.statistics();
+    RngStatsReport report = {STATUS_RNG_STATS, rng.healthy() ? (uint8_t)1 : (uint8_t)0, s.longestRun,
+                             s.maxWindowCount, s.rctFailures, s.aptFailures, s.testedBits, s.testedOnes,
+                             s.deliveredBits, s.deliveredOnes, rng.deliveredBiasPpm()};
+    esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+}
+
+// Un RNG que falló las pruebas de salud se vuelve a probar antes de cada
+// sesión: con CMD_HOME y también con CMD_VERIFY_HOME, porque si la
+// verificación pasa el Central ya no envía el homing completo
+static void retestRngIfFailed() {
+    if (rng.healthy()) return;
+    if (rng.begin()) {
+        LOG_I(NODE_TAG " RNG: pruebas de arranque superadas de nuevo");
+    } else {
+        LOG_E(NODE_TAG " RNG: sigue sin superar las pruebas de arranque");
+    }
+}
+
+// Lanzar el movimiento del pulso a currentTargetAngle; si aún no terminó el
+// anterior se reprograma el objetivo
+static void startPulseMove(uint32_t pulseNum, size_t replyLen, uint32_t rxMicros) {
+    // OPTIMIZADO: Solo loguear si no está en protocolo activo
+    if (!protocolActive) {
+        LOG_D(NODE_TAG " Pulso %d - Base:%d Bit:%d Ángulo:%.2f", 
+              pulseNum, pulseBase, pulseBit, mdegToDeg(currentTargetAngle));
+    }
+    
+    pendingPulse.pulseNum = pulseNum;
+    pendingPulse.replyLen = replyLen;
+    pendingPulse.rxMicros = rxMicros;
+    startMove(currentTargetAngle, MOVE_TAG_PULSE | (pulseNum & MOVE_TAG_PULSE_MASK));
+}
+
+// Base 0 con probabilidad weight/256: un bit del RNG si es equiprobable
+// (lo habitual) y ocho si el protocolo sesga las bases
+static uint8_t drawBase(uint8_t weight) {
+    if (weight == QKD_WEIGHT_EVEN) return rng.nextBit();
+    uint8_t value = 0;
+    for (uint8_t i = 0; i < 8; i++) value = (value << 1) | rng.nextBit();
+    return value < weight ? 0 : 1;
+}
+
+// Preparar para el siguiente pulso: base y, si el rol y el protocolo de la
+// sesión lo eligen, bit al azar (ver QkdProtocol.h).
+// STATUS_READY se envía al terminar el movimiento (ver onMotionDone)
+static void prepareForNextPulse(uint32_t pulseNum, size_t replyLen = 0, uint32_t rxMicros = 0) {
+    if (!isHomed || motionReserved()) {
+        rejectPulse(pulseNum, ERROR_NOT_READY);
+        return;
+    }
+    
+    // Base y bit del buffer de bits aleatorios probado (ver BB84/lib/RandomBits);
+    // la condición del rol es constante y la rama que no aplica desaparece
+    const QkdProtocolDef& protocol = qkdProtocols[sessionProtocol];
+    pulseBase = drawBase(protocol.baseWeight);
+    pulseBit = 0;
+    if (NodeRole::bitsPerBase > 1 && protocol.aliceChoosesBit) pulseBit = rng.nextBit();
+    if (!rng.healthy()) {
+        rejectPulse(pulseNum, ERROR_RNG_HEALTH);
+        return;
+    }
+    
+    // Calcular ángulo objetivo
+    currentTargetAngle = angulosRotacion[pulseBase * NodeRole::bitsPerBase + pulseBit];
+    startPulseMove(pulseNum, replyLen, rxMicros);
+}
+
+// Pulso de referencia (CMD_PREPARE_REFERENCE): el Central fija el estado y un
+// desplazamiento sobre su ángulo para medir la deriva de polarización; no se
+// usa el RNG. STATUS_READY lleva la base y el bit de ese estado.
+static void prepareReferencePulse(uint32_t pulseNum, uint8_t index, int32_t offset, size_t replyLen,
+                                  uint32_t rxMicros) {
+    if (!isHomed || motionReserved() || index >= PROFILE_ANGLES) {
+        rejectPulse(pulseNum, ERROR_NOT_READY);
+        return;
+    }
+    pulseBase = index / NodeRole::bitsPerBase;
+    pulseBit = index % NodeRole::bitsPerBase;
+    currentTargetAngle = tableAngle(index) + offset;
+    startPulseMove(pulseNum, replyLen, rxMicros);
+}
+
+// Notificar que está listo vía ESP-NOW, con las marcas de tiempo del movimiento
+// para el desglose de latencia en el Central
+static void sendReady(uint32_t moveStartMicros, uint32_t moveEndMicros) {
+    if (!centralRegistered) return;
+    ResponseData response = {STATUS_READY, pendingPulse.pulseNum, pulseBase, pulseBit, mdegToDeg(currentTargetAngle),
+                             pendingPulse.rxMicros, moveStartMicros, moveEndMicros, sessionProtocol};
+    sendResponse(response, pendingPulse.replyLen);
+}
+
+// Movimiento manual desde la interfaz web (CMD_MOVE_MANUAL)
+static void manualMove(int32_t targetAngle) {
+    if (!isHomed || motionReserved()) {
+        LOG_W(NODE_TAG " Movimiento manual ignorado: requiere homing");
+        return;
+    }
+    LOG_I(NODE_TAG " Movimiento manual a %.3f grados", mdegToDeg(targetAngle));
+    startMove(targetAngle, MOVE_TAG_MANUAL);
+}
+
+// Fin de un movimiento (llamado desde loop() con el evento del motor)
+static void onMotionDone(const MotionEvent& event) {
+    uint32_t kind = event.tag & MOVE_TAG_KIND_MASK;
+    if (kind == MOVE_TAG_HOMING || kind == MOVE_TAG_CALIBRATION) return;  // Siguen el estado del motor desde loop()
+    TRACE_END(TR_MOVE, event.position);
+    
+    if (event.result == MOTION_ABORTED) {
+        if (!protocolActive) {
+            LOG_W(NODE_TAG " Movimiento abortado");
+        }
+        return;
+    }
+    
+    if (transitionFrom >= 0 && transitionTo >= 0) {
+        transitionStats.record(transitionFrom, transitionTo, event.endMicros - event.startMicros, event.steps);
+    }
+    if (kind == MOVE_TAG_BENCH) return;  // transitionBenchUpdate() lanza el siguiente
+    if (kind == MOVE_TAG_SOAK) {
+        soakOnMove(event);  // soakUpdate() lanza el siguiente
+        return;
+    }
+    
+    if (kind == MOVE_TAG_MANUAL) {
+        LOG_I(NODE_TAG " Movimiento manual completado - Posición: %.2f grados", mdegToDeg(getCurrentAngle()));
+        return;
+    }
+    
+    // Pulso: solo se responde al último PREPARE (uno reprogramado no tiene evento propio)
+    if ((event.tag & MOVE_TAG_PULSE_MASK) != (pendingPulse.pulseNum & MOVE_TAG_PULSE_MASK)) return;
+    if (!protocolActive) {
+        LOG_D(NODE_TAG " Movimiento completado - Posición: %.2f grados", mdegToDeg(getCurrentAngle()));
+    }
+    sendReady(event.startMicros, event.endMicros);
+}
+
+// Enviar la matriz de transiciones al Central (CMD_TRANSITION_STATS), una celda
+// por mensaje y un mensaje final con el total
+static void sendTransitionStats() {
+    if (!centralRegistered) return;
+    uint32_t total = 0;
+    for (uint8_t from = 0; from < transitionStats.angles(); from++) {
+        for (uint8_t to = 0; to < transitionStats.angles(); to++) {
+            TransitionSummary s = transitionStats.summary(from, to);
+            if (s.count == 0) continue;
+            total += s.count;
+            TransitionStatsReport report = {STATUS_TRANSITION_STATS, from, to, PROFILE_ANGLES,
+                                            tableAngle(from), tableAngle(to), s.count, s.meanUs,
+                                            s.p99Us, s.maxUs, s.meanSteps, s.maxSteps};
+            esp_now_send(centralMAC, (uint8_t*)&report, sizeof(report));
+            delay(4);  // No saturar la cola de transmisión ESP-NOW
+        }
+    }
+    TransitionStatsReport end = {STATUS_TRANSITION_STATS, TRANSITION_REPORT_END, TRANSITION_REPORT_END,
+                                 PROFILE_ANGLES, 0, 0, total, 0, 0, 0, 0, 0};
+    esp_now_send(centralMAC, (uint8_t*)&end, sizeof(end));
+    LOG_I(NODE_TAG " Matriz de transiciones enviada: %lu movimientos", (unsigned long)total);
+}
+
+// ==============================================
+// Benchmark de transiciones (CMD_TRANSITION_BENCH)
+// ==============================================
+// Recorre cada transición de la tabla 'rounds' veces en orden aleatorio: desde
+// el ángulo actual elige al azar una transición pendiente que salga de él; si
+// no queda ninguna, va al origen de otra pendiente (ese movimiento también se
+// mide). Reinicia la matriz al empezar y la envía al Central al terminar.
+static void startTransitionBench(uint32_t rounds) {
+    if (!isHomed || motionReserved()) {
+        LOG_W(NODE_TAG " Benchmark de transiciones ignorado: requiere homing y motor libre");
+        return;
+    }
+    if (rounds == 0) rounds = 1;
+    if (rounds > TRANSITION_BENCH_MAX_ROUNDS) rounds = TRANSITION_BENCH_MAX_ROUNDS;
+    transitionStats.reset();
+    benchPending = 0;
+    for (uint8_t i = 0; i < PROFILE_ANGLES; i++) {
+        for (uint8_t j = 0; j < PROFILE_ANGLES; j++) {
+            benchLeft[i][j] = (i == j) ? 0 : rounds;
+            benchPending += benchLeft[i][j];
+        }
+    }
+    benchRunning = true;
+    LOG_I(NODE_TAG " Benchmark de transiciones: %lu movimientos", (unsigned long)benchPending);
+}
+
+static void transitionBenchUpdate() {
+    if (!benchRunning || motion.busy()) return;
+    if (benchPending == 0) {
+        benchRunning = false;
+        sendTransitionStats();
+        return;
+    }
+
+    int from = profiles.indexOf(motion.position());
+    uint8_t options[PROFILE_ANGLES];
+    uint8_t count = 0;
+    for (uint8_t j = 0; from >= 0 && j < PROFILE_ANGLES; j++) {
+        if (benchLeft[from][j] > 0) options[count++] = j;
+    }
+
+    uint8_t to;
+    if (count > 0) {
+        to = options[esp_random() % count];
+        benchLeft[from][to]--;
+        benchPending--;
+    } else {
+        // Ninguna pendiente desde aquí: ir al origen de una pendiente al azar
+        uint8_t start = esp_random() % (PROFILE_ANGLES * PROFILE_ANGLES);
+        uint8_t cell = start;
+        while (benchLeft[cell / PROFILE_ANGLES][cell % PROFILE_ANGLES] == 0) {
+            cell = (cell + 1) % (PROFILE_ANGLES * PROFILE_ANGLES);
+        }
+        to = cell / PROFILE_ANGLES;
+    }
+    startMove(tableAngle(to), MOVE_TAG_BENCH);
+}
+
+// CMD_HOME / CMD_ABORT / CMD_CALIBRATE_PROFILES durante el benchmark: se
+// conserva lo medido hasta ahora
+static void abortTransitionBench() {
+    if (!benchRunning) return;
+    benchRunning = false;
+    benchPending = 0;
+    LOG_W(NODE_TAG " Benchmark de transiciones abortado");
+}
+
+// Encolar un comando para loop() (desde el callback ESP-NOW)
+static void enqueueCommand(uint8_t cmd, uint32_t pulseNum, int len, uint32_t rxMicros, int32_t angle = 0,
+                    uint8_t index = 0) {
+    QueuedCommand command = {cmd, (uint8_t)len, pulseNum, rxMicros, angle, index};
+    commandQueue.push(command);  // Si está llena se cuenta y se informa desde loop()
+}
+
+// Callback ESP-NOW para comandos desde el Central
+// CRÍTICO: Este callback debe ser NO BLOQUEANTE
+static void OnDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len) {
+    uint32_t rxMicros = micros();  // Marca de recepción (sincronización y latencia)
+    if (len < (int)sizeof(CommandData)) return;  // Se acepta relleno al final
+    
+    CommandData cmd;
+    memcpy(&cmd, incomingData, sizeof(cmd));
+    
+    // [PRIORIDAD CRÍTICA] Registrar Central PRIMERO (antes de procesar cualquier comando)
+    if (!centralRegistered) {
+        // Copiar MAC del remitente
+        memcpy(centralMAC, mac, 6);
+        
+        // Verificar si ya está registrado como peer
+        if (!esp_now_is_peer_exist(centralMAC)) {
+            // Agregar Central como peer
+            esp_now_peer_info_t peerInfo = {};
+            memcpy(peerInfo.peer_addr, centralMAC, 6);
+            peerInfo.channel = ESP_NOW_CHANNEL;
+            peerInfo.encrypt = false;
+            
+            if (esp_now_add_peer(&peerInfo) == ESP_OK) {
+                centralRegistered = true;
+                LOG_I(NODE_TAG " ✓ Central registrado: %02X:%02X:%02X:%02X:%02X:%02X",
+                      centralMAC[0], centralMAC[1], centralMAC[2],
+                      centralMAC[3], centralMAC[4], centralMAC[5]);
+            } else {
+                LOG_E(NODE_TAG " ERROR: No se pudo registrar Central como peer");
+            }
+        } else {
+            centralRegistered = true;
+        }
+    }
+    
+    // [PRIORIDAD MÁXIMA] Sincronización de reloj: responder desde el callback,
+    // sin logging, para que t2/t3 no incluyan la espera del loop
+    if (cmd.cmd == CMD_TIME_SYNC) {
+        if (centralRegistered) {
+            TimeSyncResponse response = {STATUS_TIME_SYNC, cmd.pulseNum, cmd.totalPulses, rxMicros, (uint32_t)micros()};
+            esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+        }
+        return;
+    }
+    
+    TRACE_INSTANT(TR_ESPNOW_RX, cmd.cmd);  // La sincronización de reloj no se traza (muy frecuente)
+    
+    // [PRIORIDAD ALTA] Responder a PING inmediatamente
+    if (cmd.cmd == CMD_PING) {
+        LOG_I(NODE_TAG " • PING recibido del Central, respondiendo PONG...");
+        ResponseData response = {STATUS_PONG, 0, 0, 0, 0.0};
+        esp_err_t result = esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+        if (result != ESP_OK) {
+            LOG_E(NODE_TAG " ✗ Error enviando PONG: %d", result);
+        }
+        return;  // Salir inmediatamente
+    }
+    
+    // [PRIORIDAD ALTA] Configuración de canal (debe procesarse SIEMPRE como PING)
+    if (cmd.cmd == CMD_SET_CHANNEL) {
+        int newChannel = cmd.pulseNum;  // El canal viene en pulseNum
+        
+        // Si ya está configurado, solo reenviar confirmación (idempotente)
+        if (channelConfigured && ESP_NOW_CHANNEL == newChannel) {
+            // Ya configurado - solo confirmar nuevamente
+            ResponseData response = {STATUS_PONG, (uint32_t)newChannel, 0, 0, 0.0};
+            esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+            return;
+        }
+        
+        // Primera vez o cambio de canal (benchmark recorre varios canales): configurar canal
+        if (!channelConfigured || ESP_NOW_CHANNEL != newChannel) {
+            LOG_I(NODE_TAG " • Configurando canal: %d", newChannel);
+            
+            // CRÍTICO: Si el Central ya está registrado, actualizar su canal ANTES de cambiar
+            if (centralRegistered && esp_now_is_peer_exist(centralMAC)) {
+                esp_now_del_peer(centralMAC);
+            }
+            
+            // Cambiar canal WiFi
+            esp_wifi_set_channel(newChannel, WIFI_SECOND_CHAN_NONE);
+            ESP_NOW_CHANNEL = newChannel;
+            
+            // Re-registrar el Central con el nuevo canal
+            if (centralRegistered) {
+                esp_now_peer_info_t peerInfo = {};
+                memcpy(peerInfo.peer_addr, centralMAC, 6);
+                peerInfo.channel = newChannel;
+                peerInfo.encrypt = false;
+                
+                if (esp_now_add_peer(&peerInfo) == ESP_OK) {
+                    LOG_I(NODE_TAG " ✓ Central re-registrado en canal %d", newChannel);
+                } else {
+                    LOG_E(NODE_TAG " ✗ ERROR: No se pudo re-registrar Central");
+                }
+            }
+            
+            channelConfigured = true;
+            LOG_I(NODE_TAG " ✓ Canal sincronizado: %d (confirmando...)", ESP_NOW_CHANNEL);
+        }
+        
+        // Enviar confirmación al Central
+        ResponseData response = {STATUS_PONG, (uint32_t)newChannel, 0, 0, 0.0};
+        esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+        return;
+    }
+    
+    // [PRIORIDAD ALTA] Configuración de radio: ahorro de energía y potencia TX
+    if (cmd.cmd == CMD_SET_RADIO) {
+        if (cmd.pulseNum <= WIFI_PS_MAX_MODEM) {
+            esp_wifi_set_ps((wifi_ps_type_t)cmd.pulseNum);
+        }
+        if (cmd.totalPulses != 0) {
+            wifiTxPower = cmd.totalPulses;
+            esp_wifi_set_max_tx_power(wifiTxPower);
+        }
+        LOG_I(NODE_TAG " • Radio: PS=%u TX=%d", cmd.pulseNum, wifiTxPower);
+        ResponseData response = {STATUS_PONG, 0, 0, 0, 0.0};
+        esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+        return;
+    }
+    
+    // Protocolo de la sesión: el Central lo envía antes del primer pulso
+    if (cmd.cmd == CMD_SET_PROTOCOL) {
+        if (cmd.pulseNum < QKD_PROTOCOL_COUNT) {
+            sessionProtocol = cmd.pulseNum;
+            LOG_I(NODE_TAG " • Protocolo: %s", qkdProtocols[cmd.pulseNum].name);
+        } else {
+            LOG_W(NODE_TAG " ⚠ Protocolo desconocido: %lu", (unsigned long)cmd.pulseNum);
+        }
+        // Se confirma el protocolo vigente: si se rechazó, el Central no arranca
+        ResponseData response = {STATUS_PROTOCOL, 0, sessionProtocol, 0, 0.0};
+        esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
+        return;
+    }
+    
+    // Comandos no críticos: agregar a cola (NO ejecutar aquí para evitar bloqueo)
+    switch (cmd.cmd) {
+        case CMD_HOME:
+            LOG_I(NODE_TAG " • Comando HOME recibido, encolando...");
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            break;
+            
+        case CMD_PREPARE_PULSE:
+            if (!protocolActive) {
+                LOG_D(NODE_TAG " • Comando PREPARE_PULSE #%d recibido", cmd.pulseNum);
+            }
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            protocolActive = true;  // Activar modo rápido cuando empieza el protocolo
+            break;
+            
+        case CMD_PREPARE_REFERENCE: {
+            if (len < (int)sizeof(ReferencePulseCommand)) break;
+            ReferencePulseCommand reference;
+            memcpy(&reference, incomingData, sizeof(reference));
+            enqueueCommand(cmd.cmd, reference.pulseNum, len, rxMicros, reference.offsetMdeg, reference.index);
+            protocolActive = true;
+            break;
+        }
+            
+        case CMD_TRIM_ANGLE:
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros, (int32_t)cmd.totalPulses);
+            break;
+            
+        case CMD_TRACE_DUMP:
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            break;
+            
+        case CMD_CALIBRATE_PROFILES:
+            LOG_I(NODE_TAG " • Comando CALIBRATE_PROFILES recibido, encolando...");
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            break;
+            
+        case CMD_FIND_LIMITS:
+            LOG_I(NODE_TAG " • Comando FIND_LIMITS recibido, encolando...");
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            break;
+            
+        case CMD_SOAK:
+            LOG_I(NODE_TAG " • Comando SOAK recibido (%lu s), encolando...", (unsigned long)cmd.pulseNum);
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            break;
+            
+        case CMD_TRANSITION_STATS:
+        case CMD_TRANSITION_BENCH:
+        case CMD_RNG_STATS:
+        case CMD_VERIFY_HOME:
+        case CMD_GET_PARAMS:
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            break;
+            
+        case CMD_ABORT:
+            LOG_I(NODE_TAG " • Comando ABORT recibido, deteniendo motor...");
+            enqueueCommand(cmd.cmd, cmd.pulseNum, len, rxMicros);
+            protocolActive = false;  // Desactivar modo rápido
+            motion.stop();           // Seguro desde el callback: se aplica en el siguiente tick
+            break;
+            
+        case CMD_SET_PARAMS: {
+            if (len < (int)sizeof(ParamsCommand)) break;
+            ParamsCommand command;
+            memcpy(&command, incomingData, sizeof(command));
+            portENTER_CRITICAL(&paramsMux);
+            pendingParams = command.params;  // Si llegan dos seguidos vale el último
+            portEXIT_CRITICAL(&paramsMux);
+            enqueueCommand(cmd.cmd, 0, len, rxMicros);
+            break;
+        }
+            
+        case CMD_MOVE_MANUAL: {
+            ManualMoveCommand move;
+            memcpy(&move, incomingData, sizeof(move));
+            enqueueCommand(cmd.cmd, 0, len, rxMicros, degToMdeg(move.targetAngle));
+            break;
+        }
+            
+        default:
+            if (!protocolActive) {
+                LOG_W(NODE_TAG " ⚠ Comando desconocido: 0x%02X", cmd.cmd);
+            }
+            break;
+    }
+}
+
+// ==============================================
+// Comandos por serial (sin Central)
+// ==============================================
+// "soak [s]" lanza la prueba de resistencia (SOAK_DEFAULT_S sin duración) y
+// "soak stop" la detiene. Sin eco ni edición: una línea por comando.
+#define SERIAL_LINE_MAX 32
+
+static void serialCommandUpdate() {
+    static char line[SERIAL_LINE_MAX];
+    static uint8_t length = 0;
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c != '\n' && c != '\r') {
+            if (length < SERIAL_LINE_MAX - 1) line[length++] = c;
+            continue;
+        }
+        if (length == 0) continue;
+        line[length] = '\0';
+        length = 0;
+        if (strcmp(line, "soak stop") == 0) {
+            abortSoak();
+        } else if (strncmp(line, "soak", 4) == 0 && (line[4] == '\0' || line[4] == ' ')) {
+            startSoak(strtoul(line + 4, nullptr, 10));
+        } else {
+            LOG_W(NODE_TAG " Comando serial desconocido: %s (usar \"soak [s]\" o \"soak stop\")", line);
+        }
+    }
+}
+
+void motorNodeSetup() {
+    Serial.begin(115200);
+    delay(500);
+    logBegin();  // Logging diferido (ver lib/AsyncLog)
+    Serial.println("\n=== " NODE_NAME " - ESP-NOW Motor ===");
+    
+    // Configuración WiFi/ESP-NOW optimizada
+    WiFi.mode(WIFI_STA);
+    esp_wifi_set_ps(WIFI_PS_NONE);
+    esp_wifi_set_max_tx_power(wifiTxPower);
+    
+    // Iniciar en canal predeterminado (será actualizado por Central)
+    esp_wifi_set_channel(ESP_NOW_INITIAL_CHANNEL, WIFI_SECOND_CHAN_NONE);
+    
+    Serial.print(NODE_TAG " MAC: ");
+    Serial.println(WiFi.macAddress());
+    Serial.printf(NODE_TAG " Canal inicial: %d (esperando configuración del Central)\n", ESP_NOW_INITIAL_CHANNEL);
+    
+    // Inicializar ESP-NOW
+    if (esp_now_init() != ESP_OK) {
+        Serial.println(NODE_TAG " ERROR: ESP-NOW init");
+        return;
+    }
+    
+    // Registrar callback de recepción
+    if (esp_now_register_recv_cb(OnDataRecv) != ESP_OK) {
+        Serial.println(NODE_TAG " ERROR: Callback RX");
+        return;
+    }
+    
+    Serial.println(NODE_TAG " ESP-NOW OK - Esperando conexión del Central");
+    
+    // Configurar pines y SPI
+    pinMode(SPI_CS, OUTPUT);
+    digitalWrite(SPI_CS, HIGH);
+    pinMode(ENABLE_PIN, OUTPUT);
+    pinMode(DIR_PIN, OUTPUT);
+    pinMode(STEP_PIN, OUTPUT);
+    digitalWrite(ENABLE_PIN, HIGH);
+    
+    SPI.begin(SPI_SCLK, SPI_MISO, SPI_MOSI, SPI_CS);
+    delay(30);  // Reducido de 50ms
+    
+    memcpy(angulosRotacion, NodeRole::defaultAngles, sizeof(angulosRotacion));
+    loadParams();  // Antes de configurar el driver y el motor (puede cambiar la tabla)
+    
+    // Inicializar TMC2130
+    driver.begin();
+    delay(30);  // Reducido de 50ms
+    digitalWrite(ENABLE_PIN, LOW);
+    
+    if (driver.test_connection() == 0) {  // 0 = responde; 1/2 = SPI sin respuesta
+        driver.stealthChop(0);        // SpreadCycle para mejor torque en alta velocidad
+        driver.pwm_autoscale(true);   // Ajuste automático de PWM
+        driver.microsteps(MICROSTEPS);
+        configureDriver();            // Corriente y chopper (parámetros en tiempo de ejecución)
+        driver.interpolate(true);     // Interpolación a 256 microsteps (suaviza movimiento)
+        
+        Serial.println(NODE_TAG " TMC2130 OK (SpreadCycle + Interpolación)");
+        if (stepLoss.begin(STALL_THRESHOLD, STALL_MIN_SPEED, MICROSTEPS)) {
+            Serial.printf(NODE_TAG " Detección de pérdida de pasos: StallGuard2 sgt=%d desde %d pasos/s%s\n",
+                          STALL_THRESHOLD, STALL_MIN_SPEED, HALL_PASS_CHECK ? " + sensor Hall" : "");
+        }
+    } else {
+        Serial.println(NODE_TAG " ERROR: TMC2130");
+    }
+    
+    stepper.setEnablePin(ENABLE_PIN);
+    stepper.setMaxSpeed(stepperSpeed);
+    stepper.setAcceleration(stepperAcc);
+    stepper.setPinsInverted(true, true, true);
+    stepper.enableOutputs();
+    
+    motion.setPeriod(angleToSteps(OPTICAL_PERIOD_MDEG), APPROACH_DIR, angleToSteps(BACKLASH_OVERSHOOT_MDEG));
+    if (!motion.begin(STEP_PIN, DIR_PIN, true, true)) {  // Mismas inversiones que setPinsInverted
+        Serial.println(NODE_TAG " ERROR: Temporizador de movimiento");
+    }
+    setupProfiles();
+    transitionStats.begin(PROFILE_ANGLES);
+    loadHomeOffset();
+    restoreHomeSnapshot();
+    
+    // Pruebas de arranque del RNG (SP 800-90B) con la radio ya encendida
+    if (rng.begin()) {
+        Serial.println(NODE_TAG " RNG OK (pruebas de salud SP 800-90B)");
+    } else {
+        Serial.println(NODE_TAG " ERROR: RNG no supera las pruebas de arranque, no se aceptarán pulsos");
+    }
+    
+#ifdef MOTION_RAMP_BENCH
+    rampBenchRun();  // Coste por paso de la rampa (ver lib/MotionEngine/src/RampBench.h)
+#endif
+    
+    Serial.println(NODE_TAG " READY\n");
+}
+
+void motorNodeLoop() {
+    // Procesar comandos pendientes de la cola
+    QueuedCommand pendingCmd;
+    if (commandQueue.pop(pendingCmd)) {
+        TRACE_INSTANT(TR_CMD_DEQUEUE, pendingCmd.cmd);
+        
+        switch (pendingCmd.cmd) {
+            case CMD_HOME:
+                LOG_I(NODE_TAG " Ejecutando HOME");
+                abortCalibration();
+                abortLimits();
+                abortSoak();
+                abortTransitionBench();
+                retestRngIfFailed();
+                startHoming(pendingCmd.pulseNum == HOME_RECALIBRATE);
+                break;
+                
+            case CMD_PREPARE_PULSE:
+                // OPTIMIZADO: Sin logging durante protocolo para máxima velocidad
+                if (!protocolActive) {
+                    LOG_D(NODE_TAG " Ejecutando PREPARE #%d", pendingCmd.pulseNum);
+                }
+                currentPulseNum = pendingCmd.pulseNum;
+                prepareForNextPulse(pendingCmd.pulseNum, pendingCmd.len, pendingCmd.rxMicros);
+                break;
+                
+            case CMD_PREPARE_REFERENCE:
+                currentPulseNum = pendingCmd.pulseNum;
+                prepareReferencePulse(pendingCmd.pulseNum, pendingCmd.index, pendingCmd.angle, pendingCmd.len,
+                                      pendingCmd.rxMicros);
+                break;
+                
+            case CMD_TRIM_ANGLE:
+                trimAngle(pendingCmd.pulseNum, pendingCmd.angle);
+                break;
+                
+            case CMD_MOVE_MANUAL:
+                manualMove(pendingCmd.angle);
+                break;
+                
+            case CMD_TRACE_DUMP:
+                sendTraceDump();
+                break;
+                
+            case CMD_CALIBRATE_PROFILES:
+                abortLimits();
+                abortSoak();
+                abortTransitionBench();
+                startCalibration();
+                break;
+                
+            case CMD_FIND_LIMITS:
+                startLimitFinder();
+                break;
+                
+            case CMD_SOAK:
+                startSoak(pendingCmd.pulseNum);
+                break;
+                
+            case CMD_TRANSITION_STATS:
+                sendTransitionStats();
+                if (pendingCmd.pulseNum == 1) transitionStats.reset();
+                break;
+                
+            case CMD_TRANSITION_BENCH:
+                startTransitionBench(pendingCmd.pulseNum);
+                break;
+                
+            case CMD_RNG_STATS:
+                sendRngStats();
+                break;
+                
+            case CMD_VERIFY_HOME:
+                retestRngIfFailed();
+                startVerifyHome();
+                break;
+                
+            case CMD_GET_PARAMS:
+                sendParams(PARAMS_OK, PARAM_NONE);
+                break;
+                
+            case CMD_SET_PARAMS:
+                setParams();
+                break;
+                
+            case CMD_ABORT:
+                LOG_I(NODE_TAG " Ejecutando ABORT");
+                abortCalibration();
+                abortLimits();
+                abortSoak();
+                abortTransitionBench();
+                abortHoming();
+                break;
+        }
+    }
+    
+    // Homing y fin de movimientos: el motor avanza solo desde su temporizador
+    homingUpdate();
+    calibrationUpdate();
+    limitUpdate();
+    soakUpdate();
+    transitionBenchUpdate();
+    stepLossUpdate();
+    homeSnapshotUpdate();
+    serialCommandUpdate();
+    
+    MotionEvent event;
+    if (motion.pollEvent(event)) {
+        onMotionDone(event);
+    }
+    
+    // Comandos perdidos por cola llena (el Central reintentará por timeout)
+    uint32_t overflows = commandQueue.overflows();
+    if (overflows != reportedOverflows) {
+        LOG_W(NODE_TAG " ⚠ Cola de comandos llena: %u comandos descartados", overflows - reportedOverflows);
+        reportedOverflows = overflows;
+    }
+    yield();  // Permitir callbacks ESP-NOW
+}
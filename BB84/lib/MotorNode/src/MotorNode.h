@@ -0,0 +1,14 @@
+#ifndef MOTOR_NODE_H
+#define MOTOR_NODE_H
+
+// ==============================================
+// Firmware de nodo con motor (Alice y Bob)
+// ==============================================
+// Implementado en MotorNode.cpp y especializado por el rol del proyecto
+// (-DNODE_ROLE_ALICE o -DNODE_ROLE_BOB, ver NodeRole.h). El src/main.cpp de
+// cada nodo los llama desde setup() y loop().
+
+void motorNodeSetup();
+void motorNodeLoop();
+
+#endif // MOTOR_NODE_H
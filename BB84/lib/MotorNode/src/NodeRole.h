@@ -0,0 +1,55 @@
+#ifndef NODE_ROLE_H
+#define NODE_ROLE_H
+
+#include <stdint.h>
+#include <StepAngle.h>
+
+// ==============================================
+// Rol del nodo con motor (Alice o Bob)
+// ==============================================
+// Alice y Bob comparten todo el firmware (MotorNode.cpp); solo cambian el nombre
+// en los logs, la tabla de ángulos y si el pulso lleva bit. Cada proyecto
+// elige su rol con -DNODE_ROLE_ALICE o -DNODE_ROLE_BOB en build_flags y todo
+// se resuelve en compilación: el tamaño de la tabla y de los perfiles, el
+// índice de cada ángulo y la rama del bit en prepareForNextPulse().
+//
+// La tabla se indexa base * bitsPerBase + bit, el mismo índice que usan los
+// perfiles por transición, la matriz de transiciones y CMD_SET_PARAMS.
+
+struct AliceRole {
+  static constexpr uint8_t bases = 2;
+  static constexpr uint8_t bitsPerBase = 2;   // Elige base y bit en cada pulso
+  static constexpr uint8_t angleCount = bases * bitsPerBase;
+  // Base 0 (+): Horizontal (bit 0), Vertical (bit 1)
+  // Base 1 (x): Diagonal (bit 0), Antidiagonal (bit 1)
+  static constexpr int32_t defaultAngles[angleCount] = {
+    MDEG(47.7), MDEG(2.7),
+    MDEG(25.2), MDEG(70.2)
+  };
+};
+
+struct BobRole {
+  static constexpr uint8_t bases = 2;
+  static constexpr uint8_t bitsPerBase = 1;   // Solo elige la base de medición
+  static constexpr uint8_t angleCount = bases * bitsPerBase;
+  // Base 0 (+): Rectilínea; Base 1 (x): Diagonal
+  static constexpr int32_t defaultAngles[angleCount] = {
+    MDEG(13.95),
+    MDEG(36.45)
+  };
+};
+
+#if defined(NODE_ROLE_ALICE)
+typedef AliceRole NodeRole;
+#define NODE_NAME "Alice"
+#elif defined(NODE_ROLE_BOB)
+typedef BobRole NodeRole;
+#define NODE_NAME "Bob"
+#else
+#error "Definir NODE_ROLE_ALICE o NODE_ROLE_BOB en build_flags"
+#endif
+
+// Prefijo de los logs (concatenado en compilación con el formato)
+#define NODE_TAG "[" NODE_NAME "]"
+
+#endif // NODE_ROLE_H
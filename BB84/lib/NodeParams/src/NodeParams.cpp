@@ -0,0 +1,74 @@
+#include "NodeParams.h"
+#include <Preferences.h>
+
+#define PARAMS_NVS_KEY "motion"
+
+static bool inRange(long value, long minimum, long maximum) {
+  return value >= minimum && value <= maximum;
+}
+
+ParamsField paramsValidate(const MotionParams& params, uint8_t angleCount, uint16_t microsteps,
+                           int32_t opticalPeriodMdeg) {
+  if (!inRange(params.currentMa, PARAMS_CURRENT_MIN_MA, PARAMS_CURRENT_MAX_MA)) return PARAM_CURRENT;
+  if (!inRange(params.maxSpeed, PARAMS_SPEED_MIN, PARAMS_SPEED_MAX)) return PARAM_SPEED;
+  if (!inRange(params.acceleration, PARAMS_ACCELERATION_MIN, PARAMS_ACCELERATION_MAX)) return PARAM_ACCELERATION;
+  if (params.microsteps != microsteps) return PARAM_MICROSTEPS;
+
+  // toff = 0 apaga el driver
+  if (!inRange(params.toff, 1, 15)) return PARAM_TOFF;
+  if (params.blankTime != 16 && params.blankTime != 24 && params.blankTime != 36 && params.blankTime != 54) {
+    return PARAM_BLANK_TIME;
+  }
+  if (!inRange(params.hysteresisStart, 1, 8) || !inRange(params.hysteresisEnd, -3, 12) ||
+      params.hysteresisStart + params.hysteresisEnd > 16) {
+    return PARAM_HYSTERESIS;
+  }
+
+  // Dos ángulos equivalentes en el periodo óptico serían el mismo estado y
+  // el mismo perfil de transición
+  if (params.angleCount != angleCount || angleCount > PARAMS_MAX_ANGLES) return PARAM_ANGLES;
+  for (uint8_t i = 0; i < angleCount; i++) {
+    if (!inRange(params.angles[i], 0, 359999)) return PARAM_ANGLES;
+    for (uint8_t j = 0; j < i; j++) {
+      int32_t gap = (params.angles[i] - params.angles[j]) % opticalPeriodMdeg;
+      if (gap < 0) gap += opticalPeriodMdeg;
+      if (gap < PARAMS_MIN_ANGLE_GAP_MDEG || opticalPeriodMdeg - gap < PARAMS_MIN_ANGLE_GAP_MDEG) {
+        return PARAM_ANGLES;
+      }
+    }
+  }
+  return PARAM_NONE;
+}
+
+bool paramsLoad(const char* nvsNamespace, MotionParams& params) {
+  Preferences prefs;
+  if (!prefs.begin(nvsNamespace, true)) return false;
+  MotionParams stored;
+  size_t len = prefs.getBytes(PARAMS_NVS_KEY, &stored, sizeof(stored));
+  prefs.end();
+  if (len != sizeof(stored)) return false;  // Sin guardar o de otra versión
+  params = stored;
+  return true;
+}
+
+bool paramsSave(const char* nvsNamespace, const MotionParams& params) {
+  Preferences prefs;
+  if (!prefs.begin(nvsNamespace, false)) return false;
+  size_t len = prefs.putBytes(PARAMS_NVS_KEY, &params, sizeof(params));
+  prefs.end();
+  return len == sizeof(params);
+}
+
+const char* paramsFieldName(uint8_t field) {
+  switch (field) {
+    case PARAM_CURRENT: return "corriente";
+    case PARAM_SPEED: return "velocidad";
+    case PARAM_ACCELERATION: return "aceleración";
+    case PARAM_MICROSTEPS: return "micropasos";
+    case PARAM_TOFF: return "toff";
+    case PARAM_BLANK_TIME: return "blank_time";
+    case PARAM_HYSTERESIS: return "histéresis";
+    case PARAM_ANGLES: return "ángulos";
+    default: return "-";
+  }
+}
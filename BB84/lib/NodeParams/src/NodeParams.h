@@ -0,0 +1,38 @@
+#ifndef NODE_PARAMS_H
+#define NODE_PARAMS_H
+
+#include <stdint.h>
+#include <BB84Protocol.h>
+
+// ==============================================
+// Parámetros de movimiento en tiempo de ejecución (Alice y Bob)
+// ==============================================
+// Validación y persistencia en NVS de MotionParams (CMD_SET_PARAMS); el
+// Central solo usa paramsFieldName() para el log. Los rangos protegen al
+// hardware y al planificador, no buscan el valor óptimo: la corriente no pasa
+// del máximo del TMC2130 con Rsense 0.11 Ω y la velocidad queda por debajo de
+// lo que el generador de pasos emite sin huecos. La combinación de chopper
+// sigue las reglas del datasheet del TMC2130 (5.5.2, CHOPCONF).
+
+#define PARAMS_CURRENT_MIN_MA 100
+#define PARAMS_CURRENT_MAX_MA 1200
+#define PARAMS_SPEED_MIN 100           // pasos/s
+#define PARAMS_SPEED_MAX 20000
+#define PARAMS_ACCELERATION_MIN 100    // pasos/s²
+#define PARAMS_ACCELERATION_MAX 200000
+#define PARAMS_MIN_ANGLE_GAP_MDEG 1000 // Separación mínima entre ángulos (módulo el periodo óptico)
+
+// Primer campo fuera de rango (PARAM_NONE si todos valen). La tabla debe tener
+// angleCount ángulos en [0°, 360°), distintos módulo opticalPeriodMdeg, y los
+// micropasos deben coincidir con los del firmware.
+ParamsField paramsValidate(const MotionParams& params, uint8_t angleCount, uint16_t microsteps,
+                           int32_t opticalPeriodMdeg);
+
+// NVS: false si no hay valores guardados o son de otra versión de la estructura
+bool paramsLoad(const char* nvsNamespace, MotionParams& params);
+bool paramsSave(const char* nvsNamespace, const MotionParams& params);
+
+// Nombre del campo para el log
+const char* paramsFieldName(uint8_t field);
+
+#endif // NODE_PARAMS_H
@@ -0,0 +1,76 @@
+#include "RandomBits.h"
+#ifdef ARDUINO
+#include <esp_system.h>
+#else
+#include <stddef.h>
+// Entorno native (pio test -e native): la fuente la pone la prueba unitaria
+extern "C" void esp_fill_random(void* buf, size_t len);
+#endif
+
+bool RandomBits::begin() {
+  stats = RandomStats{};
+  lastBit = 2;
+  runLength = 0;
+  ok = true;
+  for (int i = 0; i < RANDOM_STARTUP_WINDOWS && ok; i++) {
+    refill();
+  }
+  bitIndex = RANDOM_APT_WINDOW;  // Los bits de arranque se descartan
+  stats.deliveredBits = 0;
+  stats.deliveredOnes = 0;
+  return ok;
+}
+
+bool RandomBits::refill() {
+  if (!ok) return false;
+  esp_fill_random(buffer, sizeof(buffer));
+  if (!testBuffer()) {
+    ok = false;
+    return false;
+  }
+  bitIndex = 0;
+  return true;
+}
+
+// RCT continuo (la racha sigue entre buffers) y APT sobre el buffer completo
+bool RandomBits::testBuffer() {
+  bool passed = true;
+  uint32_t ones = 0;
+  for (uint32_t w = 0; w < RANDOM_APT_WINDOW / 32; w++) {
+    uint32_t word = buffer[w];
+    ones += __builtin_popcount(word);
+    for (int b = 0; b < 32; b++) {
+      uint8_t bit = (word >> b) & 1;
+      if (bit == lastBit) {
+        runLength++;
+      } else {
+        lastBit = bit;
+        runLength = 1;
+      }
+      if (runLength > stats.longestRun) stats.longestRun = runLength;
+      if (runLength == RANDOM_RCT_CUTOFF) {
+        stats.rctFailures++;
+        passed = false;
+      }
+    }
+  }
+
+  uint32_t first = buffer[0] & 1;
+  uint32_t count = first ? ones : RANDOM_APT_WINDOW - ones;
+  if (count > stats.maxWindowCount) stats.maxWindowCount = count;
+  if (count >= RANDOM_APT_CUTOFF) {
+    stats.aptFailures++;
+    passed = false;
+  }
+
+  stats.windows++;
+  stats.testedBits += RANDOM_APT_WINDOW;
+  stats.testedOnes += ones;
+  return passed;
+}
+
+int32_t RandomBits::deliveredBiasPpm() const {
+  if (stats.deliveredBits == 0) return 0;
+  int64_t excess = 2 * (int64_t)stats.deliveredOnes - stats.deliveredBits;  // unos - ceros
+  return (int32_t)(excess * 500000 / stats.deliveredBits);
+}
@@ -0,0 +1,76 @@
+#ifndef RANDOM_BITS_H
+#define RANDOM_BITS_H
+
+#include <stdint.h>
+
+// ==============================================
+// Bits aleatorios para base y bit (Alice y Bob)
+// ==============================================
+// Llena un buffer con esp_fill_random() (RNG de hardware; con la radio
+// encendida mezcla ruido térmico del RF) y entrega los bits de a uno, en vez
+// de gastar un esp_random() de 32 bits por decisión.
+//
+// Cada buffer se somete antes de usarse a las pruebas continuas de salud de
+// NIST SP 800-90B (4.4), con muestras binarias y entropía declarada H = 1 bit
+// por muestra, falsos positivos α = 2^-20:
+//
+//   Repetition Count Test: falla si un bit se repite RANDOM_RCT_CUTOFF veces seguidas
+//   Adaptive Proportion Test: en cada ventana de RANDOM_APT_WINDOW bits, falla
+//     si el primero aparece RANDOM_APT_CUTOFF veces o más
+//
+// Al arrancar (begin()) se prueban y descartan RANDOM_STARTUP_WINDOWS ventanas.
+// Un fallo se mantiene hasta el próximo begin(): los bits de un buffer que no
+// pasa las pruebas nunca se entregan y nextBit() devuelve 0.
+
+#define RANDOM_APT_WINDOW      1024   // Bits por ventana (= un buffer)
+#define RANDOM_APT_CUTOFF      589    // 1 + CRITBINOM(1024, 0.5, 1 - 2^-20)
+#define RANDOM_RCT_CUTOFF      21     // 1 + ceil(20 / H)
+#define RANDOM_STARTUP_WINDOWS 4
+
+struct RandomStats {
+  uint32_t testedBits;       // Bits generados y probados
+  uint32_t testedOnes;
+  uint32_t deliveredBits;    // Bits entregados (bases y bits del protocolo)
+  uint32_t deliveredOnes;
+  uint32_t windows;          // Ventanas APT evaluadas
+  uint16_t longestRun;       // Racha más larga observada (RCT)
+  uint16_t maxWindowCount;   // Mayor cuenta del primer bit en una ventana (APT)
+  uint16_t rctFailures;
+  uint16_t aptFailures;
+};
+
+class RandomBits {
+public:
+  // Prueba de arranque; también rehabilita el generador tras un fallo
+  bool begin();
+
+  bool healthy() const { return ok; }
+
+  // Siguiente bit; comprobar healthy() después de extraer los bits de una decisión
+  uint8_t nextBit() {
+    if (bitIndex >= RANDOM_APT_WINDOW && !refill()) return 0;
+    uint8_t bit = (buffer[bitIndex >> 5] >> (bitIndex & 31)) & 1;
+    bitIndex++;
+    stats.deliveredBits++;
+    stats.deliveredOnes += bit;
+    return bit;
+  }
+
+  const RandomStats& statistics() const { return stats; }
+
+  // Sesgo de los bits entregados en partes por millón (0 = equilibrado)
+  int32_t deliveredBiasPpm() const;
+
+private:
+  bool refill();
+  bool testBuffer();
+
+  uint32_t buffer[RANDOM_APT_WINDOW / 32];
+  uint32_t bitIndex = RANDOM_APT_WINDOW;  // Vacío: se llena en el primer nextBit()
+  uint8_t lastBit = 2;                    // Ninguno aún
+  uint16_t runLength = 0;
+  bool ok = false;
+  RandomStats stats = {};
+};
+
+#endif // RANDOM_BITS_H
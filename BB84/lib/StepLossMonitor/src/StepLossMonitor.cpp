@@ -0,0 +1,96 @@
+#include "StepLossMonitor.h"
+
+bool StepLossMonitor::begin(int8_t threshold, uint32_t minSpeed, uint16_t microsteps) {
+  ready = driver.test_connection() == 0;
+  if (!ready) return false;
+
+  // TSTEP = tiempo entre 1/256 microsteps en ciclos del reloj del TMC2130
+  if (minSpeed == 0) minSpeed = 1;
+  coolThreshold = (TMC_CLOCK_HZ * microsteps) / (256UL * minSpeed);
+  if (coolThreshold > 0xFFFFF) coolThreshold = 0xFFFFF;  // Campo de 20 bits
+
+  driver.sgt(threshold);
+  driver.sfilt(true);          // Una medida cada 4 pasos completos: menos falsos positivos
+  driver.TCOOLTHRS(coolThreshold);
+  return true;
+}
+
+void StepLossMonitor::setHallCheck(long periodSteps, long edgeSteps, long toleranceSteps) {
+  hallPeriod = periodSteps;
+  hallEdgeSteps = edgeSteps;
+  hallTolerance = toleranceSteps;
+}
+
+void IRAM_ATTR StepLossMonitor::hallEdge(long position, int8_t dir) {
+  hallPosition = position;
+  hallDir = dir;
+  hallPending = true;
+}
+
+void StepLossMonitor::arm(bool enabled) {
+  active = enabled && ready;
+  hallPending = false;
+  stallSamples = 0;
+  wasMoving = false;
+}
+
+bool StepLossMonitor::readStatus() {
+  uint32_t value = driver.DRV_STATUS();
+  if (value == 0xFFFFFFFFUL) return false;  // MISO flotante: lectura inválida
+  status = value;
+  return true;
+}
+
+StepLossCause StepLossMonitor::detect(StepLossCause cause, int32_t value, int32_t& detail) {
+  detail = value;
+  arm(false);  // Hasta el próximo homing
+  return cause;
+}
+
+StepLossCause StepLossMonitor::poll(bool moving, int32_t& detail) {
+  detail = 0;
+  if (!active) return STEP_LOSS_NONE;
+
+  // Paso por el imán: solo el flanco en sentido + coincide con el del homing
+  if (hallPending) {
+    hallPending = false;
+    if (hallPeriod > 0 && hallDir > 0) {
+      hallCount++;
+      long offset = (hallPosition - hallEdgeSteps) % hallPeriod;
+      if (offset < 0) offset += hallPeriod;
+      if (offset > hallPeriod / 2) offset -= hallPeriod;
+      if (offset > hallTolerance || offset < -hallTolerance) {
+        return detect(STEP_LOSS_HALL, offset, detail);
+      }
+    }
+  }
+
+  if (!moving) {
+    stallSamples = 0;
+    if (!wasMoving) return STEP_LOSS_NONE;
+    // Una lectura al detenerse: fallas que aparecieron al final del movimiento
+    wasMoving = false;
+    if (readStatus() && (status & DRV_STATUS_FAULTS)) {
+      return detect(STEP_LOSS_DRIVER, status & DRV_STATUS_FAULTS, detail);
+    }
+    return STEP_LOSS_NONE;
+  }
+
+  wasMoving = true;
+  uint32_t now = millis();
+  if (now - lastPollMs < STEP_LOSS_POLL_MS) return STEP_LOSS_NONE;
+  lastPollMs = now;
+
+  if (!readStatus()) return STEP_LOSS_NONE;
+  if (status & DRV_STATUS_FAULTS) {
+    return detect(STEP_LOSS_DRIVER, status & DRV_STATUS_FAULTS, detail);
+  }
+
+  // El flag de stall solo vale por encima de la velocidad mínima (TSTEP ≤ TCOOLTHRS)
+  bool stalled = (status & DRV_STATUS_STALL) && driver.TSTEP() <= coolThreshold;
+  stallSamples = stalled ? stallSamples + 1 : 0;
+  if (stallSamples >= STEP_LOSS_STALL_CONFIRM) {
+    return detect(STEP_LOSS_STALL, status & DRV_STATUS_SG_RESULT, detail);
+  }
+  return STEP_LOSS_NONE;
+}
@@ -0,0 +1,97 @@
+#ifndef STEP_LOSS_MONITOR_H
+#define STEP_LOSS_MONITOR_H
+
+#include <Arduino.h>
+#include <TMC2130Stepper.h>
+#include <BB84Protocol.h>
+
+// ==============================================
+// Detección de pérdida de pasos (Alice y Bob)
+// ==============================================
+// Un paso perdido desplaza todos los ángulos siguientes hasta el próximo
+// homing. Se vigilan tres fuentes, de la más barata a la más cara:
+//
+//   Sensor Hall: cada vez que el motor pasa girando en sentido + por el imán,
+//     el flanco de bajada debe caer donde lo dejó el homing (módulo el periodo
+//     óptico). La ISR solo guarda posición y sentido; se evalúa en poll().
+//   StallGuard2: mientras el motor se mueve se lee DRV_STATUS por SPI cada
+//     STEP_LOSS_POLL_MS (una transacción de 40 bits, unos µs). Cuenta solo por
+//     encima de la velocidad mínima (TCOOLTHRS), donde SG_RESULT es fiable, y
+//     tras STEP_LOSS_STALL_CONFIRM lecturas seguidas.
+//   Fallas del driver: sobretemperatura y cortocircuito, durante el movimiento
+//     y una vez al detenerse.
+//
+// StallGuard2 solo funciona en SpreadCycle (stealthChop(0)). El umbral sgt
+// depende del motor, la corriente y la carga: ajustarlo con SG_RESULT
+// (lastSgResult()) girando libre y frenando la lámina a mano.
+
+#ifndef STEP_LOSS_POLL_MS
+#define STEP_LOSS_POLL_MS 2            // Periodo de lectura de DRV_STATUS en movimiento
+#endif
+
+#ifndef STEP_LOSS_STALL_CONFIRM
+#define STEP_LOSS_STALL_CONFIRM 2      // Lecturas seguidas con stall para darlo por perdido
+#endif
+
+#define TMC_CLOCK_HZ 12000000UL        // Reloj interno del TMC2130
+
+// Bits de DRV_STATUS (datasheet TMC2130, 5.5.3)
+#define DRV_STATUS_SG_RESULT 0x000003FFUL
+#define DRV_STATUS_STALL     (1UL << 24)
+#define DRV_STATUS_OT        (1UL << 25)
+#define DRV_STATUS_OTPW      (1UL << 26)
+#define DRV_STATUS_S2GA      (1UL << 27)
+#define DRV_STATUS_S2GB      (1UL << 28)
+#define DRV_STATUS_FAULTS    (DRV_STATUS_OT | DRV_STATUS_S2GA | DRV_STATUS_S2GB)
+
+class StepLossMonitor {
+public:
+  explicit StepLossMonitor(TMC2130Stepper& driver) : driver(driver) {}
+
+  // Configura StallGuard2 tras configurar el driver: umbral sgt (-64..63, más
+  // alto = menos sensible) y detección desde minSpeed pasos/s con 'microsteps'.
+  // false si el driver no responde por SPI: el monitor queda inactivo.
+  bool begin(int8_t threshold, uint32_t minSpeed, uint16_t microsteps);
+
+  // Comprobación con el sensor Hall: el flanco en sentido + debe caer en
+  // edgeSteps (módulo periodSteps) ± toleranceSteps. Sin llamarla no se comprueba.
+  void setHallCheck(long periodSteps, long edgeSteps, long toleranceSteps);
+
+  // Desde la ISR del sensor Hall (posición y sentido del último paso emitido)
+  void IRAM_ATTR hallEdge(long position, int8_t dir);
+
+  // Vigilar solo con un homing válido y fuera del homing y la calibración
+  void arm(bool enabled);
+  bool armed() const { return active; }
+
+  // Llamar en cada loop(). Devuelve la causa detectada (STEP_LOSS_NONE si no)
+  // y su detalle para STATUS_STEP_LOSS; tras una detección queda desarmado.
+  StepLossCause poll(bool moving, int32_t& detail);
+
+  uint32_t lastStatus() const { return status; }
+  uint16_t lastSgResult() const { return status & DRV_STATUS_SG_RESULT; }
+  uint32_t hallChecks() const { return hallCount; }
+
+private:
+  bool readStatus();
+  StepLossCause detect(StepLossCause cause, int32_t value, int32_t& detail);
+
+  TMC2130Stepper& driver;
+  bool ready = false;          // Driver accesible por SPI
+  bool active = false;
+  uint32_t coolThreshold = 0;  // TCOOLTHRS: TSTEP máximo con StallGuard2 válido
+  uint32_t status = 0;         // Último DRV_STATUS
+  uint32_t lastPollMs = 0;
+  uint8_t stallSamples = 0;
+  bool wasMoving = false;
+
+  long hallPeriod = 0;         // 0 = sin comprobación Hall
+  long hallEdgeSteps = 0;
+  long hallTolerance = 0;
+  uint32_t hallCount = 0;
+  volatile bool hallPending = false;
+  volatile long hallPosition = 0;
+  volatile int8_t hallDir = 0;
+};
+
+#endif // STEP_LOSS_MONITOR_H
@@ -0,0 +1,69 @@
+#include "TransitionStats.h"
+#include <string.h>
+
+void TransitionStats::begin(uint8_t angles) {
+  angleCount = angles > TRANSITION_STATS_MAX_ANGLES ? TRANSITION_STATS_MAX_ANGLES : angles;
+  reset();
+}
+
+void TransitionStats::reset() {
+  memset(cells, 0, sizeof(cells));
+}
+
+// Valores < 8 exactos; desde 8, exponente y 3 bits de mantisa
+uint8_t TransitionStats::bucketOf(uint32_t us) {
+  if (us < TRANSITION_HIST_SUB) return us;
+  uint8_t exponent = 31 - __builtin_clz(us);
+  uint32_t bucket = TRANSITION_HIST_SUB + (exponent - 3) * TRANSITION_HIST_SUB +
+                    ((us >> (exponent - 3)) & (TRANSITION_HIST_SUB - 1));
+  return bucket < TRANSITION_HIST_BUCKETS ? bucket : TRANSITION_HIST_BUCKETS - 1;
+}
+
+uint32_t TransitionStats::bucketUpper(uint8_t bucket) {
+  if (bucket < TRANSITION_HIST_SUB) return bucket;
+  uint8_t exponent = (bucket - TRANSITION_HIST_SUB) / TRANSITION_HIST_SUB + 3;
+  uint32_t mantissa = (bucket % TRANSITION_HIST_SUB) + TRANSITION_HIST_SUB;
+  return ((mantissa + 1) << (exponent - 3)) - 1;
+}
+
+void TransitionStats::record(uint8_t from, uint8_t to, uint32_t durationUs, uint32_t steps) {
+  if (from >= angleCount || to >= angleCount) return;
+  Cell& cell = cells[from][to];
+  if (steps > UINT16_MAX) steps = UINT16_MAX;
+  cell.count++;
+  cell.sumUs += durationUs;
+  if (durationUs > cell.maxUs) cell.maxUs = durationUs;
+  cell.sumSteps += steps;
+  if (steps > cell.maxSteps) cell.maxSteps = steps;
+  uint16_t& slot = cell.hist[bucketOf(durationUs)];
+  if (slot < UINT16_MAX) slot++;
+}
+
+TransitionSummary TransitionStats::summary(uint8_t from, uint8_t to) const {
+  TransitionSummary s = {0, 0, 0, 0, 0, 0};
+  if (from >= angleCount || to >= angleCount) return s;
+  const Cell& cell = cells[from][to];
+  if (cell.count == 0) return s;
+
+  s.count = cell.count;
+  s.meanUs = cell.sumUs / cell.count;
+  s.maxUs = cell.maxUs;
+  s.meanSteps = cell.sumSteps / cell.count;
+  s.maxSteps = cell.maxSteps;
+
+  // Primer intervalo que acumula el 99 % de las muestras (sin pasar del máximo real)
+  // El último intervalo es abierto, y con más de 65535 muestras en un
+  // intervalo el total puede no alcanzarse: en ambos casos, el máximo
+  uint32_t needed = cell.count - cell.count / 100;
+  uint32_t seen = 0;
+  s.p99Us = cell.maxUs;
+  for (uint8_t b = 0; b < TRANSITION_HIST_BUCKETS - 1; b++) {
+    seen += cell.hist[b];
+    if (seen >= needed) {
+      uint32_t upper = bucketUpper(b);
+      if (upper < cell.maxUs) s.p99Us = upper;
+      break;
+    }
+  }
+  return s;
+}
@@ -0,0 +1,60 @@
+#ifndef TRANSITION_STATS_H
+#define TRANSITION_STATS_H
+
+#include <stdint.h>
+
+// ==============================================
+// Matriz de coste de transiciones (Alice y Bob)
+// ==============================================
+// Tiempo de reloj y pasos de cada movimiento entre dos ángulos de la tabla,
+// agregados por celda (desde × hacia). El p99 sale de un histograma
+// logarítmico por celda: 8 subdivisiones por potencia de 2 (error < 12.5 %),
+// exacto por debajo de 8 µs y saturado a partir de ~1 s. Sin heap.
+//
+// Uso: record() desde loop() al terminar cada movimiento; summary() al
+// reportar. No es seguro entre contextos (todo ocurre en loop()).
+
+#ifndef TRANSITION_STATS_MAX_ANGLES
+#define TRANSITION_STATS_MAX_ANGLES 4
+#endif
+
+#define TRANSITION_HIST_SUB     8    // Subdivisiones por potencia de 2
+#define TRANSITION_HIST_BUCKETS 144  // Hasta 2^20 µs
+
+struct TransitionSummary {
+  uint32_t count;
+  uint32_t meanUs;
+  uint32_t p99Us;          // Límite superior del intervalo del histograma
+  uint32_t maxUs;
+  uint16_t meanSteps;
+  uint16_t maxSteps;
+};
+
+class TransitionStats {
+public:
+  void begin(uint8_t angles);
+  void reset();
+
+  void record(uint8_t from, uint8_t to, uint32_t durationUs, uint32_t steps);
+
+  TransitionSummary summary(uint8_t from, uint8_t to) const;
+  uint8_t angles() const { return angleCount; }
+
+private:
+  struct Cell {
+    uint32_t count;
+    uint64_t sumUs;
+    uint32_t maxUs;
+    uint32_t sumSteps;
+    uint16_t maxSteps;
+    uint16_t hist[TRANSITION_HIST_BUCKETS];
+  };
+
+  static uint8_t bucketOf(uint32_t us);
+  static uint32_t bucketUpper(uint8_t bucket);
+
+  Cell cells[TRANSITION_STATS_MAX_ANGLES][TRANSITION_STATS_MAX_ANGLES];
+  uint8_t angleCount = 0;
+};
+
+#endif // TRANSITION_STATS_H
@@ -6,6 +6,9 @@
 #include <ArduinoJson.h>
 #include <esp_now.h>
 #include <esp_wifi.h>
+#include <AsyncLog.h>
+#include <WsCommand.h>
+#include <HeapStats.h>
 
 // ==============================================
 // Configuración de RED
@@ -99,7 +102,7 @@ void onESPNowReceive(const uint8_t *mac_addr, const uint8_t *data, int len) {
   
   if(isMotor && !motorConnected) {
     motorConnected = true;
-    Serial.println("[Central] ✓ Motor conectado");
+    LOG_I("[Central] ✓ Motor conectado");
   }
   
   switch(response.status) {
@@ -108,18 +111,18 @@ void onESPNowReceive(const uint8_t *mac_addr, const uint8_t *data, int len) {
       
     case STATUS_HOME_COMPLETE:
       motorHomed = true;
-      Serial.println("[Central] Motor homing completado");
+      LOG_I("[Central] Motor homing completado");
       webSocket.broadcastTXT("STATUS:HOMING_COMPLETE");
       break;
       
     case STATUS_READY:
       motorReady = true;
       motorCurrentAngle = response.currentAngle;
-      Serial.printf("[Central] Motor listo en %.2f°\n", motorCurrentAngle);
+      LOG_I("[Central] Motor listo en %.2f°", motorCurrentAngle);
       break;
       
     case STATUS_ERROR:
-      Serial.println("[Central] ERROR en motor");
+      LOG_E("[Central] ERROR en motor");
       webSocket.broadcastTXT("STATUS:ERROR:Motor error");
       break;
   }
@@ -130,7 +133,7 @@ void sendCommandToMotor(uint8_t cmd, float angle = 0.0) {
   esp_err_t result = esp_now_send(motorMAC, (uint8_t*)&command, sizeof(command));
   
   if(result != ESP_OK) {
-    Serial.printf("[Central] ERROR enviando comando: %d\n", result);
+    LOG_E("[Central] ERROR enviando comando: %d", result);
   }
 }
 
@@ -141,7 +144,7 @@ void waitForMotorReady() {
   }
   
   if (!motorReady) {
-    Serial.println("[Central] TIMEOUT esperando motor");
+    LOG_W("[Central] TIMEOUT esperando motor");
     webSocket.broadcastTXT("STATUS:ERROR:Motor timeout");
   }
 }
@@ -152,7 +155,8 @@ void waitForMotorReady() {
 
 float getMeasurementFromPython(int numSamples) {
   // Solicitar medición a Python
-  PYTHON_SERIAL.println("GET_POWER:" + String(numSamples));
+  PYTHON_SERIAL.print("GET_POWER:");
+  PYTHON_SERIAL.println(numSamples);
   PYTHON_SERIAL.flush();
   
   float totalPower = 0.0;
@@ -163,15 +167,17 @@ float getMeasurementFromPython(int numSamples) {
     PYTHON_SERIAL.read(); 
   }
   
-  // Recibir muestras de Python
+  // Recibir muestras de Python (una por línea, en un buffer fijo)
+  char line[32];
   unsigned long timeout = millis();
   while (receivedSamples < numSamples && millis() - timeout < 10000) {
     if (PYTHON_SERIAL.available() > 0) {
-      String data = PYTHON_SERIAL.readStringUntil('\n');
-      data.trim();
+      size_t len = PYTHON_SERIAL.readBytesUntil('\n', line, sizeof(line) - 1);
+      while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+      line[len] = '\0';
       
-      if (data.length() > 0) {
-        float powerMicroW = data.toFloat();
+      if (len > 0) {
+        float powerMicroW = strtof(line, nullptr);
         totalPower += powerMicroW;
         receivedSamples++;
         timeout = millis();  // Reset timeout en cada muestra
@@ -181,8 +187,8 @@ float getMeasurementFromPython(int numSamples) {
   }
   
   if (receivedSamples < numSamples) {
-    Serial.printf("[Central] ADVERTENCIA: Solo %d/%d muestras recibidas\n", 
-                  receivedSamples, numSamples);
+    LOG_W("[Central] ADVERTENCIA: Solo %d/%d muestras recibidas", 
+          receivedSamples, numSamples);
   }
   
   return (receivedSamples > 0) ? (totalPower / receivedSamples) : 0.0;
@@ -192,62 +198,90 @@ float getMeasurementFromPython(int numSamples) {
 // WebSocket Handlers
 // ==============================================
 
-void handleWebSocketMessage(uint8_t num, uint8_t* payload, size_t length) {
-    String message = String((char*)payload).substring(0, length);
+// Guarda las series recibidas en SPIFFS y responde con la lista de archivos.
+// Los documentos JSON son estáticos (no se reservan en cada mensaje) y el
+// parseo es zero-copy: las cadenas quedan apuntando al propio payload.
+static void saveSeries(uint8_t num, char* json, size_t length) {
+    static StaticJsonDocument<8192> doc;
+    static StaticJsonDocument<1024> filesInfo;
+    static char response[1024];
+
+    DeserializationError error = deserializeJson(doc, json, length);
+    if (error) {
+        LOG_E("SAVE_SERIES: JSON inválido (%s)", error.c_str());
+        return;
+    }
 
-    if (message.startsWith("SAVE_SERIES:")) {
-        DynamicJsonDocument doc(8192);
-        deserializeJson(doc, message.substring(12));
-        
-        String dirPath = doc["dirPath"].as<String>();
-        JsonArray series = doc["series"];
+    const char* dirPath = doc["dirPath"] | "";
+    JsonArray series = doc["series"];
+    
+    if (!SPIFFS.mkdir(dirPath)) {
+        LOG_E("Error creando directorio: %s", dirPath);
+        return;
+    }
+
+    filesInfo.clear();
+    JsonArray filesArray = filesInfo.to<JsonArray>();
+
+    for(JsonVariant v : series) {
+        const char* name = v["name"] | "";
+        char fileName[64];
+        int pathLen = snprintf(fileName, sizeof(fileName), "%s/%s", dirPath, name);
+        if (pathLen < 0 || pathLen >= (int)sizeof(fileName)) {
+            LOG_E("Ruta demasiado larga: %s/%s", dirPath, name);
+            continue;
+        }
+
+        File file = SPIFFS.open(fileName, "w");
         
-        if (!SPIFFS.mkdir(dirPath)) {
-            Serial.println("Error creando directorio: " + dirPath);
-            return;
+        if(!file) {
+            LOG_E("Error creando archivo: %s", fileName);
+            continue;
         }
 
-        DynamicJsonDocument filesInfo(1024);
-        JsonArray filesArray = filesInfo.to<JsonArray>();
+        const char* content = v["content"] | "";
+        file.write((const uint8_t*)content, strlen(content));
+        file.close();
 
-        for(JsonVariant v : series) {
-            String fileName = dirPath + "/" + v["name"].as<String>();
-            File file = SPIFFS.open(fileName, "w");
-            
-            if(!file) {
-                Serial.println("Error creando archivo: " + fileName);
-                continue;
-            }
+        JsonObject fileInfo = filesArray.createNestedObject();
+        fileInfo["name"] = name;
+        fileInfo["path"] = fileName;  // char[]: ArduinoJson copia la cadena
+    }
 
-            file.print(v["content"].as<String>());
-            file.close();
+    const size_t prefixLen = strlen("SAVE_COMPLETE:");
+    memcpy(response, "SAVE_COMPLETE:", prefixLen);
+    size_t jsonLen = serializeJson(filesArray, response + prefixLen, sizeof(response) - prefixLen);
+    webSocket.sendTXT(num, response, prefixLen + jsonLen);
+}
 
-            JsonObject fileInfo = filesArray.createNestedObject();
-            fileInfo["name"] = v["name"].as<String>();
-            fileInfo["path"] = fileName;
+// ==============================================
+// Los comandos se interpretan directamente sobre el payload, sin copiarlo a
+// String: en sesiones largas las copias fragmentaban el heap.
+// ==============================================
+void handleWebSocketMessage(uint8_t num, uint8_t* payload, size_t length) {
+    if (wsStartsWith(payload, length, "SAVE_SERIES:")) {
+        saveSeries(num, (char*)payload + 12, length - 12);
+    }
+    else if (wsStartsWith(payload, length, "CONFIG:")) {
+        // CONFIG:<angleMax>,<angleStep>,<numSamples>,<numExecutions>
+        float values[4];
+        if (wsParseFloats((const char*)payload + 7, length - 7, ',', values, 4) != 4) {
+            webSocket.sendTXT(num, "STATUS:ERROR:Configuración inválida");
+            return;
         }
 
-        String response;
-        serializeJson(filesArray, response);
-        webSocket.sendTXT(num, "SAVE_COMPLETE:" + response);
-    }
-    else if (message.startsWith("CONFIG:")) {
-        int firstComma = message.indexOf(',');
-        int secondComma = message.indexOf(',', firstComma + 1);
-        int thirdComma = message.indexOf(',', secondComma + 1);
-
-        angleMax = message.substring(7, firstComma).toFloat();
-        angleStep = message.substring(firstComma + 1, secondComma).toFloat();
-        numSamples = message.substring(secondComma + 1, thirdComma).toInt();
-        numExecutions = message.substring(thirdComma + 1).toInt();
+        angleMax = values[0];
+        angleStep = values[1];
+        numSamples = (int)values[2];
+        numExecutions = (int)values[3];
         currentExecution = 0;
         currentAngle = 0.0;
 
-        Serial.println("Configuración recibida:");
-        Serial.printf("  Ángulo máximo: %.2f°\n", angleMax);
-        Serial.printf("  Paso angular: %.2f°\n", angleStep);
-        Serial.printf("  Muestras por punto: %d\n", numSamples);
-        Serial.printf("  Ejecuciones: %d\n", numExecutions);
+        LOG_I("Configuración recibida:");
+        LOG_I("  Ángulo máximo: %.2f°", angleMax);
+        LOG_I("  Paso angular: %.2f°", angleStep);
+        LOG_I("  Muestras por punto: %d", numSamples);
+        LOG_I("  Ejecuciones: %d", numExecutions);
 
         // Verificar que el motor esté listo
         if (!motorConnected) {
@@ -264,31 +298,31 @@ void handleWebSocketMessage(uint8_t num, uint8_t* payload, size_t length) {
         isPaused = false;
         webSocket.sendTXT(num, "STATUS:START");
     }
-    else if (message == "PAUSE") {
+    else if (wsEquals(payload, length, "PAUSE")) {
         isPaused = true;
         webSocket.sendTXT(num, "STATUS:PAUSED");
-        Serial.println("Proceso pausado");
+        LOG_I("Proceso pausado");
     }
-    else if (message == "RESUME") {
+    else if (wsEquals(payload, length, "RESUME")) {
         isPaused = false;
         webSocket.sendTXT(num, "STATUS:RESUMED");
-        Serial.println("Proceso reanudado");
+        LOG_I("Proceso reanudado");
     }
-    else if (message == "RESET") {
+    else if (wsEquals(payload, length, "RESET")) {
         processStarted = false;
         isPaused = false;
         
-        Serial.println("Ejecutando reset y homing...");
+        LOG_I("Ejecutando reset y homing...");
         motorHomed = false;
         sendCommandToMotor(CMD_HOME);
         
         webSocket.sendTXT(num, "STATUS:RESETTING");
     }
-    else if (message == "HOMING") {
+    else if (wsEquals(payload, length, "HOMING")) {
         processStarted = false;
         isPaused = false;
         
-        Serial.println("Homing solicitado desde web...");
+        LOG_I("Homing solicitado desde web...");
         motorHomed = false;
         sendCommandToMotor(CMD_HOME);
         
@@ -308,6 +342,7 @@ void onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t lengt
 
 void setup() {
     PYTHON_SERIAL.begin(115200);
+    logBegin();  // Logging diferido (ver lib/AsyncLog); las órdenes a Python siguen siendo directas
     delay(500);
     Serial.println("\n=== CENTRAL - CARACTERIZADOR LÁMINAS ===");
 
@@ -413,6 +448,13 @@ void setup() {
         }
     });
 
+    // Estado del heap (fragmentación) para pruebas de funcionamiento prolongado
+    server.on("/api/heap", HTTP_GET, []() {
+        char json[192];
+        heapStatsJson(json, sizeof(json));
+        server.send(200, "application/json", json);
+    });
+
     server.begin();
     Serial.println("Servidor HTTP iniciado");
 
@@ -440,6 +482,7 @@ void setup() {
 void loop() {
     server.handleClient();
     webSocket.loop();
+    heapStatsLoop();
 
     if (processStarted && !isPaused) {
         // Calcular siguiente ángulo
@@ -450,7 +493,7 @@ void loop() {
             nextAngle = angleMax;  // Asegurar que llegue exactamente al ángulo máximo
         }
 
-        Serial.printf("\n[Barrido] Moviendo a %.2f°\n", nextAngle);
+        LOG_I("\n[Barrido] Moviendo a %.2f°", nextAngle);
         
         // Enviar comando de movimiento al motor
         motorReady = false;
@@ -465,24 +508,26 @@ void loop() {
         }
 
         // Tomar medición via Python
-        Serial.printf("[Barrido] Tomando %d mediciones...\n", numSamples);
+        LOG_I("[Barrido] Tomando %d mediciones...", numSamples);
         float averagePower = getMeasurementFromPython(numSamples);
         
-        Serial.printf("[Barrido] Potencia promedio: %.6f µW\n", averagePower);
+        LOG_I("[Barrido] Potencia promedio: %.6f µW", averagePower);
         
         // Enviar datos a web
-        webSocket.broadcastTXT("DATA:" + String(motorCurrentAngle) + "," + String(averagePower));
+        char dataMsg[48];
+        int dataLen = snprintf(dataMsg, sizeof(dataMsg), "DATA:%.2f,%.2f", motorCurrentAngle, averagePower);
+        webSocket.broadcastTXT(dataMsg, dataLen < (int)sizeof(dataMsg) ? dataLen : sizeof(dataMsg) - 1);
         
         currentAngle = nextAngle;
 
         // Verificar si completamos el barrido
         if (isLastStep) {
             currentExecution++;
-            Serial.printf("✓ Ejecución %d/%d completada\n", currentExecution, numExecutions);
+            LOG_I("✓ Ejecución %d/%d completada", currentExecution, numExecutions);
             
             if (currentExecution < numExecutions) {
                 webSocket.broadcastTXT("STATUS:NEW_RUN");
-                Serial.println("Iniciando nueva ejecución...");
+                LOG_I("Iniciando nueva ejecución...");
                 
                 // Verificar si angleMax es múltiplo de 360°
                 bool isFullRotation = (abs(fmod(angleMax, 360.0)) < 0.01);
@@ -507,7 +552,7 @@ void loop() {
                 
                 processStarted = false;
                 webSocket.broadcastTXT("STATUS:COMPLETE");
-                Serial.println("✅ Caracterización completada\n");
+                LOG_I("✅ Caracterización completada\n");
             }
         }
     }
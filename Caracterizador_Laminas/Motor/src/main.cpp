@@ -6,6 +6,8 @@
 #include <TMC2130Stepper.h>
 #include <AccelStepper.h>
 #include <math.h>
+#include <AsyncLog.h>
+#include <MotionEngine.h>
 
 // ======================
 // CONFIGURACIÓN - MOTOR CARACTERIZADOR
@@ -25,12 +27,17 @@
 
 #define SM_RESOLUTION 200
 #define GEAR_RATIO 3.0
+#define MICROSTEPS 4        // Fijo en compilación: de él salen los pasos por vuelta
+
+// Pasos por vuelta de la lámina y conversión ángulo <-> pasos sin coma flotante
+// (el C3 no tiene FPU; ver lib/MotionEngine/src/StepAngle.h)
+constexpr uint32_t STEPS_PER_REV = STEPS_PER_REV_OF(SM_RESOLUTION, MICROSTEPS, GEAR_RATIO);
+typedef StepAngle<STEPS_PER_REV> Angle;
 
 // Motor parameters
 int   stepperCurrent = 500;   // mA
 int   stepperSpeed   = 6000;  // steps/s (mismo que Central original)
 int   stepperAcc     = 50000; // steps/s^2 (mismo que Central original)
-int   microsteps     = 4;
 
 // WiFi TX power
 int   wifiTxPower = 34;  // ESP32-C3 Super Mini funciona mejor con potencia moderada
@@ -45,6 +52,7 @@ bool centralRegistered = false;
 // Driver + stepper
 TMC2130Stepper driver = TMC2130Stepper(SPI_CS, SPI_MOSI, SPI_MISO, SPI_SCLK);
 AccelStepper stepper = AccelStepper(AccelStepper::DRIVER, STEP_PIN, DIR_PIN);
+MotionEngine motion(stepper);  // Pasos por temporizador de hardware (lib/MotionEngine)
 
 // ==============================================
 // ESTRUCTURAS ESP-NOW
@@ -80,7 +88,13 @@ struct ResponseData {
 // ==============================================
 volatile bool hallTriggered = false;
 bool isHomed = false;
-float currentTargetAngle = 0.0;
+int32_t currentTargetAngle = 0;  // Milésimas de grado
+
+// Comando recibido en el callback ESP-NOW, ejecutado en loop(). El callback
+// corre en la tarea WiFi y no debe quedarse esperando al motor.
+volatile bool cmdPending = false;
+volatile uint8_t pendingCmd = 0;
+volatile int32_t pendingAngle = 0;  // Milésimas de grado
 
 // ==============================================
 // FUNCIONES
@@ -90,16 +104,30 @@ void IRAM_ATTR hallISR() {
     hallTriggered = true;
 }
 
-long angleToSteps(float angle) {
-  return -(long)round((angle / 360.0) * (SM_RESOLUTION * microsteps * GEAR_RATIO));
+// Ángulos en milésimas de grado (sentido de giro invertido respecto a los pasos)
+long angleToSteps(int32_t angle) {
+  return -Angle::toSteps(angle);
+}
+
+int32_t getCurrentAngle() {
+    return -Angle::toMilliDeg(motion.position());
+}
+
+// Esperar a que el MotionEngine termine el movimiento en curso
+void waitMotion() {
+    while (motion.busy()) {
+        yield();
+    }
 }
 
-float getCurrentAngle() {
-    return -(stepper.currentPosition() * 360.0) / (SM_RESOLUTION * microsteps * GEAR_RATIO);
+// Un paso suelto (aproximaciones finas del homing)
+void stepOnce(int dir) {
+    motion.moveTo(motion.position() + dir, 0);
+    waitMotion();
 }
 
 void performHoming() {
-    Serial.println("[Motor] Iniciando homing...");
+    LOG_I("[Motor] Iniciando homing...");
     
     pinMode(HALL_SENSOR_PIN, INPUT);
     int initialState = digitalRead(HALL_SENSOR_PIN);
@@ -107,66 +135,54 @@ void performHoming() {
     hallTriggered = false;
     attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, FALLING);
     
-    stepper.setMaxSpeed(5500);
-    stepper.setAcceleration(50000);
+    motion.setSpeed(5500, 50000);
     
-    long stepsFor360 = (long)round((SM_RESOLUTION * microsteps * GEAR_RATIO));
-    stepper.moveTo(stepper.currentPosition() + stepsFor360 * 3);
+    long stepsFor360 = STEPS_PER_REV;
     
     // Si el sensor ya está activado, alejarse primero
     if (initialState == LOW) {
-        Serial.println("[Motor] Sensor ya activado, alejándose...");
+        LOG_I("[Motor] Sensor ya activado, alejándose...");
         detachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN));
         
         int steps = 0;
         while (digitalRead(HALL_SENSOR_PIN) == LOW && steps < 500) {
-            stepper.moveTo(stepper.currentPosition() + 1);
-            while (stepper.distanceToGo() != 0) {
-                stepper.run();
-            }
+            stepOnce(1);
             steps++;
         }
         
         hallTriggered = false;
         attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, FALLING);
-        stepper.moveTo(stepper.currentPosition() + stepsFor360 * 3);
     }
     
-    // Búsqueda rápida del sensor
-    while (!hallTriggered) {
-        stepper.run();
+    // Búsqueda rápida del sensor (tres vueltas como máximo)
+    motion.moveTo(motion.position() + stepsFor360 * 3, 0);
+    while (!hallTriggered && motion.busy()) {
+        yield();
     }
     
-    long positionAtTrigger = stepper.currentPosition();
+    long positionAtTrigger = motion.position();
     detachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN));
     
-    // Mover 345° adicionales
-    long stepsFor345 = (long)round((345.0 / 360.0) * (SM_RESOLUTION * microsteps * GEAR_RATIO));
-    stepper.moveTo(positionAtTrigger + stepsFor345);
-    while (stepper.distanceToGo() != 0) {
-        stepper.run();
-        yield();
-    }
+    // Mover 345° adicionales (reprograma el objetivo sin detenerse)
+    long stepsFor345 = Angle::toSteps(MDEG(345.0));
+    motion.moveTo(positionAtTrigger + stepsFor345, 0);
+    waitMotion();
     
     // Aproximación fina
-    stepper.setMaxSpeed(4000);
+    motion.setSpeed(4000, 50000);
     while (digitalRead(HALL_SENSOR_PIN) == HIGH) {
-        stepper.moveTo(stepper.currentPosition() + 1);
-        while (stepper.distanceToGo() != 0) {
-            stepper.run();
-        }
-        yield();
+        stepOnce(1);
     }
     
     // Establecer posición 0
-    stepper.setCurrentPosition(0);
+    motion.setPosition(0);
     
     // Restaurar velocidad normal
-    stepper.setMaxSpeed(stepperSpeed);
-    stepper.setAcceleration(stepperAcc);
+    motion.setSpeed(stepperSpeed, stepperAcc);
+    waitMotion();
     
     isHomed = true;
-    Serial.println("[Motor] Homing completado - Posición 0°");
+    LOG_I("[Motor] Homing completado - Posición 0°");
     
     // Notificar al Central
     if (centralRegistered) {
@@ -175,35 +191,31 @@ void performHoming() {
     }
 }
 
-void moveToAngle(float targetAngle) {
+void moveToAngle(int32_t targetAngle) {
     if (!isHomed) {
-        Serial.println("[Motor] ERROR: Not homed");
+        LOG_E("[Motor] ERROR: Not homed");
         if (centralRegistered) {
-            ResponseData response = {STATUS_ERROR, getCurrentAngle(), 0};
+            ResponseData response = {STATUS_ERROR, mdegToDeg(getCurrentAngle()), 0};
             esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
         }
         return;
     }
     
-    Serial.printf("[Motor] Moviendo a %.2f°\n", targetAngle);
+    LOG_I("[Motor] Moviendo a %.3f°", mdegToDeg(targetAngle));
     
     long steps = angleToSteps(targetAngle);
-    stepper.moveTo(steps);
+    motion.moveTo(steps, 0);
+    waitMotion();
     
-    while (stepper.distanceToGo() != 0) {
-        stepper.run();
-        yield();
-    }
-    
-    float finalAngle = getCurrentAngle();
-    Serial.printf("[Motor] Posición alcanzada: %.2f°\n", finalAngle);
+    int32_t finalAngle = getCurrentAngle();
+    LOG_I("[Motor] Posición alcanzada: %.3f°", mdegToDeg(finalAngle));
     
     // Pequeña pausa para estabilización
     delay(100);
     
     // Notificar que está listo
     if (centralRegistered) {
-        ResponseData response = {STATUS_READY, finalAngle, 0};
+        ResponseData response = {STATUS_READY, mdegToDeg(finalAngle), 0};
         esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
     }
 }
@@ -226,12 +238,9 @@ void OnDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len) {
             
             if (esp_now_add_peer(&peerInfo) == ESP_OK) {
                 centralRegistered = true;
-                Serial.print("[Motor] ✓ Central registrado: ");
-                for (int i = 0; i < 6; i++) {
-                    Serial.printf("%02X", centralMAC[i]);
-                    if (i < 5) Serial.print(":");
-                }
-                Serial.println();
+                LOG_I("[Motor] ✓ Central registrado: %02X:%02X:%02X:%02X:%02X:%02X",
+                      centralMAC[0], centralMAC[1], centralMAC[2],
+                      centralMAC[3], centralMAC[4], centralMAC[5]);
             }
         } else {
             centralRegistered = true;
@@ -241,31 +250,30 @@ void OnDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len) {
     // Procesar comandos
     switch (cmd.cmd) {
         case CMD_PING: {
-            ResponseData response = {STATUS_PONG, getCurrentAngle(), 0};
+            ResponseData response = {STATUS_PONG, mdegToDeg(getCurrentAngle()), 0};
             esp_now_send(centralMAC, (uint8_t*)&response, sizeof(response));
             break;
         }
         
         case CMD_HOME:
-            Serial.println("[Motor] HOME");
-            performHoming();
-            break;
-            
         case CMD_MOVE_TO_ANGLE:
-            Serial.printf("[Motor] MOVE_TO %.2f°\n", cmd.targetAngle);
-            currentTargetAngle = cmd.targetAngle;
-            moveToAngle(cmd.targetAngle);
+            // Se ejecutan en loop(); un comando nuevo reemplaza al no atendido
+            pendingAngle = degToMdeg(cmd.targetAngle);
+            pendingCmd = cmd.cmd;
+            cmdPending = true;
             break;
             
         case CMD_ABORT:
-            Serial.println("[Motor] ABORT");
-            stepper.stop();
+            LOG_I("[Motor] ABORT");
+            cmdPending = false;
+            motion.stop();  // Seguro desde el callback: se aplica en el siguiente tick
             break;
     }
 }
 
 void setup() {
     Serial.begin(115200);
+    logBegin();  // Logging diferido (ver lib/AsyncLog)
     delay(500);
     Serial.println("\n=== MOTOR CARACTERIZADOR - ESP-NOW ===");
     
@@ -314,7 +322,7 @@ void setup() {
         driver.rms_current(stepperCurrent);
         driver.stealthChop(0);
         driver.pwm_autoscale(true);
-        driver.microsteps(microsteps);
+        driver.microsteps(MICROSTEPS);
         Serial.println("[Motor] TMC2130 OK");
     } else {
         Serial.println("[Motor] ERROR: TMC2130");
@@ -326,10 +334,27 @@ void setup() {
     stepper.setPinsInverted(false, true, false);
     stepper.enableOutputs();
     
+    if (!motion.begin(STEP_PIN, DIR_PIN, true, false)) {  // Mismas inversiones que setPinsInverted
+        Serial.println("[Motor] ERROR: Temporizador de movimiento");
+    }
+    
     Serial.println("[Motor] READY\n");
 }
 
 void loop() {
-    stepper.run();
+    if (cmdPending) {
+        cmdPending = false;
+        uint8_t cmd = pendingCmd;
+        int32_t angle = pendingAngle;
+        
+        if (cmd == CMD_HOME) {
+            LOG_I("[Motor] HOME");
+            performHoming();
+        } else if (cmd == CMD_MOVE_TO_ANGLE) {
+            LOG_I("[Motor] MOVE_TO %.3f°", mdegToDeg(angle));
+            currentTargetAngle = angle;
+            moveToAngle(angle);
+        }
+    }
     yield();  // Optimizado: yield() en lugar de delay()
 }
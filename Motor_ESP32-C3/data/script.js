@@ -166,7 +166,8 @@ function updateUI() {
     }
     
     // Ángulo mínimo
-    minAngleDisplay.textContent = motorData.minAngle.toFixed(2) + '° (' +
+    // Con aproximación fina el paso queda por debajo de la centésima de grado
+    minAngleDisplay.textContent = motorData.minAngle.toFixed(motorData.minAngle < 0.01 ? 4 : 2) + '° (' +
         (360 / motorData.minAngle).toFixed(0) + ' pasos/rev)';
     
     // Habilitar/deshabilitar botones
@@ -195,12 +196,13 @@ function validateAngle(angle) {
         errors.push('El ángulo debe estar entre 0° y 360°');
     }
     
-    // Múltiplo del ángulo mínimo
+    // Múltiplo del ángulo mínimo (con aproximación fina cualquier centésima
+    // vale: el motor redondea al micropaso fino más cercano)
     const steps = angle / motorData.minAngle;
     const roundedSteps = Math.round(steps);
     const diff = Math.abs(steps - roundedSteps);
     
-    if (diff > 0.001) {
+    if (motorData.minAngle >= 0.01 && diff > 0.001) {
         const correctedAngle = (roundedSteps * motorData.minAngle).toFixed(2);
         errors.push(`El ángulo debe ser múltiplo de ${motorData.minAngle.toFixed(2)}°. Redondeado: ${correctedAngle}°`);
     }
@@ -7,6 +7,8 @@
 #include <TMC2130Stepper.h>
 #include <AccelStepper.h>
 #include <math.h>
+#include <AsyncLog.h>
+#include <MotionEngine.h>
 
 // ======================
 // CONFIGURACIÓN - MOTOR CARACTERIZADOR WEB
@@ -38,16 +40,32 @@ IPAddress subnet;
 
 #define SM_RESOLUTION 200
 #define GEAR_RATIO 3.0
+#define MICROSTEPS 4        // Fijo en compilación: de él salen los pasos por vuelta
+
+// Pasos por vuelta de la lámina y conversión ángulo <-> pasos sin coma flotante
+// (el C3 no tiene FPU; ver lib/MotionEngine/src/StepAngle.h)
+constexpr uint32_t STEPS_PER_REV = STEPS_PER_REV_OF(SM_RESOLUTION, MICROSTEPS, GEAR_RATIO);
+typedef StepAngle<STEPS_PER_REV> Angle;
+
+// Aproximación fina: el recorrido se hace con MICROSTEPS (velocidad) y el
+// último tramo, de menos de un paso grueso, con FINE_MICROSTEPS (resolución)
+#define FINE_MICROSTEPS 64
+constexpr long FINE_RATIO = FINE_MICROSTEPS / MICROSTEPS;  // Pasos finos por paso grueso
+static_assert(FINE_MICROSTEPS % MICROSTEPS == 0 && FINE_MICROSTEPS <= 256,
+              "FINE_MICROSTEPS debe ser múltiplo de MICROSTEPS y como mucho 256");
+typedef StepAngle<STEPS_PER_REV * FINE_RATIO> FineAngle;
+#define FINE_SPEED 2000      // pasos finos/s (el tramo fino dura unos ms)
+#define FINE_ACC 40000       // pasos finos/s²
 
 // Motor parameters
 int   stepperCurrent = 600;   // mA (incrementado para mejor torque)
 int   stepperSpeed   = 4000;  // steps/s
 int   stepperAcc     = 18000; // steps/s^2 (reducido para estabilidad)
-int   microsteps     = 4;
 
 // Driver + stepper
 TMC2130Stepper driver = TMC2130Stepper(SPI_CS, SPI_MOSI, SPI_MISO, SPI_SCLK);
 AccelStepper stepper = AccelStepper(AccelStepper::DRIVER, STEP_PIN, DIR_PIN);
+MotionEngine motion(stepper);  // Pasos por temporizador de hardware (lib/MotionEngine)
 
 // Servidor Web HTTP
 AsyncWebServer server(80);
@@ -57,7 +75,9 @@ AsyncWebServer server(80);
 // ==============================================
 volatile bool hallTriggered = false;
 bool isHomed = false;
-float currentTargetAngle = 0.0;
+int32_t currentTargetAngle = 0;  // Milésimas de grado
+bool fineApproach = true;        // El último movimiento se aproximó con FINE_MICROSTEPS (GET /api/status)
+bool fineMode = false;           // Driver en FINE_MICROSTEPS: posición del MotionEngine en pasos finos
 enum MotorState { IDLE, HOMING, MOVING, ERROR_STATE };
 MotorState motorState = IDLE;
 
@@ -69,17 +89,75 @@ void IRAM_ATTR hallISR() {
     hallTriggered = true;
 }
 
-long angleToSteps(float angle) {
-  return -(long)round((angle / 360.0) * (SM_RESOLUTION * microsteps * GEAR_RATIO));
+// Ángulos en milésimas de grado (sentido de giro invertido respecto a los pasos)
+long angleToSteps(int32_t angle) {
+  return -Angle::toSteps(angle);
+}
+
+int32_t getCurrentAngle() {
+    if (fineMode) return -FineAngle::toMilliDeg(motion.position());
+    return -Angle::toMilliDeg(motion.position());
+}
+
+// Esperar a que el MotionEngine termine el movimiento en curso
+void waitMotion() {
+    while (motion.busy()) {
+        yield();
+    }
+}
+
+// Un paso suelto (aproximaciones finas del homing)
+void stepOnce(int dir) {
+    motion.moveTo(motion.position() + dir, 0);
+    waitMotion();
 }
 
-float getCurrentAngle() {
-    return -(stepper.currentPosition() * 360.0) / (SM_RESOLUTION * microsteps * GEAR_RATIO);
+// ==============================================
+// MICROPASOS DINÁMICOS
+// ==============================================
+// El TMC2130 aplica MRES al momento y su contador de micropasos (MSCNT) sigue
+// donde estaba: pasar a fino es exacto en cualquier posición, y volver a
+// grueso solo en un múltiplo de FINE_RATIO pasos finos (si no, el siguiente
+// paso grueso redondea y se pierde la posición). Los cambios se hacen con el
+// motor parado, y con ellos se reescala la posición del MotionEngine: en modo
+// fino cuenta pasos finos.
+
+static long floorDiv(long a, long b) {
+    long q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+void enterFineMode() {
+    if (fineMode) return;
+    motion.setPosition(motion.position() * FINE_RATIO);
+    driver.microsteps(FINE_MICROSTEPS);
+    motion.setSpeed(FINE_SPEED, FINE_ACC);
+    fineMode = true;
+}
+
+// Vuelve a MICROSTEPS por el múltiplo de FINE_RATIO más cercano en el sentido
+// 'dir' (0 = el más cercano)
+void leaveFineMode(int dir = 0) {
+    if (!fineMode) return;
+    long position = motion.position();
+    long grid = floorDiv(position, FINE_RATIO) * FINE_RATIO;
+    if (grid != position && (dir > 0 || (dir == 0 && position - grid > FINE_RATIO / 2))) {
+        grid += FINE_RATIO;
+    }
+    if (grid != position) {
+        motion.moveTo(grid, 0);
+        waitMotion();
+    }
+    driver.microsteps(MICROSTEPS);
+    motion.setPosition(grid / FINE_RATIO);
+    motion.setSpeed(stepperSpeed, stepperAcc);
+    fineMode = false;
 }
 
 void performHoming() {
-    Serial.println("[Motor] Iniciando homing...");
+    LOG_I("[Motor] Iniciando homing...");
     motorState = HOMING;
+    leaveFineMode();  // El homing cuenta pasos gruesos
     
     pinMode(HALL_SENSOR_PIN, INPUT);
     int initialState = digitalRead(HALL_SENSOR_PIN);
@@ -87,89 +165,94 @@ void performHoming() {
     hallTriggered = false;
     attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, FALLING);
     
-    stepper.setMaxSpeed(4500);     // Reducido de 5500 para evitar trabado
-    stepper.setAcceleration(18000); // Reducido de 50000 para aceleración ajustada
+    motion.setSpeed(4500, 18000);  // Reducidos de 5500 / 50000 para evitar trabado
     
-    long stepsFor360 = (long)round((SM_RESOLUTION * microsteps * GEAR_RATIO));
-    stepper.moveTo(stepper.currentPosition() + stepsFor360 * 3);
+    long stepsFor360 = STEPS_PER_REV;
     
     // Si el sensor ya está activado, alejarse primero
     if (initialState == LOW) {
-        Serial.println("[Motor] Sensor ya activado, alejándose...");
+        LOG_I("[Motor] Sensor ya activado, alejándose...");
         detachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN));
         
         int steps = 0;
         while (digitalRead(HALL_SENSOR_PIN) == LOW && steps < 500) {
-            stepper.moveTo(stepper.currentPosition() + 1);
-            while (stepper.distanceToGo() != 0) {
-                stepper.run();
-            }
+            stepOnce(1);
             steps++;
         }
         
         hallTriggered = false;
         attachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN), hallISR, FALLING);
-        stepper.moveTo(stepper.currentPosition() + stepsFor360 * 3);
     }
     
-    // Búsqueda rápida del sensor
-    while (!hallTriggered) {
-        stepper.run();
+    // Búsqueda rápida del sensor (tres vueltas como máximo)
+    motion.moveTo(motion.position() + stepsFor360 * 3, 0);
+    while (!hallTriggered && motion.busy()) {
+        yield();
     }
     
-    long positionAtTrigger = stepper.currentPosition();
+    long positionAtTrigger = motion.position();
     detachInterrupt(digitalPinToInterrupt(HALL_SENSOR_PIN));
     
-    // Mover 345° adicionales
-    long stepsFor345 = (long)round((345.0 / 360.0) * (SM_RESOLUTION * microsteps * GEAR_RATIO));
-    stepper.moveTo(positionAtTrigger + stepsFor345);
-    while (stepper.distanceToGo() != 0) {
-        stepper.run();
-        yield();
-    }
+    // Mover 345° adicionales (reprograma el objetivo sin detenerse)
+    long stepsFor345 = Angle::toSteps(MDEG(345.0));
+    motion.moveTo(positionAtTrigger + stepsFor345, 0);
+    waitMotion();
     
     // Aproximación fina
-    stepper.setMaxSpeed(4000);
+    motion.setSpeed(4000, 18000);
     while (digitalRead(HALL_SENSOR_PIN) == HIGH) {
-        stepper.moveTo(stepper.currentPosition() + 1);
-        while (stepper.distanceToGo() != 0) {
-            stepper.run();
-        }
-        yield();
+        stepOnce(1);
     }
     
     // Establecer posición 0
-    stepper.setCurrentPosition(0);
+    motion.setPosition(0);
     
     // Restaurar velocidad normal
-    stepper.setMaxSpeed(stepperSpeed);
-    stepper.setAcceleration(stepperAcc);
+    motion.setSpeed(stepperSpeed, stepperAcc);
+    waitMotion();
     
     isHomed = true;
     motorState = IDLE;
-    Serial.println("[Motor] Homing completado - Posición 0°");
+    LOG_I("[Motor] Homing completado - Posición 0°");
 }
 
-void moveToAngle(float targetAngle) {
+// fine = aproximación con FINE_MICROSTEPS (POST /api/move "fine", por defecto sí)
+void moveToAngle(int32_t targetAngle, bool fine) {
     if (!isHomed) {
-        Serial.println("[Motor] ERROR: Not homed");
+        LOG_E("[Motor] ERROR: Not homed");
         motorState = ERROR_STATE;
         return;
     }
     
-    Serial.printf("[Motor] Moviendo a %.2f°\n", targetAngle);
+    LOG_I("[Motor] Moviendo a %.3f°", mdegToDeg(targetAngle));
     motorState = MOVING;
+    fineApproach = fine;
     
-    long steps = angleToSteps(targetAngle);
-    stepper.moveTo(steps);
-    
-    while (stepper.distanceToGo() != 0) {
-        stepper.run();
-        yield();
+    if (!fine) {
+        leaveFineMode();
+        motion.moveTo(angleToSteps(targetAngle), 0);
+        waitMotion();
+    } else {
+        // Objetivo en pasos finos: recorrido grueso hasta el paso anterior y
+        // el resto (menos de FINE_RATIO) con micropasos finos
+        long fineTarget = -FineAngle::toSteps(targetAngle);
+        long coarseTarget = floorDiv(fineTarget, FINE_RATIO);
+        if (fineMode && floorDiv(motion.position(), FINE_RATIO) != coarseTarget) {
+            leaveFineMode(fineTarget > motion.position() ? 1 : -1);
+        }
+        if (!fineMode) {
+            motion.moveTo(coarseTarget, 0);
+            waitMotion();
+        }
+        if (fineTarget != coarseTarget * FINE_RATIO || fineMode) {
+            enterFineMode();
+            motion.moveTo(fineTarget, 0);
+            waitMotion();
+        }
     }
     
-    float finalAngle = getCurrentAngle();
-    Serial.printf("[Motor] Posición alcanzada: %.2f°\n", finalAngle);
+    int32_t finalAngle = getCurrentAngle();
+    LOG_I("[Motor] Posición alcanzada: %.3f°", mdegToDeg(finalAngle));
     
     // Pequeña pausa para estabilización
     delay(100);
@@ -191,13 +274,15 @@ String getStatusJSON() {
     
     doc["status"] = stateStr;
     doc["homed"] = isHomed;
-    doc["angle"] = getCurrentAngle();
-    doc["targetAngle"] = currentTargetAngle;
-    doc["moving"] = (stepper.distanceToGo() != 0);
+    doc["angle"] = mdegToDeg(getCurrentAngle());
+    doc["targetAngle"] = mdegToDeg(currentTargetAngle);
+    doc["moving"] = motion.busy();
     
-    // Calcular ángulo mínimo
-    float minAngle = 360.0 / (SM_RESOLUTION * microsteps * GEAR_RATIO);
-    doc["minAngle"] = minAngle;
+    // Resolución angular: la de los micropasos finos si la aproximación fina está activa
+    uint32_t stepsPerRev = fineApproach ? FineAngle::stepsPerRev : Angle::stepsPerRev;
+    doc["minAngle"] = 360.0f / stepsPerRev;
+    doc["stepsPerRev"] = stepsPerRev;
+    doc["fineApproach"] = fineApproach;
     
     String output;
     serializeJson(doc, output);
@@ -206,6 +291,7 @@ String getStatusJSON() {
 
 void setup() {
     Serial.begin(115200);
+    logBegin();  // Logging diferido (ver lib/AsyncLog)
     delay(500);
     Serial.println("\n=== MOTOR CARACTERIZADOR - WEB INTERFACE ===");
     
@@ -284,7 +370,7 @@ void setup() {
     
     // POST /api/home - Iniciar homing
     server.on("/api/home", HTTP_POST, [](AsyncWebServerRequest *request){
-        Serial.println("[API] Comando: HOME");
+        LOG_I("[API] Comando: HOME");
         performHoming();
         request->send(200, "application/json", "{\"success\":true}");
     });
@@ -300,17 +386,18 @@ void setup() {
                 return;
             }
             
-            float angle = doc["angle"];
-            Serial.printf("[API] Comando: MOVE to %.2f°\n", angle);
+            int32_t angle = degToMdeg(doc["angle"].as<float>());
+            bool fine = doc["fine"] | true;  // Solo para esta petición
+            LOG_I("[API] Comando: MOVE to %.3f°%s", mdegToDeg(angle), fine ? "" : " (sin aproximación fina)");
             currentTargetAngle = angle;
-            moveToAngle(angle);
+            moveToAngle(angle, fine);
             request->send(200, "application/json", "{\"success\":true}");
     });
     
     // POST /api/stop - Detener motor
     server.on("/api/stop", HTTP_POST, [](AsyncWebServerRequest *request){
-        Serial.println("[API] Comando: STOP");
-        stepper.stop();
+        LOG_I("[API] Comando: STOP");
+        motion.stop();
         motorState = IDLE;
         request->send(200, "application/json", "{\"success\":true}");
     });
@@ -372,7 +459,7 @@ void setup() {
         driver.rms_current(stepperCurrent);
         driver.stealthChop(0);        // SpreadCycle para mejor torque en alta velocidad
         driver.pwm_autoscale(true);   // Ajuste automático de PWM
-        driver.microsteps(microsteps);
+        driver.microsteps(MICROSTEPS);
         
         // Configuración avanzada para reducir trabado en movimientos rápidos
         driver.toff(4);               // Off time (duración apagado chopper) - balance velocidad/estabilidad
@@ -392,15 +479,16 @@ void setup() {
     stepper.setPinsInverted(false, true, false);
     stepper.enableOutputs();
     
-    float minAngle = 360.0 / (SM_RESOLUTION * microsteps * GEAR_RATIO);
-    Serial.printf("[Motor] Ángulo mínimo: %.2f°\n", minAngle);
+    if (!motion.begin(STEP_PIN, DIR_PIN, true, false)) {  // Mismas inversiones que setPinsInverted
+        Serial.println("[Motor] ERROR: Temporizador de movimiento");
+    }
+    
+    Serial.printf("[Motor] Ángulo mínimo: %.3f° (recorrido), %.4f° (aproximación fina, %d micropasos)\n",
+                  mdegToDeg(Angle::stepMilliDeg()), 360.0f / FineAngle::stepsPerRev, FINE_MICROSTEPS);
     Serial.println("[Motor] READY\n");
 }
 
 void loop() {
-    // OPTIMIZADO: Movimiento no bloqueante solo si hay distancia por recorrer
-    if (stepper.distanceToGo() != 0) {
-        stepper.run();
-    }
+    // Los pasos los emite el MotionEngine (temporizador de hardware)
     yield();
 }
@@ -0,0 +1,125 @@
+#include <Arduino.h>
+#include <stdarg.h>
+#include "AsyncLog.h"
+
+// ==============================================
+// Cola MPSC acotada (Vyukov): varias tareas/callbacks escriben, la tarea de
+// vaciado es la única que lee. Cada casilla guarda un número de secuencia que
+// indica si está libre para la posición pos (seq == pos) o lista para leerse
+// (seq == pos + 1). Se almacena como seq - índice para que el estado inicial
+// (memoria en cero) sea válido sin inicialización.
+// ==============================================
+
+#define LOG_TASK_STACK    3072
+#define LOG_TASK_PRIORITY 1      // Por encima de idle, por debajo de loop() y WiFi
+#define LOG_IDLE_MS       10     // Espera cuando el buffer está vacío
+
+struct LogSlot {
+  volatile uint32_t seq;
+  uint16_t len;
+  char text[LOG_MSG_SIZE];
+};
+
+static LogSlot logSlots[LOG_SLOTS];
+static volatile uint32_t logHead = 0;   // Próxima posición a reservar (productores)
+static uint32_t logTail = 0;            // Próxima posición a leer (solo la tarea)
+static volatile uint32_t logDropCount = 0;
+static TaskHandle_t logTask = nullptr;
+
+static inline uint32_t slotSeq(uint32_t index) {
+  return __atomic_load_n(&logSlots[index].seq, __ATOMIC_ACQUIRE) + index;
+}
+
+static inline void setSlotSeq(uint32_t index, uint32_t seq) {
+  __atomic_store_n(&logSlots[index].seq, seq - index, __ATOMIC_RELEASE);
+}
+
+// Vacía lo que haya en el buffer; devuelve false si estaba vacío
+static bool drainOnce() {
+  bool any = false;
+  for (;;) {
+    uint32_t index = logTail & (LOG_SLOTS - 1);
+    if ((int32_t)(slotSeq(index) - (logTail + 1)) < 0) break;  // Casilla aún no escrita
+    Serial.write((const uint8_t*)logSlots[index].text, logSlots[index].len);
+    setSlotSeq(index, logTail + LOG_SLOTS);
+    logTail++;
+    any = true;
+  }
+  return any;
+}
+
+static void logTaskLoop(void*) {
+  uint32_t reportedDrops = 0;
+  for (;;) {
+    if (!drainOnce()) {
+      uint32_t drops = logDropCount;
+      if (drops != reportedDrops) {
+        Serial.printf("[LOG] %u mensajes descartados (buffer lleno)\n", drops - reportedDrops);
+        reportedDrops = drops;
+      }
+      vTaskDelay(pdMS_TO_TICKS(LOG_IDLE_MS));
+    }
+  }
+}
+
+void logBegin() {
+#if LOG_ASYNC
+  if (logTask != nullptr) return;
+  xTaskCreate(logTaskLoop, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, &logTask);
+#endif
+}
+
+void logFlush(uint32_t timeoutMs) {
+#if LOG_ASYNC
+  uint32_t start = millis();
+  while (logTail != logHead && millis() - start < timeoutMs) {
+    delay(1);
+  }
+#endif
+  Serial.flush();
+}
+
+uint32_t logDropped() {
+  return logDropCount;
+}
+
+void logWrite(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+#if LOG_ASYNC
+  // Reservar casilla sin bloquear
+  uint32_t pos = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+  uint32_t index;
+  for (;;) {
+    index = pos & (LOG_SLOTS - 1);
+    int32_t diff = (int32_t)(slotSeq(index) - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&logHead, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      __atomic_fetch_add(&logDropCount, 1, __ATOMIC_RELAXED);  // Buffer lleno
+      va_end(args);
+      return;
+    } else {
+      pos = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+    }
+  }
+
+  LogSlot& slot = logSlots[index];
+  int n = vsnprintf(slot.text, LOG_MSG_SIZE - 1, fmt, args);
+  if (n < 0) n = 0;
+  if (n > LOG_MSG_SIZE - 2) n = LOG_MSG_SIZE - 2;
+  slot.text[n++] = '\n';
+  slot.len = n;
+  setSlotSeq(index, pos + 1);
+#else
+  char text[LOG_MSG_SIZE];
+  vsnprintf(text, sizeof(text), fmt, args);
+  Serial.println(text);
+#endif
+
+  va_end(args);
+}
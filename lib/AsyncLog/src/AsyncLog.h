@@ -0,0 +1,70 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ==============================================
+// Logging diferido con niveles en compilación (todos los firmwares)
+// ==============================================
+// LOG_E/LOG_W/LOG_I/LOG_D/LOG_V formatean el mensaje (estilo printf, el salto de
+// línea se agrega solo) en una casilla de un buffer circular sin bloqueos. Una
+// tarea de baja prioridad vacía el buffer hacia Serial, así que el camino del
+// pulso nunca espera al FIFO de TX del UART ni al USB-CDC. Si el buffer está
+// lleno el mensaje se descarta y se cuenta.
+//
+// Los niveles por encima de LOG_LEVEL no generan código. Configuración por
+// build_flags en platformio.ini:
+//   -DLOG_LEVEL=LOG_LEVEL_DEBUG   nivel máximo compilado (por defecto INFO)
+//   -DLOG_ASYNC=0                 escribir directamente en Serial (depuración de cuelgues)
+//   -DLOG_SLOTS=64                casillas del buffer (potencia de 2)
+
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARN    2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_ASYNC
+#define LOG_ASYNC 1
+#endif
+
+#ifndef LOG_SLOTS
+#define LOG_SLOTS 32
+#endif
+
+#ifndef LOG_MSG_SIZE
+#define LOG_MSG_SIZE 128     // Bytes por mensaje (se trunca)
+#endif
+
+#if (LOG_SLOTS & (LOG_SLOTS - 1)) != 0
+#error "LOG_SLOTS debe ser potencia de 2"
+#endif
+
+// Inicia la tarea de vaciado. Llamar después de Serial.begin(); los mensajes
+// registrados antes quedan en el buffer y se imprimen al arrancar la tarea.
+void logBegin();
+
+// Espera (hasta timeoutMs) a que el buffer se vacíe, p. ej. antes de reiniciar
+void logFlush(uint32_t timeoutMs = 100);
+
+// Mensajes descartados por buffer lleno desde el arranque
+uint32_t logDropped();
+
+void logWrite(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#define LOG_AT(level, fmt, ...) \
+  do { if (LOG_LEVEL >= (level)) logWrite(fmt, ##__VA_ARGS__); } while (0)
+
+#define LOG_E(fmt, ...) LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_W(fmt, ...) LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_I(fmt, ...) LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_D(fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_V(fmt, ...) LOG_AT(LOG_LEVEL_VERBOSE, fmt, ##__VA_ARGS__)
+
+#endif // ASYNC_LOG_H
@@ -0,0 +1,46 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <AsyncLog.h>
+#include "HeapStats.h"
+
+static uint32_t minLargestSeen = UINT32_MAX;
+static uint8_t maxFragSeen = 0;
+static unsigned long lastLogMs = 0;
+
+HeapStats heapStatsSample() {
+  HeapStats s;
+  s.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  s.minFreeBytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  s.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  s.fragmentation = s.freeBytes > 0
+      ? (uint8_t)(100 - (uint64_t)s.largestBlock * 100 / s.freeBytes) : 100;
+  s.uptimeS = millis() / 1000;
+
+  if (s.largestBlock < minLargestSeen) minLargestSeen = s.largestBlock;
+  if (s.fragmentation > maxFragSeen) maxFragSeen = s.fragmentation;
+  s.minLargestBlock = minLargestSeen;
+  s.maxFragmentation = maxFragSeen;
+  return s;
+}
+
+void heapStatsLoop() {
+  if (lastLogMs != 0 && millis() - lastLogMs < HEAP_STATS_INTERVAL_MS) return;
+  lastLogMs = millis();
+  if (lastLogMs == 0) lastLogMs = 1;
+
+  HeapStats s = heapStatsSample();
+  LOG_I("[HEAP] t=%us libre=%u min=%u bloque=%u (min %u) frag=%u%% (max %u%%)",
+        s.uptimeS, s.freeBytes, s.minFreeBytes, s.largestBlock,
+        s.minLargestBlock, s.fragmentation, s.maxFragmentation);
+}
+
+size_t heapStatsJson(char* buf, size_t size) {
+  HeapStats s = heapStatsSample();
+  int n = snprintf(buf, size,
+      "{\"uptime_s\":%u,\"free\":%u,\"min_free\":%u,\"largest_block\":%u,"
+      "\"min_largest_block\":%u,\"fragmentation\":%u,\"max_fragmentation\":%u}",
+      s.uptimeS, s.freeBytes, s.minFreeBytes, s.largestBlock,
+      s.minLargestBlock, s.fragmentation, s.maxFragmentation);
+  if (n < 0) return 0;
+  return (size_t)n < size ? (size_t)n : size - 1;
+}
@@ -0,0 +1,41 @@
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ==============================================
+// Métrica de fragmentación del heap (Centrales)
+// ==============================================
+// fragmentación (%) = 100 - 100 * bloque_libre_mas_grande / libre_total
+// Con el heap sano el bloque más grande es casi todo lo libre (~0-20 %). Si
+// crece con el tiempo aunque lo libre se mantenga, hay fragmentación y tarde o
+// temprano fallará una reserva grande (buffers de WiFi, JSON, etc.).
+//
+// heapStatsLoop() registra una línea LOG_I cada HEAP_STATS_INTERVAL_MS y
+// guarda los peores valores desde el arranque para pruebas de varios días.
+
+#ifndef HEAP_STATS_INTERVAL_MS
+#define HEAP_STATS_INTERVAL_MS 600000UL   // 10 minutos
+#endif
+
+struct HeapStats {
+  uint32_t freeBytes;         // Libre ahora
+  uint32_t minFreeBytes;      // Mínimo libre desde el arranque (marca del IDF)
+  uint32_t largestBlock;      // Mayor bloque contiguo libre ahora
+  uint32_t minLargestBlock;   // Menor "mayor bloque" observado
+  uint8_t fragmentation;      // % ahora
+  uint8_t maxFragmentation;   // Peor % observado
+  uint32_t uptimeS;
+};
+
+// Toma una muestra y actualiza los peores valores
+HeapStats heapStatsSample();
+
+// Llamar desde loop(): muestrea y registra cada HEAP_STATS_INTERVAL_MS
+void heapStatsLoop();
+
+// Escribe la muestra como JSON en buf; devuelve la longitud (sin '\0')
+size_t heapStatsJson(char* buf, size_t size);
+
+#endif // HEAP_STATS_H
@@ -0,0 +1,327 @@
+#include "MotionEngine.h"
+
+bool MotionEngine::begin(uint8_t stepPin, uint8_t dirPin, bool invertStep, bool invertDir) {
+  publishedPosition = stepper.currentPosition();
+#if MOTION_STEP_HW
+  planner.setSpeed((uint32_t)stepper.maxSpeed(), (uint32_t)stepper.acceleration());
+  planner.setPosition(publishedPosition);
+  generator.setPosition(publishedPosition);
+  if (!generator.begin(stepPin, dirPin, invertStep, invertDir)) return false;
+#else
+  (void)stepPin; (void)dirPin; (void)invertStep; (void)invertDir;
+#endif
+  esp_timer_create_args_t args = {};
+  args.callback = &MotionEngine::onTick;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "motion";
+  return esp_timer_create(&args, &timer) == ESP_OK;
+}
+
+// Registra la petición y arranca el tick si estaba parado. El arranque y la
+// parada (en tick()) ocurren dentro del mismo spinlock, así una petición nunca
+// queda sin atender porque el temporizador se detuvo justo después.
+void MotionEngine::post(uint8_t request) {
+  requests |= request;
+  if (!timerActive && timer) {
+    timerActive = esp_timer_start_periodic(timer, MOTION_TICK_US) == ESP_OK;
+  }
+}
+
+void MotionEngine::moveTo(long target, uint32_t tag) {
+  portENTER_CRITICAL(&mux);
+  mailbox.target = target;
+  mailbox.periodic = false;
+  mailbox.profile = nullptr;
+  mailbox.tag = tag;
+  requests &= ~REQ_STOP;  // La petición más reciente manda
+  post(REQ_MOVE);
+  portEXIT_CRITICAL(&mux);
+}
+
+void MotionEngine::moveToNearest(long target, uint32_t tag) {
+  if (periodSteps <= 0) {
+    moveTo(target, tag);
+    return;
+  }
+  portENTER_CRITICAL(&mux);
+  mailbox.target = target;
+  mailbox.periodic = true;
+  mailbox.profile = nullptr;
+  mailbox.tag = tag;
+  requests &= ~REQ_STOP;
+  post(REQ_MOVE);
+  portEXIT_CRITICAL(&mux);
+}
+
+void MotionEngine::playProfile(const StepProfile& profile, uint32_t tag) {
+  portENTER_CRITICAL(&mux);
+  mailbox.target = profile.target;
+  mailbox.periodic = periodSteps > 0;
+  mailbox.profile = &profile;
+  mailbox.tag = tag;
+  requests &= ~REQ_STOP;
+  post(REQ_MOVE);
+  portEXIT_CRITICAL(&mux);
+}
+
+void MotionEngine::setPeriod(long period, int8_t dir, long overshoot) {
+  periodSteps = period;
+  approachDir = dir;
+  overshootSteps = overshoot;
+}
+
+void MotionEngine::stop() {
+  portENTER_CRITICAL(&mux);
+  requests &= ~REQ_MOVE;
+  post(REQ_STOP);
+  portEXIT_CRITICAL(&mux);
+}
+
+void MotionEngine::setPosition(long position) {
+  portENTER_CRITICAL(&mux);
+  mailbox.position = position;
+  post(REQ_POSITION);
+  portEXIT_CRITICAL(&mux);
+}
+
+void MotionEngine::setSpeed(uint32_t maxSpeed, uint32_t acceleration) {
+  portENTER_CRITICAL(&mux);
+  mailbox.maxSpeed = maxSpeed;
+  mailbox.acceleration = acceleration;
+  post(REQ_SPEED);
+  portEXIT_CRITICAL(&mux);
+}
+
+bool MotionEngine::busy() const {
+  return requests != 0 || movingFlag;
+}
+
+bool MotionEngine::pollEvent(MotionEvent& event) {
+  for (;;) {
+    uint32_t seq = __atomic_load_n(&eventSeq, __ATOMIC_ACQUIRE);
+    if (seq == eventSeen) return false;
+    if (seq & 1) continue;  // El tick está escribiendo el evento
+    event = lastEvent;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&eventSeq, __ATOMIC_RELAXED) != seq) continue;
+    eventSeen = seq;
+    return true;
+  }
+}
+
+void MotionEngine::onTick(void* arg) {
+  static_cast<MotionEngine*>(arg)->tick();
+}
+
+void MotionEngine::applyMove(const Mailbox& box) {
+  finalLeg = false;
+  if (!box.periodic) {
+    planMoveTo(box.target);
+    return;
+  }
+  // Reducir la posición a [0, periodo) con el motor parado: el mismo estado
+  // óptico y coordenadas acotadas
+  if (!moving) {
+    long position = planPosition();
+    long wrapped = wrapSteps(position, periodSteps);
+    if (wrapped != position) {
+      planReset(wrapped);
+      wrapTotal = wrapTotal + (position - wrapped);
+    }
+#if MOTION_STEP_HW
+    const StepProfile* profile = box.profile;
+    if (profile && profile->count > 0 && wrapped == wrapSteps(profile->start, periodSteps)) {
+      // El planificador queda parado en el destino; los pasos salen de la tabla
+      playIntervals = profile->intervals;
+      playCount = profile->count;
+      playIndex = 0;
+      planner.setPosition(wrapped + profile->displacement);
+      return;
+    }
+#endif
+  }
+  long via;
+  long target = nearestEquivalent(planPosition(), box.target, periodSteps, approachDir, overshootSteps, via);
+  planMoveTo(via);
+  if (via != target) {
+    finalLeg = true;
+    finalTarget = target;
+  }
+}
+
+#if MOTION_STEP_HW
+
+long MotionEngine::planPosition() const { return planner.position(); }
+
+// Con un perfil en curso el planificador ya está en el destino: los movimientos
+// y cambios de posición esperan en el buzón a que termine. Un cambio de
+// posición solo se aplica con el motor parado, así que hasta entonces también
+// espera, y con él los movimientos pedidos después (se planificarían sobre la
+// posición vieja).
+uint8_t MotionEngine::heldRequests() const {
+  if (playIntervals) return REQ_MOVE | REQ_POSITION;
+  if ((requests & REQ_POSITION) && !(planner.stopped() && generator.idle())) return REQ_MOVE | REQ_POSITION;
+  return 0;
+}
+void MotionEngine::planMoveTo(long target) { planner.moveTo(target); }
+
+void MotionEngine::planReset(long position) {
+  planner.setPosition(position);
+  generator.setPosition(position);
+}
+
+// Aplica las peticiones al planificador. La posición solo se redefine con el
+// motor parado (heldRequests() la retiene hasta entonces): los pasos ya
+// encolados se emitirían sobre la posición nueva.
+void MotionEngine::applyRequests(uint8_t req, const Mailbox& box) {
+  if (req & REQ_SPEED) {
+    planner.setSpeed(box.maxSpeed, box.acceleration);
+  }
+  if (req & REQ_POSITION) {
+    planReset(box.position);
+    wrapTotal = 0;
+  }
+  if (req & REQ_MOVE) {
+    applyMove(box);
+  }
+  if ((req & REQ_STOP) && moving) {
+    finalLeg = false;
+    planner.stop();
+  }
+}
+
+// Mantiene el buffer del generador con MOTION_LOOKAHEAD_US de pasos por
+// delante (al menos dos) y arranca el temporizador si estaba parado. Más
+// adelanto no mejora el ritmo, solo retrasa la reacción a stop()/moveTo().
+bool MotionEngine::advance() {
+  if (streaming && generator.idle() && (playIntervals || !planner.stopped())) {
+    underrunCount = underrunCount + 1;  // El buffer se vació antes de llegar al objetivo
+  }
+  if (finalLeg && planner.stopped()) {
+    // Planificado hasta el sobrepaso: volver al objetivo (arranca desde c0)
+    planner.moveTo(finalTarget);
+    finalLeg = false;
+  }
+
+  uint32_t interval = playIntervals ? (playIntervals[playIndex] & PROFILE_INTERVAL_MASK) : planner.intervalUs();
+  uint32_t wanted = interval ? MOTION_LOOKAHEAD_US / interval : MOTION_STEP_QUEUE;
+  if (wanted < 2) wanted = 2;
+  if (wanted > MOTION_STEP_QUEUE) wanted = MOTION_STEP_QUEUE;
+
+  if (playIntervals) {
+    while (generator.queued() < wanted && playIndex < playCount) {
+      uint16_t entry = playIntervals[playIndex++];
+      generator.push(entry & PROFILE_INTERVAL_MASK, (entry & PROFILE_DIR_NEGATIVE) ? -1 : 1);
+      moveSteps++;
+    }
+    if (playIndex >= playCount) playIntervals = nullptr;
+  } else {
+    PlannedStep step;
+    while (generator.queued() < wanted && planner.next(step)) {
+      generator.push(step.delayUs, step.dir);
+      moveSteps++;
+    }
+  }
+  generator.kick();
+  streaming = !generator.idle();
+
+  publishedPosition = generator.position();
+  return !playIntervals && planner.stopped() && generator.idle();
+}
+
+#else
+
+long MotionEngine::planPosition() const { return stepper.currentPosition(); }
+uint8_t MotionEngine::heldRequests() const { return 0; }
+void MotionEngine::planReset(long position) { stepper.setCurrentPosition(position); }
+void MotionEngine::planMoveTo(long target) { stepper.moveTo(target); }
+
+void MotionEngine::applyRequests(uint8_t req, const Mailbox& box) {
+  if (req & REQ_SPEED) {
+    stepper.setMaxSpeed(box.maxSpeed);
+    stepper.setAcceleration(box.acceleration);
+  }
+  if (req & REQ_POSITION) {
+    planReset(box.position);
+    wrapTotal = 0;
+  }
+  if (req & REQ_MOVE) {
+    applyMove(box);
+  }
+  if ((req & REQ_STOP) && moving) {
+    finalLeg = false;
+    // stop() de AccelStepper no hace nada con velocidad 0 (movimiento recién iniciado)
+    if (stepper.speed() == 0.0f) {
+      stepper.moveTo(stepper.currentPosition());
+    } else {
+      stepper.stop();
+    }
+  }
+}
+
+bool MotionEngine::advance() {
+  if (finalLeg && stepper.distanceToGo() == 0) {
+    stepper.moveTo(finalTarget);
+    finalLeg = false;
+  }
+  long before = stepper.currentPosition();
+  stepper.run();  // Como mucho un paso por llamada
+  if (stepper.currentPosition() != before) moveSteps++;
+  publishedPosition = stepper.currentPosition();
+  return !finalLeg && stepper.distanceToGo() == 0;
+}
+
+#endif
+
+void MotionEngine::tick() {
+  // Tomar las peticiones del buzón
+  portENTER_CRITICAL(&mux);
+  uint8_t held = heldRequests();
+  uint8_t req = requests & ~held;
+  requests &= held;
+  if (req & REQ_MOVE) movingFlag = true;  // busy() no debe verse falso entre buzón y estado
+  Mailbox box = mailbox;
+  portEXIT_CRITICAL(&mux);
+
+  applyRequests(req, box);
+  if (req & REQ_MOVE) {
+    tag = box.tag;
+    aborting = false;
+    if (!moving) {
+      moving = true;
+      startMicros = micros();
+      moveSteps = 0;
+    }
+  }
+  if ((req & REQ_STOP) && moving) {
+    aborting = true;
+  }
+  movingFlag = moving;
+
+  bool arrived = advance();
+
+  if (moving && arrived) {
+    moving = false;
+    movingFlag = false;
+    uint32_t seq = eventSeq + 1;
+    __atomic_store_n(&eventSeq, seq, __ATOMIC_RELEASE);  // Impar: escribiendo
+    lastEvent.tag = tag;
+    lastEvent.result = aborting ? MOTION_ABORTED : MOTION_DONE;
+    lastEvent.position = publishedPosition;
+    lastEvent.startMicros = startMicros;
+    lastEvent.endMicros = micros();
+    lastEvent.steps = moveSteps;
+    __atomic_store_n(&eventSeq, seq + 1, __ATOMIC_RELEASE);
+  }
+
+  // Sin trabajo: detener el tick hasta la próxima petición
+  if (!moving) {
+    portENTER_CRITICAL(&mux);
+    if (requests == 0 && timerActive) {
+      esp_timer_stop(timer);
+      timerActive = false;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+}
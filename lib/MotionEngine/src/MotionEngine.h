@@ -0,0 +1,207 @@
+#ifndef MOTION_ENGINE_H
+#define MOTION_ENGINE_H
+
+#include <Arduino.h>
+#include <AccelStepper.h>
+#include <esp_timer.h>
+#include "RampPlanner.h"
+#include "StepGenerator.h"
+#include "StepAngle.h"
+#include "PeriodicMove.h"
+#include "TransitionProfiles.h"
+
+// ==============================================
+// Motor de movimiento no bloqueante (nodos con motor)
+// ==============================================
+// El perfil avanza desde un esp_timer periódico, no desde loop(): el loop
+// principal queda libre para atender comandos mientras el motor se mueve.
+//
+// Con MOTION_STEP_HW=1 (por defecto) el tick solo planifica: calcula con
+// RampPlanner los intervalos de los próximos pasos (MOTION_LOOKAHEAD_US por
+// delante) y el StepGenerator los emite desde la interrupción de un
+// temporizador de hardware, sin jitter. Con -DMOTION_STEP_HW=0 se vuelve a
+// AccelStepper::run() llamado en cada tick (respaldo).
+//
+// Las peticiones (moveTo, stop, setPosition, setSpeed) pueden hacerse desde
+// cualquier tarea o callback: se dejan en un buzón protegido por un spinlock y
+// se aplican en el siguiente tick, que es el único contexto que toca el
+// planificador. Un moveTo durante un movimiento reprograma el objetivo sin
+// detener el motor; stop() desacelera y termina el movimiento como abortado.
+//
+// Al terminar cada movimiento se publica un MotionEvent con la etiqueta de la
+// última petición, que el loop recoge con pollEvent(). Un movimiento
+// reprogramado no genera evento propio: solo el último.
+
+#ifndef MOTION_STEP_HW
+#define MOTION_STEP_HW 1
+#endif
+
+#if MOTION_STEP_HW
+#ifndef MOTION_TICK_US
+#define MOTION_TICK_US 1000        // Periodo del planificador
+#endif
+#ifndef MOTION_LOOKAHEAD_US
+#define MOTION_LOOKAHEAD_US 5000   // Tiempo de pasos encolados por delante (latencia de stop/reprogramación)
+#endif
+#else
+#ifndef MOTION_TICK_US
+#define MOTION_TICK_US 50          // Periodo del tick; limita la velocidad a 1e6/MOTION_TICK_US pasos/s
+#endif
+#endif
+
+enum MotionResult : uint8_t {
+  MOTION_DONE = 0,      // Objetivo alcanzado
+  MOTION_ABORTED = 1    // Detenido por stop()
+};
+
+struct MotionEvent {
+  uint32_t tag;            // Etiqueta de la petición moveTo
+  MotionResult result;
+  long position;           // Posición final (pasos)
+  uint32_t startMicros;    // Inicio del movimiento (primer tick tras la petición)
+  uint32_t endMicros;      // Fin del movimiento
+  uint32_t steps;          // Pasos emitidos (incluye sobrepaso y vuelta)
+};
+
+class MotionEngine {
+public:
+  explicit MotionEngine(AccelStepper& stepper) : stepper(stepper) {}
+
+  // Crea los temporizadores. Configurar antes velocidad/aceleración del
+  // stepper; los pines solo se usan con MOTION_STEP_HW (mismas inversiones que
+  // setPinsInverted del AccelStepper).
+  bool begin(uint8_t stepPin, uint8_t dirPin, bool invertStep = false, bool invertDir = false);
+
+  // Ir a 'target' pasos. Si hay un movimiento en curso se reprograma.
+  void moveTo(long target, uint32_t tag);
+
+  // Periodo óptico del elemento que mueve el motor (pasos) para moveToNearest(),
+  // y sentido de aproximación final contra el juego mecánico: approachDir
+  // +1/-1 (0 = sin preferencia) y cuántos pasos pasarse antes de volver.
+  // Llamar antes de begin().
+  void setPeriod(long periodSteps, int8_t approachDir = 0, long overshootSteps = 0);
+
+  // Como moveTo(), pero a la posición equivalente (target + k·periodo) más
+  // barata desde la posición actual. Con el motor parado la posición se
+  // reduce antes a [0, periodo) para que no crezca sin límite.
+  void moveToNearest(long target, uint32_t tag);
+
+  // Reproducir un perfil precalculado (TransitionProfiles). Solo si el motor
+  // está parado en profile.start (módulo el periodo); si no, o sin
+  // MOTION_STEP_HW, equivale a moveToNearest(profile.target). Un stop()
+  // durante el perfil no lo corta (dura pocas decenas de ms): el evento llega
+  // como abortado al terminar. El perfil debe seguir vivo hasta el evento.
+  void playProfile(const StepProfile& profile, uint32_t tag);
+
+  // Desacelerar hasta detenerse; el evento llega con MOTION_ABORTED
+  void stop();
+
+  // Redefinir la posición actual (p. ej. homing). Si el motor aún se mueve, la
+  // petición espera en el buzón hasta que se detenga (busy() sigue a true) y
+  // los moveTo() posteriores se aplican después de ella
+  void setPosition(long position);
+
+  void setSpeed(uint32_t maxSpeed, uint32_t acceleration);  // pasos/s, pasos/s²
+
+  // Hay una petición pendiente o un movimiento en curso
+  bool busy() const;
+
+  // Última posición publicada por el tick (pasos)
+  long position() const { return publishedPosition; }
+
+  // Posición y sentido del último paso emitido, sin esperar al tick. Lecturas
+  // atómicas: sirven desde una ISR. Con MOTION_STEP_HW=0 la posición es la
+  // publicada y el sentido 0 (desconocido).
+#if MOTION_STEP_HW
+  long stepPosition() const { return generator.position(); }
+  int8_t stepDirection() const { return generator.direction(); }
+#else
+  long stepPosition() const { return publishedPosition; }
+  int8_t stepDirection() const { return 0; }
+#endif
+
+  // Pasos descontados por las reducciones a [0, periodo) desde el último
+  // setPosition(): position() + wrapOffset() es la posición sin reducir, que
+  // dice en qué vuelta está el motor. Leer con el motor parado.
+  long wrapOffset() const { return wrapTotal; }
+
+  // Recoge el evento de fin de movimiento más reciente (una vez por evento)
+  bool pollEvent(MotionEvent& event);
+
+  // Veces que el buffer de pasos se vació en pleno movimiento (tick atrasado)
+  uint32_t underruns() const { return underrunCount; }
+
+private:
+  enum : uint8_t {
+    REQ_MOVE     = 1 << 0,
+    REQ_STOP     = 1 << 1,
+    REQ_POSITION = 1 << 2,
+    REQ_SPEED    = 1 << 3
+  };
+
+  static void onTick(void* arg);
+  void tick();
+  void post(uint8_t request);  // Llamar con los valores del buzón ya escritos
+  struct Mailbox {
+    long target = 0;
+    bool periodic = false;       // moveToNearest()
+    const StepProfile* profile = nullptr;  // playProfile()
+    uint32_t tag = 0;
+    long position = 0;
+    uint32_t maxSpeed = 0;
+    uint32_t acceleration = 0;
+  };
+
+  void applyRequests(uint8_t req, const Mailbox& box);
+  void applyMove(const Mailbox& box);
+  bool advance();              // Avanza el perfil; true al llegar al objetivo
+
+  // Acceso al perfil según el modo (MOTION_STEP_HW o AccelStepper)
+  long planPosition() const;
+  uint8_t heldRequests() const;
+  void planReset(long position);
+  void planMoveTo(long target);
+
+  AccelStepper& stepper;
+#if MOTION_STEP_HW
+  RampPlanner planner;
+  StepGenerator generator;
+  bool streaming = false;      // El generador tenía pasos en el tick anterior
+#endif
+  esp_timer_handle_t timer = nullptr;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  bool timerActive = false;
+
+  // Buzón de peticiones (protegido por mux)
+  uint8_t requests = 0;
+  Mailbox mailbox;
+
+  // Estado del tick (solo en el contexto del temporizador)
+  bool moving = false;
+  bool aborting = false;
+  bool finalLeg = false;       // Falta el tramo final tras el sobrepaso
+  long finalTarget = 0;
+  const uint16_t* playIntervals = nullptr;  // Perfil en reproducción (nullptr = rampa)
+  uint16_t playCount = 0;
+  uint16_t playIndex = 0;
+  uint32_t tag = 0;
+  uint32_t startMicros = 0;
+  uint32_t moveSteps = 0;      // Pasos del movimiento en curso
+
+  // Periodo óptico (setPeriod)
+  long periodSteps = 0;
+  int8_t approachDir = 0;
+  long overshootSteps = 0;
+
+  volatile bool movingFlag = false;
+  volatile long publishedPosition = 0;
+  volatile long wrapTotal = 0;
+  volatile uint32_t underrunCount = 0;
+
+  // Último evento: eventSeq impar mientras se escribe (lector reintenta)
+  volatile uint32_t eventSeq = 0;
+  uint32_t eventSeen = 0;
+  MotionEvent lastEvent = {0, MOTION_DONE, 0, 0, 0};
+};
+
+#endif // MOTION_ENGINE_H
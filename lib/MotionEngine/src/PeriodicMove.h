@@ -0,0 +1,42 @@
+#ifndef PERIODIC_MOVE_H
+#define PERIODIC_MOVE_H
+
+#include <stdint.h>
+
+// ==============================================
+// Objetivos equivalentes por periodo óptico
+// ==============================================
+// Compartido por MotionEngine::moveToNearest() y TransitionProfiles, para que
+// un perfil precalculado recorra exactamente el mismo camino que el movimiento
+// genérico al que reemplaza.
+
+inline long wrapSteps(long value, long period) {
+  long r = value % period;
+  return r < 0 ? r + period : r;
+}
+
+// Objetivo equivalente (target + k·periodo) más barato desde 'from'. Con
+// sentido de aproximación, llegar en el sentido contrario cuesta además ir y
+// volver overshootSteps; en ese caso 'via' es el punto de sobrepaso (si no, el
+// propio objetivo).
+inline long nearestEquivalent(long from, long target, long period, int8_t approachDir,
+                              long overshootSteps, long& via) {
+  long offset = wrapSteps(target - from, period);
+  if (offset == 0) {
+    via = from;
+    return from;
+  }
+  long forward = from + offset;        // Alcanzado girando en sentido +
+  long backward = forward - period;    // Alcanzado girando en sentido -
+  long costForward = offset;
+  long costBackward = period - offset;
+  if (approachDir > 0) costBackward += 2 * overshootSteps;
+  if (approachDir < 0) costForward += 2 * overshootSteps;
+
+  long chosen = (costForward <= costBackward) ? forward : backward;
+  int8_t dir = (chosen > from) ? 1 : -1;
+  via = (approachDir != 0 && dir != approachDir) ? chosen - approachDir * overshootSteps : chosen;
+  return chosen;
+}
+
+#endif // PERIODIC_MOVE_H
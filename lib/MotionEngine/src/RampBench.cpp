@@ -0,0 +1,147 @@
+#ifdef MOTION_RAMP_BENCH
+
+#include <Arduino.h>
+#include <math.h>
+#include "RampBench.h"
+#include "RampPlanner.h"
+#include "StepAngle.h"
+
+#define BENCH_MOVES        20        // Movimientos completos por caso
+#define BENCH_TARGET       2400      // Una vuelta de la lámina (200 × 4 × 3)
+#define BENCH_MAX_SPEED    6000
+#define BENCH_ACCELERATION 50000
+#define BENCH_CONVERSIONS  10000
+
+// Rampa en coma flotante: AccelStepper::computeNewSpeed() tal cual, como
+// referencia del coste anterior
+class FloatRamp {
+public:
+  void setSpeed(float newMaxSpeed, float newAcceleration) {
+    maxSpeed = newMaxSpeed;
+    acceleration = newAcceleration;
+    c0 = 0.676f * sqrtf(2.0f / acceleration) * 1000000.0f;
+    cmin = 1000000.0f / maxSpeed;
+  }
+
+  void moveTo(long target) { targetPos = target; }
+
+  bool next(uint32_t& delayUs) {
+    computeNewSpeed();
+    if (cn == 0.0f) return false;
+    delayUs = (uint32_t)cn;
+    pos += direction;
+    return true;
+  }
+
+  long pos = 0;
+
+private:
+  void computeNewSpeed() {
+    long distanceTo = targetPos - pos;
+    long stepsToStop = (long)((speed * speed) / (2.0f * acceleration));
+    if (distanceTo == 0 && stepsToStop <= 1) {
+      cn = 0.0f;
+      speed = 0.0f;
+      n = 0;
+      return;
+    }
+    if (distanceTo > 0) {
+      if (n > 0) {
+        if (stepsToStop >= distanceTo || direction < 0) n = -stepsToStop;
+      } else if (n < 0) {
+        if (stepsToStop < distanceTo && direction > 0) n = -n;
+      }
+    } else if (distanceTo < 0) {
+      if (n > 0) {
+        if (stepsToStop >= -distanceTo || direction > 0) n = -stepsToStop;
+      } else if (n < 0) {
+        if (stepsToStop < -distanceTo && direction < 0) n = -n;
+      }
+    }
+    if (n == 0) {
+      cn = c0;
+      direction = (distanceTo > 0) ? 1 : -1;
+    } else {
+      cn = cn - ((2.0f * cn) / ((4.0f * n) + 1));
+      if (cn < cmin) cn = cmin;
+    }
+    n++;
+    speed = 1000000.0f / cn;
+    if (direction < 0) speed = -speed;
+  }
+
+  long targetPos = 0;
+  long n = 0;
+  float c0 = 0.0f, cn = 0.0f, cmin = 1.0f;
+  float maxSpeed = 1.0f, acceleration = 1.0f, speed = 0.0f;
+  int8_t direction = 1;
+};
+
+// volatile: evita que el compilador descarte o precalcule las operaciones
+static volatile uint32_t benchSink;
+static volatile float benchAngle = 47.7f;
+static volatile int32_t benchMilliDeg = 47700;
+static volatile long benchSteps = 318;
+
+static void report(const char* name, uint32_t cycles, uint32_t count) {
+  Serial.printf("# %-22s %8lu ciclos/op (%lu ops)\n", name,
+                (unsigned long)(cycles / count), (unsigned long)count);
+}
+
+static void benchFloatRamp() {
+  FloatRamp ramp;
+  ramp.setSpeed(BENCH_MAX_SPEED, BENCH_ACCELERATION);
+  uint32_t steps = 0, delayUs = 0;
+  uint32_t start = ESP.getCycleCount();
+  for (int i = 0; i < BENCH_MOVES; i++) {
+    ramp.moveTo((i & 1) ? 0 : BENCH_TARGET);
+    while (ramp.next(delayUs)) {
+      benchSink = delayUs;
+      steps++;
+    }
+  }
+  report("rampa float", ESP.getCycleCount() - start, steps);
+}
+
+static void benchIntegerRamp() {
+  RampPlanner planner;
+  planner.setSpeed(BENCH_MAX_SPEED, BENCH_ACCELERATION);
+  PlannedStep step;
+  uint32_t steps = 0;
+  uint32_t start = ESP.getCycleCount();
+  for (int i = 0; i < BENCH_MOVES; i++) {
+    planner.moveTo((i & 1) ? 0 : BENCH_TARGET);
+    while (planner.next(step)) {
+      benchSink = step.delayUs;
+      steps++;
+    }
+  }
+  report("rampa entera", ESP.getCycleCount() - start, steps);
+}
+
+static void benchConversions() {
+  typedef StepAngle<BENCH_TARGET> Angle;
+  uint32_t start = ESP.getCycleCount();
+  for (int i = 0; i < BENCH_CONVERSIONS; i++) {
+    benchSink = (long)round((benchAngle / 360.0) * BENCH_TARGET);   // angleToSteps() anterior
+    benchSink = (uint32_t)(benchSteps * 360.0 / BENCH_TARGET);      // getCurrentAngle() anterior
+  }
+  report("angulo<->pasos double", ESP.getCycleCount() - start, BENCH_CONVERSIONS);
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < BENCH_CONVERSIONS; i++) {
+    benchSink = Angle::toSteps(benchMilliDeg);
+    benchSink = Angle::toMilliDeg(benchSteps);
+  }
+  report("angulo<->pasos entero", ESP.getCycleCount() - start, BENCH_CONVERSIONS);
+}
+
+void rampBenchRun() {
+  Serial.printf("# Microbenchmark rampa: %d movimientos de %d pasos, %d pasos/s, %d pasos/s2\n",
+                BENCH_MOVES, BENCH_TARGET, BENCH_MAX_SPEED, BENCH_ACCELERATION);
+  benchFloatRamp();
+  benchIntegerRamp();
+  benchConversions();
+}
+
+#endif // MOTION_RAMP_BENCH
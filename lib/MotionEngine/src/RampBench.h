@@ -0,0 +1,13 @@
+#ifndef RAMP_BENCH_H
+#define RAMP_BENCH_H
+
+// ==============================================
+// Microbenchmark del planificador (solo -DMOTION_RAMP_BENCH)
+// ==============================================
+// Mide en ciclos de CPU el coste por paso de la rampa en coma flotante
+// (algoritmo de AccelStepper, la versión anterior) frente a RampPlanner en
+// aritmética entera, y el de las conversiones ángulo <-> pasos con double
+// frente a StepAngle. Imprime una línea "# ..." por caso en el serial.
+void rampBenchRun();
+
+#endif // RAMP_BENCH_H
@@ -0,0 +1,127 @@
+#include "RampPlanner.h"
+
+#define RAMP_ONE_SECOND (1000000UL << RAMP_FRAC_BITS)   // 1 s en µs × 256
+#define RAMP_ONE_SECOND_SQ ((uint64_t)RAMP_ONE_SECOND * RAMP_ONE_SECOND)
+
+// c0 = 0.676 · sqrt(2 / a) · 1e6 µs (Austin). Con la raíz de a·256 el
+// numerador es 0.676 · sqrt(2) · 1e6 · 256 · 16
+#define RAMP_C0_NUMERATOR 3915810288ULL
+
+static uint32_t isqrt32(uint32_t x) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > x) bit >>= 2;
+  while (bit) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+void RampPlanner::setSpeed(uint32_t newMaxSpeed, uint32_t newAcceleration) {
+  if (newAcceleration > 0 && newAcceleration != acceleration) {
+    // Reescalar la posición en la rampa (igual que AccelStepper::setAcceleration)
+    if (acceleration > 0) n = (int32_t)((int64_t)n * acceleration / newAcceleration);
+    uint32_t scaled = newAcceleration < (1UL << 24) ? newAcceleration << 8 : 0xFFFFFFFFUL;
+    c0 = (uint32_t)(RAMP_C0_NUMERATOR / isqrt32(scaled));
+    acceleration = newAcceleration;
+    cachedCn = 0;
+  }
+  if (newMaxSpeed > 0 && newMaxSpeed != maxSpeed) {
+    maxSpeed = newMaxSpeed;
+    cmin = RAMP_ONE_SECOND / newMaxSpeed;
+    if (cmin == 0) cmin = 1;
+    if (n > 0) {
+      // Si ya iba más rápido que la nueva velocidad máxima, desacelerar hasta ella
+      n = (int32_t)stepsToStop();
+    }
+  }
+}
+
+void RampPlanner::setPosition(long newPosition) {
+  pos = newPosition;
+  targetPos = newPosition;
+  n = 0;
+  cn = 0;
+  idle = true;
+}
+
+// v² / 2a con v = 1e6 / cn pasos/s, calculado directamente desde cn para no
+// perder precisión al truncar v (haría oscilar el punto de frenado). En
+// crucero cn no cambia y se reutiliza el resultado anterior.
+long RampPlanner::stepsToStop() {
+  if (cn == 0) return 0;
+  if (cn != cachedCn) {
+    uint64_t den = (uint64_t)cn * cn * (2 * acceleration);
+    cachedToStop = (long)(RAMP_ONE_SECOND_SQ / den);
+    cachedCn = cn;
+  }
+  return cachedToStop;
+}
+
+void RampPlanner::stop() {
+  if (idle || cn == 0) {
+    targetPos = pos;
+    return;
+  }
+  targetPos = pos + direction * (stepsToStop() + 1);
+}
+
+// AccelStepper::computeNewSpeed(): intervalo hasta el próximo paso según la
+// distancia restante y los pasos necesarios para frenar
+void RampPlanner::computeNewSpeed() {
+  long distanceTo = targetPos - pos;
+  long toStop = stepsToStop();
+
+  if (distanceTo == 0 && toStop <= 1) {
+    cn = 0;
+    n = 0;
+    return;
+  }
+
+  if (distanceTo > 0) {
+    if (n > 0) {
+      if (toStop >= distanceTo || direction < 0) n = -toStop;            // Empezar a frenar
+    } else if (n < 0) {
+      if (toStop < distanceTo && direction > 0) n = -n;                  // Volver a acelerar
+    }
+  } else if (distanceTo < 0) {
+    if (n > 0) {
+      if (toStop >= -distanceTo || direction > 0) n = -toStop;
+    } else if (n < 0) {
+      if (toStop < -distanceTo && direction < 0) n = -n;
+    }
+  }
+
+  if (n == 0) {
+    cn = c0;
+    direction = (distanceTo > 0) ? 1 : -1;
+  } else {
+    // cn = cn - 2·cn / (4n + 1); con n < 0 el intervalo crece (frenado)
+    int32_t delta = (int32_t)(2 * cn) / (4 * n + 1);
+    cn = (uint32_t)((int32_t)cn - delta);
+    if (cn < cmin) cn = cmin;
+  }
+  n++;
+}
+
+bool RampPlanner::next(PlannedStep& step) {
+  if (idle) {
+    computeNewSpeed();  // Desde reposo: intervalo c0 (el StepGenerator descuenta el tiempo ya esperado)
+    if (cn == 0) return false;
+    idle = false;
+  }
+
+  step.delayUs = (cn + (1UL << (RAMP_FRAC_BITS - 1))) >> RAMP_FRAC_BITS;
+  step.dir = direction;
+  pos += direction;
+
+  computeNewSpeed();    // Intervalo hasta el paso siguiente
+  if (cn == 0) idle = true;
+  return true;
+}
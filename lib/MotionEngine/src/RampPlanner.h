@@ -0,0 +1,61 @@
+#ifndef RAMP_PLANNER_H
+#define RAMP_PLANNER_H
+
+#include <stdint.h>
+
+// ==============================================
+// Generador de rampa trapezoidal paso a paso (aritmética entera)
+// ==============================================
+// Mismo algoritmo que AccelStepper (D. Austin, "Generate stepper-motor speed
+// profiles in real time"), pero en lugar de esperar a cada paso entrega de
+// antemano el intervalo hasta el siguiente, para que el StepGenerator los
+// emita por hardware. Solo lo usa la tarea del MotionEngine.
+//
+// Sin coma flotante (el ESP32-C3 no tiene FPU): los intervalos van en µs con
+// RAMP_FRAC_BITS bits fraccionarios y la recurrencia de Austin se hace con una
+// división entera por paso. La raíz de c0 solo se calcula en setSpeed().
+
+#define RAMP_FRAC_BITS 8   // Intervalos en µs × 256
+
+struct PlannedStep {
+  uint32_t delayUs;   // Espera mínima desde el paso anterior (µs)
+  int8_t dir;         // +1 / -1
+};
+
+class RampPlanner {
+public:
+  RampPlanner() { setSpeed(1, 1); }
+
+  // pasos/s y pasos/s² (valores 0 se ignoran)
+  void setSpeed(uint32_t maxSpeed, uint32_t acceleration);
+  void setPosition(long position);   // Solo con el motor detenido
+  void moveTo(long target) { targetPos = target; }
+  void stop();                       // Nuevo objetivo: el punto de parada con la desaceleración actual
+
+  // Siguiente paso del perfil; false si ya se llegó al objetivo y está detenido
+  bool next(PlannedStep& step);
+
+  bool stopped() const { return idle && pos == targetPos; }
+  long position() const { return pos; }   // Posición planificada (va por delante de la real)
+  long target() const { return targetPos; }
+  uint32_t intervalUs() const { return cn >> RAMP_FRAC_BITS; }
+
+private:
+  void computeNewSpeed();
+  long stepsToStop();
+
+  long pos = 0;
+  long targetPos = 0;
+  int32_t n = 0;             // Paso dentro de la rampa (>0 acelerando, <0 desacelerando)
+  uint32_t c0 = 0;           // Intervalo del primer paso (µs × 256)
+  uint32_t cn = 0;           // Intervalo actual (µs × 256), 0 = detenido
+  uint32_t cmin = 1;         // Intervalo a velocidad máxima (µs × 256)
+  uint32_t maxSpeed = 0;
+  uint32_t acceleration = 0;
+  int8_t direction = 1;
+  bool idle = true;
+  uint32_t cachedCn = 0;     // Último cn de stepsToStop()
+  long cachedToStop = 0;
+};
+
+#endif // RAMP_PLANNER_H
@@ -0,0 +1,52 @@
+#ifndef STEP_ANGLE_H
+#define STEP_ANGLE_H
+
+#include <stdint.h>
+
+// ==============================================
+// Ángulos en milésimas de grado (sin coma flotante)
+// ==============================================
+// El ESP32-C3 no tiene FPU: cada operación float/double se emula por software.
+// Los ángulos se guardan como int32_t en milésimas de grado y la conversión a
+// pasos usa aritmética entera con los pasos por vuelta fijados en compilación.
+// Solo se pasa a float en los bordes (mensajes ESP-NOW, JSON, logs).
+
+#define MDEG_PER_REV 360000L
+
+// Grados -> milésimas de grado para constantes: se evalúa en compilación
+// (tablas de ángulos). Para valores recibidos usar degToMdeg().
+#define MDEG(deg) ((int32_t)((deg) * 1000.0 + ((deg) >= 0 ? 0.5 : -0.5)))
+
+// Pasos por vuelta de la lámina: resolución del motor × microsteps × reducción
+#define STEPS_PER_REV_OF(resolution, microsteps, gear) \
+  ((uint32_t)((resolution) * (microsteps) * (gear) + 0.5))
+
+// Solo en los bordes (mensajes, JSON, logs)
+inline float mdegToDeg(int32_t mdeg) { return mdeg / 1000.0f; }
+inline int32_t degToMdeg(float deg) { return (int32_t)(deg * 1000.0f + (deg >= 0 ? 0.5f : -0.5f)); }
+
+template <uint32_t StepsPerRev>
+struct StepAngle {
+  static_assert(StepsPerRev > 0, "Pasos por vuelta nulos");
+
+  static constexpr uint32_t stepsPerRev = StepsPerRev;
+
+  // Milésimas de grado -> pasos (redondeo al más cercano)
+  static long toSteps(int32_t mdeg) {
+    int64_t num = (int64_t)mdeg * StepsPerRev;
+    return (long)((num >= 0 ? num + MDEG_PER_REV / 2 : num - MDEG_PER_REV / 2) / MDEG_PER_REV);
+  }
+
+  // Pasos -> milésimas de grado (redondeo al más cercano)
+  static int32_t toMilliDeg(long steps) {
+    int64_t num = (int64_t)steps * MDEG_PER_REV;
+    return (int32_t)((num >= 0 ? num + StepsPerRev / 2 : num - (int64_t)(StepsPerRev / 2)) / StepsPerRev);
+  }
+
+  // Resolución angular de un paso (milésimas de grado, redondeada)
+  static constexpr int32_t stepMilliDeg() {
+    return (int32_t)((MDEG_PER_REV + StepsPerRev / 2) / StepsPerRev);
+  }
+};
+
+#endif // STEP_ANGLE_H
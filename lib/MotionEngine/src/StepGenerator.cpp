@@ -0,0 +1,76 @@
+#include "StepGenerator.h"
+
+#define STEP_DIR_NEGATIVE 0x80000000UL
+
+StepGenerator* StepGenerator::instance = nullptr;
+
+bool StepGenerator::begin(uint8_t step, uint8_t dir, bool invStep, bool invDir) {
+  stepPin = step;
+  dirPin = dir;
+  invertStep = invStep;
+  invertDir = invDir;
+  pinMode(stepPin, OUTPUT);
+  pinMode(dirPin, OUTPUT);
+  digitalWrite(stepPin, invertStep ? HIGH : LOW);
+
+  instance = this;
+  timer = timerBegin(MOTION_STEP_TIMER, 80, true);  // APB 80 MHz / 80 = 1 tick por µs
+  if (!timer) return false;
+  timerAttachInterrupt(timer, &StepGenerator::onAlarm, false);  // Por nivel: el core 2.x no admite flanco
+  return true;
+}
+
+bool StepGenerator::push(uint32_t delayUs, int8_t dir) {
+  uint32_t h = head;
+  if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= MOTION_STEP_QUEUE) return false;
+  if (delayUs < MOTION_MIN_STEP_US) delayUs = MOTION_MIN_STEP_US;
+  ring[h & (MOTION_STEP_QUEUE - 1)] = delayUs | (dir < 0 ? STEP_DIR_NEGATIVE : 0);
+  __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Con el temporizador detenido la ISR no corre, así que aquí se puede consumir
+// la primera casilla. La espera descuenta el tiempo desde el último paso.
+void StepGenerator::kick() {
+  if (running || head == tail) return;
+  current = ring[tail & (MOTION_STEP_QUEUE - 1)];
+  __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+
+  uint32_t wait = current & ~STEP_DIR_NEGATIVE;
+  uint32_t elapsed = micros() - lastStepMicros;
+  wait = (elapsed >= wait) ? MOTION_MIN_STEP_US : wait - elapsed;
+  if (wait < MOTION_MIN_STEP_US) wait = MOTION_MIN_STEP_US;
+
+  running = true;
+  timerWrite(timer, 0);
+  timerAlarmWrite(timer, wait, true);
+  timerAlarmEnable(timer);
+}
+
+void IRAM_ATTR StepGenerator::onAlarm() {
+  instance->emitStep();
+}
+
+void IRAM_ATTR StepGenerator::emitStep() {
+  // Paso programado: sentido (solo si cambia) y pulso STEP (mín. 100 ns en el TMC2130)
+  int8_t dir = (current & STEP_DIR_NEGATIVE) ? -1 : 1;
+  if (dir != lastDir) {
+    digitalWrite(dirPin, ((dir > 0) != invertDir) ? HIGH : LOW);
+    lastDir = dir;
+  }
+  digitalWrite(stepPin, invertStep ? LOW : HIGH);
+  pos = pos + dir;
+  lastStepMicros = micros();
+  digitalWrite(stepPin, invertStep ? HIGH : LOW);
+
+  // Siguiente paso: la alarma se recarga sola, solo cambia el intervalo
+  uint32_t t = tail;
+  if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+    timerAlarmDisable(timer);
+    running = false;
+    return;
+  }
+  current = ring[t & (MOTION_STEP_QUEUE - 1)];
+  __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+  timerAlarmWrite(timer, current & ~STEP_DIR_NEGATIVE, true);
+}
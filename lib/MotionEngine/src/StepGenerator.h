@@ -0,0 +1,79 @@
+#ifndef STEP_GENERATOR_H
+#define STEP_GENERATOR_H
+
+#include <Arduino.h>
+
+// ==============================================
+// Pulsos STEP temporizados por hardware (ESP32-C3)
+// ==============================================
+// Un temporizador de hardware (gptimer, 1 MHz) genera una interrupción por
+// paso. La ISR emite el pulso STEP y programa la alarma con el intervalo del
+// siguiente paso, que toma de un buffer circular llenado de antemano por el
+// planificador (MotionEngine). Con recarga automática la alarma cuenta desde
+// el instante del paso anterior, así la latencia de la ISR no se acumula y el
+// ritmo no depende de loop(), WiFi ni logging.
+//
+// Un productor (tarea del MotionEngine) y un consumidor (ISR), ambos en el
+// mismo núcleo. Solo se admite una instancia (un motor por nodo).
+
+#ifndef MOTION_STEP_TIMER
+#define MOTION_STEP_TIMER 0          // Temporizador de hardware usado (0 o 1 en el C3)
+#endif
+
+#ifndef MOTION_STEP_QUEUE
+#define MOTION_STEP_QUEUE 128        // Pasos planificados por adelantado (potencia de 2)
+#endif
+
+#ifndef MOTION_MIN_STEP_US
+#define MOTION_MIN_STEP_US 10        // Intervalo mínimo entre pasos (100 kpasos/s)
+#endif
+
+#if (MOTION_STEP_QUEUE & (MOTION_STEP_QUEUE - 1)) != 0
+#error "MOTION_STEP_QUEUE debe ser potencia de 2"
+#endif
+
+class StepGenerator {
+public:
+  bool begin(uint8_t stepPin, uint8_t dirPin, bool invertStep, bool invertDir);
+
+  // Productor: encolar un paso; false si el buffer está lleno
+  bool push(uint32_t delayUs, int8_t dir);
+
+  // Productor: arrancar el temporizador si estaba detenido y hay pasos
+  void kick();
+
+  uint32_t queued() const { return head - tail; }
+  uint32_t space() const { return MOTION_STEP_QUEUE - queued(); }
+  bool idle() const { return !running; }
+
+  // Posición real (pasos emitidos)
+  long position() const { return pos; }
+  void setPosition(long position) { pos = position; }  // Solo con idle()
+
+  // Sentido del último paso emitido (+1/-1, 0 = ninguno aún)
+  int8_t direction() const { return lastDir; }
+
+private:
+  static void IRAM_ATTR onAlarm();
+  void IRAM_ATTR emitStep();
+
+  static StepGenerator* instance;
+
+  hw_timer_t* timer = nullptr;
+  uint8_t stepPin = 0;
+  uint8_t dirPin = 0;
+  bool invertStep = false;
+  bool invertDir = false;
+
+  uint32_t ring[MOTION_STEP_QUEUE];   // Intervalo en µs, bit 31 = sentido negativo
+  volatile uint32_t head = 0;         // Solo productor
+  volatile uint32_t tail = 0;         // Solo ISR (o kick() con el temporizador detenido)
+  uint32_t current = 0;               // Paso que emitirá la próxima alarma
+
+  volatile bool running = false;
+  volatile long pos = 0;
+  volatile int8_t lastDir = 0;
+  volatile uint32_t lastStepMicros = 0;
+};
+
+#endif // STEP_GENERATOR_H
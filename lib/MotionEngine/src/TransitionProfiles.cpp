@@ -0,0 +1,114 @@
+#include "TransitionProfiles.h"
+#include <Preferences.h>
+#include "PeriodicMove.h"
+#include "RampPlanner.h"
+
+#define PROFILE_NVS_KEY "params"
+
+void TransitionProfiles::configure(const long* angleSteps, uint8_t count, long period,
+                                   int8_t dir, long overshoot, ProfileParams defaults) {
+  if (count > MOTION_PROFILE_MAX_ANGLES) count = MOTION_PROFILE_MAX_ANGLES;
+  angleCount = count;
+  periodSteps = period;
+  approachDir = dir;
+  overshootSteps = overshoot;
+  for (uint8_t i = 0; i < count; i++) {
+    angles[i] = period > 0 ? wrapSteps(angleSteps[i], period) : angleSteps[i];
+  }
+  for (uint8_t i = 0; i < MOTION_PROFILE_MAX_ANGLES; i++) {
+    for (uint8_t j = 0; j < MOTION_PROFILE_MAX_ANGLES; j++) {
+      table[i][j] = defaults;
+      profiles[i][j] = StepProfile{0, 0, 0, nullptr, 0, 0};
+    }
+  }
+  used = 0;
+}
+
+void TransitionProfiles::setParams(uint8_t from, uint8_t to, ProfileParams p) {
+  if (from >= angleCount || to >= angleCount) return;
+  table[from][to] = p;
+}
+
+int TransitionProfiles::indexOf(long position) const {
+  long wrapped = periodSteps > 0 ? wrapSteps(position, periodSteps) : position;
+  for (uint8_t i = 0; i < angleCount; i++) {
+    if (angles[i] == wrapped) return i;
+  }
+  return -1;
+}
+
+bool TransitionProfiles::build() {
+  used = 0;
+  bool ok = true;
+  for (uint8_t i = 0; i < angleCount; i++) {
+    for (uint8_t j = 0; j < angleCount; j++) {
+      if (!buildOne(i, j)) ok = false;
+    }
+  }
+  return ok;
+}
+
+// Ejecuta la rampa entera sobre el pool, igual que el tick del MotionEngine:
+// primero hasta el sobrepaso (si hay) y luego hasta el objetivo
+bool TransitionProfiles::buildOne(uint8_t from, uint8_t to) {
+  StepProfile& profile = profiles[from][to];
+  profile = StepProfile{angles[from], angles[to], 0, pool + used, 0, 0};
+  if (from == to) return true;
+
+  long via = angles[to];
+  long target = angles[to];
+  if (periodSteps > 0) {
+    target = nearestEquivalent(angles[from], angles[to], periodSteps, approachDir, overshootSteps, via);
+  }
+
+  RampPlanner planner;
+  planner.setSpeed(table[from][to].maxSpeed, table[from][to].acceleration);
+  planner.setPosition(angles[from]);
+
+  uint32_t start = used;
+  uint32_t duration = 0;
+  long legs[2] = {via, target};
+  for (int leg = 0; leg < 2; leg++) {
+    planner.moveTo(legs[leg]);
+    PlannedStep step;
+    while (planner.next(step)) {
+      if (used >= MOTION_PROFILE_POOL) {
+        used = start;  // No cabe: perfil vacío
+        profile.count = 0;
+        return false;
+      }
+      uint32_t delay = step.delayUs > PROFILE_INTERVAL_MASK ? PROFILE_INTERVAL_MASK : step.delayUs;
+      pool[used++] = (uint16_t)delay | (step.dir < 0 ? PROFILE_DIR_NEGATIVE : 0);
+      duration += delay;
+    }
+  }
+
+  profile.displacement = target - angles[from];
+  profile.count = (uint16_t)(used - start);
+  profile.durationUs = duration;
+  return true;
+}
+
+bool TransitionProfiles::load(const char* nvsNamespace) {
+  Preferences prefs;
+  if (!prefs.begin(nvsNamespace, true)) return false;
+  ProfileParams stored[MOTION_PROFILE_MAX_ANGLES][MOTION_PROFILE_MAX_ANGLES];
+  size_t len = prefs.getBytes(PROFILE_NVS_KEY, stored, sizeof(stored));
+  prefs.end();
+  if (len != sizeof(stored)) return false;  // Sin calibrar o de otra versión
+
+  for (uint8_t i = 0; i < angleCount; i++) {
+    for (uint8_t j = 0; j < angleCount; j++) {
+      if (stored[i][j].maxSpeed > 0 && stored[i][j].acceleration > 0) table[i][j] = stored[i][j];
+    }
+  }
+  return true;
+}
+
+bool TransitionProfiles::save(const char* nvsNamespace) const {
+  Preferences prefs;
+  if (!prefs.begin(nvsNamespace, false)) return false;
+  size_t len = prefs.putBytes(PROFILE_NVS_KEY, table, sizeof(table));
+  prefs.end();
+  return len == sizeof(table);
+}
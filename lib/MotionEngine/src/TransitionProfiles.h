@@ -0,0 +1,88 @@
+#ifndef TRANSITION_PROFILES_H
+#define TRANSITION_PROFILES_H
+
+#include <stdint.h>
+
+// ==============================================
+// Perfiles de movimiento precalculados por transición
+// ==============================================
+// Los nodos BB84 solo se mueven entre unos pocos ángulos fijos. Para cada par
+// (desde, hacia) se calcula una vez, con su propia velocidad máxima y
+// aceleración, la secuencia completa de intervalos entre pasos (mismo camino
+// que moveToNearest(): equivalente más cercano y sobrepaso contra el juego).
+// MotionEngine::playProfile() la reproduce tal cual, sin planificar la rampa
+// en cada pulso.
+//
+// Los intervalos van en un pool estático (sin heap): uint16_t por paso, bit 15
+// = sentido negativo, 15 bits de µs. Los parámetros de cada transición se
+// guardan en NVS (Preferences) tras la calibración.
+
+#ifndef MOTION_PROFILE_MAX_ANGLES
+#define MOTION_PROFILE_MAX_ANGLES 4
+#endif
+
+#ifndef MOTION_PROFILE_POOL
+#define MOTION_PROFILE_POOL 4096     // Pasos totales entre todos los perfiles
+#endif
+
+#define PROFILE_DIR_NEGATIVE 0x8000
+#define PROFILE_INTERVAL_MASK 0x7FFF
+
+struct ProfileParams {
+  uint32_t maxSpeed;       // pasos/s
+  uint32_t acceleration;   // pasos/s²
+};
+
+struct StepProfile {
+  long start;              // Posición de partida (pasos, dentro del periodo)
+  long target;             // Ángulo de destino (pasos, dentro del periodo)
+  long displacement;       // Pasos netos del recorrido (con signo)
+  const uint16_t* intervals;
+  uint16_t count;          // Pasos (0 = perfil vacío)
+  uint32_t durationUs;     // Suma de intervalos (duración nominal)
+};
+
+class TransitionProfiles {
+public:
+  // Ángulos en pasos y geometría igual que MotionEngine::setPeriod(). Todas las
+  // transiciones quedan con 'defaults' hasta setParams()/load().
+  void configure(const long* angleSteps, uint8_t count, long periodSteps,
+                 int8_t approachDir, long overshootSteps, ProfileParams defaults);
+
+  void setParams(uint8_t from, uint8_t to, ProfileParams params);
+  ProfileParams params(uint8_t from, uint8_t to) const { return table[from][to]; }
+  uint8_t count() const { return angleCount; }
+  long angle(uint8_t index) const { return angles[index]; }
+
+  // Recalcula todos los perfiles; false si no caben en el pool (los que no
+  // caben quedan vacíos y se usa el movimiento genérico)
+  bool build();
+
+  // Perfil desde el ángulo 'from' hacia 'to'; count 0 si no hay
+  const StepProfile& get(uint8_t from, uint8_t to) const { return profiles[from][to]; }
+
+  // Índice del ángulo en la posición dada (módulo el periodo), -1 si ninguno
+  int indexOf(long position) const;
+
+  // Persistencia de los parámetros en NVS
+  bool load(const char* nvsNamespace);
+  bool save(const char* nvsNamespace) const;
+
+  uint32_t poolUsed() const { return used; }
+
+private:
+  bool buildOne(uint8_t from, uint8_t to);
+
+  long angles[MOTION_PROFILE_MAX_ANGLES] = {0};
+  uint8_t angleCount = 0;
+  long periodSteps = 0;
+  int8_t approachDir = 0;
+  long overshootSteps = 0;
+
+  ProfileParams table[MOTION_PROFILE_MAX_ANGLES][MOTION_PROFILE_MAX_ANGLES];
+  StepProfile profiles[MOTION_PROFILE_MAX_ANGLES][MOTION_PROFILE_MAX_ANGLES];
+  uint16_t pool[MOTION_PROFILE_POOL];
+  uint32_t used = 0;
+};
+
+#endif // TRANSITION_PROFILES_H
@@ -0,0 +1,52 @@
+#include <string.h>
+#include <stdlib.h>
+#include "WsCommand.h"
+
+bool wsEquals(const uint8_t* payload, size_t length, const char* literal) {
+  size_t n = strlen(literal);
+  return n == length && memcmp(payload, literal, n) == 0;
+}
+
+bool wsStartsWith(const uint8_t* payload, size_t length, const char* prefix) {
+  size_t n = strlen(prefix);
+  return n <= length && memcmp(payload, prefix, n) == 0;
+}
+
+// Copia el siguiente campo a 'field' (terminado en '\0') y avanza *pos hasta
+// después del separador. Devuelve false si no hay campo o no cabe.
+static bool nextField(const char* text, size_t length, char sep, size_t* pos,
+                      char (&field)[WS_NUMBER_MAX + 1]) {
+  if (*pos >= length) return false;
+  const char* start = text + *pos;
+  const char* end = (const char*)memchr(start, sep, length - *pos);
+  size_t n = end ? (size_t)(end - start) : length - *pos;
+  if (n == 0 || n > WS_NUMBER_MAX) return false;
+  memcpy(field, start, n);
+  field[n] = '\0';
+  *pos += n + (end ? 1 : 0);
+  return true;
+}
+
+size_t wsParseFloats(const char* text, size_t length, char sep, float* out, size_t maxFields) {
+  char field[WS_NUMBER_MAX + 1];
+  size_t pos = 0, count = 0;
+  while (count < maxFields && nextField(text, length, sep, &pos, field)) {
+    char* endPtr;
+    float value = strtof(field, &endPtr);
+    if (endPtr == field || *endPtr != '\0') break;
+    out[count++] = value;
+  }
+  return count;
+}
+
+size_t wsParseInts(const char* text, size_t length, char sep, long* out, size_t maxFields) {
+  char field[WS_NUMBER_MAX + 1];
+  size_t pos = 0, count = 0;
+  while (count < maxFields && nextField(text, length, sep, &pos, field)) {
+    char* endPtr;
+    long value = strtol(field, &endPtr, 10);
+    if (endPtr == field || *endPtr != '\0') break;
+    out[count++] = value;
+  }
+  return count;
+}
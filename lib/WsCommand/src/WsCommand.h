@@ -0,0 +1,32 @@
+#ifndef WS_COMMAND_H
+#define WS_COMMAND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ==============================================
+// Parseo de comandos WebSocket sin reservar memoria (Centrales)
+// ==============================================
+// Todas las funciones trabajan sobre el buffer (payload, length) que entrega la
+// librería de WebSockets, sin copiarlo a un String. Los números se copian a un
+// buffer en la pila (acotado) antes de convertirlos, porque el payload no
+// termina necesariamente en '\0' donde termina el campo.
+
+// Longitud máxima de un campo numérico (incluye signo, punto y exponente)
+#define WS_NUMBER_MAX 24
+
+// El mensaje completo es exactamente "literal"
+bool wsEquals(const uint8_t* payload, size_t length, const char* literal);
+
+// El mensaje empieza por "prefix"
+bool wsStartsWith(const uint8_t* payload, size_t length, const char* prefix);
+
+// Convierte los campos numéricos de [text, text+length) separados por 'sep' y
+// los guarda en out. Devuelve cuántos campos se leyeron (se detiene en el
+// primero inválido o al llegar a maxFields).
+size_t wsParseFloats(const char* text, size_t length, char sep, float* out, size_t maxFields);
+
+// Igual que wsParseFloats pero para enteros en base 10
+size_t wsParseInts(const char* text, size_t length, char sep, long* out, size_t maxFields);
+
+#endif // WS_COMMAND_H